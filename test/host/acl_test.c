@@ -0,0 +1,183 @@
+/*
+ * acl_match_compiled() against acl_match_linear(): random rule sets and
+ * packets must get the same first matching rule from both. The timings of
+ * both matchers are printed per number of rules.
+ *
+ *   acl_test [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "c_types.h"
+#include "lwip/ip.h"
+#include "lwip/def.h"
+#include "acl.h"
+
+#include "host.h"
+
+#define RULE_SETS	2000
+#define PACKETS		500
+#define BENCH_PACKETS	200000
+
+static uint64_t rng = 88172645463325252ULL;
+
+static uint32_t rnd(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)(rng >> 16);
+}
+
+/* Few addresses and ports, so that rules overlap and packets hit them */
+static const uint32_t addrs[] = { 0x0a000001, 0x0a000002, 0x0a0000fe, 0x0a010203, 0xc0a80402, 0xc0a80417, 0x08080808, 0x5db8d822 };
+static const uint16_t ports[] = { 22, 23, 53, 80, 123, 443, 5000, 8080, 49152 };
+static const uint8_t protos[] = { IP_PROTO_TCP, IP_PROTO_UDP, IP_PROTO_ICMP };
+static const uint8_t prefixes[] = { 8, 16, 24, 30, 32 };
+
+#define PICK(a)		((a)[rnd() % (sizeof(a) / sizeof((a)[0]))])
+
+static uint32_t mask_of(uint8_t len)
+{
+    return htonl(len ? 0xffffffffU << (32 - len) : 0);
+}
+
+static void random_rules(uint8_t acl_no, int n)
+{
+    int i;
+
+    acl_clear(acl_no);
+    for (i = 0; i < n; i++)
+    {
+        uint8_t proto = rnd() % 4 == 0 ? 0 : PICK(protos);
+        uint32_t src = 0, s_mask = 0, dest = 0, d_mask = 0;
+        uint16_t s_port = 0, d_port = 0;
+        uint8_t allow = rnd() & 1 ? ACL_ALLOW : ACL_DENY;
+
+        if (rnd() % 3)
+        {
+            src = htonl(PICK(addrs));
+            s_mask = mask_of(PICK(prefixes));
+        }
+        if (rnd() % 3)
+        {
+            dest = htonl(PICK(addrs));
+            d_mask = mask_of(PICK(prefixes));
+        }
+        if (proto != IP_PROTO_ICMP && rnd() % 3 == 0)
+            s_port = PICK(ports);
+        if (proto != IP_PROTO_ICMP && rnd() % 2)
+            d_port = PICK(ports);
+        if (rnd() % 20 == 0)
+            allow = ACL_ALLOW | ACL_ESTABLISHED;
+        acl_add(acl_no, src, s_mask, dest, d_mask, proto, s_port, d_port, allow);
+    }
+}
+
+typedef struct {
+    uint8_t proto;
+    uint32_t saddr, daddr;
+    uint16_t s_port, d_port;
+} test_pkt;
+
+static void random_packet(test_pkt *p)
+{
+    p->proto = PICK(protos);
+    p->saddr = htonl(rnd() % 4 ? PICK(addrs) ^ (rnd() % 4 ? 0 : rnd() & 0xff) : rnd());
+    p->daddr = htonl(rnd() % 4 ? PICK(addrs) ^ (rnd() % 4 ? 0 : rnd() & 0xff) : rnd());
+    if (p->proto == IP_PROTO_ICMP)
+    {
+        p->s_port = p->d_port = 0;
+    }
+    else
+    {
+        p->s_port = rnd() % 2 ? PICK(ports) : rnd();
+        p->d_port = rnd() % 2 ? PICK(ports) : rnd();
+    }
+}
+
+static int check(void)
+{
+    test_pkt pk;
+    int set, i, n, failures = 0;
+    uint32_t matched = 0, total = 0;
+
+    for (set = 0; set < RULE_SETS; set++)
+    {
+        n = 1 + rnd() % MAX_ACL_ENTRIES;
+        random_rules(0, n);
+        for (i = 0; i < PACKETS; i++)
+        {
+            int lin, comp;
+
+            random_packet(&pk);
+            lin = acl_match_linear(0, pk.proto, pk.saddr, pk.s_port, pk.daddr, pk.d_port);
+            comp = acl_match_compiled(0, pk.proto, pk.saddr, pk.s_port, pk.daddr, pk.d_port);
+            total++;
+            if (lin >= 0)
+                matched++;
+            if (lin != comp && failures++ < 10)
+                printf("rule set %d (%d rules), proto %d " IPSTR ":%d > " IPSTR ":%d: linear %d, compiled %d\n",
+                       set, n, pk.proto, IP2STR((ip_addr_t *)&pk.saddr), pk.s_port,
+                       IP2STR((ip_addr_t *)&pk.daddr), pk.d_port, lin, comp);
+        }
+    }
+    printf("%u packets against %d rule sets, %u matched a rule, %d mismatches\n",
+           total, RULE_SETS, matched, failures);
+    return failures;
+}
+
+static double bench_one(int (*match)(uint8_t, uint8_t, uint32_t, uint16_t, uint32_t, uint16_t),
+                        const test_pkt *pk)
+{
+    volatile int sink = 0;
+    uint64_t t0 = host_cpu_ns();
+    int i;
+
+    for (i = 0; i < BENCH_PACKETS; i++)
+    {
+        const test_pkt *p = &pk[i & 1023];
+
+        sink += match(0, p->proto, p->saddr, p->s_port, p->daddr, p->d_port);
+    }
+    (void)sink;
+    return (double)(host_cpu_ns() - t0) / BENCH_PACKETS;
+}
+
+/* ns per packet, for packets like the ones above and for packets that
+   match no rule, which the linear scan has to compare with all of them */
+static void bench(void)
+{
+    static test_pkt pk[1024], miss[1024];
+    static const int sizes[] = { 1, 4, 8, 16 };
+    int s, i;
+
+    for (i = 0; i < 1024; i++)
+    {
+        random_packet(&pk[i]);
+        random_packet(&miss[i]);
+        miss[i].saddr = htonl(0xac100000 | (rnd() & 0xfffff));
+        miss[i].daddr = htonl(0xac100000 | (rnd() & 0xfffff));
+    }
+
+    printf("ns per lookup\n%6s %12s %12s %12s %12s\n", "rules", "linear", "compiled", "linear miss", "comp. miss");
+    for (s = 0; s < 4; s++)
+    {
+        random_rules(0, sizes[s]);
+        printf("%6d %12.1f %12.1f %12.1f %12.1f\n", sizes[s],
+               bench_one(acl_match_linear, pk), bench_one(acl_match_compiled, pk),
+               bench_one(acl_match_linear, miss), bench_one(acl_match_compiled, miss));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+        rng = strtoull(argv[1], NULL, 0) | 1;
+
+    acl_init();
+    if (check() != 0)
+        return 1;
+    bench();
+    return 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * The monitor's capture path through cap_ring against the one through the
+ * old ringbuf it replaced, in bytes/sec at several frame sizes.
+ *
+ * The producer side is put_packet_to_ringbuf() as it is now and as it was:
+ * one reservation filled in place, or pcap header and frame copied in with
+ * two ringbuf_memcpy_into(). The consumer side is tcp_monitor_sent_cb():
+ * spans of up to 1400 bytes are handed to espconn_send() straight from the
+ * ring, or after ringbuf_memcpy_from() into a static buffer. espconn_send()
+ * copies the data into lwIP's buffers in both cases, here it is a memcpy().
+ * Whenever a frame doesn't fit, a span is sent to make room, so no frame
+ * is dropped.
+ *
+ * The stream of both must be a valid pcap record stream with every frame
+ * in order, which is checked in a shorter run that keeps all of it.
+ *
+ *   cap_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "user_config.h"
+#include "c_types.h"
+#include "osapi.h"
+#include "sys_time.h"
+#include "pcap.h"
+#include "ringbuf.h"
+#include "cap_ring.h"
+
+#include "host.h"
+
+#define SPAN		1400	/* as tcp_monitor_sent_cb() */
+#define BENCH_BYTES	(256 * 1024 * 1024)
+#define CHECK_FRAMES	2000
+
+static cap_ring_t ring;
+static ringbuf_t old_ring;
+
+/* What espconn_send() got: all of it when checking, else just the count */
+static uint8_t *stream;
+static uint32_t stream_len, stream_max;
+static uint8_t sink[SPAN];
+
+static uint8_t frame[1600];
+static uint32_t failures;
+
+static void espconn_send_copy(const uint8_t *data, uint16_t len)
+{
+    if (stream != NULL && stream_len + len <= stream_max)
+        memcpy(stream + stream_len, data, len);
+    else
+        memcpy(sink, data, len);
+    stream_len += len;
+}
+
+/* cap_ring */
+
+static int put_new(uint16_t len)
+{
+    struct pcap_pkthdr pcap_phdr;
+    uint8_t *rec;
+
+    rec = cap_ring_reserve(&ring, sizeof(pcap_phdr) + len);
+    if (rec == NULL)
+        return -1;
+    cap_ring_timestamp(&pcap_phdr.ts_sec, &pcap_phdr.ts_usec);
+    pcap_phdr.caplen = len;
+    pcap_phdr.len = len;
+    os_memcpy(rec, &pcap_phdr, sizeof(pcap_phdr));
+    os_memcpy(rec + sizeof(pcap_phdr), frame, len);
+    cap_ring_commit(&ring, sizeof(pcap_phdr) + len);
+    return 0;
+}
+
+static bool send_new(void)
+{
+    uint8_t *data;
+    uint16_t len = cap_ring_peek(&ring, &data, SPAN);
+
+    if (len == 0)
+        return false;
+    espconn_send_copy(data, len);
+    cap_ring_consume(&ring, len);
+    return true;
+}
+
+/* the old ringbuf */
+
+static int put_old(uint16_t len)
+{
+    struct pcap_pkthdr pcap_phdr;
+    uint64_t t_usecs;
+
+    if (ringbuf_bytes_free(old_ring) < sizeof(pcap_phdr) + len)
+        return -1;
+    t_usecs = get_long_systime();
+    pcap_phdr.ts_sec = (uint32_t)t_usecs / 1000000;
+    pcap_phdr.ts_usec = (uint32_t)t_usecs % 1000000;
+    pcap_phdr.caplen = len;
+    pcap_phdr.len = len;
+    ringbuf_memcpy_into(old_ring, (uint8_t *)&pcap_phdr, sizeof(pcap_phdr));
+    ringbuf_memcpy_into(old_ring, frame, len);
+    return 0;
+}
+
+static bool send_old(void)
+{
+    static uint8_t tbuf[SPAN];
+    uint16_t len = ringbuf_bytes_used(old_ring);
+
+    if (len == 0)
+        return false;
+    if (len > SPAN)
+        len = SPAN;
+    ringbuf_memcpy_from(tbuf, old_ring, len);
+    espconn_send_copy(tbuf, len);
+    return true;
+}
+
+typedef struct {
+    const char *name;
+    int (*put)(uint16_t len);
+    bool (*send)(void);
+} cap_path;
+
+static const cap_path paths[] = {
+    { "cap_ring", put_new, send_new },
+    { "ringbuf", put_old, send_old },
+};
+
+static void reset(void)
+{
+    cap_ring_reset(&ring);
+    ringbuf_reset(old_ring);
+    stream_len = 0;
+}
+
+/* n frames of len bytes through the path, each starting with its number */
+static void run(const cap_path *cp, uint16_t len, uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        memcpy(frame, &i, sizeof(i));
+        while (cp->put(len) < 0)
+        {
+            if (!cp->send())
+            {
+                failures++;
+                printf("%s: %u byte frame doesn't fit into the empty ring\n", cp->name, len);
+                return;
+            }
+        }
+        // a send is done by the time the next frames come in
+        if ((i & 3) == 0)
+            cp->send();
+    }
+    while (cp->send())
+        ;
+}
+
+static void check(const cap_path *cp, uint16_t len)
+{
+    struct pcap_pkthdr ph;
+    uint32_t off = 0, i, n;
+
+    reset();
+    stream_max = CHECK_FRAMES * (sizeof(ph) + len);
+    stream = malloc(stream_max);
+    run(cp, len, CHECK_FRAMES);
+    for (i = 0; off + sizeof(ph) <= stream_len; i++)
+    {
+        memcpy(&ph, stream + off, sizeof(ph));
+        memcpy(&n, stream + off + sizeof(ph), sizeof(n));
+        if (ph.caplen != len || n != i)
+        {
+            failures++;
+            printf("%s, %u byte frames: record %u has %u bytes, frame %u\n", cp->name, len, i, ph.caplen, n);
+            break;
+        }
+        off += sizeof(ph) + len;
+    }
+    if (i != CHECK_FRAMES || off != stream_len)
+    {
+        failures++;
+        printf("%s, %u byte frames: %u records of %u\n", cp->name, len, i, CHECK_FRAMES);
+    }
+    free(stream);
+    stream = NULL;
+}
+
+static double bench(const cap_path *cp, uint16_t len)
+{
+    uint32_t n = BENCH_BYTES / len;
+    uint64_t t0;
+
+    reset();
+    t0 = host_cpu_ns();
+    run(cp, len, n);
+    return (double)n * len * 1e9 / (host_cpu_ns() - t0);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint16_t sizes[] = { 64, 128, 256, 512, 1024, 1514 };
+    uint32_t s, p;
+
+    host_init(NULL);
+    if (!cap_ring_init(&ring, MONITOR_BUFFER_SIZE) || (old_ring = ringbuf_new(MONITOR_BUFFER_SIZE)) == NULL)
+        return 2;
+    memset(frame, 0x5a, sizeof(frame));
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        for (p = 0; p < sizeof(paths) / sizeof(paths[0]); p++)
+            check(&paths[p], sizes[s]);
+
+    printf("MB/s of frames through a %u byte ring\n%6s %10s %10s\n", MONITOR_BUFFER_SIZE, "frame", "cap_ring", "ringbuf");
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        printf("%6u %10.0f %10.0f\n", sizes[s], bench(&paths[0], sizes[s]) / 1e6, bench(&paths[1], sizes[s]) / 1e6);
+
+    cap_ring_free(&ring);
+    ringbuf_free(&old_ring);
+    if (failures != 0)
+    {
+        printf("%u failures\n", failures);
+        return 1;
+    }
+    return 0;
+}
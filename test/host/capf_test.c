@@ -0,0 +1,545 @@
+/*
+ * capf_compile() and capf_match() against a reference: random filter
+ * expressions, valid ones from the grammar in capfilter.h and broken ones
+ * made from them, are parsed by a plain recursive descent parser into a
+ * tree, which is evaluated on the raw bytes of the frames. Both must agree
+ * on whether an expression is valid and on the verdict for every frame of
+ * the captures, also as a non-first fragment.
+ *
+ *   capf_test capture...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "c_types.h"
+#include "lwip/pbuf.h"
+#include "pkt_info.h"
+#include "capfilter.h"
+
+#include "host.h"
+#include "capture.h"
+
+#define EXPRS		20000
+#define MAX_TOKENS	32
+#define MAX_NODES	32
+
+static capture_packet *packets;
+static uint32_t packet_count;
+
+static uint32_t failures;
+
+static uint64_t rng = 88172645463325252ULL;
+
+static uint32_t rnd(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)(rng >> 16);
+}
+
+#define PICK(a)		((a)[rnd() % (sizeof(a) / sizeof((a)[0]))])
+
+/* Reference */
+
+enum { R_ETHER, R_PROTO, R_NET, R_PORT, R_LESS, R_GREATER, R_AND, R_OR, R_NOT };
+
+typedef struct {
+    int op;
+    bool src, dst;
+    uint32_t val;
+    uint32_t addr, mask;	/* host order */
+    int a, b;			/* operands */
+} ref_node;
+
+typedef struct {
+    char **tok;
+    int n, pos;
+    bool err;
+    ref_node node[MAX_NODES];
+    int nodes;
+} ref_expr;
+
+static int ref_new(ref_expr *e, int op)
+{
+    if (e->nodes == MAX_NODES)
+    {
+        e->err = true;
+        return 0;
+    }
+    memset(&e->node[e->nodes], 0, sizeof(ref_node));
+    e->node[e->nodes].op = op;
+    return e->nodes++;
+}
+
+static const char *ref_next(ref_expr *e)
+{
+    if (e->pos == e->n)
+    {
+        e->err = true;
+        return "";
+    }
+    return e->tok[e->pos++];
+}
+
+/* decimal or 0x hex, up to max */
+static bool ref_number(const char *s, uint32_t max, uint32_t *v)
+{
+    char *end;
+    unsigned long n;
+
+    if (s[0] == '\0' || s[0] == '-' || s[0] == '+' || s[0] == ' ')
+        return false;
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+    {
+        if (s[2] == '\0' || s[2] == '-' || s[2] == '+' || s[2] == ' ')
+            return false;
+        n = strtoul(s + 2, &end, 16);
+    }
+    else
+    {
+        n = strtoul(s, &end, 10);
+    }
+    if (*end != '\0' || n > max)
+        return false;
+    *v = n;
+    return true;
+}
+
+static bool ref_addr(const char *s, bool net, uint32_t *addr, uint32_t *mask)
+{
+    char buf[32];
+    const char *slash = strchr(s, '/');
+    uint32_t bits = 32;
+    struct in_addr a;
+
+    if (strlen(s) >= sizeof(buf))
+        return false;
+    strcpy(buf, s);
+    if (slash != NULL)
+    {
+        buf[slash - s] = '\0';
+        if (!net || !ref_number(slash + 1, 32, &bits))
+            return false;
+    }
+    if (inet_pton(AF_INET, buf, &a) != 1)
+        return false;
+    *mask = bits == 0 ? 0 : 0xffffffffU << (32 - bits);
+    *addr = ntohl(a.s_addr) & *mask;
+    return true;
+}
+
+static int ref_or(ref_expr *e);
+
+static int ref_primitive(ref_expr *e)
+{
+    const char *t = ref_next(e);
+    bool src = true, dst = true;
+    int i;
+
+    if (strcmp(t, "src") == 0 || strcmp(t, "dst") == 0)
+    {
+        src = t[0] == 's';
+        dst = !src;
+        t = ref_next(e);
+    }
+    if (strcmp(t, "host") == 0 || strcmp(t, "net") == 0)
+    {
+        i = ref_new(e, R_NET);
+        if (!ref_addr(ref_next(e), t[0] == 'n', &e->node[i].addr, &e->node[i].mask))
+            e->err = true;
+    }
+    else if (strcmp(t, "port") == 0)
+    {
+        i = ref_new(e, R_PORT);
+        if (!ref_number(ref_next(e), 0xffff, &e->node[i].val))
+            e->err = true;
+    }
+    else if (!src || !dst)
+    {
+        e->err = true;
+        return 0;
+    }
+    else if (strcmp(t, "ip") == 0 || strcmp(t, "arp") == 0)
+    {
+        i = ref_new(e, R_ETHER);
+        e->node[i].val = t[0] == 'i' ? 0x0800 : 0x0806;
+    }
+    else if (strcmp(t, "icmp") == 0 || strcmp(t, "tcp") == 0 || strcmp(t, "udp") == 0)
+    {
+        i = ref_new(e, R_PROTO);
+        e->node[i].val = t[0] == 'i' ? 1 : t[0] == 't' ? 6 : 17;
+    }
+    else if (strcmp(t, "ether") == 0 || strcmp(t, "less") == 0 || strcmp(t, "greater") == 0)
+    {
+        i = ref_new(e, t[0] == 'e' ? R_ETHER : t[0] == 'l' ? R_LESS : R_GREATER);
+        if (!ref_number(ref_next(e), 0xffff, &e->node[i].val))
+            e->err = true;
+    }
+    else if (strcmp(t, "proto") == 0)
+    {
+        i = ref_new(e, R_PROTO);
+        if (!ref_number(ref_next(e), 0xff, &e->node[i].val))
+            e->err = true;
+    }
+    else
+    {
+        e->err = true;
+        return 0;
+    }
+    e->node[i].src = src;
+    e->node[i].dst = dst;
+    return i;
+}
+
+static int ref_factor(ref_expr *e)
+{
+    int i;
+
+    if (e->pos < e->n && strcmp(e->tok[e->pos], "not") == 0)
+    {
+        e->pos++;
+        i = ref_new(e, R_NOT);
+        e->node[i].a = ref_factor(e);
+        return i;
+    }
+    return ref_primitive(e);
+}
+
+static int ref_binary(ref_expr *e, const char *word, int op, int (*operand)(ref_expr *))
+{
+    int left = operand(e);
+
+    while (!e->err && e->pos < e->n && strcmp(e->tok[e->pos], word) == 0)
+    {
+        int i;
+
+        e->pos++;
+        i = ref_new(e, op);
+        e->node[i].a = left;
+        e->node[i].b = operand(e);
+        left = i;
+    }
+    return left;
+}
+
+static int ref_and(ref_expr *e)
+{
+    return ref_binary(e, "and", R_AND, ref_factor);
+}
+
+static int ref_or(ref_expr *e)
+{
+    return ref_binary(e, "or", R_OR, ref_and);
+}
+
+/* The header fields straight from the frame */
+typedef struct {
+    uint16_t len, type;
+    bool ip, ports;
+    uint8_t proto;
+    uint32_t src, dst;
+    uint16_t sport, dport;
+} ref_frame;
+
+static void ref_frame_parse(const uint8_t *f, uint16_t len, ref_frame *rf)
+{
+    uint16_t hl;
+
+    memset(rf, 0, sizeof(*rf));
+    rf->len = len;
+    if (len < 14)
+        return;
+    rf->type = f[12] << 8 | f[13];
+    if (rf->type != 0x0800 || len < 14 + 20 || len < 14 + (hl = (f[14] & 15) * 4) || hl < 20)
+        return;
+    rf->ip = true;
+    rf->proto = f[14 + 9];
+    rf->src = (uint32_t)f[26] << 24 | f[27] << 16 | f[28] << 8 | f[29];
+    rf->dst = (uint32_t)f[30] << 24 | f[31] << 16 | f[32] << 8 | f[33];
+    // only the first fragment has the transport header
+    if (((f[20] << 8 | f[21]) & 0x1fff) != 0)
+        return;
+    if ((rf->proto == 17 && len >= 14 + hl + 8) || (rf->proto == 6 && len >= 14 + hl + 20))
+    {
+        rf->ports = true;
+        rf->sport = f[14 + hl] << 8 | f[14 + hl + 1];
+        rf->dport = f[14 + hl + 2] << 8 | f[14 + hl + 3];
+    }
+}
+
+static bool ref_eval(const ref_expr *e, int i, const ref_frame *rf)
+{
+    const ref_node *nd = &e->node[i];
+
+    switch (nd->op)
+    {
+    case R_ETHER:
+        return rf->type == nd->val;
+    case R_PROTO:
+        return rf->ip && rf->proto == nd->val;
+    case R_NET:
+        return rf->ip && ((nd->src && (rf->src & nd->mask) == nd->addr) || (nd->dst && (rf->dst & nd->mask) == nd->addr));
+    case R_PORT:
+        return rf->ports && ((nd->src && rf->sport == nd->val) || (nd->dst && rf->dport == nd->val));
+    case R_LESS:
+        return rf->len <= nd->val;
+    case R_GREATER:
+        return rf->len >= nd->val;
+    case R_AND:
+        return ref_eval(e, nd->a, rf) && ref_eval(e, nd->b, rf);
+    case R_OR:
+        return ref_eval(e, nd->a, rf) || ref_eval(e, nd->b, rf);
+    case R_NOT:
+        return !ref_eval(e, nd->a, rf);
+    }
+    return false;
+}
+
+/* Random expressions, small enough for CAPF_MAX_INSNS and CAPF_MAX_STACK */
+
+static const char *addrs[] = { "192.168.4.2", "192.168.4.1", "10.0.0.1", "10.0.0.2", "8.8.8.8",
+                               "93.184.216.34", "172.31.255.2", "0.0.0.0", "255.255.255.255" };
+static const char *nets[] = { "192.168.4.0/24", "10.0.0.0/8", "0.0.0.0/0", "8.8.8.8/32", "93.184.0.0/16",
+                              "172.16.0.0/12", "10.0.0.2" };
+static const char *ports[] = { "53", "80", "23", "123", "5000", "40000", "49152", "67", "0x35", "0" };
+static const char *ethers[] = { "0x0800", "0x806", "2048", "0x86dd" };
+static const char *protos[] = { "1", "6", "17", "0x11", "47" };
+static const char *lens[] = { "60", "64", "100", "1000", "1514", "0" };
+static const char *simple[] = { "ip", "arp", "tcp", "udp", "icmp" };
+/* for the broken expressions */
+static const char *junk[] = { "and", "or", "not", "src", "dst", "host", "port", "10.0.0.1/24", "70000", "0x",
+                              "256", "1.2.3.4/33", "foo", "ether", "proto", "less" };
+
+static char *toks[MAX_TOKENS];
+static int ntoks;
+
+static void add(const char *t)
+{
+    if (ntoks < MAX_TOKENS)
+        toks[ntoks++] = (char *)t;
+}
+
+static void gen_primitive(void)
+{
+    switch (rnd() % 6)
+    {
+    case 0:
+        add(PICK(simple));
+        break;
+    case 1:
+        if (rnd() % 2)
+            add(rnd() % 2 ? "src" : "dst");
+        add("host");
+        add(PICK(addrs));
+        break;
+    case 2:
+        if (rnd() % 2)
+            add(rnd() % 2 ? "src" : "dst");
+        add("net");
+        add(PICK(nets));
+        break;
+    case 3:
+        if (rnd() % 2)
+            add(rnd() % 2 ? "src" : "dst");
+        add("port");
+        add(PICK(ports));
+        break;
+    case 4:
+        add(rnd() % 2 ? "ether" : "proto");
+        add(toks[ntoks - 1][0] == 'e' ? PICK(ethers) : PICK(protos));
+        break;
+    default:
+        add(rnd() % 2 ? "less" : "greater");
+        add(PICK(lens));
+    }
+}
+
+static void gen_expr(void)
+{
+    int prims = 1 + rnd() % 4, nots = 0, i;
+
+    ntoks = 0;
+    for (i = 0; i < prims; i++)
+    {
+        if (i > 0)
+            add(rnd() % 2 ? "and" : "or");
+        if (nots < 3 && rnd() % 4 == 0)
+        {
+            add("not");
+            nots++;
+        }
+        gen_primitive();
+    }
+}
+
+/* Drops, replaces or inserts a token */
+static void break_expr(void)
+{
+    int at = rnd() % (ntoks + 1), i;
+
+    switch (rnd() % 3)
+    {
+    case 0:
+        if (at < ntoks)
+        {
+            for (i = at; i < ntoks - 1; i++)
+                toks[i] = toks[i + 1];
+            ntoks--;
+        }
+        break;
+    case 1:
+        if (at < ntoks)
+        {
+            toks[at] = (char *)PICK(junk);
+            break;
+        }
+        // fall through
+    default:
+        if (ntoks < MAX_TOKENS)
+        {
+            for (i = ntoks; i > at; i--)
+                toks[i] = toks[i - 1];
+            toks[at] = (char *)PICK(junk);
+            ntoks++;
+        }
+    }
+}
+
+static void print_expr(void)
+{
+    int i;
+
+    for (i = 0; i < ntoks; i++)
+        printf(" %s", toks[i]);
+}
+
+/* The frames of the captures and their non-first fragment variants */
+typedef struct {
+    pkt_info pi;
+    ref_frame rf;
+} test_frame;
+
+static test_frame *frames;
+static uint32_t frame_count;
+
+static void add_frame(const uint8_t *f, uint16_t len)
+{
+    struct pbuf *p = host_frame(f, len);
+    test_frame *tf = &frames[frame_count++];
+
+    pkt_parse(p, &tf->pi);
+    pbuf_free(p);
+    ref_frame_parse(f, len, &tf->rf);
+}
+
+static void load_frames(void)
+{
+    uint8_t f[CAPTURE_MAX_FRAME];
+    uint32_t i;
+
+    frames = malloc(packet_count * 2 * sizeof(test_frame));
+    for (i = 0; i < packet_count; i++)
+    {
+        const capture_packet *pk = &packets[i];
+
+        add_frame(pk->data, pk->len);
+        if (pk->len >= 14 + 20 && pk->data[12] == 0x08 && pk->data[13] == 0x00)
+        {
+            memcpy(f, pk->data, pk->len);
+            f[20] = 0x20;
+            f[21] = 0x10;
+            add_frame(f, pk->len);
+        }
+    }
+}
+
+/* Returns true if the expression compiled */
+static bool check(uint32_t n, bool broken)
+{
+    capf_prog prog;
+    ref_expr e;
+    uint32_t i;
+    int root;
+    bool ok;
+
+    gen_expr();
+    if (broken)
+        break_expr();
+
+    memset(&e, 0, sizeof(e));
+    e.tok = toks;
+    e.n = ntoks;
+    root = ntoks ? ref_or(&e) : 0;
+    ok = capf_compile(&prog, toks, ntoks);
+    if (ok != (!e.err && e.pos == e.n))
+    {
+        if (failures++ < 10)
+        {
+            printf("expression %u \"", n);
+            print_expr();
+            printf(" \": compiled %s, reference %s\n", ok ? "ok" : "fails", ok ? "fails" : "ok");
+        }
+        return ok;
+    }
+    if (!ok)
+        return false;
+
+    for (i = 0; i < frame_count; i++)
+    {
+        bool m = capf_match(&prog, &frames[i].pi);
+
+        if (m != (ntoks == 0 || ref_eval(&e, root, &frames[i].rf)))
+        {
+            if (failures++ < 10)
+            {
+                printf("expression %u \"", n);
+                print_expr();
+                printf(" \", frame %u: capf_match %d\n", i, m);
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    static char *too_long[MAX_TOKENS];
+    capf_prog prog;
+    uint32_t valid = 0, i;
+    int t;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: capf_test capture...\n");
+        return 2;
+    }
+    for (t = 1; t < argc; t++)
+        if (capture_read(argv[t], 0, &packets, &packet_count) < 0)
+            return 2;
+    load_frames();
+
+    for (i = 0; i < EXPRS; i++)
+    {
+        if (i % 4 == 3)
+            check(i, true);
+        else
+            valid += check(i, false);
+    }
+
+    // CAPF_MAX_INSNS: 8 primitives and 7 "or" fit, 9 and 8 don't
+    for (t = 0; t < 17; t++)
+        too_long[t] = t % 2 ? "or" : "ip";
+    if (!capf_compile(&prog, too_long, 15) || capf_compile(&prog, too_long, 17) || prog.len != 0)
+    {
+        failures++;
+        printf("limit of %d instructions not enforced\n", CAPF_MAX_INSNS);
+    }
+
+    printf("%u expressions (%u of %u valid ones compiled) on %u frames, %u failures\n",
+           EXPRS, valid, EXPRS - EXPRS / 4, frame_count, failures);
+    return failures != 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * pcap and pcapng reader of the host drivers, see capture.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "c_types.h"
+#include "pcap.h"
+
+#include "capture.h"
+
+#define MAX_IDBS	16
+
+const char *capture_iface_names[CAPTURE_IFACES] = { "ap-in", "ap-out", "sta-in", "sta-out" };
+
+int capture_iface_by_name(const char *name)
+{
+    int i;
+
+    for (i = 0; i < CAPTURE_IFACES; i++)
+        if (strcmp(name, capture_iface_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+static capture_packet **packets;
+static uint32_t *packet_count;
+
+static void add_packet(int iface, uint64_t ts_us, const uint8_t *data, uint32_t len)
+{
+    capture_packet *pk;
+
+    if (len > CAPTURE_MAX_FRAME)
+        len = CAPTURE_MAX_FRAME;
+    if ((*packet_count & 255) == 0)
+        *packets = realloc(*packets, (*packet_count + 256) * sizeof(capture_packet));
+    pk = &(*packets)[(*packet_count)++];
+    pk->iface = iface;
+    pk->ts_us = ts_us;
+    pk->len = len;
+    pk->data = malloc(len ? len : 1);
+    memcpy(pk->data, data, len);
+}
+
+static int read_pcap(FILE *f, const char *name, int iface)
+{
+    struct pcap_file_header fh;
+    struct pcap_pkthdr ph;
+    uint8_t data[65536];
+
+    if (fread(&fh, sizeof(fh), 1, f) != 1 || fh.magic != PCAP_MAGIC_NUMBER || fh.linktype != LINKTYPE_ETHERNET)
+    {
+        fprintf(stderr, "%s: not a little endian Ethernet pcap\n", name);
+        return -1;
+    }
+    while (fread(&ph, sizeof(ph), 1, f) == 1)
+    {
+        if (ph.caplen > sizeof(data) || fread(data, ph.caplen, 1, f) != 1)
+        {
+            fprintf(stderr, "%s: truncated\n", name);
+            return -1;
+        }
+        add_packet(iface, (uint64_t)ph.ts_sec * 1000000 + ph.ts_usec, data, ph.caplen);
+    }
+    return 0;
+}
+
+static int read_pcapng(FILE *f, const char *name)
+{
+    static uint8_t block[65536 + 64];
+    int idb_iface[MAX_IDBS];
+    int idbs = 0;
+    uint32_t hdr[2];
+
+    while (fread(hdr, sizeof(hdr), 1, f) == 1)
+    {
+        uint32_t type = hdr[0], len = hdr[1];
+
+        if (len < 12 || len > sizeof(block) || (len & 3) || fread(block + 8, len - 8, 1, f) != 1)
+        {
+            fprintf(stderr, "%s: bad block\n", name);
+            return -1;
+        }
+        memcpy(block, hdr, sizeof(hdr));
+
+        if (type == PCAPNG_BT_SHB)
+        {
+            struct pcapng_shb *shb = (struct pcapng_shb *)block;
+
+            if (shb->magic != PCAPNG_BYTE_ORDER_MAGIC)
+            {
+                fprintf(stderr, "%s: big endian sections are not supported\n", name);
+                return -1;
+            }
+            idbs = 0;
+        }
+        else if (type == PCAPNG_BT_IDB)
+        {
+            struct pcapng_idb *idb = (struct pcapng_idb *)block;
+            uint8_t *opt = block + sizeof(*idb);
+            int iface = -1;
+
+            if (idbs == MAX_IDBS || idb->linktype != LINKTYPE_ETHERNET)
+            {
+                fprintf(stderr, "%s: unsupported interface\n", name);
+                return -1;
+            }
+            while (opt + 4 <= block + len - 4)
+            {
+                uint16_t code = opt[0] | opt[1] << 8, olen = opt[2] | opt[3] << 8;
+                char ifname[32];
+
+                if (code == PCAPNG_OPT_ENDOFOPT)
+                    break;
+                if (code == PCAPNG_OPT_IF_NAME && olen < sizeof(ifname))
+                {
+                    memcpy(ifname, opt + 4, olen);
+                    ifname[olen] = '\0';
+                    iface = capture_iface_by_name(ifname);
+                }
+                opt += 4 + PCAPNG_PAD(olen);
+            }
+            if (iface < 0)
+            {
+                fprintf(stderr, "%s: interface %d is not one of the hooks\n", name, idbs);
+                return -1;
+            }
+            idb_iface[idbs++] = iface;
+        }
+        else if (type == PCAPNG_BT_EPB)
+        {
+            struct pcapng_epb *epb = (struct pcapng_epb *)block;
+
+            if (epb->if_id >= (uint32_t)idbs || sizeof(*epb) + epb->caplen + 4 > len)
+            {
+                fprintf(stderr, "%s: bad packet block\n", name);
+                return -1;
+            }
+            add_packet(idb_iface[epb->if_id], (uint64_t)epb->ts_high << 32 | epb->ts_low,
+                       block + sizeof(*epb), epb->caplen);
+        }
+        /* anything else, e.g. the interface statistics, is skipped */
+    }
+    return 0;
+}
+
+int capture_read(const char *name, int iface, capture_packet **pkts, uint32_t *count)
+{
+    FILE *f = fopen(name, "rb");
+    uint32_t magic;
+    int ret;
+
+    if (f == NULL)
+    {
+        perror(name);
+        return -1;
+    }
+    if (fread(&magic, sizeof(magic), 1, f) != 1)
+        magic = 0;
+    rewind(f);
+    packets = pkts;
+    packet_count = count;
+    ret = magic == PCAPNG_BT_SHB ? read_pcapng(f, name) : read_pcap(f, name, iface);
+    fclose(f);
+    return ret;
+}
@@ -0,0 +1,32 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include "c_types.h"
+
+/*
+ * Reads the captures for the host drivers: pcapng as the monitor writes
+ * it, where the interface name tells the hook a packet was captured at,
+ * and classic pcap, whose packets all get the interface given by the
+ * caller. Only little endian Ethernet captures are supported.
+ */
+
+#define CAPTURE_IFACES		4	/* ap-in, ap-out, sta-in, sta-out */
+#define CAPTURE_MAX_FRAME	2048	/* longer frames are truncated */
+
+typedef struct _capture_packet {
+    uint8_t iface;
+    uint64_t ts_us;
+    uint16_t len;
+    uint8_t *data;
+} capture_packet;
+
+extern const char *capture_iface_names[CAPTURE_IFACES];
+
+/* Index of an interface name or -1 */
+int capture_iface_by_name(const char *name);
+
+/* Appends the packets of the file to *packets / *count (both start out
+   NULL / 0). 0 on success, -1 after an error message on stderr. */
+int capture_read(const char *name, int iface, capture_packet **packets, uint32_t *count);
+
+#endif /* _CAPTURE_H_ */
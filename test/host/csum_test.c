@@ -0,0 +1,221 @@
+/*
+ * The RFC 1624 helpers of csum.c against a full recompute of the sum:
+ * random data gets random changes through csum_put16(), csum_put_addr()
+ * and csum_update() (at even and odd offsets), after which the updated
+ * checksum must be the one computed over the new data. The only allowed
+ * difference is 0xffff for 0x0000, the other form of zero, which verifies
+ * just the same.
+ *
+ * csum_udp_fix() is checked on UDP datagrams whose updated checksum comes
+ * out as 0: it must be sent as 0xffff, while a datagram without a checksum
+ * (no sum to update) keeps its 0.
+ *
+ *   csum_test [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "c_types.h"
+#include "csum.h"
+
+#define ROUNDS		1000000
+#define MAX_DATA	64
+
+static uint64_t rng = 88172645463325252ULL;
+static uint32_t failures, zero_forms, udp_fixed;
+
+static uint32_t rnd(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)(rng >> 16);
+}
+
+static uint16_t rd16(const uint8_t *b)
+{
+    return b[0] << 8 | b[1];
+}
+
+static void wr16(uint8_t *b, uint16_t v)
+{
+    b[0] = v >> 8;
+    b[1] = v;
+}
+
+/* One's complement sum of the data (RFC 1071), not complemented */
+static uint16_t sum(const uint8_t *d, int len, uint32_t s)
+{
+    for (; len > 1; d += 2, len -= 2)
+        s += rd16(d);
+    if (len)
+        s += d[0] << 8;
+    while (s >> 16)
+        s = (s & 0xffff) + (s >> 16);
+    return s;
+}
+
+/* The checksum of the data with its checksum field at sum_off zeroed */
+static uint16_t recompute(uint8_t *d, int len, int sum_off, uint32_t s)
+{
+    uint8_t saved[2];
+    uint16_t c;
+
+    memcpy(saved, d + sum_off, 2);
+    memset(d + sum_off, 0, 2);
+    c = ~sum(d, len, s);
+    memcpy(d + sum_off, saved, 2);
+    return c;
+}
+
+static void expect(const char *what, uint32_t round, uint16_t got, uint16_t want)
+{
+    if (got == want)
+        return;
+    if ((got | want) == 0xffff && (got & want) == 0)
+    {
+        zero_forms++;
+        return;
+    }
+    if (failures++ < 10)
+        printf("round %u %s: %04x, recomputed %04x\n", round, what, got, want);
+}
+
+/* A random data block with a valid checksum at an even offset */
+static int random_block(uint8_t *d, int *sum_off)
+{
+    int len = 2 + rnd() % (MAX_DATA - 1), i;
+
+    for (i = 0; i < len; i++)
+        d[i] = rnd() % 8 == 0 ? (rnd() & 1 ? 0xff : 0) : rnd();
+    *sum_off = (rnd() % (len / 2)) * 2;
+    wr16(d + *sum_off, recompute(d, len, *sum_off, 0));
+    return len;
+}
+
+/* A random even offset outside the checksum field, -1 if there is none */
+static int field_off(int len, int width, int sum_off)
+{
+    int tries, off;
+
+    for (tries = 0; tries < 8; tries++)
+    {
+        off = (rnd() % (len / 2)) * 2;
+        if (off + width <= len && (off + width <= sum_off || off >= sum_off + 2))
+            return off;
+    }
+    return -1;
+}
+
+static void check_put16(uint32_t round)
+{
+    uint8_t d[MAX_DATA];
+    int sum_off, len = random_block(d, &sum_off), off = field_off(len, 2, sum_off);
+
+    if (off < 0)
+        return;
+    csum_put16(d + off, rnd() % 4 == 0 ? rd16(d + off) ^ 0xffff : rnd(), d + sum_off, NULL);
+    expect("csum_put16", round, rd16(d + sum_off), recompute(d, len, sum_off, 0));
+}
+
+/* The address is covered by two sums: the block's and a pseudo header
+   sum over the address, like the IP header and the TCP/UDP checksum */
+static void check_put_addr(uint32_t round)
+{
+    uint8_t d[MAX_DATA], ph[6];
+    int sum_off, len = random_block(d, &sum_off), off = field_off(len, 4, sum_off);
+    uint32_t addr = rnd() << 16 ^ rnd();
+
+    if (off < 0)
+        return;
+    memcpy(ph, d + off, 4);
+    wr16(ph + 4, recompute(ph, 6, 4, 0));
+    csum_put_addr(d + off, addr, d + sum_off, ph + 4);
+    memcpy(ph, &addr, 4);
+    expect("csum_put_addr", round, rd16(d + sum_off), recompute(d, len, sum_off, 0));
+    expect("csum_put_addr second sum", round, rd16(ph + 4), recompute(ph, 6, 4, 0));
+}
+
+/* Any run of bytes, at odd offsets too */
+static void check_update(uint32_t round)
+{
+    uint8_t d[MAX_DATA], new[MAX_DATA];
+    int sum_off, len = random_block(d, &sum_off), off, n, i;
+
+    off = rnd() % len;
+    n = 1 + rnd() % (len - off);
+    if (off < sum_off + 2 && off + n > sum_off)
+        return;
+    for (i = 0; i < n; i++)
+        new[i] = rnd() % 4 == 0 ? d[off + i] : rnd();
+    csum_update(d + sum_off, d + off, new, n, off & 1);
+    memcpy(d + off, new, n);
+    expect(off & 1 ? "csum_update odd" : "csum_update even", round, rd16(d + sum_off),
+           recompute(d, len, sum_off, 0));
+}
+
+/*
+ * A UDP header and payload whose destination port changes to the value
+ * that makes the checksum 0, as NAPT rewrites it: after csum_udp_fix() it
+ * has to be 0xffff. A datagram sent without a checksum has no sum to
+ * update and keeps 0 with the new port.
+ */
+static void check_udp_fix(uint32_t round)
+{
+    uint8_t u[8 + 16], *sum_p = u + 6;
+    uint16_t port, orig = rnd();
+    int i;
+
+    for (i = 0; i < (int)sizeof(u); i++)
+        u[i] = rnd();
+    wr16(u + 4, sizeof(u));
+    // the port that makes the sum over the datagram 0xffff, the checksum 0
+    wr16(u + 2, 0);
+    port = recompute(u, sizeof(u), 6, 0);
+    if (port == orig)
+        return;
+    wr16(u + 2, orig);
+    wr16(sum_p, recompute(u, sizeof(u), 6, 0));
+    if (rd16(sum_p) == 0)
+        wr16(sum_p, 0xffff);
+
+    csum_put16(u + 2, port, sum_p, NULL);
+    if (rd16(sum_p) == 0)
+        udp_fixed++;
+    csum_udp_fix(sum_p);
+    if (rd16(sum_p) != 0xffff || recompute(u, sizeof(u), 6, 0) != 0)
+    {
+        if (failures++ < 10)
+            printf("round %u csum_udp_fix: %04x for a zero checksum\n", round, rd16(sum_p));
+    }
+
+    wr16(sum_p, 0);
+    csum_put16(u + 2, port ^ 1, NULL, NULL);
+    csum_udp_fix(NULL);
+    if (rd16(sum_p) != 0 || rd16(u + 2) != (port ^ 1))
+    {
+        if (failures++ < 10)
+            printf("round %u csum_udp_fix: datagram without checksum got %04x\n", round, rd16(sum_p));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t r;
+
+    if (argc > 1)
+        rng = strtoull(argv[1], NULL, 0) | 1;
+
+    for (r = 0; r < ROUNDS; r++)
+    {
+        check_put16(r);
+        check_put_addr(r);
+        check_update(r);
+        if (r % 16 == 0)
+            check_udp_fix(r);
+    }
+    printf("%u rounds, %u results in the other form of zero, %u UDP checksums fixed from 0, %u failures\n",
+           ROUNDS, zero_forms, udp_fixed, failures);
+    return failures != 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * The FDB of the repeater bridge against the linear table of 16 entries it
+ * replaced: ns per lookup of addresses in the table and of addresses that
+ * are not, with 16, 64 and a full table of entries. bridge.c is included
+ * for its static FDB, BRIDGE_FDB_SIZE is set by the Makefile (fdb_test_64,
+ * fdb_test_128, fdb_test_256). Every lookup must return the MAC inserted
+ * for the address, and the entries must be gone after their TTL.
+ *
+ *   fdb_test_<slots>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../user/bridge.c"
+
+#include "host.h"
+
+#define LOOKUPS		2000000
+#define LINEAR_SIZE	16
+
+static uint32_t failures;
+
+static uint64_t rng = 88172645463325252ULL;
+
+static uint32_t rnd(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)(rng >> 16);
+}
+
+/* The FDB before the hash table: a linear array, every lookup reads the
+   system time for the expiry */
+static fdb_entry_t linear_fdb[LINEAR_SIZE];
+
+static void linear_insert(uint32_t ip, const uint8_t *mac)
+{
+    uint32_t now = now_secs();
+    int free_idx = -1, oldest_idx = 0;
+    uint32_t oldest_exp = 0xFFFFFFFFUL;
+    int i;
+    for (i = 0; i < LINEAR_SIZE; i++) {
+        if (linear_fdb[i].ip == ip) {
+            os_memcpy(linear_fdb[i].mac, mac, 6); linear_fdb[i].expires_s = now + FDB_TTL_S;
+            return;
+        }
+        if (linear_fdb[i].ip == 0 || linear_fdb[i].expires_s <= now) { if (free_idx < 0) free_idx = i; }
+        if (linear_fdb[i].expires_s < oldest_exp) { oldest_exp = linear_fdb[i].expires_s; oldest_idx = i; }
+    }
+    int idx = (free_idx >= 0) ? free_idx : oldest_idx;
+    linear_fdb[idx].ip = ip; os_memcpy(linear_fdb[idx].mac, mac, 6); linear_fdb[idx].expires_s = now + FDB_TTL_S;
+}
+
+static const uint8_t *linear_lookup(uint32_t ip)
+{
+    uint32_t now = now_secs();
+    int i;
+    for (i = 0; i < LINEAR_SIZE; i++) {
+        if (linear_fdb[i].ip == ip && linear_fdb[i].expires_s > now) return linear_fdb[i].mac;
+    }
+    return NULL;
+}
+
+/* Client n: 10.0.x.y and a MAC made of n */
+static uint32_t client_ip(uint32_t n)
+{
+    return htonl(0x0a000000 | (n + 1));
+}
+
+static void client_mac(uint32_t n, uint8_t *mac)
+{
+    mac[0] = 0x02;
+    mac[1] = 0;
+    mac[2] = n >> 24;
+    mac[3] = n >> 16;
+    mac[4] = n >> 8;
+    mac[5] = n;
+}
+
+/* Addresses of the first n clients (hits) or of others (misses), in
+   random order */
+static void make_keys(uint32_t *keys, uint32_t n, bool hit)
+{
+    uint32_t i;
+
+    for (i = 0; i < 1024; i++)
+        keys[i] = client_ip(hit ? rnd() % n : 100000 + rnd() % 100000);
+}
+
+static double bench(const uint8_t *(*lookup)(uint32_t), const uint32_t *keys)
+{
+    volatile uintptr_t sink = 0;
+    uint64_t t0 = host_cpu_ns();
+    uint32_t i;
+
+    for (i = 0; i < LOOKUPS; i++)
+        sink += (uintptr_t)lookup(keys[i & 1023]);
+    (void)sink;
+    return (double)(host_cpu_ns() - t0) / LOOKUPS;
+}
+
+static void fill(uint32_t n)
+{
+    uint8_t mac[6];
+    uint32_t i;
+
+    os_memset(s_fdb, 0, sizeof(s_fdb));
+    s_fdb_count = 0;
+    s_now_s = now_secs();
+    for (i = 0; i < n; i++)
+    {
+        client_mac(i, mac);
+        fdb_insert(client_ip(i), mac);
+    }
+}
+
+/* All n entries are found with their MAC, others aren't */
+static void check(uint32_t n)
+{
+    uint8_t mac[6];
+    uint32_t i;
+
+    if (s_fdb_count != n)
+    {
+        failures++;
+        printf("%u entries inserted, %u in the FDB\n", n, s_fdb_count);
+    }
+    for (i = 0; i < n; i++)
+    {
+        const uint8_t *m = fdb_lookup(client_ip(i));
+
+        client_mac(i, mac);
+        if ((m == NULL || os_memcmp(m, mac, 6) != 0) && failures++ < 10)
+            printf("%u entries: entry %u not found\n", n, i);
+    }
+    for (i = n; i < n + 1000; i++)
+    {
+        if (fdb_lookup(client_ip(i)) != NULL && failures++ < 10)
+            printf("%u entries: entry %u found but not inserted\n", n, i);
+    }
+}
+
+/* After the TTL the lookups fail at once, bridge_tick() empties the table */
+static void check_expiry(uint32_t n)
+{
+    host_advance_us((uint64_t)(FDB_TTL_S + 1) * 1000000);
+    s_now_s = now_secs();
+    if (fdb_lookup(client_ip(0)) != NULL)
+    {
+        failures++;
+        printf("%u entries: expired entry found\n", n);
+    }
+    bridge_tick();
+    if (s_fdb_count != 0)
+    {
+        failures++;
+        printf("%u entries: %u left after bridge_tick()\n", n, s_fdb_count);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t counts[] = { 16, 64, FDB_MAX_FILL };
+    static uint32_t hits[1024], misses[1024];
+    uint8_t mac[6];
+    uint32_t c, i;
+
+    host_init(NULL);
+    host_advance_us(1000000);
+
+    for (i = 0; i < LINEAR_SIZE; i++)
+    {
+        client_mac(i, mac);
+        linear_insert(client_ip(i), mac);
+    }
+    make_keys(hits, LINEAR_SIZE, true);
+    make_keys(misses, LINEAR_SIZE, false);
+    printf("FDB of %d slots, up to %d entries, ns per lookup\n", FDB_SIZE, FDB_MAX_FILL);
+    printf("%8s %10s %10s\n", "entries", "hit", "miss");
+    printf("%8s %10.1f %10.1f\n", "linear16", bench(linear_lookup, hits), bench(linear_lookup, misses));
+
+    for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+        uint32_t n = counts[c];
+
+        if (n > FDB_MAX_FILL)
+            continue;
+        fill(n);
+        check(n);
+        make_keys(hits, n, true);
+        make_keys(misses, n, false);
+        printf("%8u %10.1f %10.1f\n", n, bench(fdb_lookup, hits), bench(fdb_lookup, misses));
+        check_expiry(n);
+    }
+
+    if (failures != 0)
+    {
+        printf("%u failures\n", failures);
+        return 1;
+    }
+    return 0;
+}
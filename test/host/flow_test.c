@@ -0,0 +1,279 @@
+/*
+ * The cost of the acl, monitor and acl-drop stages per packet, as they run
+ * in the ap-in chain, with the from_sta ACL full (15 deny rules that don't
+ * match and an allow-all at the end) and the monitor on with a filter that
+ * selects none of the flows. The test is built twice: as part of the router
+ * variant with the flow cache, and as nocache with FLOW_CACHE_SIZE 0, so the
+ * stages are timed with and without it. Few flows hit the cache, as many
+ * flows as it has entries collide in part, and many flows miss.
+ *
+ * The stages are called like hook_chain_run() does, the time of the
+ * pkt_parse() it does before is measured separately and subtracted. Each
+ * time is the fastest of several runs. Every verdict must be the one of
+ * the linear scan of the rules.
+ *
+ *   flow_test [flows...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "user_config.h"
+#include "c_types.h"
+#include "lwip/ip.h"
+#include "lwip/ip_addr.h"
+#include "lwip/netif.h"
+#include "pkt_info.h"
+#include "acl.h"
+#include "flow_cache.h"
+#include "hook_chain.h"
+
+#include "host.h"
+
+#define CLIENTS		8
+#define FRAME_LEN	(PKT_ETH_HDR_LEN + 20 + 20)
+#define PACKETS		1000000
+#define RUNS		5	/* the fastest run counts */
+#define MONITOR_PORT	1000
+
+#define MAX_STAGES	3
+
+static const char *stage_names[MAX_STAGES] = { "acl", "monitor", "acl-drop" };
+static hook_stage *stages[MAX_STAGES];
+/* acl-drop goes with acl, it only looks at the verdict */
+static hook_stage *acl_stages[2];
+
+static struct pbuf **frames;
+static uint32_t *order;
+static uint32_t failures;
+
+static uint64_t rng = 88172645463325252ULL;
+
+static uint32_t rnd(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)(rng >> 16);
+}
+
+static void wr16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+/* The first packet of flow n: UDP to port 53 or TCP to port 443 of a
+   server, from one of the clients behind the SoftAP */
+static struct pbuf *flow_frame(uint32_t n)
+{
+    uint8_t f[FRAME_LEN], *ip = f + PKT_ETH_HDR_LEN, *l4 = ip + 20;
+    uint8_t proto = n & 1 ? IP_PROTO_TCP : IP_PROTO_UDP;
+    ip_addr_t client, server;
+
+    IP4_ADDR(&client, 192, 168, 4, 2 + n % CLIENTS);
+    IP4_ADDR(&server, 93, 184, n / 250 % 250, 1 + n % 250);
+    memset(f, 0, sizeof(f));
+    f[0] = 0x02;
+    f[6] = 0x02;
+    f[11] = 2 + n % CLIENTS;
+    wr16(f + 12, 0x0800);
+    ip[0] = 0x45;
+    wr16(ip + 2, proto == IP_PROTO_TCP ? 40 : 28);
+    ip[8] = 64;
+    ip[9] = proto;
+    memcpy(ip + 12, &client, 4);
+    memcpy(ip + 16, &server, 4);
+    wr16(l4, 10000 + n);
+    wr16(l4 + 2, proto == IP_PROTO_TCP ? 443 : 53);
+    if (proto == IP_PROTO_TCP)
+    {
+        l4[12] = 5 << 4;
+        l4[13] = 0x10;
+    }
+    else
+    {
+        wr16(l4 + 4, 8);
+    }
+    return host_frame(f, proto == IP_PROTO_TCP ? FRAME_LEN : FRAME_LEN - 12);
+}
+
+/* Random packets of the flows through the n stages, as hook_chain_run()
+   does, 0 only parses. Returns the ns per packet. */
+static double run_once(uint32_t flows, hook_stage **list, int n, bool verify)
+{
+    hook_pkt hp;
+    uint64_t t0;
+    uint32_t i;
+    int j;
+
+    memset(&hp, 0, sizeof(hp));
+    hp.nif = host_netif(HOST_AP);
+    hp.chain = HOOK_AP_IN;
+    t0 = host_cpu_ns();
+    for (i = 0; i < PACKETS; i++)
+    {
+        hp.p = frames[order[i % flows]];
+        pkt_parse(hp.p, &hp.pi);
+        hp.pi.acl = ACL_ALLOW;
+        hp.flow_done = false;
+        hp.flow = NULL;
+        for (j = 0; j < n; j++)
+            list[j]->fn(&hp);
+        if (verify)
+        {
+            pkt_info *pi = &hp.pi;
+            int rule = acl_match_linear(HOOK_AP_IN, pi->proto, pi->src, pi->s_port, pi->dest, pi->d_port);
+
+            if (hp.pi.acl != (rule < 0 ? ACL_DENY : acl[HOOK_AP_IN][rule].allow) && failures++ < 10)
+                printf("%u flows, flow %u: verdict %u, rule %d\n", flows, order[i % flows], hp.pi.acl, rule);
+        }
+    }
+    return (double)(host_cpu_ns() - t0) / PACKETS;
+}
+
+static double run(uint32_t flows, hook_stage **list, int n)
+{
+    double t, best = 0;
+    int r;
+
+    for (r = 0; r < RUNS; r++)
+    {
+        t = run_once(flows, list, n, false);
+        if (r == 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+static void bench(uint32_t flows)
+{
+    double t_parse, t_acl, t_mon;
+    uint32_t i;
+#if FLOW_CACHE_SIZE
+    flow_stats *fs = flow_cache_stats();
+    uint32_t hits, misses;
+#endif
+
+    frames = malloc(flows * sizeof(struct pbuf *));
+    order = malloc(flows * sizeof(uint32_t));
+    for (i = 0; i < flows; i++)
+    {
+        frames[i] = flow_frame(i);
+        order[i] = i;
+    }
+    for (i = flows - 1; i > 0; i--)
+    {
+        uint32_t j = rnd() % (i + 1), t = order[i];
+
+        order[i] = order[j];
+        order[j] = t;
+    }
+
+    run_once(flows, stages, MAX_STAGES, true);
+    t_parse = run(flows, stages, 0);
+#if FLOW_CACHE_SIZE
+    hits = fs->hits;
+    misses = fs->misses;
+#endif
+    t_mon = run(flows, stages, MAX_STAGES) - t_parse;
+    t_acl = run(flows, acl_stages, 2) - t_parse;
+#if FLOW_CACHE_SIZE
+    printf("%8u %10.1f %10.1f %10.1f %9.1f%%\n", flows, t_acl, t_mon - t_acl, t_parse,
+           100.0 * (fs->hits - hits) / (fs->hits - hits + fs->misses - misses));
+#else
+    printf("%8u %10.1f %10.1f %10.1f\n", flows, t_acl, t_mon - t_acl, t_parse);
+#endif
+
+    for (i = 0; i < flows; i++)
+        pbuf_free(frames[i]);
+    free(frames);
+    free(order);
+}
+
+static void frame_sink(struct netif *nif, bool out, struct pbuf *p)
+{
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t counts[] = { 8, FLOW_CACHE_SIZE ? FLOW_CACHE_SIZE : 64, 1024 };
+    char cmd[128];
+    ip_addr_t ip, mask, gw, client;
+    hook_stage *s;
+    int i, j;
+
+    host_init(frame_sink);
+    host_boot();
+    IP4_ADDR(&ip, 10, 0, 0, 2);
+    IP4_ADDR(&mask, 255, 255, 255, 0);
+    IP4_ADDR(&gw, 10, 0, 0, 1);
+    host_sta_got_ip(ip.addr, mask.addr, gw.addr);
+    host_advance_us(1000000);
+    for (i = 0; i < CLIENTS; i++)
+    {
+        uint8_t mac[6] = { 0x02, 0, 0, 0, 0, 2 + i };
+
+        IP4_ADDR(&client, 192, 168, 4, 2 + i);
+        host_ap_sta_join(mac, client.addr);
+    }
+
+    // rules for other clients, servers and ports, then the one that matches
+    for (i = 0; i < MAX_ACL_ENTRIES - 1; i++)
+    {
+        if (i % 3 == 0)
+            sprintf(cmd, "acl from_sta UDP any any 10.%d.0.0/16 53 deny", i);
+        else if (i % 3 == 1)
+            sprintf(cmd, "acl from_sta TCP 192.168.4.%d any any 443 deny", 100 + i);
+        else
+            sprintf(cmd, "acl from_sta IP 172.16.%d.0/24 any deny", i);
+        host_console(cmd);
+    }
+    host_console("acl from_sta IP any any allow");
+    sprintf(cmd, "monitor on %d udp and port 9 or tcp and port 9 or host 10.9.9.9", MONITOR_PORT);
+    host_console(cmd);
+    IP4_ADDR(&client, 10, 0, 0, 1);
+    if (acl_freep[HOOK_AP_IN] != MAX_ACL_ENTRIES || !host_tcp_connect(MONITOR_PORT, client.addr, 50000))
+    {
+        printf("ACL or monitor not set up\n");
+        return 2;
+    }
+
+    for (j = 0; j < MAX_STAGES; j++)
+    {
+        for (i = 0; (s = hook_get_stage(i)) != NULL && strcmp(s->name, stage_names[j]) != 0; i++)
+            ;
+        if (s == NULL || !hook_stage_active(s, HOOK_AP_IN))
+        {
+            printf("stage %s not active\n", stage_names[j]);
+            return 2;
+        }
+        stages[j] = s;
+    }
+    acl_stages[0] = stages[0];
+    acl_stages[1] = stages[2];
+
+#if FLOW_CACHE_SIZE
+    printf("ns per packet, %d rules, flow cache of %d entries\n%8s %10s %10s %10s %10s\n", MAX_ACL_ENTRIES,
+           FLOW_CACHE_SIZE, "flows", "acl", "monitor", "parse", "hits");
+#else
+    printf("ns per packet, %d rules, no flow cache\n%8s %10s %10s %10s\n", MAX_ACL_ENTRIES,
+           "flows", "acl", "monitor", "parse");
+#endif
+    if (argc > 1)
+    {
+        for (i = 1; i < argc; i++)
+            bench(atoi(argv[i]));
+    }
+    else
+    {
+        for (i = 0; i < (int)(sizeof(counts) / sizeof(counts[0])); i++)
+            bench(counts[i]);
+    }
+    if (failures != 0)
+    {
+        printf("%u failures\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,6 @@
+# The bridge only starts with a configured uplink
+set ssid uplink
+!sta 10.0.0.50 255.255.255.0 10.0.0.1
+# the 500 ms timer configures the softAP netif
+!wait 1000
+!join 02:00:00:00:00:02 10.0.0.60
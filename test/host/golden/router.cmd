@@ -0,0 +1,7 @@
+# NAPT between the softAP network and the uplink, telnet denied for the clients
+acl from_sta TCP any any any 23 deny
+acl from_sta IP any any allow
+!sta 10.0.0.2 255.255.255.0 10.0.0.1
+# the 500 ms timer configures the softAP netif
+!wait 1000
+!join 02:00:00:00:00:02 192.168.4.2
@@ -0,0 +1,61 @@
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <stdio.h>
+#include "c_types.h"
+#include "lwip/netif.h"
+#include "user_interface.h"
+
+/*
+ * Host side of the SDK/lwIP shim in test/host: what the test drivers use to
+ * stand in for the radio, the clock and the UART.
+ *
+ * Time is virtual. It only moves when a driver calls host_advance_us(),
+ * which fires the due os_timers in order and runs the posted tasks after
+ * each, so a replay is deterministic. perf_ccount() and host_cpu_ns() in
+ * contrast read the real CPU clock, they are what the benchmarks measure.
+ */
+
+#define HOST_STA	0	/* netif num of the station interface */
+#define HOST_AP		1	/* netif num of the softAP interface */
+
+/* Called with every frame the firmware hands back to the SDK: out is false
+   for frames passed up to the stack (the original netif->input), true for
+   frames sent on the radio (the original netif->linkoutput). The frame is
+   still owned by the shim, which frees it after the call. */
+typedef void (*host_frame_fn)(struct netif *nif, bool out, struct pbuf *p);
+
+extern bool host_verbose;		/* pass os_printf through to stdout */
+extern FILE *host_console_out;		/* UART output, NULL discards it */
+
+void host_init(host_frame_fn sink);
+struct netif *host_netif(uint8_t num);
+
+/* Boots the firmware: user_init(), the init done callback and the tasks */
+void host_boot(void);
+/* Fires EVENT_STAMODE_CONNECTED and EVENT_STAMODE_GOT_IP for the station */
+void host_sta_got_ip(uint32_t ip, uint32_t mask, uint32_t gw);
+/* Fires EVENT_SOFTAPMODE_STACONNECTED, ip is recorded for the station list */
+void host_ap_sta_join(const uint8_t *mac, uint32_t ip);
+
+/* A client connects to the TCP server listening on the port (espconn_accept()).
+   False if there is none. */
+bool host_tcp_connect(uint16_t port, uint32_t ip, uint16_t remote_port);
+
+/* Types one line on the serial console and runs it */
+void host_console(const char *line);
+
+void host_run_tasks(void);
+void host_advance_us(uint64_t us);
+uint64_t host_time_us(void);
+
+/* Monotonic CPU time in ns, for benchmarks */
+uint64_t host_cpu_ns(void);
+
+/* Frame as the WiFi driver delivers it: a PBUF_REF over separately
+   allocated storage, which pbuf_free() releases */
+struct pbuf *host_frame(const uint8_t *data, uint16_t len);
+/* Number of pbufs not yet freed, for leak checks */
+uint32_t host_pbufs_live(void);
+
+#endif /* _HOST_H_ */
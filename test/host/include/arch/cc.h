@@ -0,0 +1,38 @@
+/*
+ * Host shim for the esp-open-lwip arch/cc.h: lwIP's base types.  The byte
+ * order comes from the host libc's <endian.h>.
+ */
+#ifndef __ARCH_CC_H__
+#define __ARCH_CC_H__
+
+#include <stdint.h>
+#include "c_types.h"
+
+#include <endian.h>
+
+typedef uint8_t		u8_t;
+typedef int8_t		s8_t;
+typedef uint16_t	u16_t;
+typedef int16_t		s16_t;
+typedef uint32_t	u32_t;
+typedef int32_t		s32_t;
+typedef uintptr_t	mem_ptr_t;
+
+#define S16_F		"d"
+#define U16_F		"d"
+#define X16_F		"x"
+#define S32_F		"d"
+#define U32_F		"d"
+#define X32_F		"x"
+
+#define PACK_STRUCT_FIELD(x)	x
+#define PACK_STRUCT_STRUCT	__attribute__((packed))
+#define PACK_STRUCT_BEGIN
+#define PACK_STRUCT_END
+
+#define LWIP_PLATFORM_DIAG(x)
+#define LWIP_PLATFORM_ASSERT(x)
+
+#define LWIP_NO_STDINT_H	1
+
+#endif /* __ARCH_CC_H__ */
@@ -0,0 +1,66 @@
+/*
+ * Host shim for the NONOS SDK c_types.h: fixed width types and the
+ * section attributes, which are meaningless off target.
+ */
+#ifndef _C_TYPES_H_
+#define _C_TYPES_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef uint8_t		uint8;
+typedef int8_t		sint8;
+typedef int8_t		int8;
+typedef uint16_t	uint16;
+typedef int16_t		sint16;
+typedef int16_t		int16;
+typedef uint32_t	uint32;
+typedef int32_t		sint32;
+typedef int32_t		int32;
+typedef uint64_t	uint64;
+typedef int64_t		sint64;
+typedef int64_t		int64;
+typedef uint8_t		u8;
+typedef uint16_t	u16;
+typedef uint32_t	u32;
+typedef int16_t		sint16_t;
+typedef unsigned char	u_char;
+typedef unsigned int	uint;
+
+typedef float		real32;
+typedef double		real64;
+
+typedef bool		BOOL;
+#ifndef TRUE
+#define TRUE		true
+#define FALSE		false
+#endif
+
+#define __le16		u16
+
+typedef enum {
+    OK = 0,
+    FAIL,
+    PENDING,
+    BUSY,
+    CANCEL,
+} STATUS;
+
+#define BIT(nr)			(1UL << (nr))
+
+#define REG_SET_BIT(_r, _b)
+#define REG_CLR_BIT(_r, _b)
+
+#define DMEM_ATTR
+#define SHMEM_ATTR
+#define ICACHE_FLASH_ATTR
+#define ICACHE_RAM_ATTR
+#define ICACHE_RODATA_ATTR
+#define STORE_ATTR		__attribute__((aligned(4)))
+
+#ifndef __cplusplus
+#define LOCAL			static
+#endif
+
+#endif /* _C_TYPES_H_ */
@@ -0,0 +1,56 @@
+/*
+ * Host shim for the NONOS SDK eagle_soc.h.  There are no peripherals on
+ * the host: register reads return 0 and writes are dropped.
+ */
+#ifndef _EAGLE_SOC_H_
+#define _EAGLE_SOC_H_
+
+#include "c_types.h"
+
+#define ETS_UNCACHED_ADDR(addr)			(addr)
+#define READ_PERI_REG(addr)			((void)(addr), 0U)
+#define WRITE_PERI_REG(addr, val)		((void)(addr), (void)(val))
+#define CLEAR_PERI_REG_MASK(reg, mask)		((void)(reg), (void)(mask))
+#define SET_PERI_REG_MASK(reg, mask)		((void)(reg), (void)(mask))
+#define GET_PERI_REG_BITS(reg, hipos, lowpos)	0U
+#define SET_PERI_REG_BITS(reg, bit_map, value, shift)
+
+#define PERIPHS_GPIO_BASEADDR			0x60000300
+#define PERIPHS_IO_MUX				0x60000800
+#define PERIPHS_IO_MUX_MTDI_U			(PERIPHS_IO_MUX + 0x04)
+#define PERIPHS_IO_MUX_MTCK_U			(PERIPHS_IO_MUX + 0x08)
+#define PERIPHS_IO_MUX_MTMS_U			(PERIPHS_IO_MUX + 0x0C)
+#define PERIPHS_IO_MUX_MTDO_U			(PERIPHS_IO_MUX + 0x10)
+#define PERIPHS_IO_MUX_U0RXD_U			(PERIPHS_IO_MUX + 0x14)
+#define PERIPHS_IO_MUX_U0TXD_U			(PERIPHS_IO_MUX + 0x18)
+#define PERIPHS_IO_MUX_SD_CLK_U			(PERIPHS_IO_MUX + 0x1c)
+#define PERIPHS_IO_MUX_SD_DATA0_U		(PERIPHS_IO_MUX + 0x20)
+#define PERIPHS_IO_MUX_SD_DATA1_U		(PERIPHS_IO_MUX + 0x24)
+#define PERIPHS_IO_MUX_SD_DATA2_U		(PERIPHS_IO_MUX + 0x28)
+#define PERIPHS_IO_MUX_SD_DATA3_U		(PERIPHS_IO_MUX + 0x2c)
+#define PERIPHS_IO_MUX_SD_CMD_U			(PERIPHS_IO_MUX + 0x30)
+#define PERIPHS_IO_MUX_GPIO0_U			(PERIPHS_IO_MUX + 0x34)
+#define PERIPHS_IO_MUX_GPIO2_U			(PERIPHS_IO_MUX + 0x38)
+#define PERIPHS_IO_MUX_GPIO4_U			(PERIPHS_IO_MUX + 0x3C)
+#define PERIPHS_IO_MUX_GPIO5_U			(PERIPHS_IO_MUX + 0x40)
+
+#define FUNC_GPIO0				0
+#define FUNC_GPIO2				0
+#define FUNC_GPIO4				0
+#define FUNC_GPIO5				0
+#define FUNC_GPIO9				3
+#define FUNC_GPIO10				3
+#define FUNC_GPIO12				3
+#define FUNC_GPIO13				3
+#define FUNC_GPIO14				3
+#define FUNC_GPIO15				3
+#define FUNC_GPIO3				3
+#define FUNC_GPIO1				3
+#define FUNC_U0RXD				0
+#define FUNC_U0TXD				0
+
+#define PIN_PULLUP_DIS(PIN_NAME)		((void)(PIN_NAME))
+#define PIN_PULLUP_EN(PIN_NAME)			((void)(PIN_NAME))
+#define PIN_FUNC_SELECT(PIN_NAME, FUNC)		((void)(PIN_NAME), (void)(FUNC))
+
+#endif /* _EAGLE_SOC_H_ */
@@ -0,0 +1,9 @@
+/*
+ * Host shim for the NONOS SDK espconn.h.
+ */
+#ifndef __HOST_ESPCONN_H__
+#define __HOST_ESPCONN_H__
+
+#include "lwip/app/espconn.h"
+
+#endif /* __HOST_ESPCONN_H__ */
@@ -0,0 +1,50 @@
+/*
+ * Host shim for the NONOS SDK ets_sys.h: task and timer types plus the
+ * interrupt and register macros, which do nothing on the host.
+ */
+#ifndef _ETS_SYS_H
+#define _ETS_SYS_H
+
+#include "c_types.h"
+#include "eagle_soc.h"
+
+typedef uint32_t	ETSSignal;
+typedef uintptr_t	ETSParam;
+
+typedef struct ETSEventTag ETSEvent;
+
+struct ETSEventTag {
+    ETSSignal sig;
+    ETSParam  par;
+};
+
+typedef void (*ETSTask)(ETSEvent *e);
+
+typedef void ETSTimerFunc(void *timer_arg);
+
+typedef struct _ETSTIMER_ {
+    struct _ETSTIMER_	*timer_next;
+    uint32_t		timer_expire;
+    uint32_t		timer_period;
+    ETSTimerFunc	*timer_func;
+    void		*timer_arg;
+} ETSTimer;
+
+typedef void (*int_handler_t)(void *);
+
+#define ETS_INTR_LOCK()
+#define ETS_INTR_UNLOCK()
+#define ETS_UART_INTR_ATTACH(func, arg)
+#define ETS_UART_INTR_ENABLE()
+#define ETS_UART_INTR_DISABLE()
+#define ETS_GPIO_INTR_ATTACH(func, arg)
+#define ETS_GPIO_INTR_ENABLE()
+#define ETS_GPIO_INTR_DISABLE()
+#define ETS_SPI_INTR_ATTACH(func, arg)
+#define ETS_SPI_INTR_ENABLE()
+#define ETS_SPI_INTR_DISABLE()
+#define ETS_FRC_TIMER1_INTR_ATTACH(func, arg)
+#define ETS_FRC1_INTR_ENABLE()
+#define ETS_FRC1_INTR_DISABLE()
+
+#endif /* _ETS_SYS_H */
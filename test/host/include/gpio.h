@@ -0,0 +1,72 @@
+/*
+ * Host shim for the NONOS SDK gpio.h.  Pins read as 0 and writes are
+ * dropped; the replay driver never exercises GPIO.
+ */
+#ifndef _GPIO_H_
+#define _GPIO_H_
+
+#include "c_types.h"
+#include "eagle_soc.h"
+
+#define RTC_GPIO_OUT			0x60000768
+#define RTC_GPIO_ENABLE			0x60000774
+#define RTC_GPIO_IN_DATA		0x6000078C
+#define RTC_GPIO_CONF			0x60000790
+#define PAD_XPD_DCDC_CONF		0x600007A0
+
+#define GPIO_OUT_ADDRESS		0x00
+#define GPIO_OUT_W1TS_ADDRESS		0x04
+#define GPIO_OUT_W1TC_ADDRESS		0x08
+#define GPIO_ENABLE_ADDRESS		0x0c
+#define GPIO_ENABLE_W1TS_ADDRESS	0x10
+#define GPIO_ENABLE_W1TC_ADDRESS	0x14
+#define GPIO_IN_ADDRESS			0x18
+#define GPIO_STATUS_ADDRESS		0x1c
+#define GPIO_STATUS_W1TS_ADDRESS	0x20
+#define GPIO_STATUS_W1TC_ADDRESS	0x24
+#define GPIO_PIN0_ADDRESS		0x28
+#define GPIO_PIN_ADDR(i)		(GPIO_PIN0_ADDRESS + (i) * 4)
+
+#define GPIO_REG_READ(reg)		((void)(reg), 0U)
+#define GPIO_REG_WRITE(reg, val)	((void)(reg), (void)(val))
+
+#define GPIO_ID_PIN0			0
+#define GPIO_ID_PIN(n)			(GPIO_ID_PIN0 + (n))
+#define GPIO_LAST_REGISTER_ID		GPIO_ID_PIN(15)
+#define GPIO_ID_NONE			0xffffffff
+
+#define GPIO_PIN_INT_TYPE_SET(x)	(((x) & 7) << 7)
+#define GPIO_PIN_PAD_DRIVER_SET(x)	(((x) & 1) << 2)
+#define GPIO_PIN_SOURCE_SET(x)		(((x) & 1) << 0)
+
+#define GPIO_PAD_DRIVER_DISABLE		0
+#define GPIO_PAD_DRIVER_ENABLE		1
+#define GPIO_AS_PIN_SOURCE		0
+#define SIGMA_AS_PIN_SOURCE		(~GPIO_AS_PIN_SOURCE)
+
+typedef enum {
+    GPIO_PIN_INTR_DISABLE = 0,
+    GPIO_PIN_INTR_POSEDGE = 1,
+    GPIO_PIN_INTR_NEGEDGE = 2,
+    GPIO_PIN_INTR_ANYEDGE = 3,
+    GPIO_PIN_INTR_LOLEVEL = 4,
+    GPIO_PIN_INTR_HILEVEL = 5
+} GPIO_INT_TYPE;
+
+#define GPIO_OUTPUT_SET(gpio_no, bit_value) \
+    gpio_output_set((bit_value) << (gpio_no), ((~(bit_value)) & 0x01) << (gpio_no), 1 << (gpio_no), 0)
+#define GPIO_DIS_OUTPUT(gpio_no)	gpio_output_set(0, 0, 0, 1 << (gpio_no))
+#define GPIO_INPUT_GET(gpio_no)		((gpio_input_get() >> (gpio_no)) & BIT0)
+
+#define BIT0				0x00000001
+
+typedef void (*gpio_intr_handler_fn_t)(uint32 intr_mask, void *arg);
+
+void gpio_output_set(uint32 set_mask, uint32 clear_mask, uint32 enable_mask, uint32 disable_mask);
+uint32 gpio_input_get(void);
+void gpio_intr_handler_register(void *fn, void *arg);
+void gpio_pin_intr_state_set(uint32 i, GPIO_INT_TYPE intr_state);
+void gpio_register_set(uint32 reg_id, uint32 value);
+void gpio_init(void);
+
+#endif /* _GPIO_H_ */
@@ -0,0 +1,9 @@
+/*
+ * Host shim for lwip/app/espconn_tcp.h.
+ */
+#ifndef __ESPCONN_TCP_H__
+#define __ESPCONN_TCP_H__
+
+#include "lwip/app/espconn.h"
+
+#endif /* __ESPCONN_TCP_H__ */
@@ -0,0 +1,22 @@
+/*
+ * Host shim for lwip/debug.h: all debug output compiled out.
+ */
+#ifndef __LWIP_DEBUG_H__
+#define __LWIP_DEBUG_H__
+
+#include "arch/cc.h"
+
+#define LWIP_DBG_OFF		0x00
+#define LWIP_DBG_ON		0x80
+#define LWIP_DBG_LEVEL_ALL	0x00
+#define LWIP_DBG_MASK_LEVEL	0x03
+#define LWIP_DBG_TRACE		0x40
+#define LWIP_DBG_STATE		0x20
+#define LWIP_DBG_FRESH		0x10
+#define LWIP_DBG_HALT		0x08
+
+#define LWIP_ASSERT(message, assertion)
+#define LWIP_ERROR(message, expression, handler) do { if (!(expression)) { handler; } } while (0)
+#define LWIP_DEBUGF(debug, message)
+
+#endif /* __LWIP_DEBUG_H__ */
@@ -0,0 +1,38 @@
+/*
+ * Host shim for lwip/def.h (lwIP 1.4) on a little endian host.
+ */
+#ifndef __LWIP_DEF_H__
+#define __LWIP_DEF_H__
+
+#include "lwip/opt.h"
+
+#define LWIP_MAX(x, y)		(((x) > (y)) ? (x) : (y))
+#define LWIP_MIN(x, y)		(((x) < (y)) ? (x) : (y))
+
+#ifndef NULL
+#define NULL			((void *)0)
+#endif
+
+#define LWIP_UNUSED_ARG(x)	(void)x
+
+#define LWIP_MAKE_U16(a, b)	((b << 8) | a)
+
+#define PP_HTONS(x)	((u16_t)((((x) & 0xff) << 8) | (((x) & 0xff00) >> 8)))
+#define PP_NTOHS(x)	PP_HTONS(x)
+#define PP_HTONL(x)	((((x) & 0xff) << 24) | \
+			 (((x) & 0xff00) << 8) | \
+			 (((x) & 0xff0000UL) >> 8) | \
+			 (((x) & 0xff000000UL) >> 24))
+#define PP_NTOHL(x)	PP_HTONL(x)
+
+#define htons(x)	lwip_htons(x)
+#define ntohs(x)	lwip_ntohs(x)
+#define htonl(x)	lwip_htonl(x)
+#define ntohl(x)	lwip_ntohl(x)
+
+static inline u16_t lwip_htons(u16_t x) { return PP_HTONS(x); }
+static inline u16_t lwip_ntohs(u16_t x) { return PP_NTOHS(x); }
+static inline u32_t lwip_htonl(u32_t x) { return PP_HTONL(x); }
+static inline u32_t lwip_ntohl(u32_t x) { return PP_NTOHL(x); }
+
+#endif /* __LWIP_DEF_H__ */
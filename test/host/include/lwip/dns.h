@@ -0,0 +1,18 @@
+/*
+ * Host shim for lwip/dns.h (lwIP 1.4).
+ */
+#ifndef __LWIP_DNS_H__
+#define __LWIP_DNS_H__
+
+#include "lwip/opt.h"
+#include "lwip/ip_addr.h"
+#include "lwip/err.h"
+
+#define DNS_MAX_SERVERS		2
+
+typedef void (*dns_found_callback)(const char *name, ip_addr_t *ipaddr, void *callback_arg);
+
+ip_addr_t dns_getserver(u8_t numdns);
+void dns_setserver(u8_t numdns, ip_addr_t *dnsserver);
+
+#endif /* __LWIP_DNS_H__ */
@@ -0,0 +1,62 @@
+/*
+ * Host shim for lwip/ip.h (lwIP 1.4): the header layout and accessors.
+ */
+#ifndef __LWIP_IP_H__
+#define __LWIP_IP_H__
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/pbuf.h"
+#include "lwip/ip_addr.h"
+#include "lwip/err.h"
+#include "lwip/netif.h"
+
+#define IP_HLEN			20
+
+#define IP_PROTO_ICMP		1
+#define IP_PROTO_IGMP		2
+#define IP_PROTO_UDP		17
+#define IP_PROTO_UDPLITE	136
+#define IP_PROTO_TCP		6
+
+#define IP_HDRINCL		NULL
+
+struct ip_hdr {
+    u16_t _v_hl_tos;
+    u16_t _len;
+    u16_t _id;
+    u16_t _offset;
+#define IP_RF			0x8000U
+#define IP_DF			0x4000U
+#define IP_MF			0x2000U
+#define IP_OFFMASK		0x1fffU
+    u16_t _ttl_proto;
+    u16_t _chksum;
+    ip_addr_p_t src;
+    ip_addr_p_t dest;
+} __attribute__((packed));
+
+#define IPH_V(hdr)		(ntohs((hdr)->_v_hl_tos) >> 12)
+#define IPH_HL(hdr)		((ntohs((hdr)->_v_hl_tos) >> 8) & 0x0f)
+#define IPH_TOS(hdr)		(ntohs((hdr)->_v_hl_tos) & 0xff)
+#define IPH_LEN(hdr)		((hdr)->_len)
+#define IPH_ID(hdr)		((hdr)->_id)
+#define IPH_OFFSET(hdr)		((hdr)->_offset)
+#define IPH_TTL(hdr)		(ntohs((hdr)->_ttl_proto) >> 8)
+#define IPH_PROTO(hdr)		(ntohs((hdr)->_ttl_proto) & 0xff)
+#define IPH_CHKSUM(hdr)		((hdr)->_chksum)
+
+extern struct netif *current_netif;
+extern const struct ip_hdr *current_header;
+extern ip_addr_t current_iphdr_src;
+extern ip_addr_t current_iphdr_dest;
+
+#define ip_current_netif()	(current_netif)
+#define ip_current_header()	(current_header)
+#define ip_current_src_addr()	(&current_iphdr_src)
+#define ip_current_dest_addr()	(&current_iphdr_dest)
+
+err_t ip_input(struct pbuf *p, struct netif *inp);
+struct netif *ip_route(ip_addr_t *dest);
+
+#endif /* __LWIP_IP_H__ */
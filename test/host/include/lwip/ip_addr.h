@@ -0,0 +1,82 @@
+/*
+ * Host shim for lwip/ip_addr.h (lwIP 1.4).  Addresses are kept in network
+ * byte order, as on the target.
+ */
+#ifndef __LWIP_IP_ADDR_H__
+#define __LWIP_IP_ADDR_H__
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+
+struct ip_addr {
+    u32_t addr;
+};
+
+typedef struct ip_addr ip_addr_t;
+
+struct ip_addr_packed {
+    u32_t addr;
+} __attribute__((packed));
+
+typedef struct ip_addr_packed ip_addr_p_t;
+
+struct ip_info {
+    struct ip_addr ip;
+    struct ip_addr netmask;
+    struct ip_addr gw;
+};
+
+struct netif;
+
+extern const ip_addr_t ip_addr_any;
+extern const ip_addr_t ip_addr_broadcast;
+
+#define IP_ADDR_ANY		((ip_addr_t *)&ip_addr_any)
+#define IP_ADDR_BROADCAST	((ip_addr_t *)&ip_addr_broadcast)
+
+#define IPADDR_NONE		((u32_t)0xffffffffUL)
+#define IPADDR_LOOPBACK		((u32_t)0x7f000001UL)
+#define IPADDR_ANY		((u32_t)0x00000000UL)
+#define IPADDR_BROADCAST	((u32_t)0xffffffffUL)
+
+#define IP4_ADDR(ipaddr, a, b, c, d) \
+    (ipaddr)->addr = ((u32_t)((d) & 0xff) << 24) | \
+                     ((u32_t)((c) & 0xff) << 16) | \
+                     ((u32_t)((b) & 0xff) << 8)  | \
+                      (u32_t)((a) & 0xff)
+
+#define ip_addr_copy(dest, src)		((dest).addr = (src).addr)
+#define ip_addr_set(dest, src)		((dest)->addr = ((src) == NULL ? 0 : (src)->addr))
+#define ip_addr_set_zero(ipaddr)	((ipaddr)->addr = 0)
+#define ip_addr_set_any(ipaddr)		((ipaddr)->addr = IPADDR_ANY)
+#define ip_addr_netcmp(addr1, addr2, mask) \
+    (((addr1)->addr & (mask)->addr) == ((addr2)->addr & (mask)->addr))
+#define ip_addr_cmp(addr1, addr2)	((addr1)->addr == (addr2)->addr)
+#define ip_addr_isany(addr1)		((addr1) == NULL || (addr1)->addr == IPADDR_ANY)
+#define ip_addr_isbroadcast(ipaddr, netif) ip4_addr_isbroadcast((ipaddr)->addr, (netif))
+#define ip_addr_ismulticast(addr1) \
+    (((addr1)->addr & PP_HTONL(0xf0000000UL)) == PP_HTONL(0xe0000000UL))
+
+#define ip4_addr1(ipaddr)	(((u8_t *)(ipaddr))[0])
+#define ip4_addr2(ipaddr)	(((u8_t *)(ipaddr))[1])
+#define ip4_addr3(ipaddr)	(((u8_t *)(ipaddr))[2])
+#define ip4_addr4(ipaddr)	(((u8_t *)(ipaddr))[3])
+
+#define ip4_addr1_16(ipaddr)	((u16_t)ip4_addr1(ipaddr))
+#define ip4_addr2_16(ipaddr)	((u16_t)ip4_addr2(ipaddr))
+#define ip4_addr3_16(ipaddr)	((u16_t)ip4_addr3(ipaddr))
+#define ip4_addr4_16(ipaddr)	((u16_t)ip4_addr4(ipaddr))
+
+#define IP2STR(ipaddr)	ip4_addr1_16(ipaddr), ip4_addr2_16(ipaddr), \
+			ip4_addr3_16(ipaddr), ip4_addr4_16(ipaddr)
+#define IPSTR		"%d.%d.%d.%d"
+
+#define MAC2STR(a)	(a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+#define MACSTR		"%02x:%02x:%02x:%02x:%02x:%02x"
+
+u8_t ip4_addr_isbroadcast(u32_t addr, const struct netif *netif);
+u32_t ipaddr_addr(const char *cp);
+int ipaddr_aton(const char *cp, ip_addr_t *addr);
+char *ipaddr_ntoa(const ip_addr_t *addr);
+
+#endif /* __LWIP_IP_ADDR_H__ */
@@ -0,0 +1,9 @@
+/*
+ * Host shim for lwip/mdns.h.  The responder itself is not built.
+ */
+#ifndef __LWIP_MDNS_H__
+#define __LWIP_MDNS_H__
+
+#include "lwip/opt.h"
+
+#endif /* __LWIP_MDNS_H__ */
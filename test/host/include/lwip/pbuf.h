@@ -0,0 +1,65 @@
+/*
+ * Host shim for lwip/pbuf.h (lwIP 1.4 as patched by Espressif).  The
+ * implementation in test/host/lwip.c allocates every pbuf as a single
+ * chunk and does no pooling.
+ */
+#ifndef __LWIP_PBUF_H__
+#define __LWIP_PBUF_H__
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+
+#define LWIP_SUPPORT_CUSTOM_PBUF	0
+
+#define PBUF_TRANSPORT_HLEN	20
+#define PBUF_IP_HLEN		20
+
+typedef enum {
+    PBUF_TRANSPORT,
+    PBUF_IP,
+    PBUF_LINK,
+    PBUF_RAW
+} pbuf_layer;
+
+typedef enum {
+    PBUF_RAM,
+    PBUF_ROM,
+    PBUF_REF,
+    PBUF_POOL,
+    PBUF_ESF_RX
+} pbuf_type;
+
+#define PBUF_FLAG_PUSH		0x01U
+#define PBUF_FLAG_IS_CUSTOM	0x02U
+#define PBUF_FLAG_MCASTLOOP	0x04U
+#define PBUF_FLAG_LLBCAST	0x08U
+#define PBUF_FLAG_LLMCAST	0x10U
+#define PBUF_FLAG_TCP_FIN	0x20U
+
+struct pbuf {
+    struct pbuf *next;
+    void *payload;
+    u16_t tot_len;
+    u16_t len;
+    u8_t type;
+    u8_t flags;
+    u16_t ref;
+    void *eb;
+};
+
+struct pbuf *pbuf_alloc(pbuf_layer l, u16_t length, pbuf_type type);
+void pbuf_realloc(struct pbuf *p, u16_t size);
+u8_t pbuf_header(struct pbuf *p, s16_t header_size);
+void pbuf_ref(struct pbuf *p);
+u8_t pbuf_free(struct pbuf *p);
+u8_t pbuf_clen(struct pbuf *p);
+void pbuf_cat(struct pbuf *head, struct pbuf *tail);
+void pbuf_chain(struct pbuf *head, struct pbuf *tail);
+struct pbuf *pbuf_dechain(struct pbuf *p);
+err_t pbuf_copy(struct pbuf *p_to, struct pbuf *p_from);
+u16_t pbuf_copy_partial(struct pbuf *p, void *dataptr, u16_t len, u16_t offset);
+err_t pbuf_take(struct pbuf *buf, const void *dataptr, u16_t len);
+struct pbuf *pbuf_coalesce(struct pbuf *p, pbuf_layer layer);
+u8_t pbuf_get_at(struct pbuf *p, u16_t offset);
+
+#endif /* __LWIP_PBUF_H__ */
@@ -0,0 +1,53 @@
+/*
+ * Host shim for lwip/tcp.h (lwIP 1.4): the pcb lists the firmware walks,
+ * reduced to the fields it reads.
+ */
+#ifndef __LWIP_TCP_H__
+#define __LWIP_TCP_H__
+
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "lwip/ip.h"
+#include "lwip/err.h"
+
+enum tcp_state {
+    CLOSED	= 0,
+    LISTEN	= 1,
+    SYN_SENT	= 2,
+    SYN_RCVD	= 3,
+    ESTABLISHED	= 4,
+    FIN_WAIT_1	= 5,
+    FIN_WAIT_2	= 6,
+    CLOSE_WAIT	= 7,
+    CLOSING	= 8,
+    LAST_ACK	= 9,
+    TIME_WAIT	= 10
+};
+
+#define TCP_PCB_COMMON(type) \
+    type *next;			\
+    enum tcp_state state;	\
+    u8_t prio;			\
+    void *callback_arg;		\
+    u16_t local_port
+
+struct tcp_pcb {
+    ip_addr_t local_ip;
+    ip_addr_t remote_ip;
+    u8_t so_options;
+    u8_t tos;
+    u8_t ttl;
+    TCP_PCB_COMMON(struct tcp_pcb);
+    u16_t remote_port;
+};
+
+struct tcp_pcb_listen {
+    ip_addr_t local_ip;
+    ip_addr_t remote_ip;
+    u8_t so_options;
+    u8_t tos;
+    u8_t ttl;
+    TCP_PCB_COMMON(struct tcp_pcb_listen);
+};
+
+#endif /* __LWIP_TCP_H__ */
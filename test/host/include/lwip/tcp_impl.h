@@ -0,0 +1,48 @@
+/*
+ * Host shim for lwip/tcp_impl.h (lwIP 1.4): the TCP header layout and the
+ * global pcb lists.
+ */
+#ifndef __LWIP_TCP_IMPL_H__
+#define __LWIP_TCP_IMPL_H__
+
+#include "lwip/opt.h"
+#include "lwip/tcp.h"
+
+#define TCP_HLEN 20
+
+struct tcp_hdr {
+    u16_t src;
+    u16_t dest;
+    u32_t seqno;
+    u32_t ackno;
+    u16_t _hdrlen_rsvd_flags;
+    u16_t wnd;
+    u16_t chksum;
+    u16_t urgp;
+} __attribute__((packed));
+
+#define TCPH_HDRLEN(phdr)	(ntohs((phdr)->_hdrlen_rsvd_flags) >> 12)
+#define TCPH_FLAGS(phdr)	(ntohs((phdr)->_hdrlen_rsvd_flags) & TCP_FLAGS)
+
+#define TCP_FIN			0x01U
+#define TCP_SYN			0x02U
+#define TCP_RST			0x04U
+#define TCP_PSH			0x08U
+#define TCP_ACK			0x10U
+#define TCP_URG			0x20U
+#define TCP_ECE			0x40U
+#define TCP_CWR			0x80U
+
+#define TCP_FLAGS		0x3fU
+
+union tcp_listen_pcbs_t {
+    struct tcp_pcb_listen *listen_pcbs;
+    struct tcp_pcb *pcbs;
+};
+
+extern struct tcp_pcb *tcp_bound_pcbs;
+extern union tcp_listen_pcbs_t tcp_listen_pcbs;
+extern struct tcp_pcb *tcp_active_pcbs;
+extern struct tcp_pcb *tcp_tw_pcbs;
+
+#endif /* __LWIP_TCP_IMPL_H__ */
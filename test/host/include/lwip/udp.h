@@ -0,0 +1,37 @@
+/*
+ * Host shim for lwip/udp.h (lwIP 1.4).  Only the pcb list is needed: the
+ * firmware walks it to keep NAPT ports clear of local sockets.
+ */
+#ifndef __LWIP_UDP_H__
+#define __LWIP_UDP_H__
+
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+#include "lwip/ip_addr.h"
+#include "lwip/ip.h"
+
+#define UDP_HLEN 8
+
+struct udp_hdr {
+    u16_t src;
+    u16_t dest;
+    u16_t len;
+    u16_t chksum;
+} __attribute__((packed));
+
+struct udp_pcb {
+    ip_addr_t local_ip;
+    ip_addr_t remote_ip;
+    u8_t so_options;
+    u8_t tos;
+    u8_t ttl;
+    struct udp_pcb *next;
+    u8_t flags;
+    u16_t local_port;
+    u16_t remote_port;
+};
+
+extern struct udp_pcb *udp_pcbs;
+
+#endif /* __LWIP_UDP_H__ */
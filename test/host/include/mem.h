@@ -0,0 +1,15 @@
+/*
+ * Host shim for the NONOS SDK mem.h: the heap is libc's.
+ */
+#ifndef __MEM_H__
+#define __MEM_H__
+
+#include <stdlib.h>
+
+#define os_free(s)		free(s)
+#define os_malloc(s)		malloc(s)
+#define os_calloc(l, s)		calloc(l, s)
+#define os_realloc(p, s)	realloc(p, s)
+#define os_zalloc(s)		calloc(1, s)
+
+#endif /* __MEM_H__ */
@@ -0,0 +1,12 @@
+/*
+ * Host shim for the esp-open-lwip ENC28J60 driver header.  HAVE_ENC28J60
+ * builds are not supported on the host.
+ */
+#ifndef __NETIF_ESPENC_H__
+#define __NETIF_ESPENC_H__
+
+#include "lwip/netif.h"
+
+struct netif *espenc_init(uint8_t *mac_addr, ip_addr_t *ip, ip_addr_t *mask, ip_addr_t *gw, bool dhcp);
+
+#endif /* __NETIF_ESPENC_H__ */
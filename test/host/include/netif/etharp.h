@@ -0,0 +1,38 @@
+/*
+ * Host shim for netif/etharp.h (lwIP 1.4).
+ */
+#ifndef __NETIF_ETHARP_H__
+#define __NETIF_ETHARP_H__
+
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "lwip/ip_addr.h"
+#include "lwip/netif.h"
+#include "lwip/ip.h"
+
+#define ETHARP_HWADDR_LEN	6
+
+struct eth_addr {
+    u8_t addr[ETHARP_HWADDR_LEN];
+} __attribute__((packed));
+
+struct eth_hdr {
+    struct eth_addr dest;
+    struct eth_addr src;
+    u16_t type;
+} __attribute__((packed));
+
+#define SIZEOF_ETH_HDR		(14 + ETH_PAD_SIZE)
+
+#define ETHTYPE_ARP		0x0806U
+#define ETHTYPE_IP		0x0800U
+#define ETHTYPE_VLAN		0x8100U
+#define ETHTYPE_PPPOEDISC	0x8863U
+#define ETHTYPE_PPPOE		0x8864U
+
+extern const struct eth_addr ethbroadcast, ethzero;
+
+err_t etharp_output(struct netif *netif, struct pbuf *q, ip_addr_t *ipaddr);
+err_t ethernet_input(struct pbuf *p, struct netif *netif);
+
+#endif /* __NETIF_ETHARP_H__ */
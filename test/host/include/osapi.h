@@ -0,0 +1,55 @@
+/*
+ * Host shim for the NONOS SDK osapi.h: the os_* wrappers map onto libc,
+ * the timers onto the virtual clock in test/host/sdk.c.  Like the SDK
+ * original it pulls in user_config.h.
+ */
+#ifndef _OSAPI_H_
+#define _OSAPI_H_
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "os_type.h"
+#include "user_config.h"
+
+#define os_bzero		bzero
+#define os_delay_us(us)		((void)(us))
+#define os_install_putc1	ets_install_putc1
+
+#define os_memcmp		memcmp
+#define os_memcpy		memcpy
+#define os_memmove		memmove
+#define os_memset		memset
+#define os_strcat		strcat
+#define os_strchr		strchr
+#define os_strcmp		strcmp
+#define os_strcpy		strcpy
+#define os_strlen		strlen
+#define os_strncmp		strncmp
+#define os_strncpy		strncpy
+#define os_strstr		strstr
+
+#define os_timer_arm		ets_timer_arm
+#define os_timer_disarm		ets_timer_disarm
+#define os_timer_setfn		ets_timer_setfn
+
+#define os_sprintf		sprintf
+#define os_sprintf_plus		sprintf
+#define os_printf		ets_printf
+#define os_printf_plus		ets_printf
+#define os_random		host_random
+
+void ets_timer_arm(ETSTimer *ptimer, uint32_t milliseconds, bool repeat_flag);
+void ets_timer_disarm(ETSTimer *ptimer);
+void ets_timer_setfn(ETSTimer *ptimer, ETSTimerFunc *pfunction, void *parg);
+
+int ets_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+int ets_vsprintf(char *str, const char *fmt, ...);
+void ets_install_putc1(void (*p)(char c));
+int ets_str2macaddr(uint8_t *mac, char *str);
+
+int os_get_random(unsigned char *buf, size_t len);
+unsigned long host_random(void);
+
+#endif /* _OSAPI_H_ */
@@ -0,0 +1,22 @@
+/*
+ * Host shim for the NONOS SDK queue.h: the BSD singly linked tail queue
+ * macros used by the station and scan lists.
+ */
+#ifndef _SYS_QUEUE_H_
+#define _SYS_QUEUE_H_
+
+#define STAILQ_HEAD(name, type)						\
+struct name {								\
+    struct type *stqh_first;						\
+    struct type **stqh_last;						\
+}
+
+#define STAILQ_ENTRY(type)						\
+struct {								\
+    struct type *stqe_next;						\
+}
+
+#define STAILQ_FIRST(head)	((head)->stqh_first)
+#define STAILQ_NEXT(elm, field)	((elm)->field.stqe_next)
+
+#endif /* _SYS_QUEUE_H_ */
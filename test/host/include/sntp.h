@@ -0,0 +1,18 @@
+/*
+ * Host shim for the SDK sntp.h.  There is never a time sync on the host.
+ */
+#ifndef __SNTP_H__
+#define __SNTP_H__
+
+#include "c_types.h"
+#include "lwip/ip_addr.h"
+
+uint32 sntp_get_current_timestamp(void);
+char *sntp_get_real_time(long t);
+void sntp_init(void);
+void sntp_stop(void);
+void sntp_setserver(unsigned char idx, ip_addr_t *addr);
+void sntp_setservername(unsigned char idx, char *server);
+bool sntp_set_timezone(sint8 timezone);
+
+#endif /* __SNTP_H__ */
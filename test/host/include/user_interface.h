@@ -0,0 +1,456 @@
+/*
+ * Host shim for the NONOS SDK user_interface.h.  The system and wifi calls
+ * are implemented in test/host/sdk.c; the replay driver raises the wifi
+ * events itself through host_wifi_event().
+ */
+#ifndef __USER_INTERFACE_H__
+#define __USER_INTERFACE_H__
+
+#include "os_type.h"
+#include "lwip/ip_addr.h"
+#include "queue.h"
+#include "gpio.h"
+#include "spi_flash.h"
+
+enum rst_reason {
+    REASON_DEFAULT_RST		= 0,
+    REASON_WDT_RST		= 1,
+    REASON_EXCEPTION_RST	= 2,
+    REASON_SOFT_WDT_RST		= 3,
+    REASON_SOFT_RESTART		= 4,
+    REASON_DEEP_SLEEP_AWAKE	= 5,
+    REASON_EXT_SYS_RST		= 6
+};
+
+struct rst_info {
+    uint32 reason;
+    uint32 exccause;
+    uint32 epc1;
+    uint32 epc2;
+    uint32 epc3;
+    uint32 excvaddr;
+    uint32 depc;
+};
+
+struct rst_info *system_get_rst_info(void);
+
+#define UPGRADE_FW_BIN1		0x00
+#define UPGRADE_FW_BIN2		0x01
+
+void system_restore(void);
+void system_restart(void);
+
+bool system_deep_sleep(uint64 time_in_us);
+bool system_deep_sleep_set_option(uint8 option);
+
+uint32 system_get_boot_version(void);
+uint32 system_get_userbin_addr(void);
+uint8 system_get_boot_mode(void);
+bool system_restart_enhance(uint8 bin_type, uint32 bin_addr);
+
+#define SYS_BOOT_ENHANCE_MODE	0
+#define SYS_BOOT_NORMAL_MODE	1
+
+#define SYS_BOOT_NORMAL_BIN	0
+#define SYS_BOOT_TEST_BIN	1
+
+bool system_upgrade_userbin_set(uint8 userbin);
+uint8 system_upgrade_userbin_check(void);
+
+#define UPGRADE_FLAG_IDLE	0x00
+#define UPGRADE_FLAG_START	0x01
+#define UPGRADE_FLAG_FINISH	0x02
+
+void system_upgrade_flag_set(uint8 flag);
+uint8 system_upgrade_flag_check(void);
+void system_upgrade_reboot(void);
+
+bool system_os_task(os_task_t task, uint8 prio, os_event_t *queue, uint8 qlen);
+bool system_os_post(uint8 prio, os_signal_t sig, os_param_t par);
+
+uint32 system_get_time(void);
+uint32 system_get_rtc_time(void);
+uint32 system_rtc_clock_cali_proc(void);
+
+bool system_rtc_mem_read(uint8 src_addr, void *des_addr, uint16 load_size);
+bool system_rtc_mem_write(uint8 des_addr, const void *src_addr, uint16 save_size);
+
+void system_print_meminfo(void);
+uint32 system_get_free_heap_size(void);
+uint32 system_get_chip_id(void);
+
+void system_set_os_print(uint8 onoff);
+uint8 system_get_os_print(void);
+
+const char *system_get_sdk_version(void);
+
+uint16 system_get_vdd33(void);
+uint16 system_adc_read(void);
+
+typedef void (*init_done_cb_t)(void);
+
+void system_init_done_cb(init_done_cb_t cb);
+
+uint32 user_rf_cal_sector_set(void);
+void user_rf_pre_init(void);
+void user_init(void);
+
+#define SYS_CPU_80MHZ		80
+#define SYS_CPU_160MHZ		160
+
+bool system_update_cpu_freq(uint8 freq);
+uint8 system_get_cpu_freq(void);
+
+enum flash_size_map {
+    FLASH_SIZE_4M_MAP_256_256 = 0,
+    FLASH_SIZE_2M,
+    FLASH_SIZE_8M_MAP_512_512,
+    FLASH_SIZE_16M_MAP_512_512,
+    FLASH_SIZE_32M_MAP_512_512,
+    FLASH_SIZE_16M_MAP_1024_1024,
+    FLASH_SIZE_32M_MAP_1024_1024,
+    FLASH_SIZE_32M_MAP_2048_2048,
+    FLASH_SIZE_64M_MAP_1024_1024,
+    FLASH_SIZE_128M_MAP_1024_1024
+};
+
+enum flash_size_map system_get_flash_size_map(void);
+
+typedef enum {
+    SYSTEM_PARTITION_INVALID = 0,
+    SYSTEM_PARTITION_BOOTLOADER,
+    SYSTEM_PARTITION_OTA_1,
+    SYSTEM_PARTITION_OTA_2,
+    SYSTEM_PARTITION_RF_CAL,
+    SYSTEM_PARTITION_PHY_DATA,
+    SYSTEM_PARTITION_SYSTEM_PARAMETER,
+    SYSTEM_PARTITION_AT_PARAMETER,
+    SYSTEM_PARTITION_SSL_CLIENT_CERT_PRIVKEY,
+    SYSTEM_PARTITION_SSL_CLIENT_CA,
+    SYSTEM_PARTITION_SSL_SERVER_CERT_PRIVKEY,
+    SYSTEM_PARTITION_SSL_SERVER_CA,
+    SYSTEM_PARTITION_WPA2_ENTERPRISE_CERT_PRIVKEY,
+    SYSTEM_PARTITION_WPA2_ENTERPRISE_CA,
+    SYSTEM_PARTITION_CUSTOMER_BEGIN = 100,
+    SYSTEM_PARTITION_MAX
+} partition_type_t;
+
+typedef struct {
+    partition_type_t type;
+    uint32_t addr;
+    uint32_t size;
+} partition_item_t;
+
+bool system_partition_table_regist(const partition_item_t *partition_table, uint32_t partition_num, uint32_t map);
+
+#define NULL_MODE		0x00
+#define STATION_MODE		0x01
+#define SOFTAP_MODE		0x02
+#define STATIONAP_MODE		0x03
+
+typedef enum _auth_mode {
+    AUTH_OPEN = 0,
+    AUTH_WEP,
+    AUTH_WPA_PSK,
+    AUTH_WPA2_PSK,
+    AUTH_WPA_WPA2_PSK,
+    AUTH_MAX
+} AUTH_MODE;
+
+uint8 wifi_get_opmode(void);
+uint8 wifi_get_opmode_default(void);
+bool wifi_set_opmode(uint8 opmode);
+bool wifi_set_opmode_current(uint8 opmode);
+uint8 wifi_get_broadcast_if(void);
+bool wifi_set_broadcast_if(uint8 interface);
+
+struct bss_info {
+    STAILQ_ENTRY(bss_info) next;
+
+    uint8 bssid[6];
+    uint8 ssid[32];
+    uint8 ssid_len;
+    uint8 channel;
+    sint8 rssi;
+    AUTH_MODE authmode;
+    uint8 is_hidden;
+    sint16 freq_offset;
+    sint16 freqcal_val;
+    uint8 *esp_mesh_ie;
+    uint8 simple_pair;
+};
+
+typedef struct _scaninfo {
+    STAILQ_HEAD(, bss_info) *pbss;
+    struct espconn *pespconn;
+    uint8 totalpage;
+    uint8 pagenum;
+    uint8 page_sn;
+    uint8 data_cnt;
+} scaninfo;
+
+typedef void (*scan_done_cb_t)(void *arg, STATUS status);
+
+struct station_config {
+    uint8 ssid[32];
+    uint8 password[64];
+    uint8 bssid_set;
+    uint8 bssid[6];
+};
+
+bool wifi_station_get_config(struct station_config *config);
+bool wifi_station_get_config_default(struct station_config *config);
+bool wifi_station_set_config(struct station_config *config);
+bool wifi_station_set_config_current(struct station_config *config);
+
+bool wifi_station_connect(void);
+bool wifi_station_disconnect(void);
+
+sint8 wifi_station_get_rssi(void);
+
+struct scan_config {
+    uint8 *ssid;
+    uint8 *bssid;
+    uint8 channel;
+    uint8 show_hidden;
+};
+
+bool wifi_station_scan(struct scan_config *config, scan_done_cb_t cb);
+
+uint8 wifi_station_get_auto_connect(void);
+bool wifi_station_set_auto_connect(uint8 set);
+
+bool wifi_station_set_reconnect_policy(bool set);
+
+enum {
+    STATION_IDLE = 0,
+    STATION_CONNECTING,
+    STATION_WRONG_PASSWORD,
+    STATION_NO_AP_FOUND,
+    STATION_CONNECT_FAIL,
+    STATION_GOT_IP
+};
+
+uint8 wifi_station_get_connect_status(void);
+
+bool wifi_station_dhcpc_start(void);
+bool wifi_station_dhcpc_stop(void);
+
+char *wifi_station_get_hostname(void);
+bool wifi_station_set_hostname(char *name);
+
+struct softap_config {
+    uint8 ssid[32];
+    uint8 password[64];
+    uint8 ssid_len;
+    uint8 channel;
+    AUTH_MODE authmode;
+    uint8 ssid_hidden;
+    uint8 max_connection;
+    uint16 beacon_interval;
+};
+
+bool wifi_softap_get_config(struct softap_config *config);
+bool wifi_softap_get_config_default(struct softap_config *config);
+bool wifi_softap_set_config(struct softap_config *config);
+bool wifi_softap_set_config_current(struct softap_config *config);
+
+struct station_info {
+    STAILQ_ENTRY(station_info) next;
+
+    uint8 bssid[6];
+    struct ip_addr ip;
+};
+
+struct dhcps_lease {
+    bool enable;
+    struct ip_addr start_ip;
+    struct ip_addr end_ip;
+};
+
+enum dhcps_offer_option {
+    OFFER_START = 0x00,
+    OFFER_ROUTER = 0x01,
+    OFFER_END
+};
+
+uint8 wifi_softap_get_station_num(void);
+struct station_info *wifi_softap_get_station_info(void);
+void wifi_softap_free_station_info(void);
+
+bool wifi_softap_dhcps_start(void);
+bool wifi_softap_dhcps_stop(void);
+
+bool wifi_softap_set_dhcps_lease(struct dhcps_lease *please);
+bool wifi_softap_get_dhcps_lease(struct dhcps_lease *please);
+uint32 wifi_softap_get_dhcps_lease_time(void);
+bool wifi_softap_set_dhcps_lease_time(uint32 minute);
+bool wifi_softap_reset_dhcps_lease_time(void);
+
+bool wifi_softap_set_dhcps_offer_option(uint8 level, void *optarg);
+
+#define STATION_IF		0x00
+#define SOFTAP_IF		0x01
+
+bool wifi_get_ip_info(uint8 if_index, struct ip_info *info);
+bool wifi_set_ip_info(uint8 if_index, struct ip_info *info);
+bool wifi_get_macaddr(uint8 if_index, uint8 *macaddr);
+bool wifi_set_macaddr(uint8 if_index, uint8 *macaddr);
+
+uint8 wifi_get_channel(void);
+bool wifi_set_channel(uint8 channel);
+
+enum phy_mode {
+    PHY_MODE_11B = 1,
+    PHY_MODE_11G = 2,
+    PHY_MODE_11N = 3
+};
+
+enum phy_mode wifi_get_phy_mode(void);
+bool wifi_set_phy_mode(enum phy_mode mode);
+
+enum sleep_type {
+    NONE_SLEEP_T = 0,
+    LIGHT_SLEEP_T,
+    MODEM_SLEEP_T
+};
+
+bool wifi_set_sleep_type(enum sleep_type type);
+enum sleep_type wifi_get_sleep_type(void);
+
+enum {
+    EVENT_STAMODE_CONNECTED = 0,
+    EVENT_STAMODE_DISCONNECTED,
+    EVENT_STAMODE_AUTHMODE_CHANGE,
+    EVENT_STAMODE_GOT_IP,
+    EVENT_STAMODE_DHCP_TIMEOUT,
+    EVENT_SOFTAPMODE_STACONNECTED,
+    EVENT_SOFTAPMODE_STADISCONNECTED,
+    EVENT_SOFTAPMODE_PROBEREQRECVED,
+    EVENT_OPMODE_CHANGED,
+    EVENT_SOFTAPMODE_DISTRIBUTE_STA_IP,
+    EVENT_MAX
+};
+
+enum {
+    REASON_UNSPECIFIED			= 1,
+    REASON_AUTH_EXPIRE			= 2,
+    REASON_AUTH_LEAVE			= 3,
+    REASON_ASSOC_EXPIRE			= 4,
+    REASON_ASSOC_TOOMANY		= 5,
+    REASON_NOT_AUTHED			= 6,
+    REASON_NOT_ASSOCED			= 7,
+    REASON_ASSOC_LEAVE			= 8,
+    REASON_ASSOC_NOT_AUTHED		= 9,
+    REASON_DISASSOC_PWRCAP_BAD		= 10,
+    REASON_DISASSOC_SUPCHAN_BAD		= 11,
+    REASON_IE_INVALID			= 13,
+    REASON_MIC_FAILURE			= 14,
+    REASON_4WAY_HANDSHAKE_TIMEOUT	= 15,
+    REASON_GROUP_KEY_UPDATE_TIMEOUT	= 16,
+    REASON_IE_IN_4WAY_DIFFERS		= 17,
+    REASON_GROUP_CIPHER_INVALID		= 18,
+    REASON_PAIRWISE_CIPHER_INVALID	= 19,
+    REASON_AKMP_INVALID			= 20,
+    REASON_UNSUPP_RSN_IE_VERSION	= 21,
+    REASON_INVALID_RSN_IE_CAP		= 22,
+    REASON_802_1X_AUTH_FAILED		= 23,
+    REASON_CIPHER_SUITE_REJECTED	= 24,
+
+    REASON_BEACON_TIMEOUT		= 200,
+    REASON_NO_AP_FOUND			= 201,
+    REASON_AUTH_FAIL			= 202,
+    REASON_ASSOC_FAIL			= 203,
+    REASON_HANDSHAKE_TIMEOUT		= 204,
+};
+
+typedef struct {
+    uint8 ssid[32];
+    uint8 ssid_len;
+    uint8 bssid[6];
+    uint8 channel;
+} Event_StaMode_Connected_t;
+
+typedef struct {
+    uint8 ssid[32];
+    uint8 ssid_len;
+    uint8 bssid[6];
+    uint8 reason;
+} Event_StaMode_Disconnected_t;
+
+typedef struct {
+    uint8 old_mode;
+    uint8 new_mode;
+} Event_StaMode_AuthMode_Change_t;
+
+typedef struct {
+    struct ip_addr ip;
+    struct ip_addr mask;
+    struct ip_addr gw;
+} Event_StaMode_Got_IP_t;
+
+typedef struct {
+    uint8 mac[6];
+    uint8 aid;
+} Event_SoftAPMode_StaConnected_t;
+
+typedef struct {
+    uint8 mac[6];
+    struct ip_addr ip;
+    uint8 aid;
+} Event_SoftAPMode_Distribute_Sta_IP_t;
+
+typedef struct {
+    uint8 mac[6];
+    uint8 aid;
+} Event_SoftAPMode_StaDisconnected_t;
+
+typedef struct {
+    int rssi;
+    uint8 mac[6];
+} Event_SoftAPMode_ProbeReqRecved_t;
+
+typedef struct {
+    uint8 old_opmode;
+    uint8 new_opmode;
+} Event_OpMode_Change_t;
+
+typedef union {
+    Event_StaMode_Connected_t			connected;
+    Event_StaMode_Disconnected_t		disconnected;
+    Event_StaMode_AuthMode_Change_t		auth_change;
+    Event_StaMode_Got_IP_t			got_ip;
+    Event_SoftAPMode_StaConnected_t		sta_connected;
+    Event_SoftAPMode_Distribute_Sta_IP_t	distribute_sta_ip;
+    Event_SoftAPMode_StaDisconnected_t		sta_disconnected;
+    Event_SoftAPMode_ProbeReqRecved_t		ap_probereqrecved;
+    Event_OpMode_Change_t			opmode_changed;
+} Event_Info_u;
+
+typedef struct _esp_event {
+    uint32 event;
+    Event_Info_u event_info;
+} System_Event_t;
+
+typedef void (*wifi_event_handler_cb_t)(System_Event_t *event);
+
+void wifi_set_event_handler_cb(wifi_event_handler_cb_t cb);
+
+/* Undocumented SDK export; the firmware calls it without a prototype. */
+struct netif *eagle_lwip_getif(uint8 index);
+
+/* Host only: deliver a wifi event to the registered handler. */
+void host_wifi_event(System_Event_t *event);
+
+/* WPA2 enterprise, from wpa2_enterprise.h */
+int wifi_station_set_wpa2_enterprise_auth(int enable);
+int wifi_station_set_enterprise_identity(unsigned char *identity, int len);
+void wifi_station_clear_enterprise_identity(void);
+int wifi_station_set_enterprise_username(unsigned char *username, int len);
+void wifi_station_clear_enterprise_username(void);
+int wifi_station_set_enterprise_password(unsigned char *password, int len);
+void wifi_station_clear_enterprise_password(void);
+int wifi_station_set_enterprise_ca_cert(unsigned char *ca_cert, int len);
+void wifi_station_clear_enterprise_ca_cert(void);
+
+#endif /* __USER_INTERFACE_H__ */
@@ -0,0 +1,13 @@
+/*
+ * Host shim for the NONOS SDK version.h.
+ */
+#ifndef ESP_SDK_VERSION_H
+#define ESP_SDK_VERSION_H
+
+#define ESP_SDK_VERSION_MAJOR	2
+#define ESP_SDK_VERSION_MINOR	0
+#define ESP_SDK_VERSION_PATCH	0
+
+#define ESP_SDK_VERSION_NUMBER	0x020000
+
+#endif /* ESP_SDK_VERSION_H */
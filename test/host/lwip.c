@@ -0,0 +1,516 @@
+/*
+ * Host shim for the parts of esp-open-lwip the firmware links against:
+ * pbufs, the netif list, the static routes and a few address helpers.
+ *
+ * pbufs are allocated as a single chunk, never from pools. A PBUF_REF with
+ * eb set stands for a frame received by the WiFi driver, pbuf_free()
+ * releases eb as the SDK hands it back to the driver.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+#include "lwip/ip_addr.h"
+#include "lwip/ip_route.h"
+#include "lwip/dns.h"
+#include "lwip/udp.h"
+#include "lwip/tcp_impl.h"
+#include "lwip/lwip_napt.h"
+#include "user_config.h"
+
+#include "host.h"
+
+struct netif *netif_list;
+struct netif *netif_default;
+
+struct udp_pcb *udp_pcbs;
+struct tcp_pcb *tcp_bound_pcbs;
+union tcp_listen_pcbs_t tcp_listen_pcbs;
+struct tcp_pcb *tcp_active_pcbs;
+struct tcp_pcb *tcp_tw_pcbs;
+
+const ip_addr_t ip_addr_any = { IPADDR_ANY };
+const ip_addr_t ip_addr_broadcast = { IPADDR_BROADCAST };
+
+struct route_entry ip_rt_table[MAX_ROUTES];
+int ip_route_max;
+
+static uint32_t pbufs_live;
+
+/* pbufs */
+
+static u16_t pbuf_offset(pbuf_layer layer)
+{
+    switch (layer)
+    {
+    case PBUF_TRANSPORT:
+        return PBUF_LINK_HLEN + PBUF_IP_HLEN + PBUF_TRANSPORT_HLEN;
+    case PBUF_IP:
+        return PBUF_LINK_HLEN + PBUF_IP_HLEN;
+    case PBUF_LINK:
+        return PBUF_LINK_HLEN;
+    default:
+        return 0;
+    }
+}
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
+{
+    struct pbuf *p;
+    u16_t offset = pbuf_offset(layer);
+
+    switch (type)
+    {
+    case PBUF_RAM:
+    case PBUF_POOL:
+        p = malloc(sizeof(struct pbuf) + offset + length);
+        if (p == NULL)
+            return NULL;
+        p->payload = (u8_t *)(p + 1) + offset;
+        break;
+    case PBUF_ROM:
+    case PBUF_REF:
+        p = malloc(sizeof(struct pbuf));
+        if (p == NULL)
+            return NULL;
+        p->payload = NULL;
+        break;
+    default:
+        return NULL;
+    }
+    p->next = NULL;
+    p->tot_len = p->len = length;
+    p->type = type;
+    p->flags = 0;
+    p->ref = 1;
+    p->eb = NULL;
+    pbufs_live++;
+    return p;
+}
+
+void pbuf_realloc(struct pbuf *p, u16_t new_len)
+{
+    struct pbuf *q;
+    u16_t rem_len;
+
+    if (new_len >= p->tot_len)
+        return;
+
+    rem_len = new_len;
+    for (q = p; rem_len > q->len; q = q->next)
+    {
+        rem_len -= q->len;
+        q->tot_len -= p->tot_len - new_len;
+    }
+    q->len = rem_len;
+    q->tot_len = rem_len;
+    if (q->next != NULL)
+        pbuf_free(q->next);
+    q->next = NULL;
+}
+
+u8_t pbuf_header(struct pbuf *p, s16_t header_size_increment)
+{
+    u8_t *payload;
+
+    if (p == NULL || header_size_increment == 0)
+        return 0;
+
+    if (header_size_increment < 0)
+    {
+        if (-header_size_increment > p->len)
+            return 1;
+    }
+    else if (p->type == PBUF_RAM || p->type == PBUF_POOL)
+    {
+        payload = (u8_t *)p->payload - header_size_increment;
+        if (payload < (u8_t *)(p + 1))
+            return 1;
+    }
+    else
+    {
+        /* lwIP 1.4 cannot grow the header of a PBUF_REF or PBUF_ROM */
+        return 1;
+    }
+
+    p->payload = (u8_t *)p->payload - header_size_increment;
+    p->len += header_size_increment;
+    p->tot_len += header_size_increment;
+    return 0;
+}
+
+void pbuf_ref(struct pbuf *p)
+{
+    if (p != NULL)
+        p->ref++;
+}
+
+u8_t pbuf_free(struct pbuf *p)
+{
+    u8_t count = 0;
+
+    while (p != NULL)
+    {
+        struct pbuf *q;
+
+        if (--p->ref > 0)
+            break;
+        q = p->next;
+        if (p->eb != NULL)
+            free(p->eb);
+        free(p);
+        pbufs_live--;
+        count++;
+        p = q;
+    }
+    return count;
+}
+
+u8_t pbuf_clen(struct pbuf *p)
+{
+    u8_t len;
+
+    for (len = 0; p != NULL; p = p->next)
+        len++;
+    return len;
+}
+
+void pbuf_cat(struct pbuf *h, struct pbuf *t)
+{
+    struct pbuf *p;
+
+    for (p = h; p->next != NULL; p = p->next)
+        p->tot_len += t->tot_len;
+    p->tot_len += t->tot_len;
+    p->next = t;
+}
+
+void pbuf_chain(struct pbuf *h, struct pbuf *t)
+{
+    pbuf_cat(h, t);
+    pbuf_ref(t);
+}
+
+err_t pbuf_copy(struct pbuf *p_to, struct pbuf *p_from)
+{
+    u16_t offset_to = 0, offset_from = 0, len;
+
+    if (p_to == NULL || p_from == NULL || p_to->tot_len < p_from->tot_len)
+        return ERR_ARG;
+
+    while (p_from != NULL && p_to != NULL)
+    {
+        len = LWIP_MIN(p_to->len - offset_to, p_from->len - offset_from);
+        memcpy((u8_t *)p_to->payload + offset_to, (u8_t *)p_from->payload + offset_from, len);
+        offset_to += len;
+        offset_from += len;
+        if (offset_from >= p_from->len)
+        {
+            offset_from = 0;
+            p_from = p_from->next;
+        }
+        if (offset_to == p_to->len)
+        {
+            offset_to = 0;
+            p_to = p_to->next;
+        }
+    }
+    return p_from == NULL ? ERR_OK : ERR_VAL;
+}
+
+u16_t pbuf_copy_partial(struct pbuf *buf, void *dataptr, u16_t len, u16_t offset)
+{
+    struct pbuf *p;
+    u16_t copied = 0, n;
+
+    for (p = buf; len != 0 && p != NULL; p = p->next)
+    {
+        if (offset >= p->len)
+        {
+            offset -= p->len;
+            continue;
+        }
+        n = LWIP_MIN(p->len - offset, len);
+        memcpy((u8_t *)dataptr + copied, (u8_t *)p->payload + offset, n);
+        copied += n;
+        len -= n;
+        offset = 0;
+    }
+    return copied;
+}
+
+err_t pbuf_take(struct pbuf *buf, const void *dataptr, u16_t len)
+{
+    struct pbuf *p;
+    u16_t copied = 0, n;
+
+    if (buf == NULL || buf->tot_len < len)
+        return ERR_ARG;
+
+    for (p = buf; len != 0 && p != NULL; p = p->next)
+    {
+        n = LWIP_MIN(p->len, len);
+        memcpy(p->payload, (const u8_t *)dataptr + copied, n);
+        copied += n;
+        len -= n;
+    }
+    return ERR_OK;
+}
+
+u8_t pbuf_get_at(struct pbuf *p, u16_t offset)
+{
+    for (; p != NULL; p = p->next)
+    {
+        if (offset < p->len)
+            return ((u8_t *)p->payload)[offset];
+        offset -= p->len;
+    }
+    return 0;
+}
+
+struct pbuf *host_frame(const uint8_t *data, uint16_t len)
+{
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, len, PBUF_REF);
+
+    if (p == NULL)
+        return NULL;
+    p->eb = malloc(len ? len : 1);
+    if (p->eb == NULL)
+    {
+        pbuf_free(p);
+        return NULL;
+    }
+    memcpy(p->eb, data, len);
+    p->payload = p->eb;
+    return p;
+}
+
+uint32_t host_pbufs_live(void)
+{
+    return pbufs_live;
+}
+
+/* netifs */
+
+void netif_set_default(struct netif *netif)
+{
+    netif_default = netif;
+}
+
+void netif_set_up(struct netif *netif)
+{
+    netif->flags |= NETIF_FLAG_UP;
+}
+
+void netif_set_down(struct netif *netif)
+{
+    netif->flags &= ~NETIF_FLAG_UP;
+}
+
+void netif_poll(struct netif *netif)
+{
+    (void)netif;
+}
+
+/* No loopback traffic on the host: nothing ever schedules a poll */
+void loopback_netif_init(netif_status_callback_fn cb)
+{
+    (void)cb;
+}
+
+/* Static routes, as in esp-open-lwip's ip_route.c */
+
+bool ip_add_route(ip_addr_t ip, ip_addr_t mask, ip_addr_t gw)
+{
+    int i;
+
+    if (ip_route_max >= MAX_ROUTES)
+        return false;
+
+    ip.addr &= mask.addr;
+    for (i = 0; i < ip_route_max; i++)
+    {
+        if (ip.addr == ip_rt_table[i].ip.addr && mask.addr == ip_rt_table[i].mask.addr)
+        {
+            ip_rt_table[i].gw = gw;
+            return true;
+        }
+    }
+    ip_rt_table[ip_route_max].ip = ip;
+    ip_rt_table[ip_route_max].mask = mask;
+    ip_rt_table[ip_route_max].gw = gw;
+    ip_route_max++;
+    return true;
+}
+
+bool ip_rm_route(ip_addr_t ip, ip_addr_t mask)
+{
+    int i;
+
+    for (i = 0; i < ip_route_max; i++)
+    {
+        if (ip.addr == ip_rt_table[i].ip.addr && mask.addr == ip_rt_table[i].mask.addr)
+        {
+            memmove(&ip_rt_table[i], &ip_rt_table[i + 1], (ip_route_max - i - 1) * sizeof(struct route_entry));
+            ip_route_max--;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct route_entry *ip_find_route(ip_addr_t ip)
+{
+    int i;
+
+    for (i = 0; i < ip_route_max; i++)
+    {
+        if ((ip.addr & ip_rt_table[i].mask.addr) == ip_rt_table[i].ip.addr)
+            return &ip_rt_table[i];
+    }
+    return NULL;
+}
+
+void ip_delete_routes(void)
+{
+    ip_route_max = 0;
+}
+
+bool ip_get_route(uint32_t no, ip_addr_t *ip, ip_addr_t *mask, ip_addr_t *gw)
+{
+    if (no >= (uint32_t)ip_route_max)
+        return false;
+    *ip = ip_rt_table[no].ip;
+    *mask = ip_rt_table[no].mask;
+    *gw = ip_rt_table[no].gw;
+    return true;
+}
+
+/* Addresses */
+
+u8_t ip4_addr_isbroadcast(u32_t addr, const struct netif *netif)
+{
+    if (addr == IPADDR_BROADCAST || addr == IPADDR_ANY)
+        return 1;
+    if ((netif->flags & NETIF_FLAG_BROADCAST) == 0)
+        return 0;
+    if (addr == netif->ip_addr.addr)
+        return 0;
+    return (addr & netif->netmask.addr) == (netif->ip_addr.addr & netif->netmask.addr) &&
+           (addr & ~netif->netmask.addr) == (IPADDR_BROADCAST & ~netif->netmask.addr);
+}
+
+int ipaddr_aton(const char *cp, ip_addr_t *addr)
+{
+    uint32_t parts[4];
+    int n = 0;
+
+    while (n < 4)
+    {
+        uint32_t v = 0;
+        int digits = 0;
+
+        while (*cp >= '0' && *cp <= '9')
+        {
+            v = v * 10 + (*cp++ - '0');
+            if (++digits > 3 || v > 255)
+                return 0;
+        }
+        if (digits == 0)
+            return 0;
+        parts[n++] = v;
+        if (*cp != '.')
+            break;
+        cp++;
+    }
+    if (n != 4 || (*cp != '\0' && *cp != ' '))
+        return 0;
+    if (addr != NULL)
+        IP4_ADDR(addr, parts[0], parts[1], parts[2], parts[3]);
+    return 1;
+}
+
+u32_t ipaddr_addr(const char *cp)
+{
+    ip_addr_t val;
+
+    if (ipaddr_aton(cp, &val))
+        return val.addr;
+    return IPADDR_NONE;
+}
+
+char *ipaddr_ntoa(const ip_addr_t *addr)
+{
+    static char str[16];
+
+    sprintf(str, IPSTR, IP2STR(addr));
+    return str;
+}
+
+ip_addr_t dns_getserver(u8_t numdns)
+{
+    ip_addr_t any = { IPADDR_ANY };
+
+    (void)numdns;
+    return any;
+}
+
+void dns_setserver(u8_t numdns, ip_addr_t *dnsserver)
+{
+    (void)numdns;
+    (void)dnsserver;
+}
+
+#if !NAPT_INTREE
+/* The library NAPT is not part of the shim: port maps are kept, never used */
+
+static struct portmap_table portmaps[IP_PORTMAP_MAX];
+struct portmap_table *ip_portmap_table = portmaps;
+
+u8_t ip_portmap_add(u8_t proto, u32_t maddr, u16_t mport, u32_t daddr, u16_t dport)
+{
+    int i;
+
+    for (i = 0; i < IP_PORTMAP_MAX; i++)
+    {
+        if (!portmaps[i].valid || (portmaps[i].proto == proto && portmaps[i].mport == mport))
+        {
+            portmaps[i].proto = proto;
+            portmaps[i].maddr = maddr;
+            portmaps[i].mport = mport;
+            portmaps[i].daddr = daddr;
+            portmaps[i].dport = dport;
+            portmaps[i].valid = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+u8_t ip_portmap_remove(u8_t proto, u16_t mport)
+{
+    int i;
+
+    for (i = 0; i < IP_PORTMAP_MAX; i++)
+    {
+        if (portmaps[i].valid && portmaps[i].proto == proto && portmaps[i].mport == mport)
+        {
+            portmaps[i].valid = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void ip_napt_set_tcp_timeout(u32_t secs)
+{
+    (void)secs;
+}
+
+void ip_napt_set_udp_timeout(u32_t secs)
+{
+    (void)secs;
+}
+#endif /* !NAPT_INTREE */
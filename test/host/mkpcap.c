@@ -0,0 +1,382 @@
+/*
+ * Writes the sample captures for the replay tests, so that no binaries are
+ * kept in the tree:
+ *
+ *   mkpcap router|bridge out.pcapng
+ *
+ * The addresses are the ones the scripts in golden/ set up. The router has
+ * the softAP network 192.168.4.0/24 and the uplink 10.0.0.2/24, the bridge
+ * puts its clients into the uplink network 10.0.0.0/24.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pcap.h"
+
+#define IF_AP_IN	0
+#define IF_AP_OUT	1
+#define IF_STA_IN	2
+#define IF_STA_OUT	3
+
+static const char *if_names[] = { "ap-in", "ap-out", "sta-in", "sta-out" };
+
+/* The default MACs of config_flash.c, the shim reads 0 from the efuses */
+static const uint8_t mac_sta[6]    = { 0x18, 0xfe, 0x34, 0x00, 0x00, 0x00 };
+static const uint8_t mac_ap[6]     = { 0x1a, 0xfe, 0x34, 0x00, 0x00, 0x00 };
+static const uint8_t mac_gw[6]     = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const uint8_t mac_client[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+static const uint8_t mac_bcast[6]  = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+static FILE *out;
+static uint64_t ts_us = 1000000;
+static uint16_t ip_id = 1;
+
+/* pcapng */
+
+static void put32(uint32_t v)
+{
+    fwrite(&v, 4, 1, out);
+}
+
+static void write_shb(void)
+{
+    struct pcapng_shb shb = {
+        .block_type = PCAPNG_BT_SHB, .block_len = sizeof(shb), .magic = PCAPNG_BYTE_ORDER_MAGIC,
+        .version_major = 1, .section_len_lo = 0xffffffff, .section_len_hi = 0xffffffff,
+        .block_len2 = sizeof(shb)
+    };
+
+    fwrite(&shb, sizeof(shb), 1, out);
+}
+
+static void write_idb(const char *name)
+{
+    uint16_t nlen = strlen(name);
+    uint32_t len = sizeof(struct pcapng_idb) + 4 + PCAPNG_PAD(nlen) + 4 + 4;
+    struct pcapng_idb idb = { .block_type = PCAPNG_BT_IDB, .block_len = len, .linktype = LINKTYPE_ETHERNET, .snaplen = 2048 };
+    uint8_t opt[4 + 32] = { PCAPNG_OPT_IF_NAME, 0, nlen, 0 };
+
+    memcpy(opt + 4, name, nlen);
+    fwrite(&idb, sizeof(idb), 1, out);
+    fwrite(opt, 4 + PCAPNG_PAD(nlen), 1, out);
+    put32(PCAPNG_OPT_ENDOFOPT);
+    put32(len);
+}
+
+static void write_epb(int iface, const uint8_t *data, uint16_t len)
+{
+    struct pcapng_epb epb = {
+        .block_type = PCAPNG_BT_EPB, .block_len = sizeof(epb) + PCAPNG_PAD(len) + 4, .if_id = iface,
+        .ts_high = ts_us >> 32, .ts_low = (uint32_t)ts_us, .caplen = len, .len = len
+    };
+    static const uint8_t pad[3];
+
+    fwrite(&epb, sizeof(epb), 1, out);
+    fwrite(data, len, 1, out);
+    fwrite(pad, PCAPNG_PAD(len) - len, 1, out);
+    put32(epb.block_len);
+    ts_us += 1000;
+}
+
+/* Frames */
+
+typedef struct {
+    uint8_t b[1600];
+    uint16_t len;
+} frame;
+
+static uint32_t ip(int a, int b, int c, int d)
+{
+    return (uint32_t)a << 24 | b << 16 | c << 8 | d;
+}
+
+static void wr16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void wr32(uint8_t *p, uint32_t v)
+{
+    wr16(p, v >> 16);
+    wr16(p + 2, v);
+}
+
+static uint32_t sum16(const uint8_t *p, int len, uint32_t sum)
+{
+    while (len > 1)
+    {
+        sum += p[0] << 8 | p[1];
+        p += 2;
+        len -= 2;
+    }
+    if (len)
+        sum += p[0] << 8;
+    return sum;
+}
+
+static uint16_t fold(uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return ~sum;
+}
+
+static void eth(frame *f, const uint8_t *dst, const uint8_t *src, uint16_t type)
+{
+    memcpy(f->b, dst, 6);
+    memcpy(f->b + 6, src, 6);
+    wr16(f->b + 12, type);
+    f->len = 14;
+}
+
+/* IPv4 header plus payload of plen bytes, with frag = flags and offset */
+static uint8_t *ipv4(frame *f, uint8_t proto, uint32_t src, uint32_t dst, uint16_t plen, uint16_t frag)
+{
+    uint8_t *h = f->b + 14;
+
+    memset(h, 0, 20 + plen);
+    h[0] = 0x45;
+    wr16(h + 2, 20 + plen);
+    wr16(h + 4, ip_id++);
+    wr16(h + 6, frag);
+    h[8] = 64;
+    h[9] = proto;
+    wr32(h + 12, src);
+    wr32(h + 16, dst);
+    wr16(h + 10, fold(sum16(h, 20, 0)));
+    f->len = 14 + 20 + plen;
+    return h + 20;
+}
+
+static void l4_sum(frame *f, int sum_off)
+{
+    uint8_t *h = f->b + 14, *l4 = h + 20;
+    uint16_t len = f->len - 34;
+    uint32_t sum = sum16(h + 12, 8, h[9] + len);
+    uint16_t s;
+
+    wr16(l4 + sum_off, 0);
+    s = fold(sum16(l4, len, sum));
+    if (h[9] == 17 && s == 0)
+        s = 0xffff;
+    wr16(l4 + sum_off, s);
+}
+
+static void udp(frame *f, const uint8_t *dmac, const uint8_t *smac, uint32_t src, uint16_t sport,
+                uint32_t dst, uint16_t dport, uint16_t dlen)
+{
+    uint8_t *u;
+    int i;
+
+    eth(f, dmac, smac, 0x0800);
+    u = ipv4(f, 17, src, dst, 8 + dlen, 0);
+    wr16(u, sport);
+    wr16(u + 2, dport);
+    wr16(u + 4, 8 + dlen);
+    for (i = 0; i < dlen; i++)
+        u[8 + i] = i;
+    l4_sum(f, 6);
+}
+
+static void tcp(frame *f, const uint8_t *dmac, const uint8_t *smac, uint32_t src, uint16_t sport,
+                uint32_t dst, uint16_t dport, uint8_t flags, uint16_t mss)
+{
+    uint8_t *t;
+
+    eth(f, dmac, smac, 0x0800);
+    t = ipv4(f, 6, src, dst, mss ? 24 : 20, 0);
+    wr16(t, sport);
+    wr16(t + 2, dport);
+    wr32(t + 4, 1000);
+    wr32(t + 8, (flags & 0x10) ? 2000 : 0);
+    t[12] = (mss ? 6 : 5) << 4;
+    t[13] = flags;
+    wr16(t + 14, 65535);
+    if (mss)
+    {
+        t[20] = 2;
+        t[21] = 4;
+        wr16(t + 22, mss);
+    }
+    l4_sum(f, 16);
+}
+
+static void icmp_echo(frame *f, const uint8_t *dmac, const uint8_t *smac, uint32_t src, uint32_t dst,
+                      uint8_t type, uint16_t id)
+{
+    uint8_t *c;
+
+    eth(f, dmac, smac, 0x0800);
+    c = ipv4(f, 1, src, dst, 16, 0);
+    c[0] = type;
+    wr16(c + 4, id);
+    wr16(c + 6, 1);
+    wr16(c + 2, fold(sum16(c, 16, 0)));
+}
+
+static void arp(frame *f, const uint8_t *dmac, const uint8_t *smac, uint16_t op,
+                const uint8_t *sha, uint32_t spa, const uint8_t *tha, uint32_t tpa)
+{
+    uint8_t *a = f->b + 14;
+
+    eth(f, dmac, smac, 0x0806);
+    wr16(a, 1);
+    wr16(a + 2, 0x0800);
+    a[4] = 6;
+    a[5] = 4;
+    wr16(a + 6, op);
+    memcpy(a + 8, sha, 6);
+    wr32(a + 14, spa);
+    memcpy(a + 18, tha, 6);
+    wr32(a + 24, tpa);
+    f->len = 42;
+}
+
+/* A UDP datagram of 1608 bytes in two fragments */
+static void udp_fragments(int iface, const uint8_t *dmac, const uint8_t *smac, uint32_t src, uint32_t dst)
+{
+    frame f;
+    uint8_t *p;
+    uint16_t id = ip_id;
+
+    eth(&f, dmac, smac, 0x0800);
+    p = ipv4(&f, 17, src, dst, 1480, 0x2000);
+    wr16(p, 5001);
+    wr16(p + 2, 5001);
+    wr16(p + 4, 1608);
+    write_epb(iface, f.b, f.len);
+
+    ip_id = id;
+    eth(&f, dmac, smac, 0x0800);
+    ipv4(&f, 17, src, dst, 128, 1480 / 8);
+    write_epb(iface, f.b, f.len);
+}
+
+static void router(void)
+{
+    uint32_t client = ip(192, 168, 4, 2), sta = ip(10, 0, 0, 2), dns = ip(8, 8, 8, 8), web = ip(93, 184, 216, 34);
+    frame f;
+
+    /* from the client: passed to the stack unless the ACL denies it */
+    arp(&f, mac_bcast, mac_client, 1, mac_client, client, (uint8_t[6]){ 0 }, ip(192, 168, 4, 1));
+    write_epb(IF_AP_IN, f.b, f.len);
+    udp(&f, mac_ap, mac_client, client, 5000, dns, 53, 32);
+    write_epb(IF_AP_IN, f.b, f.len);
+    tcp(&f, mac_ap, mac_client, client, 40000, web, 80, 0x02, 1460);
+    write_epb(IF_AP_IN, f.b, f.len);
+    tcp(&f, mac_ap, mac_client, client, 40001, web, 23, 0x02, 1460);
+    write_epb(IF_AP_IN, f.b, f.len);
+    icmp_echo(&f, mac_ap, mac_client, client, dns, 8, 0x1234);
+    write_epb(IF_AP_IN, f.b, f.len);
+    udp_fragments(IF_AP_IN, mac_ap, mac_client, client, dns);
+
+    /* as forwarded by lwIP to the uplink: translated by NAPT */
+    udp(&f, mac_gw, mac_sta, client, 5000, dns, 53, 32);
+    write_epb(IF_STA_OUT, f.b, f.len);
+    tcp(&f, mac_gw, mac_sta, client, 40000, web, 80, 0x02, 1460);
+    write_epb(IF_STA_OUT, f.b, f.len);
+    icmp_echo(&f, mac_gw, mac_sta, client, dns, 8, 0x1234);
+    write_epb(IF_STA_OUT, f.b, f.len);
+    udp_fragments(IF_STA_OUT, mac_gw, mac_sta, client, dns);
+    /* the ESP's own traffic isn't translated */
+    udp(&f, mac_gw, mac_sta, sta, 123, ip(10, 0, 0, 1), 123, 48);
+    write_epb(IF_STA_OUT, f.b, f.len);
+
+    /* the replies, the mapped ports are handed out from 49152 in order */
+    udp(&f, mac_sta, mac_gw, dns, 53, sta, 49152, 64);
+    write_epb(IF_STA_IN, f.b, f.len);
+    tcp(&f, mac_sta, mac_gw, web, 80, sta, 49153, 0x12, 1460);
+    write_epb(IF_STA_IN, f.b, f.len);
+    icmp_echo(&f, mac_sta, mac_gw, dns, sta, 0, 49154);
+    write_epb(IF_STA_IN, f.b, f.len);
+    /* no session: left to the stack */
+    udp(&f, mac_sta, mac_gw, dns, 53, sta, 50000, 16);
+    write_epb(IF_STA_IN, f.b, f.len);
+    tcp(&f, mac_sta, mac_gw, web, 80, sta, 8080, 0x02, 0);
+    write_epb(IF_STA_IN, f.b, f.len);
+    arp(&f, mac_bcast, mac_gw, 1, mac_gw, ip(10, 0, 0, 1), (uint8_t[6]){ 0 }, sta);
+    write_epb(IF_STA_IN, f.b, f.len);
+
+    /* translated back by lwIP, to the client */
+    udp(&f, mac_client, mac_ap, dns, 53, client, 5000, 64);
+    write_epb(IF_AP_OUT, f.b, f.len);
+    tcp(&f, mac_client, mac_ap, web, 80, client, 40000, 0x12, 1460);
+    write_epb(IF_AP_OUT, f.b, f.len);
+    tcp(&f, mac_client, mac_ap, web, 23, client, 40001, 0x12, 1460);
+    write_epb(IF_AP_OUT, f.b, f.len);
+}
+
+static void bridge(void)
+{
+    uint32_t client = ip(10, 0, 0, 60), sta = ip(10, 0, 0, 50), gw = ip(10, 0, 0, 1), dns = ip(8, 8, 8, 8);
+    uint8_t *u;
+    frame f;
+
+    /* the client resolves the gateway and talks to the internet */
+    arp(&f, mac_bcast, mac_client, 1, mac_client, client, (uint8_t[6]){ 0 }, gw);
+    write_epb(IF_AP_IN, f.b, f.len);
+    arp(&f, mac_sta, mac_gw, 2, mac_gw, gw, mac_sta, client);
+    write_epb(IF_STA_IN, f.b, f.len);
+    udp(&f, mac_gw, mac_client, client, 5000, dns, 53, 32);
+    write_epb(IF_AP_IN, f.b, f.len);
+    udp(&f, mac_sta, mac_gw, dns, 53, client, 5000, 64);
+    write_epb(IF_STA_IN, f.b, f.len);
+    tcp(&f, mac_gw, mac_client, client, 40000, ip(93, 184, 216, 34), 80, 0x02, 1460);
+    write_epb(IF_AP_IN, f.b, f.len);
+    tcp(&f, mac_sta, mac_gw, ip(93, 184, 216, 34), 80, client, 40000, 0x12, 1460);
+    write_epb(IF_STA_IN, f.b, f.len);
+
+    /* the gateway looks for the client */
+    arp(&f, mac_bcast, mac_gw, 1, mac_gw, gw, (uint8_t[6]){ 0 }, client);
+    write_epb(IF_STA_IN, f.b, f.len);
+
+    /* DHCP discover from the client, broadcast */
+    udp(&f, mac_bcast, mac_client, 0, 68, 0xffffffff, 67, 240);
+    u = f.b + 34 + 8;
+    u[0] = 1;
+    u[1] = 1;
+    u[2] = 6;
+    wr32(u + 4, 0xdeadbeef);
+    memcpy(u + 28, mac_client, 6);
+    l4_sum(&f, 6);
+    write_epb(IF_AP_IN, f.b, f.len);
+
+    /* to the ESP itself, on both sides */
+    udp(&f, mac_sta, mac_gw, gw, 123, sta, 123, 48);
+    write_epb(IF_STA_IN, f.b, f.len);
+    tcp(&f, mac_ap, mac_client, client, 40002, sta, 7777, 0x02, 1460);
+    write_epb(IF_AP_IN, f.b, f.len);
+
+    /* to an unknown station: not forwarded */
+    udp(&f, mac_sta, mac_gw, dns, 53, ip(10, 0, 0, 99), 5000, 16);
+    write_epb(IF_STA_IN, f.b, f.len);
+    udp_fragments(IF_AP_IN, mac_gw, mac_client, client, dns);
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+
+    if (argc != 3 || (strcmp(argv[1], "router") != 0 && strcmp(argv[1], "bridge") != 0))
+    {
+        fprintf(stderr, "usage: mkpcap router|bridge out.pcapng\n");
+        return 2;
+    }
+    out = fopen(argv[2], "wb");
+    if (out == NULL)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+    write_shb();
+    for (i = 0; i < 4; i++)
+        write_idb(if_names[i]);
+    if (strcmp(argv[1], "router") == 0)
+        router();
+    else
+        bridge();
+    return fclose(out) == 0 ? 0 : 1;
+}
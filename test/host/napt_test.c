@@ -0,0 +1,304 @@
+/*
+ * NAPT at different table sizes: napt_output() and napt_input() on UDP and
+ * TCP flows of 8 clients behind the SoftAP, as the station hooks call them.
+ * The first packets of the flows create the sessions, then random packets
+ * of the flows and their replies are translated in both directions, then
+ * as many new flows evict the old sessions. The translated headers must
+ * have valid checksums and the replies must go back to their clients.
+ *
+ * The ns per packet are printed without the time to copy and parse the
+ * frame, which is measured separately.
+ *
+ *   napt_test [sessions...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "c_types.h"
+#include "lwip/ip.h"
+#include "lwip/ip_addr.h"
+#include "lwip/def.h"
+#include "lwip/netif.h"
+#include "pkt_info.h"
+#include "napt.h"
+
+#include "host.h"
+
+#define CLIENTS		8
+#define FRAME_LEN	(PKT_ETH_HDR_LEN + 20 + 20 + 16)
+#define STEADY_PACKETS	1000000
+
+typedef struct {
+    uint8_t out[FRAME_LEN];	/* client -> server, as lwIP forwards it */
+    uint8_t in[FRAME_LEN];	/* the reply to the mapped port */
+    uint16_t len;
+    uint32_t client;
+    uint16_t sport;
+} flow;
+
+static flow *flows;
+static uint32_t *order;
+static struct pbuf *frame;
+static uint32_t failures;
+
+static uint64_t rng = 88172645463325252ULL;
+
+static uint32_t rnd(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)(rng >> 16);
+}
+
+static void wr16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static uint16_t rd16(const uint8_t *p)
+{
+    return p[0] << 8 | p[1];
+}
+
+static uint32_t sum16(const uint8_t *p, int len, uint32_t sum)
+{
+    for (; len > 1; p += 2, len -= 2)
+        sum += rd16(p);
+    if (len)
+        sum += p[0] << 8;
+    return sum;
+}
+
+static uint16_t fold(uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return sum;
+}
+
+/* 0 if the IP and the transport checksum of the frame are valid */
+static int check_sums(const uint8_t *f, uint16_t len)
+{
+    const uint8_t *ip = f + PKT_ETH_HDR_LEN;
+    uint16_t l4_len = len - PKT_ETH_HDR_LEN - 20;
+    uint32_t sum;
+
+    if (fold(sum16(ip, 20, 0)) != 0xffff)
+        return -1;
+    sum = sum16(ip + 12, 8, ip[9] + l4_len);
+    return fold(sum16(ip + 20, l4_len, sum)) == 0xffff ? 0 : -1;
+}
+
+/* Ethernet, IP and a UDP or TCP header, with valid checksums */
+static uint16_t build(uint8_t *f, uint8_t proto, uint32_t src, uint16_t sport, uint32_t dest, uint16_t dport,
+                      uint8_t tcp_flags)
+{
+    uint8_t *ip = f + PKT_ETH_HDR_LEN, *l4 = ip + 20;
+    uint16_t l4_len = proto == IP_PROTO_TCP ? 20 : 8 + 16;
+    uint32_t sum;
+
+    memset(f, 0, FRAME_LEN);
+    f[0] = 0x02;
+    f[6] = 0x02;
+    f[11] = 1;
+    wr16(f + 12, 0x0800);
+    ip[0] = 0x45;
+    wr16(ip + 2, 20 + l4_len);
+    wr16(ip + 4, rnd());
+    ip[8] = 64;
+    ip[9] = proto;
+    memcpy(ip + 12, &src, 4);
+    memcpy(ip + 16, &dest, 4);
+    wr16(ip + 10, ~fold(sum16(ip, 20, 0)));
+    wr16(l4, sport);
+    wr16(l4 + 2, dport);
+    if (proto == IP_PROTO_TCP)
+    {
+        wr16(l4 + 4, rnd());
+        l4[12] = 5 << 4;
+        l4[13] = tcp_flags;
+        wr16(l4 + 14, 8192);
+    }
+    else
+    {
+        wr16(l4 + 4, l4_len);
+        memset(l4 + 8, 0xa5, 16);
+    }
+    sum = sum16(ip + 12, 8, proto + l4_len);
+    sum = fold(sum16(l4, l4_len, sum));
+    wr16(l4 + (proto == IP_PROTO_TCP ? 16 : 6), ~sum ? ~sum : 0xffff);
+    return PKT_ETH_HDR_LEN + 20 + l4_len;
+}
+
+static void new_flow(flow *fl, uint32_t n)
+{
+    uint8_t proto = n & 1 ? IP_PROTO_TCP : IP_PROTO_UDP;
+    uint32_t server;
+
+    IP4_ADDR((ip_addr_t *)&fl->client, 192, 168, 4, 2 + n % CLIENTS);
+    IP4_ADDR((ip_addr_t *)&server, 93, 184, n / 250 % 250, 1 + n % 250);
+    fl->sport = 10000 + n;
+    fl->len = build(fl->out, proto, fl->client, fl->sport, server, proto == IP_PROTO_TCP ? 443 : 53, 0x02);
+}
+
+/* The frame of a flow in the pbuf, parsed as the hooks do */
+static uint8_t *load(const uint8_t *f, uint16_t len, pkt_info *pi)
+{
+    memcpy(frame->payload, f, len);
+    frame->len = frame->tot_len = len;
+    pkt_parse(frame, pi);
+    return frame->payload;
+}
+
+/* The first packets of n new flows, which create their sessions. The
+   translated frames are kept in in[] until the replies are built from
+   them, after the timing. Returns the ns per packet. */
+static double run_new(uint32_t first, uint32_t n)
+{
+    struct netif *sta = host_netif(HOST_STA);
+    uint64_t t0;
+    uint32_t i;
+    pkt_info pi;
+
+    for (i = 0; i < n; i++)
+        new_flow(&flows[i], first + i);
+    t0 = host_cpu_ns();
+    for (i = 0; i < n; i++)
+    {
+        flow *fl = &flows[i];
+        uint8_t *f = load(fl->out, fl->len, &pi);
+
+        if (!napt_output(frame, &pi, sta))
+            pi.src = 0;
+        memcpy(fl->in, f, fl->len);
+    }
+    t0 = host_cpu_ns() - t0;
+
+    for (i = 0; i < n; i++)
+    {
+        flow *fl = &flows[i];
+
+        if (load(fl->in, fl->len, &pi) && (pi.src != sta->ip_addr.addr || check_sums(fl->in, fl->len) != 0))
+        {
+            if (failures++ < 10)
+                printf("flow %u: not translated\n", first + i);
+            continue;
+        }
+        build(fl->in, pi.proto, pi.dest, pi.d_port, pi.src, pi.s_port, 0x12);
+    }
+    return (double)t0 / n;
+}
+
+/* Random packets of the flows in both directions, translate 0: only the
+   copy and the parse, for the baseline. Returns the ns per packet. */
+static double run_steady(uint32_t sessions, bool out, bool translate, bool verify)
+{
+    struct netif *sta = host_netif(HOST_STA);
+    uint64_t t0 = host_cpu_ns();
+    uint32_t i;
+    pkt_info pi;
+
+    for (i = 0; i < STEADY_PACKETS; i++)
+    {
+        const flow *fl = &flows[order[i % sessions]];
+        uint8_t *f = load(out ? fl->out : fl->in, fl->len, &pi);
+
+        if (!translate)
+            continue;
+        if (out)
+            napt_output(frame, &pi, sta);
+        else
+            napt_input(frame, &pi, sta);
+        if (verify && ((out ? pi.src != sta->ip_addr.addr : pi.dest != fl->client || pi.d_port != fl->sport) ||
+                       check_sums(f, fl->len) != 0))
+        {
+            if (failures++ < 10)
+                printf("%s packet of flow %u not translated\n", out ? "outgoing" : "reply", order[i % sessions]);
+        }
+    }
+    return (double)(host_cpu_ns() - t0) / STEADY_PACKETS;
+}
+
+static void bench(uint16_t sessions)
+{
+    double t_new, t_out, t_in, t_evict, t_base;
+    napt_stats *st;
+    uint32_t i;
+
+    napt_init(sessions, 4);
+    napt_enable_no(HOST_AP, 1);
+
+    flows = calloc(sessions, sizeof(flow));
+    order = malloc(sessions * sizeof(uint32_t));
+    for (i = 0; i < sessions; i++)
+        order[i] = i;
+    for (i = sessions - 1; i > 0; i--)
+    {
+        uint32_t j = rnd() % (i + 1), t = order[i];
+
+        order[i] = order[j];
+        order[j] = t;
+    }
+
+    t_new = run_new(0, sessions);
+    st = napt_get_stats();
+    if (st->used != sessions || st->evicted != 0)
+    {
+        failures++;
+        printf("%u sessions: %u in the table, %u evicted\n", sessions, st->used, st->evicted);
+    }
+    run_steady(sessions, false, true, true);
+    run_steady(sessions, true, true, true);
+    t_base = run_steady(sessions, true, false, false);
+    t_out = run_steady(sessions, true, true, false) - t_base;
+    t_in = run_steady(sessions, false, true, false) - t_base;
+    t_evict = run_new(sessions, sessions);
+    if (st->evicted != sessions)
+    {
+        failures++;
+        printf("%u sessions: %u evicted by as many new flows\n", sessions, st->evicted);
+    }
+
+    printf("%8u %10.1f %10.1f %10.1f %10.1f %10.1f\n", sessions, t_new - t_base, t_out, t_in, t_evict - t_base, t_base);
+    free(flows);
+    free(order);
+}
+
+static void frame_sink(struct netif *nif, bool out, struct pbuf *p)
+{
+}
+
+int main(int argc, char **argv)
+{
+    static const uint16_t sizes[] = { 64, 256, 1024, 2048 };
+    int i;
+
+    host_init(frame_sink);
+    IP4_ADDR(&host_netif(HOST_STA)->ip_addr, 10, 0, 0, 2);
+    IP4_ADDR(&host_netif(HOST_STA)->netmask, 255, 255, 255, 0);
+    IP4_ADDR(&host_netif(HOST_AP)->ip_addr, 192, 168, 4, 1);
+    IP4_ADDR(&host_netif(HOST_AP)->netmask, 255, 255, 255, 0);
+    frame = pbuf_alloc(PBUF_RAW, FRAME_LEN, PBUF_RAM);
+
+    printf("ns per packet\n%8s %10s %10s %10s %10s %10s\n", "sessions", "new", "out", "in", "evict", "copy+parse");
+    if (argc > 1)
+    {
+        for (i = 1; i < argc; i++)
+            bench(atoi(argv[i]));
+    }
+    else
+    {
+        for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++)
+            bench(sizes[i]);
+    }
+    pbuf_free(frame);
+    if (failures != 0)
+    {
+        printf("%u failures\n", failures);
+        return 1;
+    }
+    return 0;
+}
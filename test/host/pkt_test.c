@@ -0,0 +1,215 @@
+/*
+ * pkt_parse() on the frames of captures, against a reference parser built
+ * on the lwIP header structs. Every frame is also checked cut short at
+ * each length, with IP options (a longer IHL) and as a non-first and a
+ * first fragment, so the bounds checks see all of their edges. The time
+ * per pkt_parse() call is printed.
+ *
+ *   pkt_test capture...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "c_types.h"
+#include "lwip/pbuf.h"
+#include "lwip/ip.h"
+#include "lwip/udp.h"
+#include "lwip/tcp_impl.h"
+#include "netif/etharp.h"
+#include "pkt_info.h"
+
+#include "host.h"
+#include "capture.h"
+
+#define BENCH_LOOPS	20000
+
+static capture_packet *packets;
+static uint32_t packet_count;
+
+static uint32_t checked, ip, ports, frags, failures;
+
+/*
+ * What pkt_parse() has to return. Non-first fragments (offset != 0) get
+ * PKT_F_FRAG and no ports: their payload starts in the middle of the
+ * datagram, so the bytes after the IP header aren't a transport header.
+ */
+static void ref_parse(const uint8_t *f, uint16_t len, pkt_info *pi)
+{
+    struct eth_hdr eth;
+    struct ip_hdr iph;
+    uint16_t hl;
+
+    memset(pi, 0, sizeof(*pi));
+    pi->tot_len = len;
+    if (len < sizeof(eth))
+        return;
+    memcpy(&eth, f, sizeof(eth));
+    pi->eth_type = ntohs(eth.type);
+    if (eth.dest.addr[0] & 1)
+        pi->flags |= PKT_F_BCAST;
+    if (pi->eth_type != ETHTYPE_IP)
+        return;
+    pi->ip_off = sizeof(eth);
+    if (len < sizeof(eth) + IP_HLEN)
+        return;
+
+    memcpy(&iph, f + sizeof(eth), sizeof(iph));
+    hl = IPH_HL(&iph) * 4;
+    if (hl < IP_HLEN || len < sizeof(eth) + hl)
+        return;
+    pi->flags |= PKT_F_IP;
+    pi->l4_off = sizeof(eth) + hl;
+    pi->proto = IPH_PROTO(&iph);
+    pi->src = iph.src.addr;
+    pi->dest = iph.dest.addr;
+    if (ntohs(IPH_OFFSET(&iph)) & IP_OFFMASK)
+    {
+        pi->flags |= PKT_F_FRAG;
+        return;
+    }
+
+    if (pi->proto == IP_PROTO_UDP && len >= pi->l4_off + sizeof(struct udp_hdr))
+    {
+        struct udp_hdr uh;
+
+        memcpy(&uh, f + pi->l4_off, sizeof(uh));
+        pi->s_port = ntohs(uh.src);
+        pi->d_port = ntohs(uh.dest);
+        pi->flags |= PKT_F_PORTS;
+    }
+    else if (pi->proto == IP_PROTO_TCP && len >= pi->l4_off + sizeof(struct tcp_hdr))
+    {
+        struct tcp_hdr th;
+
+        memcpy(&th, f + pi->l4_off, sizeof(th));
+        pi->s_port = ntohs(th.src);
+        pi->d_port = ntohs(th.dest);
+        pi->tcp_flags = TCPH_FLAGS(&th);
+        pi->flags |= PKT_F_PORTS;
+    }
+}
+
+static void check_one(uint32_t n, const char *what, const uint8_t *f, uint16_t len)
+{
+    struct pbuf *p = host_frame(f, len);
+    pkt_info pi, ref;
+
+    pkt_parse(p, &pi);
+    pbuf_free(p);
+    ref_parse(f, len, &ref);
+
+    checked++;
+    if (memcmp(&pi, &ref, sizeof(pi)) != 0)
+    {
+        if (failures++ < 10)
+            printf("packet %u %s len %u: flags %02x/%02x proto %u/%u ports %u>%u / %u>%u ip %u/%u l4 %u/%u\n",
+                   n, what, len, pi.flags, ref.flags, pi.proto, ref.proto, pi.s_port, pi.d_port,
+                   ref.s_port, ref.d_port, pi.ip_off, ref.ip_off, pi.l4_off, ref.l4_off);
+        return;
+    }
+    if (pi.flags & PKT_F_IP)
+        ip++;
+    if (pi.flags & PKT_F_PORTS)
+        ports++;
+    if (pi.flags & PKT_F_FRAG)
+        frags++;
+}
+
+/* The frame and all of its prefixes */
+static void check_cut(uint32_t n, const char *what, const uint8_t *f, uint16_t len)
+{
+    uint16_t l;
+
+    for (l = 0; l <= len; l++)
+        check_one(n, what, f, l);
+}
+
+static void check(void)
+{
+    static uint8_t f[CAPTURE_MAX_FRAME + 8];
+    uint32_t i;
+
+    for (i = 0; i < packet_count; i++)
+    {
+        const capture_packet *pk = &packets[i];
+        uint16_t len = pk->len;
+
+        check_cut(i + 1, "", pk->data, len);
+        if (len < PKT_ETH_HDR_LEN + IP_HLEN || pk->data[12] != 0x08 || pk->data[13] != 0x00)
+            continue;
+
+        /* 8 bytes of options: the transport header moves behind them */
+        memcpy(f, pk->data, PKT_ETH_HDR_LEN + IP_HLEN);
+        memset(f + PKT_ETH_HDR_LEN + IP_HLEN, 1, 8);
+        memcpy(f + PKT_ETH_HDR_LEN + IP_HLEN + 8, pk->data + PKT_ETH_HDR_LEN + IP_HLEN,
+               len - PKT_ETH_HDR_LEN - IP_HLEN);
+        f[PKT_ETH_HDR_LEN] = (f[PKT_ETH_HDR_LEN] & 0xf0) | 7;
+        check_cut(i + 1, "options", f, len + 8);
+
+        /* a non-first fragment with the same bytes: no ports */
+        memcpy(f, pk->data, len);
+        f[PKT_ETH_HDR_LEN + 6] = 0x20;
+        f[PKT_ETH_HDR_LEN + 7] = 0xb9;
+        check_cut(i + 1, "offset", f, len);
+
+        /* the first fragment has its transport header */
+        f[PKT_ETH_HDR_LEN + 6] = 0x20;
+        f[PKT_ETH_HDR_LEN + 7] = 0x00;
+        check_cut(i + 1, "first", f, len);
+    }
+    printf("%u frames as %u variants: %u IP, %u with ports, %u non-first fragments, %u mismatches\n",
+           packet_count, checked, ip, ports, frags, failures);
+}
+
+static void bench(void)
+{
+    struct pbuf **p = malloc(packet_count * sizeof(*p));
+    volatile uint32_t sink = 0;
+    uint64_t t0, ns;
+    uint32_t i, loop;
+    pkt_info pi;
+
+    for (i = 0; i < packet_count; i++)
+        p[i] = host_frame(packets[i].data, packets[i].len);
+    t0 = host_cpu_ns();
+    for (loop = 0; loop < BENCH_LOOPS; loop++)
+    {
+        for (i = 0; i < packet_count; i++)
+        {
+            pkt_parse(p[i], &pi);
+            sink += pi.flags;
+        }
+    }
+    ns = host_cpu_ns() - t0;
+    (void)sink;
+    for (i = 0; i < packet_count; i++)
+        pbuf_free(p[i]);
+    free(p);
+    printf("pkt_parse: %.1f ns per frame\n", (double)ns / ((uint64_t)BENCH_LOOPS * packet_count));
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: pkt_test capture...\n");
+        return 2;
+    }
+    for (i = 1; i < argc; i++)
+        if (capture_read(argv[i], 0, &packets, &packet_count) < 0)
+            return 2;
+    if (packet_count == 0)
+    {
+        fprintf(stderr, "no packets\n");
+        return 2;
+    }
+
+    check();
+    if (failures != 0)
+        return 1;
+    bench();
+    return 0;
+}
@@ -0,0 +1,453 @@
+/*
+ * Replays a capture through the firmware's netif hooks on the host.
+ *
+ *   replay [-v] [-n loops] [-i iface] [-s script] [-o out] capture [golden]
+ *
+ * The capture is pcapng, as the monitor writes it in pcapng mode: the name
+ * of the interface a packet was captured on ("ap-in", "ap-out", "sta-in",
+ * "sta-out") says where it is injected. The -in packets go to the netif's
+ * input, i.e. my_input_ap() / my_input_sta() in the router build and
+ * bridge_input_ap() / bridge_input_sta() in the bridge build, the -out ones
+ * to its linkoutput (my_output_ap() / my_output_sta()). A classic pcap has
+ * no interfaces, all of its packets go to the one given with -i (default
+ * ap-in).
+ *
+ * Before the capture, the script is run line by line: lines starting with
+ * '!' set up the radio side (see script_line()), '#' starts a comment and
+ * everything else is typed on the serial console.
+ *
+ * For every packet one line is written with the frames the SDK got back
+ * in response, up to the next packet: "stack" for a frame passed up to
+ * lwIP, "tx" for one sent on the radio, or "drop" if there was none.
+ * Together with the console output this is compared to the golden file,
+ * -o writes it to a file instead (e.g. to create the golden).
+ *
+ * The timestamps of the capture drive the virtual clock. After the first
+ * pass the capture is replayed loops - 1 more times without recording the
+ * verdicts, for the timing. Packets/sec and the CPU time per packet
+ * (injection until the posted tasks are done) are reported per interface.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "c_types.h"
+#include "osapi.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+#include "lwip/ip_addr.h"
+
+#include "host.h"
+#include "capture.h"
+
+#define LINE_LEN	1024
+
+typedef struct _iface_stats {
+    uint32_t packets;
+    uint64_t ns;
+    uint64_t max_ns;
+} iface_stats;
+
+static capture_packet *packets;
+static uint32_t packet_count;
+
+static FILE *out;
+static char line[LINE_LEN];
+static size_t line_len;
+static uint32_t frames_seen;
+static bool recording;
+
+/* Verdicts */
+
+static void out_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void out_printf(const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(line + line_len, sizeof(line) - line_len, fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        line_len += (size_t)n < sizeof(line) - line_len ? (size_t)n : sizeof(line) - line_len - 1;
+}
+
+static void out_flush(void)
+{
+    fprintf(out, "%s\n", line);
+    line_len = 0;
+    line[0] = '\0';
+}
+
+static uint32_t fnv1a(const uint8_t *data, uint16_t len)
+{
+    uint32_t h = 0x811c9dc5;
+
+    while (len--)
+    {
+        h ^= *data++;
+        h *= 0x01000193;
+    }
+    return h;
+}
+
+/* A short description of the frame, so that a golden diff is readable */
+static void describe(const uint8_t *f, uint16_t len)
+{
+    uint16_t type;
+
+    if (len < 14)
+        return;
+    type = f[12] << 8 | f[13];
+    if (type == 0x0806 && len >= 42)
+    {
+        out_printf(" arp%s %d.%d.%d.%d>%d.%d.%d.%d", f[21] == 1 ? "-req" : "-rep",
+                   f[28], f[29], f[30], f[31], f[38], f[39], f[40], f[41]);
+    }
+    else if (type == 0x0800 && len >= 34)
+    {
+        const uint8_t *ip = f + 14, *l4 = ip + (ip[0] & 0x0f) * 4;
+        bool first = ((ip[6] & 0x1f) | ip[7]) == 0;
+
+        out_printf(" ip/%d %d.%d.%d.%d", ip[9], ip[12], ip[13], ip[14], ip[15]);
+        if (first && (ip[9] == 6 || ip[9] == 17) && l4 + 4 <= f + len)
+            out_printf(":%d", l4[0] << 8 | l4[1]);
+        out_printf(">%d.%d.%d.%d", ip[16], ip[17], ip[18], ip[19]);
+        if (first && (ip[9] == 6 || ip[9] == 17) && l4 + 4 <= f + len)
+            out_printf(":%d", l4[2] << 8 | l4[3]);
+        if (!first)
+            out_printf(" frag");
+    }
+    else
+    {
+        out_printf(" type %04x", type);
+    }
+}
+
+static void frame_sink(struct netif *nif, bool is_out, struct pbuf *p)
+{
+    static uint8_t buf[65536];
+    uint16_t len;
+
+    frames_seen++;
+    if (!recording)
+        return;
+    len = pbuf_copy_partial(p, buf, p->tot_len, 0);
+    out_printf(" %s:%s %d", is_out ? "tx" : "stack", nif->num == HOST_AP ? "ap" : "sta", len);
+    describe(buf, len);
+    out_printf(" %08x", fnv1a(buf, len));
+}
+
+/* Script */
+
+static int parse_ip(const char *s, uint32_t *ip)
+{
+    ip_addr_t a;
+
+    if (!ipaddr_aton(s, &a))
+        return -1;
+    *ip = a.addr;
+    return 0;
+}
+
+/*
+ * The radio side of the script:
+ *   !sta <ip> <mask> <gw>     the station is connected and got the address
+ *   !join <mac> <ip>          a client joined the softAP
+ *   !wait <ms>                lets the virtual time pass
+ */
+static int script_line(char *s)
+{
+    char *argv[4];
+    int argc = 0;
+    char *tok;
+
+    for (tok = strtok(s, " \t"); tok != NULL && argc < 4; tok = strtok(NULL, " \t"))
+        argv[argc++] = tok;
+
+    if (argc == 4 && strcmp(argv[0], "!sta") == 0)
+    {
+        uint32_t ip, mask, gw;
+
+        if (parse_ip(argv[1], &ip) || parse_ip(argv[2], &mask) || parse_ip(argv[3], &gw))
+            return -1;
+        host_sta_got_ip(ip, mask, gw);
+        return 0;
+    }
+    if (argc == 3 && strcmp(argv[0], "!join") == 0)
+    {
+        uint8_t mac[6];
+        uint32_t ip;
+
+        if (!ets_str2macaddr(mac, argv[1]) || parse_ip(argv[2], &ip))
+            return -1;
+        host_ap_sta_join(mac, ip);
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[0], "!wait") == 0)
+    {
+        host_advance_us((uint64_t)atoi(argv[1]) * 1000);
+        return 0;
+    }
+    return -1;
+}
+
+static int run_script(const char *name)
+{
+    FILE *f = fopen(name, "r");
+    char s[256];
+    int lineno = 0;
+
+    if (f == NULL)
+    {
+        perror(name);
+        return -1;
+    }
+    while (fgets(s, sizeof(s), f) != NULL)
+    {
+        lineno++;
+        s[strcspn(s, "\r\n")] = '\0';
+        if (s[0] == '\0' || s[0] == '#')
+            continue;
+        fprintf(out, "> %s\n", s);
+        if (s[0] == '!')
+        {
+            if (script_line(s) < 0)
+            {
+                fprintf(stderr, "%s:%d: bad line\n", name, lineno);
+                fclose(f);
+                return -1;
+            }
+            continue;
+        }
+        host_console(s);
+        fputc('\n', out);
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Replay */
+
+static void inject(const capture_packet *pk)
+{
+    struct netif *nif = host_netif(pk->iface < 2 ? HOST_AP : HOST_STA);
+    struct pbuf *p;
+
+    if (pk->iface & 1)
+    {
+        /* as lwIP hands it to the driver: a RAM pbuf of its own */
+        p = pbuf_alloc(PBUF_RAW, pk->len, PBUF_RAM);
+        if (p == NULL)
+            return;
+        memcpy(p->payload, pk->data, pk->len);
+        nif->linkoutput(nif, p);
+#ifdef REPEATER_MODE
+        /* the bridge doesn't hook the output, the shim didn't take it */
+        pbuf_free(p);
+#endif
+    }
+    else
+    {
+        p = host_frame(pk->data, pk->len);
+        if (p == NULL)
+            return;
+        nif->input(p, nif);
+    }
+    host_run_tasks();
+}
+
+static void replay(uint64_t offset_us, iface_stats *stats)
+{
+    uint32_t i;
+
+    for (i = 0; i < packet_count; i++)
+    {
+        const capture_packet *pk = &packets[i];
+        uint64_t t0, ns, ts = pk->ts_us - packets[0].ts_us + offset_us;
+        uint32_t seen = frames_seen;
+
+        if (ts > host_time_us())
+            host_advance_us(ts - host_time_us());
+        if (recording)
+            out_printf("%u %s %d", i + 1, capture_iface_names[pk->iface], pk->len);
+
+        t0 = host_cpu_ns();
+        inject(pk);
+        ns = host_cpu_ns() - t0;
+
+        if (recording)
+        {
+            if (frames_seen == seen)
+                out_printf(" drop");
+            out_flush();
+        }
+        stats[pk->iface].packets++;
+        stats[pk->iface].ns += ns;
+        if (ns > stats[pk->iface].max_ns)
+            stats[pk->iface].max_ns = ns;
+    }
+}
+
+static int compare(const char *actual, const char *golden)
+{
+    FILE *a = fopen(actual, "r"), *g = fopen(golden, "r");
+    char la[LINE_LEN + 2], lg[LINE_LEN + 2];
+    int lineno = 0, diffs = 0;
+
+    if (a == NULL || g == NULL)
+    {
+        perror(a == NULL ? actual : golden);
+        return -1;
+    }
+    for (;;)
+    {
+        char *ra = fgets(la, sizeof(la), a), *rg = fgets(lg, sizeof(lg), g);
+
+        if (ra == NULL && rg == NULL)
+            break;
+        lineno++;
+        if (ra == NULL || rg == NULL || strcmp(la, lg) != 0)
+        {
+            if (diffs++ < 10)
+                fprintf(stderr, "%s:%d:\n-%s+%s", golden, lineno, rg ? lg : "(end)\n", ra ? la : "(end)\n");
+        }
+    }
+    fclose(a);
+    fclose(g);
+    if (diffs)
+        fprintf(stderr, "%d line(s) differ from %s\n", diffs, golden);
+    return diffs ? -1 : 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: replay [-v] [-n loops] [-i iface] [-s script] [-o out] capture [golden]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *script = NULL, *out_name = NULL, *golden = NULL;
+    char tmp_name[] = "/tmp/replayXXXXXX";
+    iface_stats stats[CAPTURE_IFACES];
+    uint32_t loops = 1, n, live, leaked;
+    uint64_t duration;
+    int iface = 0, opt, i, ret = 0;
+
+    while ((opt = getopt(argc, argv, "vn:i:s:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'v':
+            host_verbose = true;
+            break;
+        case 'n':
+            loops = atoi(optarg);
+            if (loops < 1)
+                usage();
+            break;
+        case 'i':
+            if ((iface = capture_iface_by_name(optarg)) < 0)
+                usage();
+            break;
+        case 's':
+            script = optarg;
+            break;
+        case 'o':
+            out_name = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1 && optind != argc - 2)
+        usage();
+    if (optind == argc - 2)
+        golden = argv[argc - 1];
+
+    if (capture_read(argv[optind], iface, &packets, &packet_count) < 0)
+        return 1;
+    if (packet_count == 0)
+    {
+        fprintf(stderr, "%s: no packets\n", argv[optind]);
+        return 1;
+    }
+
+    if (out_name != NULL)
+    {
+        out = fopen(out_name, "w");
+    }
+    else
+    {
+        int fd = mkstemp(tmp_name);
+
+        out = fd < 0 ? NULL : fdopen(fd, "w");
+        out_name = tmp_name;
+    }
+    if (out == NULL)
+    {
+        perror(out_name);
+        return 1;
+    }
+
+    host_console_out = out;
+    host_init(frame_sink);
+    host_boot();
+    if (script != NULL && run_script(script) < 0)
+        return 1;
+    for (i = 0; i < 2; i++)
+    {
+        struct netif *nif = host_netif(i);
+
+        fprintf(out, "= %s " MACSTR " " IPSTR "\n", i == HOST_AP ? "ap" : "sta", MAC2STR(nif->hwaddr), IP2STR(&nif->ip_addr));
+    }
+    host_console_out = NULL;
+
+    /* starts a second after the setup, the NAPT and FDB timeouts are seconds */
+    host_advance_us(1000000);
+    live = host_pbufs_live();
+
+    memset(stats, 0, sizeof(stats));
+    recording = true;
+    replay(host_time_us(), stats);
+    recording = false;
+    fflush(out);
+
+    duration = packets[packet_count - 1].ts_us - packets[0].ts_us + 1000000;
+    if (loops > 1)
+    {
+        memset(stats, 0, sizeof(stats));
+        for (n = 1; n < loops; n++)
+            replay(host_time_us() + 1000000, stats);
+    }
+
+    /* whatever is still queued goes out, everything else must be freed */
+    host_advance_us(duration + 10000000);
+    leaked = host_pbufs_live() - live;
+    fclose(out);
+
+    printf("%-8s %8s %10s %9s %9s\n", "iface", "packets", "pkts/sec", "ns/pkt", "max ns");
+    for (i = 0; i < CAPTURE_IFACES; i++)
+    {
+        if (stats[i].packets == 0)
+            continue;
+        printf("%-8s %8u %10.0f %9.0f %9llu\n", capture_iface_names[i], stats[i].packets,
+               stats[i].ns ? stats[i].packets * 1e9 / stats[i].ns : 0.0,
+               (double)stats[i].ns / stats[i].packets, (unsigned long long)stats[i].max_ns);
+    }
+    if (leaked != 0)
+    {
+        fprintf(stderr, "%u pbuf(s) not freed\n", leaked);
+        ret = 1;
+    }
+
+    if (golden != NULL && compare(out_name, golden) < 0)
+        ret = 1;
+    if (out_name == tmp_name)
+        remove(tmp_name);
+    return ret;
+}
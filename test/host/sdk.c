@@ -0,0 +1,1067 @@
+/*
+ * Host shim for the NONOS SDK: system, timers, tasks, flash, wifi, espconn
+ * and the console UART, just enough for user_init() to run and for the
+ * packet hooks to see the same netifs and events as on the device.
+ *
+ * See host.h for the virtual clock. Everything network facing that is not
+ * a packet hook (espconn, DNS, ping, SNTP, MQTT) accepts the call and never
+ * completes it, except for the TCP servers, which a driver can connect to
+ * with host_tcp_connect().
+ */
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "c_types.h"
+#include "osapi.h"
+#include "mem.h"
+#include "user_interface.h"
+#include "espconn.h"
+#include "spi_flash.h"
+#include "sntp.h"
+#include "gpio.h"
+#include "lwip/netif.h"
+#include "lwip/app/dhcpserver.h"
+#include "lwip/app/ping.h"
+#include "driver/uart.h"
+#include "ringbuf.h"
+#include "perf.h"
+
+#include "host.h"
+
+#define HOST_CPU_MHZ		80
+#define HOST_FLASH_SIZE		(4 * 1024 * 1024)
+#define HOST_RTC_MEM_SIZE	768
+#define HOST_TASK_PRIOS		3
+#define HOST_MAX_STATIONS	8
+#define HOST_MAX_SERVERS	4
+
+bool host_verbose;
+FILE *host_console_out;
+
+static uint64_t now_us;
+static ETSTimer *timer_list;
+
+static struct {
+    os_task_t task;
+    os_event_t *queue;
+    uint8_t qlen;
+    uint8_t head;
+    uint8_t count;
+} tasks[HOST_TASK_PRIOS];
+
+static uint8_t *flash;
+static uint8_t rtc_mem[HOST_RTC_MEM_SIZE];
+static uint8_t os_print = 1;
+static uint8_t cpu_freq = HOST_CPU_MHZ;
+static uint8_t upgrade_flag;
+static uint64_t rand_state = 0x9e3779b97f4a7c15ULL;
+
+static struct netif netifs[2];
+static host_frame_fn frame_sink;
+static init_done_cb_t init_done_cb;
+static wifi_event_handler_cb_t wifi_event_cb;
+static uint8_t opmode = STATIONAP_MODE;
+static struct station_config sta_config;
+static struct softap_config ap_config;
+static struct station_info stations[HOST_MAX_STATIONS];
+static uint8_t station_num;
+static enum phy_mode phy_mode = PHY_MODE_11N;
+
+static ringbuf_t console_rx;
+
+/* Clock and timers */
+
+uint64_t host_time_us(void)
+{
+    return now_us;
+}
+
+uint64_t host_cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint32_t perf_ccount(void)
+{
+    return (uint32_t)(host_cpu_ns() * HOST_CPU_MHZ / 1000);
+}
+
+uint32 system_get_time(void)
+{
+    return (uint32)now_us;
+}
+
+uint32 system_get_rtc_time(void)
+{
+    return (uint32)now_us;
+}
+
+static bool timer_armed(ETSTimer *t)
+{
+    ETSTimer *p;
+
+    for (p = timer_list; p != NULL; p = p->timer_next)
+        if (p == t)
+            return true;
+    return false;
+}
+
+void ets_timer_disarm(ETSTimer *t)
+{
+    ETSTimer **pp;
+
+    for (pp = &timer_list; *pp != NULL; pp = &(*pp)->timer_next)
+    {
+        if (*pp == t)
+        {
+            *pp = t->timer_next;
+            break;
+        }
+    }
+    t->timer_next = NULL;
+}
+
+void ets_timer_setfn(ETSTimer *t, ETSTimerFunc *fn, void *arg)
+{
+    ets_timer_disarm(t);
+    t->timer_func = fn;
+    t->timer_arg = arg;
+}
+
+void ets_timer_arm(ETSTimer *t, uint32_t ms, bool repeat)
+{
+    if (timer_armed(t))
+        ets_timer_disarm(t);
+    t->timer_expire = (uint32_t)(now_us / 1000) + ms;
+    t->timer_period = repeat ? (ms ? ms : 1) : 0;
+    t->timer_next = timer_list;
+    timer_list = t;
+}
+
+static ETSTimer *timer_next_due(uint32_t until_ms)
+{
+    ETSTimer *t, *due = NULL;
+
+    for (t = timer_list; t != NULL; t = t->timer_next)
+    {
+        if ((int32_t)(t->timer_expire - until_ms) > 0)
+            continue;
+        if (due == NULL || (int32_t)(t->timer_expire - due->timer_expire) < 0)
+            due = t;
+    }
+    return due;
+}
+
+void host_advance_us(uint64_t us)
+{
+    uint64_t target = now_us + us;
+    ETSTimer *t;
+
+    while ((t = timer_next_due((uint32_t)(target / 1000))) != NULL)
+    {
+        if ((uint64_t)t->timer_expire * 1000 > now_us)
+            now_us = (uint64_t)t->timer_expire * 1000;
+        ets_timer_disarm(t);
+        if (t->timer_period)
+        {
+            t->timer_expire += t->timer_period;
+            t->timer_next = timer_list;
+            timer_list = t;
+        }
+        t->timer_func(t->timer_arg);
+        host_run_tasks();
+    }
+    now_us = target;
+}
+
+/* Tasks */
+
+bool system_os_task(os_task_t task, uint8 prio, os_event_t *queue, uint8 qlen)
+{
+    if (prio >= HOST_TASK_PRIOS || qlen == 0)
+        return false;
+    tasks[prio].task = task;
+    tasks[prio].queue = queue;
+    tasks[prio].qlen = qlen;
+    tasks[prio].head = tasks[prio].count = 0;
+    return true;
+}
+
+bool system_os_post(uint8 prio, os_signal_t sig, os_param_t par)
+{
+    os_event_t *e;
+
+    if (prio >= HOST_TASK_PRIOS || tasks[prio].task == NULL || tasks[prio].count >= tasks[prio].qlen)
+        return false;
+    e = &tasks[prio].queue[(tasks[prio].head + tasks[prio].count) % tasks[prio].qlen];
+    e->sig = sig;
+    e->par = par;
+    tasks[prio].count++;
+    return true;
+}
+
+void host_run_tasks(void)
+{
+    int prio;
+
+    for (prio = HOST_TASK_PRIOS - 1; prio >= 0; prio--)
+    {
+        if (tasks[prio].count == 0)
+            continue;
+
+        os_event_t e = tasks[prio].queue[tasks[prio].head];
+        tasks[prio].head = (tasks[prio].head + 1) % tasks[prio].qlen;
+        tasks[prio].count--;
+        tasks[prio].task(&e);
+        /* a task may have posted to a higher priority */
+        prio = HOST_TASK_PRIOS;
+    }
+}
+
+/* System */
+
+int ets_printf(const char *fmt, ...)
+{
+    va_list ap;
+    int n = 0;
+
+    if (!host_verbose || !os_print)
+        return 0;
+    va_start(ap, fmt);
+    n = vprintf(fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+int ets_vsprintf(char *str, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsprintf(str, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+int ets_str2macaddr(uint8_t *mac, char *str)
+{
+    unsigned int m[6];
+    int i;
+
+    if (sscanf(str, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != 6)
+        return 0;
+    for (i = 0; i < 6; i++)
+    {
+        if (m[i] > 0xff)
+            return 0;
+        mac[i] = m[i];
+    }
+    return 1;
+}
+
+unsigned long host_random(void)
+{
+    /* xorshift64*, seeded the same on every run */
+    rand_state ^= rand_state >> 12;
+    rand_state ^= rand_state << 25;
+    rand_state ^= rand_state >> 27;
+    return (unsigned long)((rand_state * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+int os_get_random(unsigned char *buf, size_t len)
+{
+    while (len--)
+        *buf++ = (unsigned char)host_random();
+    return 0;
+}
+
+void system_set_os_print(uint8 onoff)
+{
+    os_print = onoff;
+}
+
+uint8 system_get_os_print(void)
+{
+    return os_print;
+}
+
+void system_restart(void)
+{
+    os_printf("system_restart() ignored on the host\n");
+}
+
+bool system_deep_sleep(uint64 time_in_us)
+{
+    (void)time_in_us;
+    return false;
+}
+
+const char *system_get_sdk_version(void)
+{
+    return "host";
+}
+
+uint32 system_get_free_heap_size(void)
+{
+    /* constant, so that heap dependent decisions replay the same */
+    return 40000;
+}
+
+uint32 system_get_chip_id(void)
+{
+    return 0x00c0ffee;
+}
+
+uint16 system_get_vdd33(void)
+{
+    return 3300;
+}
+
+bool system_update_cpu_freq(uint8 freq)
+{
+    cpu_freq = freq;
+    return true;
+}
+
+uint8 system_get_cpu_freq(void)
+{
+    return cpu_freq;
+}
+
+enum flash_size_map system_get_flash_size_map(void)
+{
+    return FLASH_SIZE_32M_MAP_1024_1024;
+}
+
+void system_init_done_cb(init_done_cb_t cb)
+{
+    init_done_cb = cb;
+}
+
+void system_upgrade_flag_set(uint8 flag)
+{
+    upgrade_flag = flag;
+}
+
+uint8 system_upgrade_flag_check(void)
+{
+    return upgrade_flag;
+}
+
+bool system_rtc_mem_read(uint8 src_addr, void *des_addr, uint16 load_size)
+{
+    if (src_addr * 4 + load_size > HOST_RTC_MEM_SIZE)
+        return false;
+    memcpy(des_addr, rtc_mem + src_addr * 4, load_size);
+    return true;
+}
+
+bool system_rtc_mem_write(uint8 des_addr, const void *src_addr, uint16 save_size)
+{
+    if (des_addr * 4 + save_size > HOST_RTC_MEM_SIZE)
+        return false;
+    memcpy(rtc_mem + des_addr * 4, src_addr, save_size);
+    return true;
+}
+
+uint32 user_rf_cal_sector_set(void)
+{
+    return HOST_FLASH_SIZE / SPI_FLASH_SEC_SIZE - 5;
+}
+
+/* Flash, erased on start */
+
+static uint8_t *flash_mem(void)
+{
+    if (flash == NULL)
+    {
+        flash = malloc(HOST_FLASH_SIZE);
+        memset(flash, 0xff, HOST_FLASH_SIZE);
+    }
+    return flash;
+}
+
+SpiFlashOpResult spi_flash_erase_sector(uint16 sec)
+{
+    if ((uint32_t)(sec + 1) * SPI_FLASH_SEC_SIZE > HOST_FLASH_SIZE)
+        return SPI_FLASH_RESULT_ERR;
+    memset(flash_mem() + sec * SPI_FLASH_SEC_SIZE, 0xff, SPI_FLASH_SEC_SIZE);
+    return SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_write(uint32 des_addr, uint32 *src_addr, uint32 size)
+{
+    uint8_t *f = flash_mem();
+    uint32 i;
+
+    if (des_addr + size > HOST_FLASH_SIZE)
+        return SPI_FLASH_RESULT_ERR;
+    /* NOR flash: a write can only clear bits */
+    for (i = 0; i < size; i++)
+        f[des_addr + i] &= ((uint8_t *)src_addr)[i];
+    return SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_read(uint32 src_addr, uint32 *des_addr, uint32 size)
+{
+    if (src_addr + size > HOST_FLASH_SIZE)
+        return SPI_FLASH_RESULT_ERR;
+    memcpy(des_addr, flash_mem() + src_addr, size);
+    return SPI_FLASH_RESULT_OK;
+}
+
+/* Console UART */
+
+void UART_init_console(UartBautRate uart0_br, uint8 recv_task_priority, ringbuf_t rxbuffer, ringbuf_t txBuffer)
+{
+    (void)uart0_br;
+    (void)recv_task_priority;
+    (void)txBuffer;
+    console_rx = rxbuffer;
+}
+
+int UART_Send(uint8 uart_no, char *buffer, int len)
+{
+    (void)uart_no;
+    if (host_console_out != NULL)
+        fwrite(buffer, 1, len, host_console_out);
+    return len;
+}
+
+void host_console(const char *line)
+{
+    if (console_rx == NULL)
+        return;
+    ringbuf_memcpy_into(console_rx, line, strlen(line));
+    ringbuf_memcpy_into(console_rx, "\r", 1);
+    system_os_post(0, SIG_CONSOLE_RX, 0);
+    host_run_tasks();
+}
+
+/* GPIO */
+
+void gpio_init(void)
+{
+}
+
+void gpio_output_set(uint32 set_mask, uint32 clear_mask, uint32 enable_mask, uint32 disable_mask)
+{
+    (void)set_mask;
+    (void)clear_mask;
+    (void)enable_mask;
+    (void)disable_mask;
+}
+
+uint32 gpio_input_get(void)
+{
+    return 0;
+}
+
+void gpio_intr_handler_register(void *fn, void *arg)
+{
+    (void)fn;
+    (void)arg;
+}
+
+void gpio_pin_intr_state_set(uint32 i, GPIO_INT_TYPE intr_state)
+{
+    (void)i;
+    (void)intr_state;
+}
+
+void gpio_register_set(uint32 reg_id, uint32 value)
+{
+    (void)reg_id;
+    (void)value;
+}
+
+/* WiFi */
+
+static err_t host_input(struct pbuf *p, struct netif *inp)
+{
+    if (frame_sink != NULL)
+        frame_sink(inp, false, p);
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+static err_t host_linkoutput(struct netif *outp, struct pbuf *p)
+{
+    if (frame_sink != NULL)
+        frame_sink(outp, true, p);
+#ifndef REPEATER_MODE
+    /* The router hooks hand the frame over (they free the ones they drop and
+       send queued ones without freeing them later), the bridge keeps its
+       reference and frees it after the call */
+    pbuf_free(p);
+#endif
+    return ERR_OK;
+}
+
+void host_init(host_frame_fn sink)
+{
+    static const char names[2][2] = { { 's', 't' }, { 'a', 'p' } };
+    int i;
+
+    frame_sink = sink;
+    netif_list = NULL;
+    for (i = 1; i >= 0; i--)
+    {
+        struct netif *nif = &netifs[i];
+
+        memset(nif, 0, sizeof(*nif));
+        nif->name[0] = names[i][0];
+        nif->name[1] = names[i][1];
+        nif->num = i;
+        nif->mtu = 1500;
+        nif->hwaddr_len = 6;
+        nif->hwaddr[0] = i == HOST_STA ? 0x5c : 0x5e;
+        nif->hwaddr[1] = 0xcf;
+        nif->hwaddr[2] = 0x7f;
+        nif->hwaddr[5] = i;
+        nif->flags = NETIF_FLAG_UP | NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP;
+        nif->input = host_input;
+        nif->linkoutput = host_linkoutput;
+        nif->next = netif_list;
+        netif_list = nif;
+    }
+    netif_default = &netifs[HOST_STA];
+}
+
+struct netif *host_netif(uint8_t num)
+{
+    return num < 2 ? &netifs[num] : NULL;
+}
+
+struct netif *eagle_lwip_getif(uint8 index)
+{
+    return host_netif(index);
+}
+
+void host_boot(void)
+{
+    user_init();
+    if (init_done_cb != NULL)
+        init_done_cb();
+    host_run_tasks();
+}
+
+void wifi_set_event_handler_cb(wifi_event_handler_cb_t cb)
+{
+    wifi_event_cb = cb;
+}
+
+void host_wifi_event(System_Event_t *event)
+{
+    if (wifi_event_cb != NULL)
+        wifi_event_cb(event);
+    host_run_tasks();
+}
+
+void host_sta_got_ip(uint32_t ip, uint32_t mask, uint32_t gw)
+{
+    System_Event_t evt;
+    struct netif *nif = &netifs[HOST_STA];
+
+    memset(&evt, 0, sizeof(evt));
+    evt.event = EVENT_STAMODE_CONNECTED;
+    memcpy(evt.event_info.connected.ssid, sta_config.ssid, sizeof(evt.event_info.connected.ssid));
+    evt.event_info.connected.ssid_len = strnlen((char *)sta_config.ssid, sizeof(sta_config.ssid));
+    memcpy(evt.event_info.connected.bssid, "\x02\x00\x00\x00\x00\x01", 6);
+    evt.event_info.connected.channel = 1;
+    host_wifi_event(&evt);
+
+    nif->ip_addr.addr = ip;
+    nif->netmask.addr = mask;
+    nif->gw.addr = gw;
+
+    memset(&evt, 0, sizeof(evt));
+    evt.event = EVENT_STAMODE_GOT_IP;
+    evt.event_info.got_ip.ip.addr = ip;
+    evt.event_info.got_ip.mask.addr = mask;
+    evt.event_info.got_ip.gw.addr = gw;
+    host_wifi_event(&evt);
+}
+
+void host_ap_sta_join(const uint8_t *mac, uint32_t ip)
+{
+    System_Event_t evt;
+
+    if (station_num < HOST_MAX_STATIONS)
+    {
+        memcpy(stations[station_num].bssid, mac, 6);
+        stations[station_num].ip.addr = ip;
+        station_num++;
+    }
+
+    memset(&evt, 0, sizeof(evt));
+    evt.event = EVENT_SOFTAPMODE_STACONNECTED;
+    memcpy(evt.event_info.sta_connected.mac, mac, 6);
+    evt.event_info.sta_connected.aid = station_num;
+    host_wifi_event(&evt);
+}
+
+bool wifi_set_opmode(uint8 mode)
+{
+    opmode = mode;
+    return true;
+}
+
+uint8 wifi_get_opmode(void)
+{
+    return opmode;
+}
+
+bool wifi_set_broadcast_if(uint8 interface)
+{
+    (void)interface;
+    return true;
+}
+
+bool wifi_get_macaddr(uint8 if_index, uint8 *macaddr)
+{
+    if (if_index > SOFTAP_IF)
+        return false;
+    memcpy(macaddr, netifs[if_index].hwaddr, 6);
+    return true;
+}
+
+bool wifi_set_macaddr(uint8 if_index, uint8 *macaddr)
+{
+    if (if_index > SOFTAP_IF)
+        return false;
+    memcpy(netifs[if_index].hwaddr, macaddr, 6);
+    return true;
+}
+
+bool wifi_get_ip_info(uint8 if_index, struct ip_info *info)
+{
+    if (if_index > SOFTAP_IF)
+        return false;
+    info->ip = netifs[if_index].ip_addr;
+    info->netmask = netifs[if_index].netmask;
+    info->gw = netifs[if_index].gw;
+    return true;
+}
+
+bool wifi_set_ip_info(uint8 if_index, struct ip_info *info)
+{
+    if (if_index > SOFTAP_IF)
+        return false;
+    netifs[if_index].ip_addr = info->ip;
+    netifs[if_index].netmask = info->netmask;
+    netifs[if_index].gw = info->gw;
+    return true;
+}
+
+enum phy_mode wifi_get_phy_mode(void)
+{
+    return phy_mode;
+}
+
+bool wifi_set_phy_mode(enum phy_mode mode)
+{
+    phy_mode = mode;
+    return true;
+}
+
+bool wifi_set_sleep_type(enum sleep_type type)
+{
+    (void)type;
+    return true;
+}
+
+bool wifi_station_set_config(struct station_config *config)
+{
+    sta_config = *config;
+    return true;
+}
+
+bool wifi_station_get_config(struct station_config *config)
+{
+    *config = sta_config;
+    return true;
+}
+
+bool wifi_station_connect(void)
+{
+    return true;
+}
+
+bool wifi_station_disconnect(void)
+{
+    return true;
+}
+
+sint8 wifi_station_get_rssi(void)
+{
+    return -50;
+}
+
+bool wifi_station_scan(struct scan_config *config, scan_done_cb_t cb)
+{
+    (void)config;
+    (void)cb;
+    return true;
+}
+
+bool wifi_station_set_auto_connect(uint8 set)
+{
+    (void)set;
+    return true;
+}
+
+bool wifi_station_dhcpc_stop(void)
+{
+    return true;
+}
+
+bool wifi_station_set_hostname(char *name)
+{
+    (void)name;
+    return true;
+}
+
+bool wifi_softap_get_config(struct softap_config *config)
+{
+    *config = ap_config;
+    return true;
+}
+
+bool wifi_softap_set_config(struct softap_config *config)
+{
+    ap_config = *config;
+    return true;
+}
+
+uint8 wifi_softap_get_station_num(void)
+{
+    return station_num;
+}
+
+struct station_info *wifi_softap_get_station_info(void)
+{
+    struct station_info *list = NULL;
+    int i;
+
+    for (i = station_num - 1; i >= 0; i--)
+    {
+        struct station_info *s = os_zalloc(sizeof(*s));
+
+        memcpy(s->bssid, stations[i].bssid, 6);
+        s->ip = stations[i].ip;
+        s->next.stqe_next = list;
+        list = s;
+    }
+    return list;
+}
+
+void wifi_softap_free_station_info(void)
+{
+    /* the firmware walks the list to its end, so it cannot be handed back;
+       the few bytes per call are not worth tracking here */
+}
+
+bool wifi_softap_dhcps_start(void)
+{
+    return true;
+}
+
+bool wifi_softap_dhcps_stop(void)
+{
+    return true;
+}
+
+bool wifi_softap_set_dhcps_lease(struct dhcps_lease *please)
+{
+    (void)please;
+    return true;
+}
+
+bool wifi_softap_set_dhcps_lease_time(uint32 minute)
+{
+    (void)minute;
+    return true;
+}
+
+int wifi_station_set_wpa2_enterprise_auth(int enable)
+{
+    (void)enable;
+    return 0;
+}
+
+int wifi_station_set_enterprise_identity(unsigned char *identity, int len)
+{
+    (void)identity;
+    (void)len;
+    return 0;
+}
+
+int wifi_station_set_enterprise_username(unsigned char *username, int len)
+{
+    (void)username;
+    (void)len;
+    return 0;
+}
+
+int wifi_station_set_enterprise_password(unsigned char *password, int len)
+{
+    (void)password;
+    (void)len;
+    return 0;
+}
+
+void dhcps_set_DNS(struct ip_addr *dns_ip)
+{
+    (void)dns_ip;
+}
+
+struct dhcps_pool *dhcps_get_mapping(uint16_t no)
+{
+    (void)no;
+    return NULL;
+}
+
+void dhcps_set_mapping(struct ip_addr *addr, uint8 *mac, uint32 lease_time)
+{
+    (void)addr;
+    (void)mac;
+    (void)lease_time;
+}
+
+/* espconn, ping, SNTP, mDNS: accepted, never completed */
+
+static struct espconn *servers[HOST_MAX_SERVERS];
+
+sint8 espconn_connect(struct espconn *espconn)
+{
+    (void)espconn;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_disconnect(struct espconn *espconn)
+{
+    (void)espconn;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_delete(struct espconn *espconn)
+{
+    int i;
+
+    for (i = 0; i < HOST_MAX_SERVERS; i++)
+    {
+        if (servers[i] == espconn)
+            servers[i] = NULL;
+    }
+    return ESPCONN_OK;
+}
+
+sint8 espconn_accept(struct espconn *espconn)
+{
+    int i;
+
+    for (i = 0; i < HOST_MAX_SERVERS; i++)
+    {
+        if (servers[i] == NULL)
+        {
+            servers[i] = espconn;
+            return ESPCONN_OK;
+        }
+    }
+    return ESPCONN_MEM;
+}
+
+bool host_tcp_connect(uint16_t port, uint32_t ip, uint16_t remote_port)
+{
+    struct espconn *conn;
+    int i;
+
+    for (i = 0; i < HOST_MAX_SERVERS; i++)
+    {
+        if (servers[i] != NULL && servers[i]->proto.tcp->local_port == port)
+            break;
+    }
+    if (i == HOST_MAX_SERVERS || servers[i]->proto.tcp->connect_callback == NULL)
+        return false;
+
+    // the SDK frees it after the disconnect, the few of a test are kept
+    conn = calloc(1, sizeof(struct espconn));
+    conn->type = ESPCONN_TCP;
+    conn->state = ESPCONN_CONNECT;
+    conn->proto.tcp = calloc(1, sizeof(esp_tcp));
+    conn->proto.tcp->local_port = port;
+    conn->proto.tcp->remote_port = remote_port;
+    memcpy(conn->proto.tcp->remote_ip, &ip, 4);
+    memcpy(conn->proto.tcp->local_ip, &host_netif(HOST_STA)->ip_addr, 4);
+    servers[i]->proto.tcp->connect_callback(conn);
+    host_run_tasks();
+    return true;
+}
+
+sint8 espconn_abort(struct espconn *espconn)
+{
+    (void)espconn;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_regist_time(struct espconn *espconn, uint32 interval, uint8 type_flag)
+{
+    (void)espconn;
+    (void)interval;
+    (void)type_flag;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_regist_sentcb(struct espconn *espconn, espconn_sent_callback sent_cb)
+{
+    espconn->sent_callback = sent_cb;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_regist_recvcb(struct espconn *espconn, espconn_recv_callback recv_cb)
+{
+    espconn->recv_callback = recv_cb;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_regist_connectcb(struct espconn *espconn, espconn_connect_callback connect_cb)
+{
+    if (espconn->type == ESPCONN_TCP && espconn->proto.tcp != NULL)
+        espconn->proto.tcp->connect_callback = connect_cb;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_regist_reconcb(struct espconn *espconn, espconn_reconnect_callback recon_cb)
+{
+    if (espconn->type == ESPCONN_TCP && espconn->proto.tcp != NULL)
+        espconn->proto.tcp->reconnect_callback = recon_cb;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_regist_disconcb(struct espconn *espconn, espconn_connect_callback discon_cb)
+{
+    if (espconn->type == ESPCONN_TCP && espconn->proto.tcp != NULL)
+        espconn->proto.tcp->disconnect_callback = discon_cb;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_send(struct espconn *espconn, uint8 *psent, uint16 length)
+{
+    (void)espconn;
+    (void)psent;
+    (void)length;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_sent(struct espconn *espconn, uint8 *psent, uint16 length)
+{
+    return espconn_send(espconn, psent, length);
+}
+
+sint8 espconn_secure_connect(struct espconn *espconn)
+{
+    (void)espconn;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_secure_disconnect(struct espconn *espconn)
+{
+    (void)espconn;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_secure_send(struct espconn *espconn, uint8 *psent, uint16 length)
+{
+    return espconn_send(espconn, psent, length);
+}
+
+bool espconn_secure_set_size(uint8 level, uint16 size)
+{
+    (void)level;
+    (void)size;
+    return true;
+}
+
+uint32 espconn_port(void)
+{
+    static uint32 port = 49152;
+
+    return port++;
+}
+
+err_t espconn_gethostbyname(struct espconn *pespconn, const char *hostname, ip_addr_t *addr, dns_found_callback found)
+{
+    (void)pespconn;
+    (void)hostname;
+    (void)addr;
+    (void)found;
+    return ESPCONN_ARG;
+}
+
+void espconn_dns_setserver(u8_t numdns, ip_addr_t *dnsserver)
+{
+    (void)numdns;
+    (void)dnsserver;
+}
+
+void espconn_mdns_init(struct mdns_info *info)
+{
+    (void)info;
+}
+
+void espconn_mdns_close(void)
+{
+}
+
+bool ping_start(struct ping_option *ping_opt)
+{
+    (void)ping_opt;
+    return false;
+}
+
+bool ping_regist_recv(struct ping_option *ping_opt, ping_recv_function ping_recv)
+{
+    ping_opt->recv_function = ping_recv;
+    return true;
+}
+
+bool ping_regist_sent(struct ping_option *ping_opt, ping_sent_function ping_sent)
+{
+    ping_opt->sent_function = ping_sent;
+    return true;
+}
+
+uint32 sntp_get_current_timestamp(void)
+{
+    return 0;
+}
+
+char *sntp_get_real_time(long t)
+{
+    (void)t;
+    return "";
+}
+
+void sntp_init(void)
+{
+}
+
+void sntp_setservername(unsigned char idx, char *server)
+{
+    (void)idx;
+    (void)server;
+}
+
+bool sntp_set_timezone(sint8 timezone)
+{
+    (void)timezone;
+    return true;
+}
@@ -11,7 +11,11 @@
 #include "user_interface.h"
 #include "string.h"
 
+#include "user_config.h"
 #include "acl.h"
+#include "perf.h"
+#include "flow_cache.h"
+#include "conntrack.h"
 
 acl_entry acl[MAX_NO_ACLS][MAX_ACL_ENTRIES];
 uint8_t acl_freep[MAX_NO_ACLS];
@@ -19,6 +23,53 @@ uint32_t acl_allow_count;
 uint32_t acl_deny_count;
 static packet_deny_cb my_deny_cb;
 
+/*
+ * Compiled form of an ACL. Each rule is represented by one bit in a
+ * rule mask, bit i standing for acl[acl_no][i]. For every packet field
+ * the set of rules that accept the field value is looked up, the sets
+ * are ANDed together and the lowest remaining bit is the first match.
+ */
+#if MAX_ACL_ENTRIES > 16
+#error "acl_rulemask too small for MAX_ACL_ENTRIES"
+#endif
+typedef uint16_t acl_rulemask;
+
+#define ACL_PORT_HASH_SIZE 32	/* power of 2, at least 2*MAX_ACL_ENTRIES */
+#define ACL_PORT_HASH(port) (((port) ^ ((port) >> 5)) & (ACL_PORT_HASH_SIZE-1))
+
+#define ACL_BUCKET_TCP	0
+#define ACL_BUCKET_UDP	1
+#define ACL_BUCKET_ICMP	2
+#define ACL_BUCKETS	3
+
+typedef struct _acl_port_slot {
+uint16_t	port;	/* 0 = empty slot */
+acl_rulemask	rules;
+} acl_port_slot;
+
+typedef struct _acl_prefix {
+uint32_t	addr;
+uint32_t	mask;
+acl_rulemask	rules;
+} acl_prefix;
+
+typedef struct _acl_compiled {
+acl_rulemask	proto_rules[ACL_BUCKETS];
+acl_rulemask	s_port_any;
+acl_rulemask	d_port_any;
+acl_rulemask	src_any;
+acl_rulemask	dest_any;
+acl_port_slot	s_port_hash[ACL_PORT_HASH_SIZE];
+acl_port_slot	d_port_hash[ACL_PORT_HASH_SIZE];
+uint8_t		no_src;
+uint8_t		no_dest;
+acl_prefix	src[MAX_ACL_ENTRIES];	/* longest prefix first */
+acl_prefix	dest[MAX_ACL_ENTRIES];
+} acl_compiled;
+
+static acl_compiled *acl_comp[MAX_NO_ACLS];
+static int8_t acl_est[MAX_NO_ACLS];	/* index of the "established" rule, -1 if none */
+
 void ICACHE_FLASH_ATTR acl_init()
 {
 int i;
@@ -27,6 +78,7 @@ int i;
     for(i=0; i< MAX_NO_ACLS; i++) {
 	acl_freep[i] = 0;
 	acl_clear_stats(i);
+	acl_compile(i);
     }
 }
 
@@ -43,6 +95,7 @@ void ICACHE_FLASH_ATTR acl_clear(uint8_t acl_no)
 	return;
     acl_freep[acl_no] = 0;
     acl_clear_stats(acl_no);
+    acl_compile(acl_no);
 }
 
 void ICACHE_FLASH_ATTR acl_clear_stats(uint8_t acl_no)
@@ -77,68 +130,236 @@ acl_entry *my_entry;
     my_entry->hit_count = 0;
 
     acl_freep[acl_no]++;
+    acl_compile(acl_no);
     return true;
 }
 
+static void ICACHE_FLASH_ATTR acl_port_insert(acl_port_slot *hash, uint16_t port, uint8_t rule)
+{
+uint8_t i;
+
+    for (i = ACL_PORT_HASH(port); hash[i].port != 0 && hash[i].port != port; i = (i+1) & (ACL_PORT_HASH_SIZE-1));
+    hash[i].port = port;
+    hash[i].rules |= 1 << rule;
+}
 
-uint8_t ICACHE_FLASH_ATTR acl_check_packet(uint8_t acl_no, struct pbuf *p)
+static inline acl_rulemask acl_port_lookup(acl_port_slot *hash, uint16_t port)
+{
+uint8_t i;
+
+    for (i = ACL_PORT_HASH(port); hash[i].port != 0; i = (i+1) & (ACL_PORT_HASH_SIZE-1)) {
+	if (hash[i].port == port)
+	    return hash[i].rules;
+    }
+    return 0;
+}
+
+static uint8_t ICACHE_FLASH_ATTR acl_prefix_insert(acl_prefix *prefixes, uint8_t no_prefixes,
+	uint32_t addr, uint32_t mask, uint8_t rule)
+{
+uint8_t i, j;
+
+    for (i = 0; i < no_prefixes; i++) {
+	if (prefixes[i].addr == addr && prefixes[i].mask == mask) {
+	    prefixes[i].rules |= 1 << rule;
+	    return no_prefixes;
+	}
+	// keep the list ordered by prefix length, longest first
+	if (ntohl(mask) > ntohl(prefixes[i].mask))
+	    break;
+    }
+    for (j = no_prefixes; j > i; j--)
+	prefixes[j] = prefixes[j-1];
+    prefixes[i].addr = addr;
+    prefixes[i].mask = mask;
+    prefixes[i].rules = 1 << rule;
+    return no_prefixes + 1;
+}
+
+static inline acl_rulemask acl_prefix_lookup(acl_prefix *prefixes, uint8_t no_prefixes,
+	acl_rulemask any, acl_rulemask candidates, uint32_t addr)
+{
+uint8_t i;
+
+    for (i = 0; i < no_prefixes; i++) {
+	if ((prefixes[i].rules & candidates) && (addr & prefixes[i].mask) == prefixes[i].addr)
+	    any |= prefixes[i].rules;
+    }
+    return any;
+}
+
+void ICACHE_FLASH_ATTR acl_compile(uint8_t acl_no)
+{
+acl_compiled *c;
+acl_entry *my_entry;
+uint8_t i;
+
+    if (acl_no >= MAX_NO_ACLS)
+	return;
+
+#if FLOW_CACHE_SIZE
+    // cached verdicts may be outdated now
+    flow_cache_invalidate();
+#endif
+
+    // The "established" rule is not part of the rule masks, it is
+    // checked before all others
+    acl_est[acl_no] = -1;
+    for (i = 0; i < acl_freep[acl_no]; i++) {
+	if (acl[acl_no][i].allow & ACL_ESTABLISHED) {
+	    acl_est[acl_no] = i;
+	    break;
+	}
+    }
+#if CONNTRACK_SIZE
+    if (acl_est[acl_no] < 0 && (acl_no == ACL_TO_STA || acl_no == ACL_FROM_AP))
+	conntrack_flush(acl_no == ACL_TO_STA ? CT_SIDE_AP : CT_SIDE_STA);
+#endif
+
+    if (acl_freep[acl_no] == 0) {
+	if (acl_comp[acl_no] != NULL) {
+	    os_free(acl_comp[acl_no]);
+	    acl_comp[acl_no] = NULL;
+	}
+	return;
+    }
+
+    if (acl_comp[acl_no] == NULL) {
+	// if this fails acl_check_packet() falls back to the linear scan
+	acl_comp[acl_no] = (acl_compiled *)os_zalloc(sizeof(acl_compiled));
+	if (acl_comp[acl_no] == NULL)
+	    return;
+    } else {
+	os_memset(acl_comp[acl_no], 0, sizeof(acl_compiled));
+    }
+    c = acl_comp[acl_no];
+
+    for (i = 0; i < acl_freep[acl_no]; i++) {
+	my_entry = &acl[acl_no][i];
+	if (my_entry->allow & ACL_ESTABLISHED)
+	    continue;
+
+	if (my_entry->proto == 0 || my_entry->proto == IP_PROTO_TCP)
+	    c->proto_rules[ACL_BUCKET_TCP] |= 1 << i;
+	if (my_entry->proto == 0 || my_entry->proto == IP_PROTO_UDP)
+	    c->proto_rules[ACL_BUCKET_UDP] |= 1 << i;
+	if (my_entry->proto == 0 || my_entry->proto == IP_PROTO_ICMP)
+	    c->proto_rules[ACL_BUCKET_ICMP] |= 1 << i;
+
+	if (my_entry->s_port == 0)
+	    c->s_port_any |= 1 << i;
+	else
+	    acl_port_insert(c->s_port_hash, my_entry->s_port, i);
+	if (my_entry->d_port == 0)
+	    c->d_port_any |= 1 << i;
+	else
+	    acl_port_insert(c->d_port_hash, my_entry->d_port, i);
+
+	if (my_entry->src == 0)
+	    c->src_any |= 1 << i;
+	else
+	    c->no_src = acl_prefix_insert(c->src, c->no_src, my_entry->src, my_entry->s_mask, i);
+	if (my_entry->dest == 0)
+	    c->dest_any |= 1 << i;
+	else
+	    c->no_dest = acl_prefix_insert(c->dest, c->no_dest, my_entry->dest, my_entry->d_mask, i);
+    }
+}
+
+int ICACHE_FLASH_ATTR acl_match_compiled(uint8_t acl_no, uint8_t proto,
+	uint32_t saddr, uint16_t src_port, uint32_t daddr, uint16_t dest_port)
+{
+acl_compiled *c = acl_comp[acl_no];
+acl_rulemask candidates;
+
+    switch (proto) {
+    case IP_PROTO_TCP: candidates = c->proto_rules[ACL_BUCKET_TCP]; break;
+    case IP_PROTO_UDP: candidates = c->proto_rules[ACL_BUCKET_UDP]; break;
+    default: candidates = c->proto_rules[ACL_BUCKET_ICMP]; break;
+    }
+
+    if (candidates)
+	candidates &= c->d_port_any | acl_port_lookup(c->d_port_hash, dest_port);
+    if (candidates)
+	candidates &= c->s_port_any | acl_port_lookup(c->s_port_hash, src_port);
+    if (candidates)
+	candidates &= acl_prefix_lookup(c->dest, c->no_dest, c->dest_any, candidates, daddr);
+    if (candidates)
+	candidates &= acl_prefix_lookup(c->src, c->no_src, c->src_any, candidates, saddr);
+
+    if (candidates == 0)
+	return -1;
+    return __builtin_ctz(candidates);
+}
+
+int ICACHE_FLASH_ATTR acl_match_linear(uint8_t acl_no, uint8_t proto,
+	uint32_t saddr, uint16_t src_port, uint32_t daddr, uint16_t dest_port)
 {
-struct eth_hdr *mac_h;
-struct ip_hdr *ip_h;
-uint8_t proto;
-struct udp_hdr *udp_h;
-struct tcp_hdr *tcp_h;
-uint16_t src_port, dest_port;
-uint8_t *packet;
 int i;
 acl_entry *my_entry;
+
+    for(i=0; i<acl_freep[acl_no]; i++) {
+	my_entry = &acl[acl_no][i];
+	if (!(my_entry->allow & ACL_ESTABLISHED) &&
+	    (my_entry->proto == 0  || proto == my_entry->proto) &&
+	    (my_entry->src == 0    || my_entry->src == (saddr&my_entry->s_mask)) &&
+	    (my_entry->dest == 0   || my_entry->dest == (daddr&my_entry->d_mask)) &&
+	    (my_entry->s_port == 0 || my_entry->s_port == src_port) &&
+	    (my_entry->d_port == 0 || my_entry->d_port == dest_port)) {
+		return i;
+	}
+    }
+    return -1;
+}
+
+
+static uint8_t ICACHE_FLASH_ATTR acl_check(uint8_t acl_no, pkt_info *pi, int8_t *rule)
+{
+uint16_t src_port, dest_port;
+int i;
 uint8_t allow;
 
+    *rule = -1;
+
     if (acl_no >= MAX_NO_ACLS)
 	return ACL_DENY;
 
-    if (p->len < sizeof(struct eth_hdr))
+    if (pi->eth_type == 0)
 	return ACL_DENY;
 
-    mac_h = (struct eth_hdr *)p->payload;
-
     // Allow ARP
-    if (ntohs(mac_h->type) == ETHTYPE_ARP) {
+    if (pi->eth_type == ETHTYPE_ARP) {
 	acl_allow_count++;
 	return ACL_ALLOW;
     }
 
     // Drop anything else if not IPv4
-    if (ntohs(mac_h->type) != ETHTYPE_IP) {
+    if (pi->eth_type != ETHTYPE_IP || !(pi->flags & PKT_F_IP)) {
 	acl_deny_count++;
 	return ACL_DENY;
     }
-   
-    if (p->len < sizeof(struct eth_hdr)+sizeof(struct ip_hdr)) {
-	acl_deny_count++;
-	return ACL_DENY;
+
+#if CONNTRACK_SIZE
+    // Replies to known connections skip the rules
+    if (acl_est[acl_no] >= 0 &&
+	conntrack_established(acl_no == ACL_TO_STA ? CT_SIDE_AP : CT_SIDE_STA, pi)) {
+	*rule = acl_est[acl_no];
+	acl[acl_no][*rule].hit_count++;
+	acl_allow_count++;
+	return acl[acl_no][*rule].allow;
     }
+#endif
 
     allow = ACL_DENY;
-    packet = (uint8_t*)p->payload;
-    ip_h = (struct ip_hdr *)&packet[sizeof(struct eth_hdr)];
-    proto = IPH_PROTO(ip_h);
 
-    switch (proto) {
+    switch (pi->proto) {
     case IP_PROTO_UDP:
-	if (p->len < sizeof(struct eth_hdr)+sizeof(struct ip_hdr)+sizeof(struct udp_hdr))
-	    return ACL_DENY;
-	udp_h = (struct udp_hdr *)&packet[sizeof(struct eth_hdr)+sizeof(struct ip_hdr)];
-	src_port = ntohs(udp_h->src);
-	dest_port = ntohs(udp_h->dest);
-	break;
-
     case IP_PROTO_TCP:
-	if (p->len < sizeof(struct eth_hdr)+sizeof(struct ip_hdr)+sizeof(struct tcp_hdr))
+	// Truncated header: drop, unless it is a later fragment without one
+	if (!(pi->flags & (PKT_F_PORTS | PKT_F_FRAG)))
 	    return ACL_DENY;
-	tcp_h = (struct tcp_hdr *)&packet[sizeof(struct eth_hdr)+sizeof(struct ip_hdr)];
-	src_port = ntohs(tcp_h->src);
-	dest_port = ntohs(tcp_h->dest);
+	src_port = pi->s_port;
+	dest_port = pi->d_port;
 	break;
 
     case IP_PROTO_ICMP:
@@ -152,35 +373,69 @@ uint8_t allow;
     }
 
 //    os_printf("Src: %d.%d.%d.%d Dst: %d.%d.%d.%d Proto: %s SP:%d DP:%d\n", 
-//		IP2STR(&ip_h->src), IP2STR(&ip_h->dest), 
-//		proto==IP_PROTO_TCP?"TCP":proto==IP_PROTO_UDP?"UDP":"IP4", src_port, dest_port);
+//		IP2STR((ip_addr_t *)&pi->src), IP2STR((ip_addr_t *)&pi->dest), 
+//		pi->proto==IP_PROTO_TCP?"TCP":pi->proto==IP_PROTO_UDP?"UDP":"IP4", src_port, dest_port);
 
-    for(i=0; i<acl_freep[acl_no]; i++) {
-	my_entry = &acl[acl_no][i];
-	if ((my_entry->proto == 0  || proto == my_entry->proto) &&
-	    (my_entry->src == 0    || my_entry->src == (ip_h->src.addr&my_entry->s_mask)) &&
-	    (my_entry->dest == 0   || my_entry->dest == (ip_h->dest.addr&my_entry->d_mask)) &&
-	    (my_entry->s_port == 0 || my_entry->s_port == src_port) &&
-	    (my_entry->d_port == 0 || my_entry->d_port == dest_port)) {
-		allow = my_entry->allow;
-		my_entry->hit_count++;
-		goto done;
-	}
+    if (acl_comp[acl_no] != NULL)
+	i = acl_match_compiled(acl_no, pi->proto, pi->src, src_port, pi->dest, dest_port);
+    else
+	i = acl_match_linear(acl_no, pi->proto, pi->src, src_port, pi->dest, dest_port);
+
+    if (i >= 0) {
+	allow = acl[acl_no][i].allow;
+	acl[acl_no][i].hit_count++;
+	*rule = i;
     }
 
-done:
     if (!(allow & ACL_ALLOW) && my_deny_cb != NULL)
-	allow = my_deny_cb(proto, ip_h->src.addr, src_port, ip_h->dest.addr, dest_port, allow);
+	allow = my_deny_cb(pi->proto, pi->src, src_port, pi->dest, dest_port, allow);
     if (allow & ACL_ALLOW) acl_allow_count++; else acl_deny_count++;
 //    os_printf(" allow: %d\r\n",  allow);
     return allow;
 }
 
+uint8_t ICACHE_FLASH_ATTR acl_check_packet_rule(uint8_t acl_no, pkt_info *pi, int8_t *rule)
+{
+#if PERF_STATS
+uint8_t allow;
+
+    PERF_START(t);
+    allow = acl_check(acl_no, pi, rule);
+    PERF_END_V(PERF_ACL, t, (allow & ACL_ALLOW) ? PERF_PASS : PERF_DROP);
+    return allow;
+#else
+    return acl_check(acl_no, pi, rule);
+#endif
+}
+
+uint8_t ICACHE_FLASH_ATTR acl_check_packet(uint8_t acl_no, pkt_info *pi)
+{
+int8_t rule;
+
+    return acl_check_packet_rule(acl_no, pi, &rule);
+}
+
+void ICACHE_FLASH_ATTR acl_count_cached(uint8_t acl_no, int8_t rule, uint8_t allow)
+{
+    if (acl_no >= MAX_NO_ACLS)
+	return;
+    if (rule >= 0 && rule < acl_freep[acl_no])
+	acl[acl_no][rule].hit_count++;
+    if (allow & ACL_ALLOW) acl_allow_count++; else acl_deny_count++;
+}
+
 void acl_set_deny_cb(packet_deny_cb cb)
 {
     my_deny_cb = cb;
 }
 
+bool ICACHE_FLASH_ATTR acl_established(uint8_t acl_no)
+{
+    if (acl_no >= MAX_NO_ACLS)
+	return false;
+    return acl_est[acl_no] >= 0;
+}
+
 void ICACHE_FLASH_ATTR addr2str(uint8_t *buf, uint32_t addr, uint32_t mask)
 {
 uint8_t clidr;
@@ -223,7 +478,9 @@ uint8_t line[80], addr1[21], addr2[21], port1[6], port2[6];
 	port2str(port1, my_entry->s_port);
 	addr2str(addr2, my_entry->dest, my_entry->d_mask);
 	port2str(port2, my_entry->d_port);
-	if (my_entry->proto != 0)
+	if (my_entry->allow & ACL_ESTABLISHED)
+	    os_sprintf(line, "established (%d hits)\r\n", my_entry->hit_count);
+	else if (my_entry->proto != 0)
 	    os_sprintf(line, "%s %s:%s %s:%s %s%s (%d hits)\r\n",
 		my_entry->proto==IP_PROTO_TCP?"TCP":"UDP", 
 		addr1, port1, addr2, port2,
@@ -3,6 +3,7 @@
 
 #include "lwip/ip.h"
 #include "lwip/pbuf.h"
+#include "pkt_info.h"
 
 #define MAX_NO_ACLS 4
 #define MAX_ACL_ENTRIES 16
@@ -10,6 +11,12 @@
 #define ACL_DENY     0x0
 #define ACL_ALLOW    0x1
 #define ACL_MONITOR  0x2
+#define ACL_ESTABLISHED 0x4	/* allows replies to tracked connections */
+
+/* The ACLs with an "established" rule, the replies to connections learned
+   on the other hook of the same interface */
+#define ACL_TO_STA   1
+#define ACL_FROM_AP  2
 
 typedef struct _acl_entry {
 uint32_t	src;
@@ -37,8 +44,22 @@ void acl_clear_stats(uint8_t acl_no);
 bool acl_add(uint8_t acl_no, 
 	uint32_t src, uint32_t s_mask, uint32_t dest, uint32_t d_mask, 
 	uint8_t proto, uint16_t s_port, uint16_t d_port, uint8_t allow);
-uint8_t acl_check_packet(uint8_t acl_no, struct pbuf *p);
+void acl_compile(uint8_t acl_no);
+uint8_t acl_check_packet(uint8_t acl_no, pkt_info *pi);
+/* Same, but also returns the index of the matching rule (-1 if none) */
+uint8_t acl_check_packet_rule(uint8_t acl_no, pkt_info *pi, int8_t *rule);
+/* Updates the statistics for a packet whose verdict is already known */
+void acl_count_cached(uint8_t acl_no, int8_t rule, uint8_t allow);
 void acl_set_deny_cb(packet_deny_cb cb);
+/* The two rule matchers behind acl_check_packet(), exported for the host
+   tests: the index of the first rule that matches or -1. The "established"
+   rule is skipped, acl_match_compiled() needs a compiled ACL (not empty). */
+int acl_match_linear(uint8_t acl_no, uint8_t proto,
+	uint32_t saddr, uint16_t src_port, uint32_t daddr, uint16_t dest_port);
+int acl_match_compiled(uint8_t acl_no, uint8_t proto,
+	uint32_t saddr, uint16_t src_port, uint32_t daddr, uint16_t dest_port);
+/* True if the ACL contains an "established" rule */
+bool acl_established(uint8_t acl_no);
 
 void addr2str(uint8_t *buf, uint32_t addr, uint32_t mask);
 void acl_show(uint8_t acl_no, uint8_t *buf);
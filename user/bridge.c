@@ -13,6 +13,9 @@
 #include "sys_time.h"
 #include "config_flash.h"
 #include "easygpio.h"
+#include "pkt_info.h"
+#include "perf.h"
+#include "csum.h"
 
 extern sysconfig_t config;
 
@@ -34,6 +37,7 @@ static netif_output_fn      s_orig_output_sta;
 static netif_output_fn      s_orig_output_ap;
 static netif_linkoutput_fn  s_orig_lo_sta;
 static netif_linkoutput_fn  s_orig_lo_ap;
+static bool                 s_unconfigured;     /* still the default ssid: no bridging */
 
 /* -------------------------------------------------------------------------
  * Compact packed header types
@@ -41,6 +45,7 @@ static netif_linkoutput_fn  s_orig_lo_ap;
 
 #define ETHTYPE_IP  0x0800
 #define ETHTYPE_ARP 0x0806
+#define IP_PROTO_IGMP 2
 
 typedef struct {
     uint8_t  dst[6];
@@ -115,12 +120,32 @@ static uint32_t ICACHE_FLASH_ATTR now_secs(void)
     return (uint32_t)(get_long_systime() / 1000000ULL);
 }
 
+/* Coarse clock for the tables below, advanced by bridge_tick() once a
+   second, so the per-packet paths never read the system time. */
+static uint32_t s_now_s;
+
 /* -------------------------------------------------------------------------
  * Forwarding Database (FDB)
+ *
+ * Open-addressed hash table with linear probing, keyed by IP. Expired
+ * entries are still found by the probe but ignored; bridge_tick() removes
+ * them with backward-shift deletion, so no tombstones are needed.
  * ------------------------------------------------------------------------- */
 
-#define FDB_SIZE   16
-#define FDB_TTL_S 600
+#if BRIDGE_FDB_SIZE == 64
+#define FDB_HASH_BITS  6
+#elif BRIDGE_FDB_SIZE == 128
+#define FDB_HASH_BITS  7
+#elif BRIDGE_FDB_SIZE == 256
+#define FDB_HASH_BITS  8
+#else
+#error "BRIDGE_FDB_SIZE must be 64, 128 or 256"
+#endif
+
+#define FDB_SIZE      BRIDGE_FDB_SIZE
+#define FDB_MASK      (FDB_SIZE - 1)
+#define FDB_MAX_FILL  (FDB_SIZE * 3 / 4)
+#define FDB_TTL_S     600
 
 typedef struct {
     uint32_t ip;
@@ -129,38 +154,168 @@ typedef struct {
 } fdb_entry_t;
 
 static fdb_entry_t s_fdb[FDB_SIZE];
+static uint16_t s_fdb_count;
+
+static inline uint16_t ICACHE_FLASH_ATTR fdb_hash_ip(uint32_t ip)
+{
+    return (uint16_t)((uint32_t)(ip * 2654435761U) >> (32 - FDB_HASH_BITS));
+}
+
+/* Is the home slot k outside of the cyclic range (i, j]? Then the entry
+   at j may be moved back into the hole at i. */
+static inline bool ICACHE_FLASH_ATTR fdb_may_shift(uint16_t i, uint16_t j, uint16_t k)
+{
+    return (i <= j) ? (k <= i || k > j) : (k <= i && k > j);
+}
+
+#if BRIDGE_FDB_MAC_INDEX
+/* Reverse index MAC -> IP, same scheme. Holds the latest IP per MAC. */
+typedef struct {
+    uint8_t  mac[6];
+    uint32_t ip;
+} fdb_mac_entry_t;
+
+static fdb_mac_entry_t s_fdb_mac[FDB_SIZE];
+
+static inline uint16_t ICACHE_FLASH_ATTR fdb_hash_mac(const uint8_t *mac)
+{
+    uint32_t h = ((uint32_t)mac[2] << 24 | (uint32_t)mac[3] << 16 | (uint32_t)mac[4] << 8 | mac[5]) ^
+                 ((uint32_t)mac[0] << 8 | mac[1]);
+    return (uint16_t)((uint32_t)(h * 2654435761U) >> (32 - FDB_HASH_BITS));
+}
+
+static int ICACHE_FLASH_ATTR fdb_mac_find(const uint8_t *mac)
+{
+    uint16_t i = fdb_hash_mac(mac);
+    for (; s_fdb_mac[i].ip != 0; i = (i + 1) & FDB_MASK)
+        if (os_memcmp(s_fdb_mac[i].mac, mac, 6) == 0) return i;
+    return -1;
+}
+
+static void ICACHE_FLASH_ATTR fdb_mac_set(const uint8_t *mac, uint32_t ip)
+{
+    uint16_t i = fdb_hash_mac(mac);
+    for (; s_fdb_mac[i].ip != 0; i = (i + 1) & FDB_MASK)
+        if (os_memcmp(s_fdb_mac[i].mac, mac, 6) == 0) break;
+    os_memcpy(s_fdb_mac[i].mac, mac, 6); s_fdb_mac[i].ip = ip;
+}
+
+/* Drops the MAC entry, if it still points to ip */
+static void ICACHE_FLASH_ATTR fdb_mac_remove(const uint8_t *mac, uint32_t ip)
+{
+    int f = fdb_mac_find(mac);
+    if (f < 0 || s_fdb_mac[f].ip != ip) return;
+
+    uint16_t i = f, j = f;
+    for (;;) {
+        j = (j + 1) & FDB_MASK;
+        if (s_fdb_mac[j].ip == 0) break;
+        if (!fdb_may_shift(i, j, fdb_hash_mac(s_fdb_mac[j].mac))) continue;
+        s_fdb_mac[i] = s_fdb_mac[j];
+        i = j;
+    }
+    s_fdb_mac[i].ip = 0;
+}
+#endif /* BRIDGE_FDB_MAC_INDEX */
+
+static int ICACHE_FLASH_ATTR fdb_find(uint32_t ip)
+{
+    uint16_t i = fdb_hash_ip(ip);
+    for (; s_fdb[i].ip != 0; i = (i + 1) & FDB_MASK)
+        if (s_fdb[i].ip == ip) return i;
+    return -1;
+}
+
+static void ICACHE_FLASH_ATTR fdb_remove(uint16_t i)
+{
+    uint16_t j = i;
+#if BRIDGE_FDB_MAC_INDEX
+    fdb_mac_remove(s_fdb[i].mac, s_fdb[i].ip);
+#endif
+    for (;;) {
+        j = (j + 1) & FDB_MASK;
+        if (s_fdb[j].ip == 0) break;
+        if (!fdb_may_shift(i, j, fdb_hash_ip(s_fdb[j].ip))) continue;
+        s_fdb[i] = s_fdb[j];
+        i = j;
+    }
+    s_fdb[i].ip = 0;
+    s_fdb_count--;
+}
 
 static void ICACHE_FLASH_ATTR fdb_insert(uint32_t ip, const uint8_t *mac)
 {
     if (ip == 0) return;
     if (s_sta_nif && ip == s_sta_nif->ip_addr.addr) return;
     if (s_ap_nif  && ip == s_ap_nif->ip_addr.addr)  return;
-    uint32_t now = now_secs();
-    int free_idx = -1, oldest_idx = 0;
-    uint32_t oldest_exp = 0xFFFFFFFFUL;
-    int i;
-    for (i = 0; i < FDB_SIZE; i++) {
-        if (s_fdb[i].ip == ip) {
-            os_memcpy(s_fdb[i].mac, mac, 6); s_fdb[i].expires_s = now + FDB_TTL_S;
-            return;
+
+    int f = fdb_find(ip);
+    if (f >= 0) {
+        if (os_memcmp(s_fdb[f].mac, mac, 6) != 0) {
+#if BRIDGE_FDB_MAC_INDEX
+            fdb_mac_remove(s_fdb[f].mac, ip);
+            fdb_mac_set(mac, ip);
+#endif
+            os_memcpy(s_fdb[f].mac, mac, 6);
         }
-        if (s_fdb[i].ip == 0 || s_fdb[i].expires_s <= now) { if (free_idx < 0) free_idx = i; }
-        if (s_fdb[i].expires_s < oldest_exp) { oldest_exp = s_fdb[i].expires_s; oldest_idx = i; }
+        s_fdb[f].expires_s = s_now_s + FDB_TTL_S;
+        return;
     }
-    int idx = (free_idx >= 0) ? free_idx : oldest_idx;
-    s_fdb[idx].ip = ip; os_memcpy(s_fdb[idx].mac, mac, 6); s_fdb[idx].expires_s = now + FDB_TTL_S;
+
+    if (s_fdb_count >= FDB_MAX_FILL) {
+        /* Full: make room by dropping the entry closest to expiry */
+        uint16_t i, oldest_idx = 0;
+        uint32_t oldest_exp = 0xFFFFFFFFUL;
+        for (i = 0; i < FDB_SIZE; i++) {
+            if (s_fdb[i].ip != 0 && s_fdb[i].expires_s < oldest_exp) { oldest_exp = s_fdb[i].expires_s; oldest_idx = i; }
+        }
+        fdb_remove(oldest_idx);
+    }
+
+    uint16_t i = fdb_hash_ip(ip);
+    while (s_fdb[i].ip != 0) i = (i + 1) & FDB_MASK;
+    s_fdb[i].ip = ip; os_memcpy(s_fdb[i].mac, mac, 6); s_fdb[i].expires_s = s_now_s + FDB_TTL_S;
+    s_fdb_count++;
+#if BRIDGE_FDB_MAC_INDEX
+    fdb_mac_set(mac, ip);
+#endif
 }
 
 static const uint8_t * ICACHE_FLASH_ATTR fdb_lookup(uint32_t ip)
 {
-    uint32_t now = now_secs();
-    int i;
-    for (i = 0; i < FDB_SIZE; i++) {
-        if (s_fdb[i].ip == ip && s_fdb[i].expires_s > now) return s_fdb[i].mac;
-    }
+    int f = fdb_find(ip);
+    if (f >= 0 && s_fdb[f].expires_s > s_now_s) return s_fdb[f].mac;
     return NULL;
 }
 
+/* A new DHCP lease for a client invalidates its previous address */
+static void ICACHE_FLASH_ATTR fdb_set_lease(uint32_t ip, const uint8_t *mac)
+{
+#if BRIDGE_FDB_MAC_INDEX
+    int m = fdb_mac_find(mac);
+    if (m >= 0 && s_fdb_mac[m].ip != ip) {
+        int f = fdb_find(s_fdb_mac[m].ip);
+        if (f >= 0) fdb_remove(f);
+    }
+#endif
+    fdb_insert(ip, mac);
+}
+
+#if BRIDGE_IGMP_SNOOP
+/* The client is still known, with any address */
+static bool ICACHE_FLASH_ATTR fdb_has_mac(const uint8_t *mac)
+{
+#if BRIDGE_FDB_MAC_INDEX
+    return fdb_mac_find(mac) >= 0;
+#else
+    uint16_t i;
+    for (i = 0; i < FDB_SIZE; i++)
+        if (s_fdb[i].ip != 0 && os_memcmp(s_fdb[i].mac, mac, 6) == 0) return true;
+    return false;
+#endif
+}
+#endif
+
 /* -------------------------------------------------------------------------
  * DHCP XID map
  * ------------------------------------------------------------------------- */
@@ -178,7 +333,7 @@ static xid_entry_t s_xid_map[XID_MAP_SIZE];
 
 static void ICACHE_FLASH_ATTR xid_map_insert(uint32_t xid, const uint8_t *chaddr)
 {
-    uint32_t now = now_secs();
+    uint32_t now = s_now_s;
     int free_idx = -1, oldest_idx = 0;
     uint32_t oldest_exp = 0xFFFFFFFFUL;
     int i;
@@ -188,7 +343,7 @@ static void ICACHE_FLASH_ATTR xid_map_insert(uint32_t xid, const uint8_t *chaddr
             return;
         }
         if (s_xid_map[i].xid == 0 || s_xid_map[i].expires_s <= now) { if (free_idx < 0) free_idx = i; }
-        if (s_xid_map[i].expires_s < oldest_exp) { oldest_exp = s_fdb[i].expires_s; oldest_idx = i; }
+        if (s_xid_map[i].expires_s < oldest_exp) { oldest_exp = s_xid_map[i].expires_s; oldest_idx = i; }
     }
     int idx = (free_idx >= 0) ? free_idx : oldest_idx;
     s_xid_map[idx].xid = xid; os_memcpy(s_xid_map[idx].chaddr, chaddr, 6); s_xid_map[idx].expires_s = now + XID_TTL_S;
@@ -196,7 +351,7 @@ static void ICACHE_FLASH_ATTR xid_map_insert(uint32_t xid, const uint8_t *chaddr
 
 static const uint8_t * ICACHE_FLASH_ATTR xid_map_lookup(uint32_t xid)
 {
-    uint32_t now = now_secs();
+    uint32_t now = s_now_s;
     int i;
     for (i = 0; i < XID_MAP_SIZE; i++) {
         if (s_xid_map[i].xid == xid && s_xid_map[i].expires_s > now) return s_xid_map[i].chaddr;
@@ -214,6 +369,133 @@ static inline void * ICACHE_FLASH_ATTR pkt_at(struct pbuf *p, uint16_t off, uint
     return (uint8_t *)p->payload + off;
 }
 
+/* -------------------------------------------------------------------------
+ * Frame pool
+ *
+ * Full-size PBUF_RAM frames allocated once in bridge_init(). The pool keeps
+ * one reference on each of them, a frame is free again as soon as everyone
+ * else (including a driver that queued it) has dropped theirs. So borrowed
+ * frames are released with a plain pbuf_free().
+ *
+ * The free frames are on a stack, the lent ones in a FIFO in the order they
+ * were lent. The drivers send in order, so the oldest lent frame is the
+ * first to come back: only the head of the FIFO is checked for frames that
+ * were released. If the stack is empty and the head is still held (e.g.
+ * buffered for a dozing client), it moves to the tail, so the next try looks
+ * at another frame. Allocation, reclaim and the high-water mark are O(1)
+ * (amortized, each lent frame is reclaimed once).
+ * ------------------------------------------------------------------------- */
+
+#if BRIDGE_POOL_FRAMES > 0
+typedef struct {
+    struct pbuf *p;
+    void        *payload;
+} pool_frame_t;
+
+static pool_frame_t s_pool[BRIDGE_POOL_FRAMES];
+static uint8_t  s_pool_n;
+static uint8_t  s_pool_free[BRIDGE_POOL_FRAMES];   /* stack of free frames */
+static uint8_t  s_pool_nfree;
+static uint8_t  s_pool_lent[BRIDGE_POOL_FRAMES];   /* FIFO, oldest first */
+static uint8_t  s_pool_lent_head;
+static uint8_t  s_pool_nlent;
+static uint8_t  s_pool_hwm;
+static uint32_t s_pool_exhausted;
+static uint32_t s_pool_heap;
+
+static void ICACHE_FLASH_ATTR pool_init(void)
+{
+    while (s_pool_n < BRIDGE_POOL_FRAMES) {
+        struct pbuf *p = pbuf_alloc(PBUF_RAW, BRIDGE_POOL_FRAME_SIZE, PBUF_RAM);
+        if (!p) break;
+        s_pool[s_pool_n].p = p; s_pool[s_pool_n].payload = p->payload;
+        s_pool_free[s_pool_nfree++] = s_pool_n;
+        s_pool_n++;
+    }
+}
+
+static inline uint8_t ICACHE_FLASH_ATTR pool_in_use(void)
+{
+    return s_pool_nlent;
+}
+
+static void ICACHE_FLASH_ATTR pool_lent_pop(void)
+{
+    if (++s_pool_lent_head == s_pool_n) s_pool_lent_head = 0;
+    s_pool_nlent--;
+}
+
+static void ICACHE_FLASH_ATTR pool_lent_push(uint8_t i)
+{
+    uint8_t tail = s_pool_lent_head + s_pool_nlent;
+    if (tail >= s_pool_n) tail -= s_pool_n;
+    s_pool_lent[tail] = i;
+    s_pool_nlent++;
+}
+
+/* Moves the released frames at the head of the FIFO back to the stack */
+static void ICACHE_FLASH_ATTR pool_reclaim(void)
+{
+    while (s_pool_nlent > 0) {
+        uint8_t i = s_pool_lent[s_pool_lent_head];
+        if (s_pool[i].p->ref > 1) {
+            /* still held: let the next try look at another frame */
+            if (s_pool_nfree == 0 && s_pool_nlent > 1) { pool_lent_pop(); pool_lent_push(i); }
+            return;
+        }
+        pool_lent_pop();
+        s_pool_free[s_pool_nfree++] = i;
+    }
+}
+#endif /* BRIDGE_POOL_FRAMES > 0 */
+
+/* Returns a single-chunk frame of len bytes, from the pool if possible */
+static struct pbuf * ICACHE_FLASH_ATTR bridge_pbuf_alloc(uint16_t len)
+{
+#if BRIDGE_POOL_FRAMES > 0
+    if (len <= BRIDGE_POOL_FRAME_SIZE && s_pool_n > 0) {
+        pool_reclaim();
+        if (s_pool_nfree > 0) {
+            uint8_t i = s_pool_free[--s_pool_nfree];
+            pool_frame_t *f = &s_pool[i];
+            pbuf_ref(f->p);
+            f->p->payload = f->payload; f->p->len = f->p->tot_len = len;
+            pool_lent_push(i);
+            if (s_pool_nlent > s_pool_hwm) s_pool_hwm = s_pool_nlent;
+            return f->p;
+        }
+        s_pool_exhausted++;
+    }
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+    if (p) s_pool_heap++;
+    return p;
+#else
+    return pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+#endif
+}
+
+/* Forwarding path counters, shown by "show repeater" */
+static uint32_t s_fwd_copied;
+static uint32_t s_fwd_alloc_failed;
+
+/* Returns a copy of p to rewrite and forward across the bridge, with
+   tailroom extra bytes behind the frame. The copy is a single chunk with
+   len == tot_len == p->tot_len. Returns NULL if out of memory.
+   Every frame the bridge gets is in one of the WiFi driver's receive
+   buffers (esf_buf, PBUF_REF). They must go back to the driver quickly,
+   but the other side's linkoutput may queue the frame, and there is no way
+   to tell whether it will. So received frames are never forwarded
+   themselves, the copy comes from the frame pool (see bridge_pbuf_alloc()). */
+static struct pbuf * ICACHE_FLASH_ATTR bridge_fwd_pbuf(struct pbuf *p, uint16_t tailroom)
+{
+    struct pbuf *q = bridge_pbuf_alloc(p->tot_len + tailroom);
+    if (!q) { s_fwd_alloc_failed++; return NULL; }
+    pbuf_copy(q, p);
+    q->len = q->tot_len = p->tot_len;
+    s_fwd_copied++;
+    return q;
+}
+
 static void ICACHE_FLASH_ATTR update_ip_chksum(ip_hdr_t *ip)
 {
     ip->chksum = 0;
@@ -245,7 +527,7 @@ static uint8_t * ICACHE_FLASH_ATTR dhcp_find_option(uint8_t *opts, uint16_t opts
 static void ICACHE_FLASH_ATTR send_proxy_arp_reply(struct netif *tx_nif, netif_linkoutput_fn lo, const arp_hdr_t *req, uint32_t target_ip)
 {
     uint16_t pkt_len = sizeof(eth_hdr_t) + sizeof(arp_hdr_t);
-    struct pbuf *p = pbuf_alloc(PBUF_RAW, pkt_len, PBUF_RAM);
+    struct pbuf *p = bridge_pbuf_alloc(pkt_len);
     if (!p) return;
     eth_hdr_t *eth = (eth_hdr_t *)p->payload;
     arp_hdr_t *arp = (arp_hdr_t *)((uint8_t *)p->payload + sizeof(eth_hdr_t));
@@ -257,19 +539,136 @@ static void ICACHE_FLASH_ATTR send_proxy_arp_reply(struct netif *tx_nif, netif_l
     lo(tx_nif, p); pbuf_free(p);
 }
 
+/* -------------------------------------------------------------------------
+ * Upstream ARP cache
+ *
+ * The IP->MAC bindings of the upstream hosts are learned from the ARP replies
+ * (and gratuitous ARPs) that arrive on the STA side. An AP client's request
+ * for a cached address is answered locally, with the AP MAC as for the
+ * forwarded replies, instead of being broadcast upstream. Entries live for
+ * config.arp_cache_ttl seconds from the last reply (0: no cache). With
+ * config.arp_cache_probe, an entry that has been used is verified by a
+ * unicast ARP request to the cached MAC in the last quarter of its life,
+ * so it is renewed while the host answers and dropped otherwise.
+ * ------------------------------------------------------------------------- */
+
+#if BRIDGE_ARP_CACHE
+typedef struct {
+    uint32_t ip;            /* 0 if unused */
+    uint8_t  mac[6];
+    uint8_t  used;          /* answered from since the last reply */
+    uint8_t  probed;
+    uint32_t expires_s;
+} arpc_entry_t;
+
+static arpc_entry_t s_arpc[BRIDGE_ARP_CACHE_SIZE];
+static uint32_t s_arpc_hits;
+static uint32_t s_arpc_misses;
+static uint32_t s_arpc_learned;
+static uint32_t s_arpc_probes;
+static uint32_t s_arpc_verified;    /* probes answered */
+static uint32_t s_arpc_expired;
+
+static arpc_entry_t * ICACHE_FLASH_ATTR arpc_find(uint32_t ip)
+{
+    int i;
+    for (i = 0; i < BRIDGE_ARP_CACHE_SIZE; i++)
+        if (s_arpc[i].ip == ip) return &s_arpc[i];
+    return NULL;
+}
+
+/* An ARP packet from upstream */
+static void ICACHE_FLASH_ATTR arpc_learn(const arp_hdr_t *arp)
+{
+    arpc_entry_t *e;
+    int i;
+
+    if (config.arp_cache_ttl == 0 || arp->spa == 0 || (arp->sha[0] & 0x01)) return;
+    if (ntohs(arp->op) != 2 && arp->spa != arp->tpa) return;
+    if (os_memcmp(arp->sha, s_sta_nif->hwaddr, 6) == 0 || fdb_lookup(arp->spa)) return;
+
+    if ((e = arpc_find(arp->spa)) == NULL) {
+        /* a free one, if full the one closest to expiry */
+        e = &s_arpc[0];
+        for (i = 0; i < BRIDGE_ARP_CACHE_SIZE && s_arpc[i].ip != 0; i++)
+            if (s_arpc[i].expires_s < e->expires_s) e = &s_arpc[i];
+        if (i < BRIDGE_ARP_CACHE_SIZE) e = &s_arpc[i];
+        e->ip = arp->spa;
+        s_arpc_learned++;
+    } else if (e->probed) {
+        s_arpc_verified++;
+    }
+    os_memcpy(e->mac, arp->sha, 6);
+    e->used = 0; e->probed = 0;
+    e->expires_s = s_now_s + config.arp_cache_ttl;
+}
+
+/* An AP client's ARP request for an upstream address: true if answered */
+static bool ICACHE_FLASH_ATTR arpc_answer(const arp_hdr_t *arp)
+{
+    arpc_entry_t *e;
+
+    /* no probes (RFC 5227) or announcements */
+    if (config.arp_cache_ttl == 0 || arp->spa == 0 || arp->spa == arp->tpa) return false;
+    e = arpc_find(arp->tpa);
+    if (e == NULL || e->expires_s <= s_now_s) { s_arpc_misses++; return false; }
+    send_proxy_arp_reply(s_ap_nif, s_orig_lo_ap, arp, arp->tpa);
+    e->used = 1; s_arpc_hits++;
+    return true;
+}
+
+static void ICACHE_FLASH_ATTR arpc_send_probe(const arpc_entry_t *e)
+{
+    struct pbuf *p = bridge_pbuf_alloc(sizeof(eth_hdr_t) + sizeof(arp_hdr_t));
+    if (!p) return;
+    eth_hdr_t *eth = (eth_hdr_t *)p->payload;
+    arp_hdr_t *arp = (arp_hdr_t *)((uint8_t *)p->payload + sizeof(eth_hdr_t));
+    os_memcpy(eth->dst, e->mac, 6); os_memcpy(eth->src, s_sta_nif->hwaddr, 6); eth->type = htons(ETHTYPE_ARP);
+    arp->hwtype = htons(1); arp->prtype = htons(ETHTYPE_IP); arp->hwlen = 6; arp->prlen = 4;
+    arp->op = htons(1);
+    os_memcpy(arp->sha, s_sta_nif->hwaddr, 6); arp->spa = s_sta_nif->ip_addr.addr;
+    os_memset(arp->tha, 0, 6); arp->tpa = e->ip;
+    s_orig_lo_sta(s_sta_nif, p); pbuf_free(p);
+    s_arpc_probes++;
+}
+
+static void ICACHE_FLASH_ATTR arpc_tick(void)
+{
+    int i;
+
+    for (i = 0; i < BRIDGE_ARP_CACHE_SIZE; i++) {
+        arpc_entry_t *e = &s_arpc[i];
+        if (e->ip == 0) continue;
+        if (e->expires_s <= s_now_s) { e->ip = 0; s_arpc_expired++; continue; }
+        if (config.arp_cache_probe && e->used && !e->probed && s_sta_nif->ip_addr.addr != 0 &&
+            (e->expires_s - s_now_s) * 4 <= config.arp_cache_ttl) {
+            arpc_send_probe(e); e->probed = 1;
+        }
+    }
+}
+#endif /* BRIDGE_ARP_CACHE */
+
 
 /* -------------------------------------------------------------------------
  * DHCP snooping
  * ------------------------------------------------------------------------- */
 
+/* The chaddr and the option 61 are rewritten in place, the checksums are
+   updated incrementally (a UDP checksum of 0 stays "none") */
 static void ICACHE_FLASH_ATTR snoop_dhcp_request(struct pbuf *p, uint16_t eth_ip_udp_hdr_len)
 {
     dhcp_msg_t *dhcp = (dhcp_msg_t *)pkt_at(p, eth_ip_udp_hdr_len, sizeof(dhcp_msg_t));
     if (!dhcp || dhcp->op != DHCP_OP_REQUEST || dhcp->hlen != 6 || dhcp->magic != htonl(DHCP_MAGIC_COOKIE)) return;
+    ip_hdr_t *ip = (ip_hdr_t *)pkt_at(p, sizeof(eth_hdr_t), sizeof(ip_hdr_t));
+    udp_hdr_t *udp = (udp_hdr_t *)pkt_at(p, eth_ip_udp_hdr_len - (uint16_t)sizeof(udp_hdr_t), sizeof(udp_hdr_t));
+    if (!ip || !udp) return;
+    uint8_t *udp_sum = udp->chksum ? (uint8_t *)&udp->chksum : NULL;
 
+    /* chaddr and flags are at even offsets of the UDP datagram */
     uint8_t client_mac[6]; os_memcpy(client_mac, dhcp->chaddr, 6);
+    csum_update(udp_sum, client_mac, s_sta_nif->hwaddr, 6, false);
     os_memcpy(dhcp->chaddr, s_sta_nif->hwaddr, 6); 
-    dhcp->flags |= htons(0x8000); 
+    csum_put16((uint8_t *)&dhcp->flags, ntohs(dhcp->flags) | 0x8000, udp_sum, NULL);
 
     uint16_t opts_len = p->len - eth_ip_udp_hdr_len - (uint16_t)sizeof(dhcp_msg_t);
     uint8_t msg_type = 0, optlen;
@@ -280,22 +679,31 @@ static void ICACHE_FLASH_ATTR snoop_dhcp_request(struct pbuf *p, uint16_t eth_ip
         xid_map_insert(dhcp->xid, client_mac);
         uint8_t opt61len;
         uint8_t *opt61 = dhcp_find_option(dhcp->options, opts_len, 61, &opt61len);
-        if (!opt61 && opts_len + 9 <= 308) { 
-            uint8_t *end = dhcp_find_option(dhcp->options, opts_len, 255, NULL);
-            if (end) {
-                end[0] = 61; end[1] = 7; end[2] = 1; os_memcpy(&end[3], client_mac, 6); end[9] = 255;
-                uint16_t *ip_len_ptr = (uint16_t *)pkt_at(p, sizeof(eth_hdr_t) + 2, 2);
-                uint16_t *udp_len_ptr = (uint16_t *)pkt_at(p, eth_ip_udp_hdr_len - 4, 2);
-                if (ip_len_ptr) *ip_len_ptr = htons(ntohs(*ip_len_ptr) + 9);
-                if (udp_len_ptr) *udp_len_ptr = htons(ntohs(*udp_len_ptr) + 9);
-                p->len += 9; p->tot_len += 9;
-                ip_hdr_t *ip = (ip_hdr_t *)pkt_at(p, sizeof(eth_hdr_t), sizeof(ip_hdr_t));
-                if (ip) update_ip_chksum(ip);
+        uint8_t *end = opt61 ? NULL : dhcp_find_option(dhcp->options, opts_len, 255, NULL);
+        if (end) {
+            /* the option replaces the end option and the padding behind it,
+               the datagram only grows by what doesn't fit there */
+            uint16_t udp_len = ntohs(udp->len), e = end - (uint8_t *)udp, i;
+            uint16_t room = udp_len > e ? udp_len - e - 1 : 0;
+            uint16_t grow = room >= 9 ? 0 : 9 - room;
+            if (opts_len + grow <= 308) {
+                uint8_t old[10], new[10];
+                /* bytes behind the datagram didn't count (as 0) */
+                for (i = 0; i < 10; i++) old[i] = e + i < udp_len ? end[i] : 0;
+                new[0] = 61; new[1] = 7; new[2] = 1; os_memcpy(&new[3], client_mac, 6); new[9] = 255;
+                csum_update(udp_sum, old, new, 10, e & 1);
+                os_memcpy(end, new, 10);
+                if (grow) {
+                    csum_put16((uint8_t *)&ip->len, ntohs(ip->len) + grow, (uint8_t *)&ip->chksum, NULL);
+                    /* the length is in the UDP header and in the pseudo header */
+                    csum_put16((uint8_t *)&udp->len, udp_len + grow, udp_sum, NULL);
+                    csum_adjust(udp_sum, udp_len, udp_len + grow);
+                    p->len += grow; p->tot_len += grow;
+                }
             }
         }
-        udp_hdr_t *udp = (udp_hdr_t *)pkt_at(p, eth_ip_udp_hdr_len - (uint16_t)sizeof(udp_hdr_t), sizeof(udp_hdr_t));
-        if (udp) udp->chksum = 0;
     }
+    csum_udp_fix(udp_sum);
 }
 
 static bool ICACHE_FLASH_ATTR snoop_dhcp_reply(struct pbuf *p, uint16_t eth_ip_udp_hdr_len, uint8_t chaddr_out[6])
@@ -305,9 +713,11 @@ static bool ICACHE_FLASH_ATTR snoop_dhcp_reply(struct pbuf *p, uint16_t eth_ip_u
 
     const uint8_t *orig_mac = xid_map_lookup(dhcp->xid);
     if (orig_mac) {
-        os_memcpy(chaddr_out, orig_mac, 6); os_memcpy(dhcp->chaddr, orig_mac, 6);
         udp_hdr_t *udp = (udp_hdr_t *)pkt_at(p, eth_ip_udp_hdr_len - (uint16_t)sizeof(udp_hdr_t), sizeof(udp_hdr_t));
-        if (udp) udp->chksum = 0;
+        uint8_t *udp_sum = udp && udp->chksum ? (uint8_t *)&udp->chksum : NULL;
+        csum_update(udp_sum, dhcp->chaddr, orig_mac, 6, false);
+        csum_udp_fix(udp_sum);
+        os_memcpy(chaddr_out, orig_mac, 6); os_memcpy(dhcp->chaddr, orig_mac, 6);
     } else { os_memcpy(chaddr_out, dhcp->chaddr, 6); }
 
     if (dhcp->yiaddr != 0) {
@@ -321,12 +731,413 @@ static bool ICACHE_FLASH_ATTR snoop_dhcp_reply(struct pbuf *p, uint16_t eth_ip_u
                 ttl = ((uint32_t)opt[0] << 24) | ((uint32_t)opt[1] << 16) | ((uint32_t)opt[2] << 8) | (uint32_t)opt[3];
                 if (ttl == 0 || ttl > 86400 * 7) ttl = FDB_TTL_S;
             }
-            fdb_insert(dhcp->yiaddr, chaddr_out);
+            fdb_set_lease(dhcp->yiaddr, chaddr_out);
+        }
+    }
+    return true;
+}
+
+/* -------------------------------------------------------------------------
+ * IGMP snooping
+ *
+ * The IGMPv1/v2/v3 reports and leaves of the AP clients are tracked as
+ * (group, client MAC) members. There is no source filtering: a v3 record of
+ * INCLUDE with no sources is a leave, all other records but BLOCK are a join.
+ * A leave removes the client at once, it is the only member behind its MAC.
+ *
+ * Aging follows the upstream querier: while queries are seen, a member that
+ * doesn't report within the group membership interval (robustness * query
+ * interval + max response time, taken from the queries) is removed. Without
+ * a querier hosts don't renew their reports, a member is kept for
+ * IGMP_NOQ_AGE_S after its last report. Members of a client also end with
+ * its FDB entries, i.e. when it has left. With config.igmp_snoop set,
+ * multicast is only sent to the AP side if the group has members, link-local
+ * groups (224.0.0.x) always are. If the table has been full in the last GMI,
+ * snooping is suspended, it may lack members.
+ * ------------------------------------------------------------------------- */
+
+#if BRIDGE_IGMP_SNOOP
+#define IGMP_QUERY       0x11
+#define IGMP_V1_REPORT   0x12
+#define IGMP_V2_REPORT   0x16
+#define IGMP_V2_LEAVE    0x17
+#define IGMP_V3_REPORT   0x22
+#define IGMP_QI_DEFAULT  125    /* query interval in s (RFC 3376) */
+#define IGMP_QRV_DEFAULT 2
+#define IGMP_NOQ_AGE_S   3600   /* member lifetime without a querier */
+
+#define IGMP_GMI(qrv, qi, mrt_ds) ((qrv) * (qi) + ((mrt_ds) + 9) / 10)
+
+static inline bool ICACHE_FLASH_ATTR mcast_link_local(uint32_t group)
+{
+    return (ntohl(group) & 0xffffff00) == 0xe0000000;
+}
+
+typedef struct {
+    uint32_t group;         /* 0 if unused */
+    uint8_t  mac[6];
+    uint32_t expires_s;
+} igmp_member_t;
+
+static igmp_member_t s_igmp[BRIDGE_IGMP_SIZE];
+static uint32_t s_igmp_query_s;     /* last general query, 0: no querier */
+static uint32_t s_igmp_gmi = IGMP_GMI(IGMP_QRV_DEFAULT, IGMP_QI_DEFAULT, 100);
+static uint32_t s_igmp_full_s;      /* table full, 0: not in the last GMI */
+static uint32_t s_igmp_reports;
+static uint32_t s_igmp_leaves;
+static uint32_t s_igmp_queries;
+static uint32_t s_igmp_expired;
+static uint32_t s_igmp_unregistered; /* frames not sent to the AP side */
+
+static bool ICACHE_FLASH_ATTR igmp_snooping(uint32_t group)
+{
+    return config.igmp_snoop && s_igmp_full_s == 0 && !mcast_link_local(group);
+}
+
+/* Length of the IGMP message in the first chunk of p */
+static uint16_t ICACHE_FLASH_ATTR igmp_len(struct pbuf *p, const pkt_info *pi)
+{
+    const uint8_t *ip = (const uint8_t *)p->payload + pi->ip_off;
+    uint16_t len = (uint16_t)ip[2] << 8 | ip[3], ihl = pi->l4_off - pi->ip_off;
+
+    if ((pi->flags & PKT_F_FRAG) || len < ihl + 8) return 0;
+    len -= ihl;
+    return len > p->len - pi->l4_off ? 0 : len;
+}
+
+/* Max response code and QQIC of RFC 3376 4.1.1: from 128 on a float */
+static uint32_t ICACHE_FLASH_ATTR igmp_code_value(uint8_t c)
+{
+    if (c < 128) return c;
+    return (uint32_t)((c & 0x0f) | 0x10) << (((c >> 4) & 0x07) + 3);
+}
+
+static void ICACHE_FLASH_ATTR igmp_join(uint32_t group, const uint8_t *mac)
+{
+    int i, slot = -1;
+
+    if ((ntohl(group) >> 28) != 0xE || mcast_link_local(group)) return;
+    s_igmp_reports++;
+    for (i = 0; i < BRIDGE_IGMP_SIZE; i++) {
+        if (s_igmp[i].group == group && os_memcmp(s_igmp[i].mac, mac, 6) == 0) { slot = i; break; }
+        if (s_igmp[i].group == 0 && slot < 0) slot = i;
+    }
+    if (slot < 0) { s_igmp_full_s = s_now_s; return; }
+    s_igmp[slot].group = group; os_memcpy(s_igmp[slot].mac, mac, 6);
+    s_igmp[slot].expires_s = s_now_s + (s_igmp_query_s ? s_igmp_gmi : IGMP_NOQ_AGE_S);
+}
+
+static void ICACHE_FLASH_ATTR igmp_leave(uint32_t group, const uint8_t *mac)
+{
+    int i;
+
+    s_igmp_leaves++;
+    for (i = 0; i < BRIDGE_IGMP_SIZE; i++) {
+        if (s_igmp[i].group == group && os_memcmp(s_igmp[i].mac, mac, 6) == 0) { s_igmp[i].group = 0; return; }
+    }
+}
+
+/* IGMP from an AP client: reports and leaves */
+static void ICACHE_FLASH_ATTR igmp_snoop_report(struct pbuf *p, const pkt_info *pi, const uint8_t *mac)
+{
+    uint16_t len = igmp_len(p, pi), off, nrec;
+    const uint8_t *b = (const uint8_t *)p->payload + pi->l4_off;
+    uint32_t group;
+
+    if (len == 0) return;
+    switch (b[0]) {
+    case IGMP_V1_REPORT:
+    case IGMP_V2_REPORT:
+        os_memcpy(&group, &b[4], 4); igmp_join(group, mac);
+        break;
+    case IGMP_V2_LEAVE:
+        os_memcpy(&group, &b[4], 4); igmp_leave(group, mac);
+        break;
+    case IGMP_V3_REPORT:
+        nrec = (uint16_t)b[6] << 8 | b[7];
+        for (off = 8; nrec > 0 && off + 8 <= len; nrec--) {
+            uint8_t type = b[off], aux = b[off + 1];
+            uint16_t nsrc = (uint16_t)b[off + 2] << 8 | b[off + 3];
+            os_memcpy(&group, &b[off + 4], 4);
+            /* 1: MODE_IS_INCLUDE, 3: CHANGE_TO_INCLUDE, 6: BLOCK_OLD */
+            if ((type == 1 || type == 3) && nsrc == 0) igmp_leave(group, mac);
+            else if (type >= 1 && type <= 5) igmp_join(group, mac);
+            off += 8 + nsrc * 4 + aux * 4;
+        }
+        break;
+    }
+}
+
+/* IGMP from upstream: general queries set the aging of the members */
+static void ICACHE_FLASH_ATTR igmp_snoop_query(struct pbuf *p, const pkt_info *pi)
+{
+    uint16_t len = igmp_len(p, pi);
+    const uint8_t *b = (const uint8_t *)p->payload + pi->l4_off;
+    uint32_t group, qi = IGMP_QI_DEFAULT, qrv = IGMP_QRV_DEFAULT, mrt;
+    int i;
+
+    if (len == 0 || b[0] != IGMP_QUERY) return;
+    s_igmp_queries++;
+    os_memcpy(&group, &b[4], 4);
+    if (group != 0) return;     /* group specific, after a leave */
+
+    mrt = b[1] ? igmp_code_value(b[1]) : 100;   /* v1: 10 s */
+    if (len >= 12) {
+        if (b[8] & 0x07) qrv = b[8] & 0x07;
+        if (b[9]) qi = igmp_code_value(b[9]);
+    } else if (s_igmp_query_s && s_now_s - s_igmp_query_s > qi) {
+        /* v1/v2 queries don't tell the interval, a longer one is measured */
+        qi = s_now_s - s_igmp_query_s;
+    }
+    s_igmp_gmi = IGMP_GMI(qrv, qi, mrt);
+    if (s_igmp_query_s == 0) {
+        for (i = 0; i < BRIDGE_IGMP_SIZE; i++)
+            if (s_igmp[i].group != 0) s_igmp[i].expires_s = s_now_s + s_igmp_gmi;
+    }
+    s_igmp_query_s = s_now_s;
+}
+
+/* Collects the member MACs of group. Returns their number, max + 1 if
+   there are more than max. */
+static uint8_t ICACHE_FLASH_ATTR igmp_members(uint32_t group, uint8_t macs[][6], uint8_t max)
+{
+    uint8_t n = 0;
+    int i;
+    for (i = 0; i < BRIDGE_IGMP_SIZE; i++) {
+        if (s_igmp[i].group != group) continue;
+        if (n == max) return max + 1;
+        os_memcpy(macs[n++], s_igmp[i].mac, 6);
+    }
+    return n;
+}
+
+static void ICACHE_FLASH_ATTR igmp_tick(void)
+{
+    int i;
+
+    /* querier gone: keep the members rather than let them all expire */
+    if (s_igmp_query_s && s_now_s - s_igmp_query_s >= s_igmp_gmi) {
+        s_igmp_query_s = 0;
+        for (i = 0; i < BRIDGE_IGMP_SIZE; i++) s_igmp[i].expires_s = s_now_s + IGMP_NOQ_AGE_S;
+    }
+    for (i = 0; i < BRIDGE_IGMP_SIZE; i++) {
+        if (s_igmp[i].group == 0) continue;
+        if (s_igmp[i].expires_s <= s_now_s || !fdb_has_mac(s_igmp[i].mac)) {
+            s_igmp[i].group = 0; s_igmp_expired++;
         }
     }
+    if (s_igmp_full_s && s_now_s - s_igmp_full_s >= s_igmp_gmi) s_igmp_full_s = 0;
+}
+#endif /* BRIDGE_IGMP_SNOOP */
+
+/* -------------------------------------------------------------------------
+ * Multicast to unicast
+ *
+ * Multicast frames go out on the AP at the basic rate and without acks, so a
+ * single stream can eat most of the airtime. Instead they can be sent as one
+ * unicast copy per AP client, at the client's own rate. The clients are the
+ * members of the group if IGMP snooping is on, otherwise the distinct MACs
+ * in the FDB (which also holds clients that left in the last FDB_TTL_S).
+ * With more than config.mcast_unicast of them the frame is sent as multicast.
+ * ------------------------------------------------------------------------- */
+
+#if BRIDGE_MCAST_UNICAST || BRIDGE_IGMP_SNOOP
+static uint32_t s_mcast_unicast;    /* frames sent as unicast copies */
+static uint32_t s_mcast_copies;
+static uint32_t s_mcast_fallback;   /* too many clients or out of memory */
+
+/* Collects the distinct client MACs. Returns their number, max + 1 if
+   there are more than max. */
+static uint8_t ICACHE_FLASH_ATTR mcast_targets(uint8_t macs[][6], uint8_t max)
+{
+    uint16_t i;
+    uint8_t n = 0, k;
+    for (i = 0; i < FDB_SIZE; i++) {
+        if (s_fdb[i].ip == 0 || s_fdb[i].expires_s <= s_now_s) continue;
+        for (k = 0; k < n && os_memcmp(macs[k], s_fdb[i].mac, 6) != 0; k++);
+        if (k < n) continue;
+        if (n == max) return max + 1;
+        os_memcpy(macs[n++], s_fdb[i].mac, 6);
+    }
+    return n;
+}
+
+/* Sends the multicast frame q (with its Ethernet header) for group to the
+   AP side, as unicast copies if possible. q itself is sent as the last copy. */
+static void ICACHE_FLASH_ATTR mcast_output_ap(struct pbuf *q, uint32_t group)
+{
+    uint8_t macs[MAX_CLIENTS][6];
+    struct pbuf *c[MAX_CLIENTS];
+    uint8_t n, k, max = 0;
+    eth_hdr_t *eth;
+
+#if BRIDGE_MCAST_UNICAST
+    max = config.mcast_unicast;
+#endif
+#if BRIDGE_IGMP_SNOOP
+    if (igmp_snooping(group)) {
+        n = igmp_members(group, macs, max);
+        if (n == 0) { s_igmp_unregistered++; return; }
+    } else
+#endif
+    n = max > 0 ? mcast_targets(macs, max) : 0;
+    if (n > max) { if (max > 0) s_mcast_fallback++; n = 0; }
+
+    /* all copies first, without memory for one of them only the multicast
+     * goes out, so no client gets the frame twice */
+    for (k = 0; k + 1 < n; k++) {
+        c[k] = bridge_pbuf_alloc(q->tot_len);
+        if (!c[k]) {
+            while (k > 0) pbuf_free(c[--k]);
+            s_mcast_fallback++; n = 0; break;
+        }
+    }
+    for (k = 0; k + 1 < n; k++) {
+        pbuf_copy(c[k], q);
+        c[k]->len = c[k]->tot_len = q->tot_len;
+        eth = (eth_hdr_t *)c[k]->payload; os_memcpy(eth->dst, macs[k], 6);
+        s_orig_lo_ap(s_ap_nif, c[k]); pbuf_free(c[k]);
+    }
+    if (n > 0) {
+        eth = (eth_hdr_t *)q->payload; os_memcpy(eth->dst, macs[n - 1], 6);
+        s_mcast_unicast++; s_mcast_copies += n;
+    }
+    s_orig_lo_ap(s_ap_nif, q);
+}
+#define BRIDGE_MCAST_OUTPUT_AP(q, group) mcast_output_ap(q, group)
+#else
+#define BRIDGE_MCAST_OUTPUT_AP(q, group) s_orig_lo_ap(s_ap_nif, q)
+#endif /* BRIDGE_MCAST_UNICAST || BRIDGE_IGMP_SNOOP */
+
+/* -------------------------------------------------------------------------
+ * Broadcast rate limits
+ *
+ * Broadcasts and multicasts are forwarded and also go to the local stack, so
+ * a chatty upstream LAN keeps both the AP and the CPU busy. They are counted
+ * per direction and class, each class has a token bucket of
+ * config.bcast_rate frames per second (0: no limit) with BCAST_BURST_S
+ * seconds of it as burst, a bucket starts full when its rate is set. Frames
+ * over the limit are dropped before anything else is done with them.
+ * bridge_tick() refills the buckets, so the frame path doesn't read the
+ * clock. ARP requests for the repeater's own address are never limited.
+ *
+ * If the broadcasts of a direction stay above config.storm_rate per second
+ * for STORM_ON_S seconds, every class but DHCP is limited to at most
+ * STORM_CLASS_FPS until the rate has been below it for STORM_OFF_S seconds.
+ * IGMP is never limited, the snooping depends on it.
+ * ------------------------------------------------------------------------- */
+
+#if BRIDGE_BCAST_LIMIT
+#define BCAST_BURST_S    2
+#define STORM_ON_S       3
+#define STORM_OFF_S      10
+#define STORM_CLASS_FPS  10
+
+#define BCAST_FROM_AP    0
+#define BCAST_FROM_STA   1
+
+typedef struct {
+    uint32_t tokens[BCAST_CLASSES];
+    uint32_t passed[BCAST_CLASSES];
+    uint32_t dropped[BCAST_CLASSES];
+    uint32_t second;        /* frames in the current second */
+    uint32_t peak;          /* max frames per second */
+    uint32_t storms;
+    uint16_t rate[BCAST_CLASSES];   /* config.bcast_rate the buckets are for */
+    uint8_t  storm;         /* storm protection active */
+    uint8_t  storm_s;       /* secs above (in a storm: below) storm_rate */
+} bcast_dir_t;
+
+static bcast_dir_t s_bcast[2];
+
+static const char *s_bcast_names[BCAST_CLASSES] = { "arp", "dhcp", "mdns", "ssdp", "other" };
+
+const char * ICACHE_FLASH_ATTR bridge_bcast_name(uint8_t cls)
+{
+    return s_bcast_names[cls];
+}
+
+/* BCAST_* of a frame, -1 if it is never limited */
+static int8_t ICACHE_FLASH_ATTR bcast_class(struct pbuf *p, const pkt_info *pi)
+{
+    if (pi->eth_type == ETHTYPE_ARP) {
+        /* who-has for the repeater itself, it must stay reachable */
+        arp_hdr_t *arp = (arp_hdr_t *)pkt_at(p, sizeof(eth_hdr_t), sizeof(arp_hdr_t));
+        if (arp && ntohs(arp->op) == 1 && s_sta_nif->ip_addr.addr != 0 && arp->tpa == s_sta_nif->ip_addr.addr) return -1;
+        return BCAST_ARP;
+    }
+    if (!(pi->flags & PKT_F_IP)) return BCAST_OTHER;
+    if (pi->proto == IP_PROTO_IGMP) return -1;
+    if (pi->proto == 17 && (pi->flags & PKT_F_PORTS)) {
+        if (pi->d_port == 67 || pi->d_port == 68) return BCAST_DHCP;
+        if (pi->d_port == 5353) return BCAST_MDNS;
+        if (pi->d_port == 1900) return BCAST_SSDP;
+    }
+    return BCAST_OTHER;
+}
+
+/* Frames per second of a class, 0: no limit */
+static uint16_t ICACHE_FLASH_ATTR bcast_limit(const bcast_dir_t *d, uint8_t cls)
+{
+    uint16_t rate = config.bcast_rate[cls];
+    if (d->storm && cls != BCAST_DHCP && (rate == 0 || rate > STORM_CLASS_FPS)) rate = STORM_CLASS_FPS;
+    return rate;
+}
+
+/* Counts a broadcast frame, false if it is over its limit */
+static bool ICACHE_FLASH_ATTR bcast_allow(uint8_t dir, struct pbuf *p, const pkt_info *pi)
+{
+    bcast_dir_t *d = &s_bcast[dir];
+    int8_t cls = bcast_class(p, pi);
+
+    d->second++;
+    if (cls < 0) return true;
+    /* a new limit starts with a full bucket */
+    if (d->rate[cls] != config.bcast_rate[cls]) {
+        d->rate[cls] = config.bcast_rate[cls];
+        d->tokens[cls] = bcast_limit(d, cls) * BCAST_BURST_S;
+    }
+    if (bcast_limit(d, cls) != 0) {
+        if (d->tokens[cls] == 0) { d->dropped[cls]++; return false; }
+        d->tokens[cls]--;
+    }
+    d->passed[cls]++;
     return true;
 }
 
+static void ICACHE_FLASH_ATTR bcast_tick(void)
+{
+    uint8_t dir, cls;
+
+    for (dir = 0; dir < 2; dir++) {
+        bcast_dir_t *d = &s_bcast[dir];
+
+        if (d->second > d->peak) d->peak = d->second;
+        if (config.storm_rate == 0) {
+            d->storm = 0; d->storm_s = 0;
+        } else if (!d->storm) {
+            d->storm_s = d->second > config.storm_rate ? d->storm_s + 1 : 0;
+            if (d->storm_s >= STORM_ON_S) {
+                d->storm = 1; d->storm_s = 0; d->storms++;
+                os_printf("bridge: broadcast storm from %s\n", dir == BCAST_FROM_AP ? "AP" : "STA");
+            }
+        } else {
+            d->storm_s = d->second <= config.storm_rate ? d->storm_s + 1 : 0;
+            if (d->storm_s >= STORM_OFF_S) {
+                d->storm = 0; d->storm_s = 0;
+                os_printf("bridge: broadcast storm from %s over\n", dir == BCAST_FROM_AP ? "AP" : "STA");
+            }
+        }
+        d->second = 0;
+
+        for (cls = 0; cls < BCAST_CLASSES; cls++) {
+            uint32_t rate = bcast_limit(d, cls), tokens = d->tokens[cls] + rate;
+            d->tokens[cls] = tokens > rate * BCAST_BURST_S ? rate * BCAST_BURST_S : tokens;
+        }
+    }
+}
+#endif /* BRIDGE_BCAST_LIMIT */
+
 /* -------------------------------------------------------------------------
  * Minimal mDNS responder for AP-side queries
  *
@@ -407,7 +1218,7 @@ static void ICACHE_FLASH_ATTR send_mdns_a_reply(const uint8_t *client_mac, uint3
     const uint16_t ip_len     = sizeof(ip_hdr_t) + udp_len;
     const uint16_t pkt_len    = sizeof(eth_hdr_t) + ip_len;
 
-    struct pbuf *p = pbuf_alloc(PBUF_RAW, pkt_len, PBUF_RAM);
+    struct pbuf *p = bridge_pbuf_alloc(pkt_len);
     if (!p) return;
 
     eth_hdr_t *eth = (eth_hdr_t *)p->payload;
@@ -516,7 +1327,7 @@ static err_t ICACHE_FLASH_ATTR bridge_output_sta(struct netif *netif, struct pbu
         eth->dst[4] = (uint8_t)((hip >>  8) & 0xff);
         eth->dst[5] = (uint8_t)( hip        & 0xff);
         os_memcpy(eth->src, s_ap_nif->hwaddr, 6); eth->type = htons(ETHTYPE_IP);
-        s_orig_lo_ap(s_ap_nif, p);
+        BRIDGE_MCAST_OUTPUT_AP(p, ipaddr->addr);
         pbuf_header(p, -(s16_t)sizeof(eth_hdr_t));
     }
 
@@ -537,70 +1348,87 @@ static err_t ICACHE_FLASH_ATTR bridge_output_ap(struct netif *netif, struct pbuf
 
 static err_t ICACHE_FLASH_ATTR bridge_input_ap(struct pbuf *p, struct netif *inp)
 {
-    if (os_strcmp(config.ssid, WIFI_SSID) == 0) return s_orig_input_ap(p, inp);
+    if (s_unconfigured) return s_orig_input_ap(p, inp);
 
     if (config.status_led <= 16)
         easygpio_outputSet(config.status_led, 1);
 
-    struct pbuf *q = pbuf_alloc(PBUF_RAW, p->tot_len + 16, PBUF_RAM);
+    pkt_info pi;
+    pkt_parse(p, &pi);
 
-    Bytes_out += p->tot_len;
+    Bytes_out += pi.tot_len;
     Packets_out++;
 #if DAILY_LIMIT
-    Bytes_per_day += p->tot_len;
+    Bytes_per_day += pi.tot_len;
 #endif
 
-    if (!q) return s_orig_input_ap(p, inp);
-    pbuf_copy(q, p);
+    if (pi.eth_type == 0) return s_orig_input_ap(p, inp);
 
-    eth_hdr_t *eth = (eth_hdr_t *)q->payload;
-    bool is_bcast = (eth->dst[0] & 0x01) != 0, is_to_ap_mac = (os_memcmp(eth->dst, s_ap_nif->hwaddr, 6) == 0);
-    uint16_t eth_type = ntohs(eth->type);
+    eth_hdr_t *eth = (eth_hdr_t *)p->payload;
+    bool is_bcast = (pi.flags & PKT_F_BCAST) != 0, is_to_ap_mac = (os_memcmp(eth->dst, s_ap_nif->hwaddr, 6) == 0);
+    arp_hdr_t *arp = NULL;
+    uint8_t src_mac[6];
+    os_memcpy(src_mac, eth->src, 6);
 
     /* Learn source IP→MAC before any early return so replies to the management
        address (which take the is_to_ap_mac path) can be routed back via the FDB. */
-    {
-        const uint8_t *src_mac = ((eth_hdr_t *)p->payload)->src;
-        if (eth_type == ETHTYPE_ARP) {
-            arp_hdr_t *arp = (arp_hdr_t *)pkt_at(q, sizeof(eth_hdr_t), sizeof(arp_hdr_t));
-            if (arp) fdb_insert(arp->spa, src_mac);
-        } else if (eth_type == ETHTYPE_IP) {
-            ip_hdr_t *ip = (ip_hdr_t *)pkt_at(q, sizeof(eth_hdr_t), sizeof(ip_hdr_t));
-            if (ip) fdb_insert(ip->src, src_mac);
-        }
+    if (pi.eth_type == ETHTYPE_ARP) {
+        arp = (arp_hdr_t *)pkt_at(p, sizeof(eth_hdr_t), sizeof(arp_hdr_t));
+        if (arp) fdb_insert(arp->spa, src_mac);
+    } else if (pi.flags & PKT_F_IP) {
+        fdb_insert(pi.src, src_mac);
+#if BRIDGE_IGMP_SNOOP
+        if (pi.proto == IP_PROTO_IGMP) igmp_snoop_report(p, &pi, src_mac);
+#endif
     }
 
-    if (is_to_ap_mac && !is_bcast) { pbuf_free(q); return s_orig_input_ap(p, inp); }
+#if BRIDGE_BCAST_LIMIT
+    if (is_bcast && !bcast_allow(BCAST_FROM_AP, p, &pi)) {
+        PERF_VERDICT(PERF_DROP);
+        pbuf_free(p); return ERR_OK;
+    }
+#endif
+
+    if (is_to_ap_mac && !is_bcast) return s_orig_input_ap(p, inp);
 
     bool handled = false;
-    os_memcpy(eth->src, s_sta_nif->hwaddr, 6);
+    struct pbuf *q = NULL;
 
-    if (eth_type == ETHTYPE_ARP) {
-        arp_hdr_t *arp = (arp_hdr_t *)pkt_at(q, sizeof(eth_hdr_t), sizeof(arp_hdr_t));
+    if (pi.eth_type == ETHTYPE_ARP) {
         if (arp) {
-            fdb_insert(arp->spa, ((eth_hdr_t*)p->payload)->src);
             if (ntohs(arp->op) == 1 && s_sta_nif->ip_addr.addr != 0 && arp->tpa == s_sta_nif->ip_addr.addr) {
                 send_proxy_arp_reply(s_ap_nif, s_orig_lo_ap, arp, s_sta_nif->ip_addr.addr); handled = true;
-            } else {
+#if BRIDGE_ARP_CACHE
+            } else if (ntohs(arp->op) == 1 && !fdb_lookup(arp->tpa) && arpc_answer(arp)) {
+                handled = true;
+#endif
+            } else if ((q = bridge_fwd_pbuf(p, 0)) != NULL) {
+                eth = (eth_hdr_t *)q->payload; arp = (arp_hdr_t *)((uint8_t *)q->payload + sizeof(eth_hdr_t));
+                os_memcpy(eth->src, s_sta_nif->hwaddr, 6);
                 os_memcpy(arp->sha, s_sta_nif->hwaddr, 6); s_orig_lo_sta(s_sta_nif, q); handled = true;
             }
         }
-    } else if (eth_type == ETHTYPE_IP) {
-        ip_hdr_t *ip = (ip_hdr_t *)pkt_at(q, sizeof(eth_hdr_t), sizeof(ip_hdr_t));
-        if (ip) {
-            fdb_insert(ip->src, ((eth_hdr_t*)p->payload)->src);
-            if (ip->proto == 17) {
-                uint16_t udp_off = sizeof(eth_hdr_t) + (ip->vhl & 0x0f) * 4;
-                udp_hdr_t *udp = (udp_hdr_t *)pkt_at(q, udp_off, sizeof(udp_hdr_t));
-                if (udp && ntohs(udp->dst_port) == 67) snoop_dhcp_request(q, udp_off + sizeof(udp_hdr_t));
-                if (udp && ntohs(udp->dst_port) == 5353)
-                    handle_ap_mdns_query(q, udp_off, ((eth_hdr_t *)p->payload)->src);
+    } else if (pi.eth_type == ETHTYPE_IP) {
+        if (pi.flags & PKT_F_IP) {
+            /* Forwarded as a copy (see bridge_fwd_pbuf()), DHCP requests
+               get some tailroom as they may grow by an option 61 */
+            bool is_dhcp = pi.proto == 17 && (pi.flags & PKT_F_PORTS) && pi.d_port == 67;
+            if ((q = bridge_fwd_pbuf(p, is_dhcp ? 16 : 0)) != NULL) {
+                eth = (eth_hdr_t *)q->payload;
+                os_memcpy(eth->src, s_sta_nif->hwaddr, 6);
+                if (is_dhcp) snoop_dhcp_request(q, pi.l4_off + sizeof(udp_hdr_t));
+                if (pi.proto == 17 && (pi.flags & PKT_F_PORTS) && pi.d_port == 5353)
+                    handle_ap_mdns_query(q, pi.l4_off, src_mac);
+                s_orig_lo_sta(s_sta_nif, q); handled = true;
             }
-            s_orig_lo_sta(s_sta_nif, q); handled = true;
         }
-    } else { s_orig_lo_sta(s_sta_nif, q); handled = true; }
+    } else if ((q = bridge_fwd_pbuf(p, 0)) != NULL) {
+        eth = (eth_hdr_t *)q->payload;
+        os_memcpy(eth->src, s_sta_nif->hwaddr, 6); s_orig_lo_sta(s_sta_nif, q); handled = true;
+    }
 
-    pbuf_free(q);
+    if (q != NULL) pbuf_free(q);
+    if (handled) PERF_VERDICT(PERF_FWD);
     if (is_bcast) return s_orig_input_ap(p, inp);
 
     if (handled) { pbuf_free(p); return ERR_OK; }
@@ -609,63 +1437,83 @@ static err_t ICACHE_FLASH_ATTR bridge_input_ap(struct pbuf *p, struct netif *inp
 
 static err_t ICACHE_FLASH_ATTR bridge_input_sta(struct pbuf *p, struct netif *inp)
 {
-    struct pbuf *q = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM);
+    pkt_info pi;
+    pkt_parse(p, &pi);
 
-    Bytes_in += p->tot_len;
+    Bytes_in += pi.tot_len;
     Packets_in++;
 #if DAILY_LIMIT
-    Bytes_per_day += p->tot_len;
+    Bytes_per_day += pi.tot_len;
 #endif
     if (config.status_led <= 16)
         easygpio_outputSet(config.status_led, 0);
-        
-    if (!q) return s_orig_input_sta(p, inp);
-    pbuf_copy(q, p);
 
-    eth_hdr_t *eth = (eth_hdr_t *)q->payload;
-    if (os_memcmp(eth->src, s_ap_nif->hwaddr, 6) == 0) { pbuf_free(q); return s_orig_input_sta(p, inp); }
+    if (pi.eth_type == 0) return s_orig_input_sta(p, inp);
 
-    uint16_t eth_type = ntohs(eth->type);
-    bool is_bcast = (eth->dst[0] & 0x01) != 0, is_to_sta_mac = (os_memcmp(eth->dst, s_sta_nif->hwaddr, 6) == 0);
+    eth_hdr_t *eth = (eth_hdr_t *)p->payload;
+    if (os_memcmp(eth->src, s_ap_nif->hwaddr, 6) == 0) return s_orig_input_sta(p, inp);
+
+    bool is_bcast = (pi.flags & PKT_F_BCAST) != 0, is_to_sta_mac = (os_memcmp(eth->dst, s_sta_nif->hwaddr, 6) == 0);
     bool handled = false;
-    os_memcpy(eth->src, s_ap_nif->hwaddr, 6);
+    struct pbuf *q = NULL;
 
-    if (eth_type == ETHTYPE_IP) {
-        ip_hdr_t *ip = (ip_hdr_t *)pkt_at(q, sizeof(eth_hdr_t), sizeof(ip_hdr_t));
-        if (ip) {
-            uint8_t ch[6]; bool have_dhcp = false;
-            if (ip->proto == 17) {
-                uint16_t udp_off = sizeof(eth_hdr_t) + (ip->vhl & 0x0f) * 4;
-                udp_hdr_t *udp = (udp_hdr_t *)pkt_at(q, udp_off, sizeof(udp_hdr_t));
-                if (udp && ntohs(udp->src_port) == 67 && ntohs(udp->dst_port) == 68) have_dhcp = snoop_dhcp_reply(q, udp_off + sizeof(udp_hdr_t), ch);
-            }
-            const uint8_t *mac = NULL;
-            if (have_dhcp) mac = ch; else if (!is_bcast) { if (s_sta_nif->ip_addr.addr && ip->dst != s_sta_nif->ip_addr.addr) mac = fdb_lookup(ip->dst); }
-            if (is_bcast || mac) {
-                if (mac) os_memcpy(eth->dst, mac, 6);
-                s_orig_lo_ap(s_ap_nif, q); handled = true;
-            }
+#if BRIDGE_BCAST_LIMIT
+    if (is_bcast && !bcast_allow(BCAST_FROM_STA, p, &pi)) {
+        PERF_VERDICT(PERF_DROP);
+        pbuf_free(p); return ERR_OK;
+    }
+#endif
+
+    /* Only copies are rewritten and forwarded (see bridge_fwd_pbuf()), p
+       itself may still go to the local stack. DHCP replies are rewritten
+       before their client is known. */
+    if (pi.flags & PKT_F_IP) {
+#if BRIDGE_IGMP_SNOOP
+        if (pi.proto == IP_PROTO_IGMP) igmp_snoop_query(p, &pi);
+#endif
+        bool is_dhcp = pi.proto == 17 && (pi.flags & PKT_F_PORTS) && pi.s_port == 67 && pi.d_port == 68;
+        const uint8_t *mac = NULL;
+        uint8_t ch[6];
+        if (!is_bcast && s_sta_nif->ip_addr.addr && pi.dest != s_sta_nif->ip_addr.addr) mac = fdb_lookup(pi.dest);
+        if ((is_bcast || is_dhcp || mac) && (q = bridge_fwd_pbuf(p, 0)) != NULL) {
+            if (is_dhcp && snoop_dhcp_reply(q, pi.l4_off + sizeof(udp_hdr_t), ch)) mac = ch;
         }
-    } else if (eth_type == ETHTYPE_ARP) {
-        arp_hdr_t *arp = (arp_hdr_t *)pkt_at(q, sizeof(eth_hdr_t), sizeof(arp_hdr_t));
+        if (q != NULL && (is_bcast || mac)) {
+            eth = (eth_hdr_t *)q->payload;
+            os_memcpy(eth->src, s_ap_nif->hwaddr, 6);
+            if (mac) os_memcpy(eth->dst, mac, 6);
+            if (!mac && (ntohl(pi.dest) >> 28) == 0xE) BRIDGE_MCAST_OUTPUT_AP(q, pi.dest);
+            else s_orig_lo_ap(s_ap_nif, q);
+            handled = true;
+        }
+    } else if (pi.eth_type == ETHTYPE_ARP) {
+        arp_hdr_t *arp = (arp_hdr_t *)pkt_at(p, sizeof(eth_hdr_t), sizeof(arp_hdr_t));
         if (arp) {
+#if BRIDGE_ARP_CACHE
+            arpc_learn(arp);
+#endif
             if (ntohs(arp->op) == 1 && fdb_lookup(arp->tpa)) {
                 send_proxy_arp_reply(s_sta_nif, s_orig_lo_sta, arp, arp->tpa);
-                handled = true; pbuf_free(q); pbuf_free(p); return ERR_OK;
+                PERF_VERDICT(PERF_FWD);
+                pbuf_free(p); return ERR_OK;
             }
-            os_memcpy(arp->sha, s_ap_nif->hwaddr, 6);
             const uint8_t *mac = NULL;
             if (!is_bcast) { if (s_sta_nif->ip_addr.addr && arp->tpa != s_sta_nif->ip_addr.addr) mac = fdb_lookup(arp->tpa); }
-            if (is_bcast || mac) {
+            if ((is_bcast || mac) && (q = bridge_fwd_pbuf(p, 0)) != NULL) {
+                eth = (eth_hdr_t *)q->payload; arp = (arp_hdr_t *)((uint8_t *)q->payload + sizeof(eth_hdr_t));
+                os_memcpy(eth->src, s_ap_nif->hwaddr, 6);
+                os_memcpy(arp->sha, s_ap_nif->hwaddr, 6);
                 if (mac) { os_memcpy(eth->dst, mac, 6); os_memcpy(arp->tha, mac, 6); }
                 s_orig_lo_ap(s_ap_nif, q); handled = true;
             }
         }
     }
-    
-    pbuf_free(q);
 
+    if (q != NULL) pbuf_free(q);
+
+    if (handled) PERF_VERDICT(PERF_FWD);
     if (is_bcast || (is_to_sta_mac && !handled)) return s_orig_input_sta(p, inp);
+    if (!handled) PERF_VERDICT(PERF_DROP);
     pbuf_free(p); return ERR_OK;
 }
 /*
@@ -720,25 +1568,82 @@ static err_t ICACHE_FLASH_ATTR bridge_input_sta(struct pbuf *p, struct netif *in
     pbuf_free(p); return ERR_OK;
 }
 */
+#if PERF_STATS
+static err_t ICACHE_FLASH_ATTR bridge_input_ap_timed(struct pbuf *p, struct netif *inp)
+{
+    PERF_START(t);
+    err_t err = bridge_input_ap(p, inp);
+    PERF_END(PERF_BRIDGE_AP, t);
+    return err;
+}
+
+static err_t ICACHE_FLASH_ATTR bridge_input_sta_timed(struct pbuf *p, struct netif *inp)
+{
+    PERF_START(t);
+    err_t err = bridge_input_sta(p, inp);
+    PERF_END(PERF_BRIDGE_STA, t);
+    return err;
+}
+#define BRIDGE_INPUT_AP  bridge_input_ap_timed
+#define BRIDGE_INPUT_STA bridge_input_sta_timed
+#else
+#define BRIDGE_INPUT_AP  bridge_input_ap
+#define BRIDGE_INPUT_STA bridge_input_sta
+#endif
+
 void ICACHE_FLASH_ATTR bridge_init(struct netif *sta_nif, struct netif *ap_nif)
 {
     s_sta_nif = sta_nif; s_ap_nif = ap_nif;
-    s_orig_input_sta = sta_nif->input; sta_nif->input = bridge_input_sta;
-    s_orig_input_ap = ap_nif->input; ap_nif->input = bridge_input_ap;
+    /* The ssid only changes with a reconnect, which calls us again */
+    s_unconfigured = os_strcmp(config.ssid, WIFI_SSID) == 0;
+    s_orig_input_sta = sta_nif->input; sta_nif->input = BRIDGE_INPUT_STA;
+    s_orig_input_ap = ap_nif->input; ap_nif->input = BRIDGE_INPUT_AP;
     s_orig_output_sta = sta_nif->output; sta_nif->output = bridge_output_sta;
     s_orig_output_ap = ap_nif->output; ap_nif->output = bridge_output_ap;
     s_orig_lo_sta = sta_nif->linkoutput; s_orig_lo_ap = ap_nif->linkoutput;
     netif_set_default(sta_nif); sta_nif->napt = 0; ap_nif->napt = 0;
-    os_memset(s_fdb, 0, sizeof(s_fdb)); os_memset(s_xid_map, 0, sizeof(s_xid_map));
+    os_memset(s_fdb, 0, sizeof(s_fdb)); s_fdb_count = 0; os_memset(s_xid_map, 0, sizeof(s_xid_map));
+#if BRIDGE_FDB_MAC_INDEX
+    os_memset(s_fdb_mac, 0, sizeof(s_fdb_mac));
+#endif
+#if BRIDGE_ARP_CACHE
+    os_memset(s_arpc, 0, sizeof(s_arpc));
+#endif
+#if BRIDGE_IGMP_SNOOP
+    os_memset(s_igmp, 0, sizeof(s_igmp)); s_igmp_query_s = 0; s_igmp_full_s = 0;
+#endif
+    s_now_s = now_secs();
+#if BRIDGE_POOL_FRAMES > 0
+    pool_init();
+#endif
     struct softap_config ap_cfg; wifi_softap_get_config(&ap_cfg); ap_cfg.channel = my_channel; wifi_softap_set_config(&ap_cfg);
     wifi_set_sleep_type(NONE_SLEEP_T);
     os_printf("bridge: init done\n");
 }
 
+void ICACHE_FLASH_ATTR bridge_tick(void)
+{
+    uint16_t i;
+
+    s_now_s = now_secs();
+    for (i = 0; i < FDB_SIZE; i++) {
+        while (s_fdb[i].ip != 0 && s_fdb[i].expires_s <= s_now_s) fdb_remove(i);
+    }
+#if BRIDGE_IGMP_SNOOP
+    igmp_tick();
+#endif
+#if BRIDGE_BCAST_LIMIT
+    bcast_tick();
+#endif
+#if BRIDGE_ARP_CACHE
+    arpc_tick();
+#endif
+}
+
 void ICACHE_FLASH_ATTR bridge_show_fdb(void)
 {
-    uint32_t now = now_secs();
-    os_printf("Repeater FDB (IP -> Client MAC):\n");
+    uint32_t now = s_now_s;
+    os_printf("Repeater FDB (IP -> Client MAC, %d/%d):\n", s_fdb_count, FDB_MAX_FILL);
     int i, count = 0;
     for (i = 0; i < FDB_SIZE; i++) {
         if (s_fdb[i].ip != 0 && s_fdb[i].expires_s > now) {
@@ -753,4 +1658,62 @@ void ICACHE_FLASH_ATTR bridge_show_fdb(void)
     if (count == 0) os_printf("  (empty)\n");
 }
 
+#if BRIDGE_IGMP_SNOOP
+void ICACHE_FLASH_ATTR bridge_show_igmp(void)
+{
+    int i, count = 0;
+    os_printf("IGMP snooping %s, ", config.igmp_snoop ? (s_igmp_full_s ? "suspended (table full)" : "on") : "off");
+    if (s_igmp_query_s)
+        os_printf("querier seen %d s ago, GMI %d s\n", s_now_s - s_igmp_query_s, s_igmp_gmi);
+    else
+        os_printf("no querier\n");
+    for (i = 0; i < BRIDGE_IGMP_SIZE; i++) {
+        if (s_igmp[i].group == 0) continue;
+        os_printf("  " IPSTR " -> %02x:%02x:%02x:%02x:%02x:%02x",
+                  IP2STR(&s_igmp[i].group),
+                  s_igmp[i].mac[0], s_igmp[i].mac[1], s_igmp[i].mac[2],
+                  s_igmp[i].mac[3], s_igmp[i].mac[4], s_igmp[i].mac[5]);
+        os_printf(" (expires in %d s)\n", (int)(s_igmp[i].expires_s - s_now_s));
+        count++;
+    }
+    if (count == 0) os_printf("  (no members)\n");
+    os_printf("IGMP: %d reports, %d leaves, %d queries, %d expired, %d frames without members\n",
+              s_igmp_reports, s_igmp_leaves, s_igmp_queries, s_igmp_expired, s_igmp_unregistered);
+}
+#endif
+
+void ICACHE_FLASH_ATTR bridge_show_stats(void)
+{
+    os_printf("Forwarding: %d copied, %d alloc failed\n",
+              s_fwd_copied, s_fwd_alloc_failed);
+#if BRIDGE_POOL_FRAMES > 0
+    pool_reclaim();
+    os_printf("Frame pool: %d/%d in use, high-water %d, exhausted %d, heap fallback %d\n",
+              pool_in_use(), s_pool_n, s_pool_hwm, s_pool_exhausted, s_pool_heap);
+#endif
+#if BRIDGE_MCAST_UNICAST
+    os_printf("Multicast to unicast: %d frames, %d copies, %d sent as multicast\n",
+              s_mcast_unicast, s_mcast_copies, s_mcast_fallback);
+#endif
+#if BRIDGE_ARP_CACHE
+    uint32_t lookups = s_arpc_hits + s_arpc_misses;
+    int i, n = 0;
+    for (i = 0; i < BRIDGE_ARP_CACHE_SIZE; i++) if (s_arpc[i].ip != 0) n++;
+    os_printf("ARP cache: %d/%d entries, %d hits, %d misses (%d%% hits), %d learned, %d expired, %d probes, %d verified\n",
+              n, BRIDGE_ARP_CACHE_SIZE, s_arpc_hits, s_arpc_misses, lookups ? (int)((uint64_t)s_arpc_hits * 100 / lookups) : 0,
+              s_arpc_learned, s_arpc_expired, s_arpc_probes, s_arpc_verified);
+#endif
+#if BRIDGE_BCAST_LIMIT
+    uint8_t dir, cls;
+    for (dir = 0; dir < 2; dir++) {
+        bcast_dir_t *d = &s_bcast[dir];
+        os_printf("Broadcasts from %s: peak %d/s, %d storms%s\n", dir == BCAST_FROM_AP ? "AP" : "STA",
+                  d->peak, d->storms, d->storm ? ", storm now" : "");
+        for (cls = 0; cls < BCAST_CLASSES; cls++)
+            os_printf(" %s %d/%d", s_bcast_names[cls], d->passed[cls], d->dropped[cls]);
+        os_printf(" (passed/dropped)\n");
+    }
+#endif
+}
+
 #endif /* REPEATER_MODE */
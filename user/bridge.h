@@ -5,11 +5,30 @@
 
 #include "lwip/netif.h"
 
+/* Classes of the broadcast rate limits */
+#define BCAST_ARP       0
+#define BCAST_DHCP      1
+#define BCAST_MDNS      2
+#define BCAST_SSDP      3
+#define BCAST_OTHER     4
+#define BCAST_CLASSES   5
+
 /* Called once from user_main.c EVENT_STAMODE_GOT_IP when both netifs are ready.
    Installs input hooks on both netifs, saves linkoutput pointers for forwarding,
    and locks the AP channel to the current STA channel. */
 void bridge_init(struct netif *sta_netif, struct netif *ap_netif);
+/* Called once a second from timer_func(): advances the bridge's coarse
+   clock and purges expired FDB entries. */
+void bridge_tick(void);
 void bridge_show_fdb(void);
+#if BRIDGE_IGMP_SNOOP
+void bridge_show_igmp(void);
+#endif
+void bridge_show_stats(void);
+#if BRIDGE_BCAST_LIMIT
+/* Console name of a BCAST_* class */
+const char *bridge_bcast_name(uint8_t cls);
+#endif
 
 #endif /* REPEATER_MODE */
 #endif /* _BRIDGE_H_ */
@@ -0,0 +1,158 @@
+#include "user_config.h"
+
+#if REMOTE_MONITORING
+
+#include "c_types.h"
+#include "osapi.h"
+#include "mem.h"
+#include "user_interface.h"
+#include "sys_time.h"
+#include "cap_ring.h"
+
+bool ICACHE_FLASH_ATTR cap_ring_init(cap_ring_t *r, uint16_t size)
+{
+    os_memset(r, 0, sizeof(cap_ring_t));
+    r->buf = (uint8_t *)os_malloc(size);
+    if (r->buf == NULL)
+        return false;
+    r->size = size;
+    r->wrap = size;
+    return true;
+}
+
+void ICACHE_FLASH_ATTR cap_ring_free(cap_ring_t *r)
+{
+    if (r->buf != NULL)
+        os_free(r->buf);
+    os_memset(r, 0, sizeof(cap_ring_t));
+}
+
+void ICACHE_FLASH_ATTR cap_ring_reset(cap_ring_t *r)
+{
+    r->head = r->tail = 0;
+    r->wrap = r->size;
+    r->packets = r->drops = r->truncated = 0;
+}
+
+uint16_t ICACHE_FLASH_ATTR cap_ring_space(cap_ring_t *r)
+{
+    uint16_t h = r->head, t = r->tail, end;
+
+    if (r->buf == NULL)
+        return 0;
+    if (h < t)
+        return t - h - 1;
+    /* one byte stays free, so that a full ring never looks empty */
+    end = r->size - h - (t == 0 ? 1 : 0);
+    return (t > 0 && t - 1 > end) ? t - 1 : end;
+}
+
+uint8_t * ICACHE_FLASH_ATTR cap_ring_reserve(cap_ring_t *r, uint16_t len)
+{
+    uint16_t h = r->head, t = r->tail;
+
+    if (r->buf == NULL || len == 0)
+        return NULL;
+
+    if (h < t)
+    {
+        if (len < t - h)
+        {
+            r->res_off = h;
+            return r->buf + h;
+        }
+    }
+    else
+    {
+        if (len <= r->size - h - (t == 0 ? 1 : 0))
+        {
+            r->res_off = h;
+            return r->buf + h;
+        }
+        /* does not fit behind head: restart at the beginning */
+        if (len < t)
+        {
+            r->res_off = 0;
+            return r->buf;
+        }
+    }
+
+    r->drops++;
+    return NULL;
+}
+
+void ICACHE_FLASH_ATTR cap_ring_commit(cap_ring_t *r, uint16_t len)
+{
+    uint16_t h = r->head;
+
+    if (r->res_off != h)
+    {
+        /* wrapped: data ends at the old head */
+        r->wrap = h;
+        h = 0;
+    }
+    h += len;
+    if (h == r->size)
+    {
+        r->wrap = r->size;
+        h = 0;
+    }
+    r->head = h;
+    r->packets++;
+}
+
+uint16_t ICACHE_FLASH_ATTR cap_ring_peek(cap_ring_t *r, uint8_t **data, uint16_t max)
+{
+    uint16_t h = r->head, t = r->tail, end;
+
+    if (r->buf == NULL)
+        return 0;
+    if (h < t && t >= r->wrap)
+    {
+        /* follow the producer to the start of the buffer */
+        r->wrap = r->size;
+        r->tail = t = 0;
+    }
+    if (h == t)
+        return 0;
+
+    end = (h > t) ? h : r->wrap;
+    *data = r->buf + t;
+    return (end - t > max) ? max : end - t;
+}
+
+void ICACHE_FLASH_ATTR cap_ring_consume(cap_ring_t *r, uint16_t len)
+{
+    r->tail += len;
+}
+
+void ICACHE_FLASH_ATTR cap_ring_timestamp(uint32_t *sec, uint32_t *usec)
+{
+    static uint32_t ts_sec, ts_base;
+    static bool ts_valid;
+    uint32_t now = system_get_time();
+    uint32_t d = now - ts_base;
+
+    /* resync with the 64 bit system time after a pause, as the
+       microsecond counter wraps every 71 minutes */
+    if (!ts_valid || d >= 60000000)
+    {
+        uint64_t t = get_long_systime();
+
+        now = (uint32_t)t;
+        ts_sec = (uint32_t)(t / 1000000);
+        d = (uint32_t)(t - (uint64_t)ts_sec * 1000000);
+        ts_base = now - d;
+        ts_valid = true;
+    }
+    while (d >= 1000000)
+    {
+        d -= 1000000;
+        ts_base += 1000000;
+        ts_sec++;
+    }
+    *sec = ts_sec;
+    *usec = d;
+}
+
+#endif /* REMOTE_MONITORING */
@@ -0,0 +1,52 @@
+#ifndef _CAP_RING_H_
+#define _CAP_RING_H_
+
+#include "c_types.h"
+
+/*
+ * Single-producer/single-consumer ring for captured frames.
+ *
+ * The producer (the netif hooks) reserves one contiguous record per frame,
+ * fills it in place and commits it. Records never wrap around the end of
+ * the buffer, so the consumer (the monitor's TCP sent callback) can hand
+ * the bytes between tail and head directly to espconn_send() and release
+ * them only after they have been sent.
+ *
+ * head is only written by the producer and tail only by the consumer.
+ * wrap marks the end of valid data after the producer has wrapped to the
+ * start of the buffer, it is reset by the consumer when it follows.
+ */
+
+typedef struct _cap_ring {
+    uint8_t           *buf;
+    uint16_t           size;
+    volatile uint16_t  head;
+    volatile uint16_t  tail;
+    volatile uint16_t  wrap;
+    uint16_t           res_off;      /* offset of the pending reservation */
+    uint32_t           packets;      /* records committed */
+    uint32_t           drops;        /* records that did not fit */
+    uint32_t           truncated;    /* records shortened to save space */
+} cap_ring_t;
+
+bool cap_ring_init(cap_ring_t *r, uint16_t size);
+void cap_ring_free(cap_ring_t *r);
+void cap_ring_reset(cap_ring_t *r);
+
+/* Number of bytes a single record could get right now */
+uint16_t cap_ring_space(cap_ring_t *r);
+
+/* Producer: returns len contiguous bytes or NULL (counted as drop),
+   cap_ring_commit() makes them visible to the consumer. */
+uint8_t *cap_ring_reserve(cap_ring_t *r, uint16_t len);
+void cap_ring_commit(cap_ring_t *r, uint16_t len);
+
+/* Consumer: returns the length of the contiguous span at the tail (at most
+   max bytes), cap_ring_consume() releases it after it has been sent. */
+uint16_t cap_ring_peek(cap_ring_t *r, uint8_t **data, uint16_t max);
+void cap_ring_consume(cap_ring_t *r, uint16_t len);
+
+/* Capture timestamp, only doing a 64 bit division once in a while */
+void cap_ring_timestamp(uint32_t *sec, uint32_t *usec);
+
+#endif /* _CAP_RING_H_ */
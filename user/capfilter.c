@@ -0,0 +1,294 @@
+#include "user_config.h"
+
+#if REMOTE_MONITORING
+
+#include "c_types.h"
+#include "osapi.h"
+#include "lwip/ip_addr.h"
+#include "capfilter.h"
+
+typedef struct {
+    char      **tok;
+    int         n;
+    int         pos;
+    int         depth;
+    bool        err;
+    capf_prog  *prog;
+} capf_parser;
+
+static bool ICACHE_FLASH_ATTR capf_number(const char *s, uint32_t *val)
+{
+    uint32_t v = 0;
+    uint8_t base = 10;
+
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+    {
+        base = 16;
+        s += 2;
+    }
+    if (*s == 0)
+        return false;
+    for (; *s != 0; s++)
+    {
+        uint8_t d;
+        if (*s >= '0' && *s <= '9')
+            d = *s - '0';
+        else if (base == 16 && *s >= 'a' && *s <= 'f')
+            d = *s - 'a' + 10;
+        else if (base == 16 && *s >= 'A' && *s <= 'F')
+            d = *s - 'A' + 10;
+        else
+            return false;
+        v = v * base + d;
+    }
+    *val = v;
+    return true;
+}
+
+/* "a.b.c.d" or "a.b.c.d/bits" */
+static bool ICACHE_FLASH_ATTR capf_addr(const char *s, uint32_t *addr, uint32_t *mask, bool net)
+{
+    char buf[16];
+    uint32_t bits = 32;
+    int i;
+
+    for (i = 0; s[i] != 0 && s[i] != '/'; i++)
+    {
+        if (i >= sizeof(buf) - 1)
+            return false;
+        buf[i] = s[i];
+    }
+    buf[i] = 0;
+    if (s[i] == '/')
+    {
+        if (!net || !capf_number(&s[i + 1], &bits) || bits > 32)
+            return false;
+    }
+    *addr = ipaddr_addr(buf);
+    if (*addr == IPADDR_NONE && os_strcmp(buf, "255.255.255.255") != 0)
+        return false;
+    *mask = bits == 0 ? 0 : htonl(0xffffffff << (32 - bits));
+    *addr &= *mask;
+    return true;
+}
+
+static void ICACHE_FLASH_ATTR capf_emit(capf_parser *ps, uint8_t op, uint8_t dir, uint16_t val, uint32_t addr, uint32_t mask)
+{
+    capf_insn *in;
+
+    if (ps->prog->len >= CAPF_MAX_INSNS)
+    {
+        ps->err = true;
+        return;
+    }
+    in = &ps->prog->insn[ps->prog->len++];
+    in->op = op;
+    in->dir = dir;
+    in->val = val;
+    in->addr = addr;
+    in->mask = mask;
+
+    if (op == CAPF_OP_AND || op == CAPF_OP_OR)
+        ps->depth--;
+    else if (op != CAPF_OP_NOT)
+        ps->depth++;
+    if (ps->depth > CAPF_MAX_STACK)
+        ps->err = true;
+}
+
+static const char * ICACHE_FLASH_ATTR capf_next(capf_parser *ps)
+{
+    if (ps->pos >= ps->n)
+    {
+        ps->err = true;
+        return "";
+    }
+    return ps->tok[ps->pos++];
+}
+
+static bool ICACHE_FLASH_ATTR capf_peek(capf_parser *ps, const char *word)
+{
+    return ps->pos < ps->n && os_strcmp(ps->tok[ps->pos], word) == 0;
+}
+
+static void ICACHE_FLASH_ATTR capf_primitive(capf_parser *ps)
+{
+    const char *t = capf_next(ps);
+    uint8_t dir = CAPF_DIR_SRC | CAPF_DIR_DST;
+    uint32_t v = 0, addr = 0, mask = 0;
+
+    if (os_strcmp(t, "src") == 0 || os_strcmp(t, "dst") == 0)
+    {
+        dir = (t[0] == 's') ? CAPF_DIR_SRC : CAPF_DIR_DST;
+        t = capf_next(ps);
+    }
+
+    if (os_strcmp(t, "host") == 0 || os_strcmp(t, "net") == 0)
+    {
+        bool net = t[0] == 'n';
+        if (!capf_addr(capf_next(ps), &addr, &mask, net))
+            ps->err = true;
+        capf_emit(ps, CAPF_OP_NET, dir, 0, addr, mask);
+        return;
+    }
+    if (os_strcmp(t, "port") == 0)
+    {
+        if (!capf_number(capf_next(ps), &v) || v > 0xffff)
+            ps->err = true;
+        capf_emit(ps, CAPF_OP_PORT, dir, v, 0, 0);
+        return;
+    }
+    // the rest has no direction
+    if (dir != (CAPF_DIR_SRC | CAPF_DIR_DST))
+    {
+        ps->err = true;
+        return;
+    }
+
+    if (os_strcmp(t, "ip") == 0)
+        capf_emit(ps, CAPF_OP_ETHER, 0, 0x0800, 0, 0);
+    else if (os_strcmp(t, "arp") == 0)
+        capf_emit(ps, CAPF_OP_ETHER, 0, 0x0806, 0, 0);
+    else if (os_strcmp(t, "icmp") == 0)
+        capf_emit(ps, CAPF_OP_PROTO, 0, 1, 0, 0);
+    else if (os_strcmp(t, "tcp") == 0)
+        capf_emit(ps, CAPF_OP_PROTO, 0, 6, 0, 0);
+    else if (os_strcmp(t, "udp") == 0)
+        capf_emit(ps, CAPF_OP_PROTO, 0, 17, 0, 0);
+    else if (os_strcmp(t, "ether") == 0 || os_strcmp(t, "proto") == 0 ||
+             os_strcmp(t, "less") == 0 || os_strcmp(t, "greater") == 0)
+    {
+        uint8_t op = (t[0] == 'e') ? CAPF_OP_ETHER : (t[0] == 'p') ? CAPF_OP_PROTO :
+                     (t[0] == 'l') ? CAPF_OP_LESS : CAPF_OP_GREATER;
+        if (!capf_number(capf_next(ps), &v) || v > 0xffff || (op == CAPF_OP_PROTO && v > 0xff))
+            ps->err = true;
+        capf_emit(ps, op, 0, v, 0, 0);
+    }
+    else
+        ps->err = true;
+}
+
+static void ICACHE_FLASH_ATTR capf_factor(capf_parser *ps)
+{
+    if (capf_peek(ps, "not"))
+    {
+        ps->pos++;
+        capf_factor(ps);
+        capf_emit(ps, CAPF_OP_NOT, 0, 0, 0, 0);
+        return;
+    }
+    capf_primitive(ps);
+}
+
+static void ICACHE_FLASH_ATTR capf_term(capf_parser *ps)
+{
+    capf_factor(ps);
+    while (!ps->err && capf_peek(ps, "and"))
+    {
+        ps->pos++;
+        capf_factor(ps);
+        capf_emit(ps, CAPF_OP_AND, 0, 0, 0, 0);
+    }
+}
+
+bool ICACHE_FLASH_ATTR capf_compile(capf_prog *prog, char **tokens, int n)
+{
+    capf_parser ps;
+
+    os_memset(prog, 0, sizeof(capf_prog));
+    if (n == 0)
+        return true;
+
+    os_memset(&ps, 0, sizeof(ps));
+    ps.tok = tokens;
+    ps.n = n;
+    ps.prog = prog;
+
+    capf_term(&ps);
+    while (!ps.err && capf_peek(&ps, "or"))
+    {
+        ps.pos++;
+        capf_term(&ps);
+        capf_emit(&ps, CAPF_OP_OR, 0, 0, 0, 0);
+    }
+    if (ps.err || ps.pos != n || ps.depth != 1)
+    {
+        prog->len = 0;
+        return false;
+    }
+    return true;
+}
+
+static bool ICACHE_FLASH_ATTR capf_test(const capf_insn *in, const pkt_info *pi)
+{
+    switch (in->op)
+    {
+    case CAPF_OP_ETHER:
+        return pi->eth_type == in->val;
+    case CAPF_OP_PROTO:
+        return (pi->flags & PKT_F_IP) && pi->proto == in->val;
+    case CAPF_OP_NET:
+        if (!(pi->flags & PKT_F_IP))
+            return false;
+        return ((in->dir & CAPF_DIR_SRC) && (pi->src & in->mask) == in->addr) ||
+               ((in->dir & CAPF_DIR_DST) && (pi->dest & in->mask) == in->addr);
+    case CAPF_OP_PORT:
+        if (!(pi->flags & PKT_F_PORTS))
+            return false;
+        return ((in->dir & CAPF_DIR_SRC) && pi->s_port == in->val) ||
+               ((in->dir & CAPF_DIR_DST) && pi->d_port == in->val);
+    case CAPF_OP_LESS:
+        return pi->tot_len <= in->val;
+    case CAPF_OP_GREATER:
+        return pi->tot_len >= in->val;
+    }
+    return false;
+}
+
+bool ICACHE_FLASH_ATTR capf_match(const capf_prog *prog, const pkt_info *pi)
+{
+    bool stack[CAPF_MAX_STACK];
+    int sp = 0;
+    uint8_t i;
+
+    if (prog->len == 0)
+        return true;
+
+    // the stack depth has been checked by capf_compile()
+    for (i = 0; i < prog->len; i++)
+    {
+        const capf_insn *in = &prog->insn[i];
+
+        switch (in->op)
+        {
+        case CAPF_OP_AND:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] && stack[sp];
+            break;
+        case CAPF_OP_OR:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] || stack[sp];
+            break;
+        case CAPF_OP_NOT:
+            stack[sp - 1] = !stack[sp - 1];
+            break;
+        default:
+            stack[sp++] = capf_test(in, pi);
+        }
+    }
+    return stack[0];
+}
+
+bool ICACHE_FLASH_ATTR capf_per_flow(const capf_prog *prog)
+{
+    uint8_t i;
+
+    for (i = 0; i < prog->len; i++)
+    {
+        if (prog->insn[i].op == CAPF_OP_LESS || prog->insn[i].op == CAPF_OP_GREATER)
+            return false;
+    }
+    return true;
+}
+
+#endif /* REMOTE_MONITORING */
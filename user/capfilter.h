@@ -0,0 +1,61 @@
+#ifndef _CAPFILTER_H_
+#define _CAPFILTER_H_
+
+#include "c_types.h"
+#include "pkt_info.h"
+
+/*
+ * Capture filter for the remote monitor, a small subset of the tcpdump
+ * syntax compiled into postfix bytecode:
+ *
+ *   expr      := term { "or" term }
+ *   term      := factor { "and" factor }
+ *   factor    := "not" factor | primitive
+ *   primitive := "ip" | "arp" | "tcp" | "udp" | "icmp"
+ *              | "ether" <type> | "proto" <number>
+ *              | ["src"|"dst"] "host" <addr> | ["src"|"dst"] "net" <addr>/<bits>
+ *              | ["src"|"dst"] "port" <number>
+ *              | "less" <len> | "greater" <len>
+ *
+ * The program runs on the already parsed pkt_info, so packets that don't
+ * match are rejected before anything is copied.
+ */
+
+#define CAPF_MAX_INSNS  16
+#define CAPF_MAX_STACK  8
+
+#define CAPF_OP_ETHER   1   /* ethertype == val */
+#define CAPF_OP_PROTO   2   /* IP protocol == val */
+#define CAPF_OP_NET     3   /* address & mask == addr */
+#define CAPF_OP_PORT    4   /* TCP/UDP port == val */
+#define CAPF_OP_LESS    5   /* frame length <= val */
+#define CAPF_OP_GREATER 6   /* frame length >= val */
+#define CAPF_OP_AND     7
+#define CAPF_OP_OR      8
+#define CAPF_OP_NOT     9
+
+#define CAPF_DIR_SRC    0x1
+#define CAPF_DIR_DST    0x2
+
+typedef struct _capf_insn {
+    uint8_t  op;
+    uint8_t  dir;           /* CAPF_DIR_*, for NET and PORT */
+    uint16_t val;
+    uint32_t addr;          /* network byte order */
+    uint32_t mask;
+} capf_insn;
+
+typedef struct _capf_prog {
+    uint8_t   len;          /* 0: matches everything */
+    capf_insn insn[CAPF_MAX_INSNS];
+} capf_prog;
+
+/* Compiles the expression given as tokens. Returns false on a syntax
+   error or if the program gets too long. */
+bool capf_compile(capf_prog *prog, char **tokens, int n);
+bool capf_match(const capf_prog *prog, const pkt_info *pi);
+/* True if the result only depends on the flow (no length tests), so it
+   may be cached per flow */
+bool capf_per_flow(const capf_prog *prog);
+
+#endif /* _CAPFILTER_H_ */
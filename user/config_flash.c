@@ -21,9 +21,9 @@ uint32_t reg0, reg1, reg3;
     config->magic_number                = MAGIC_NUMBER;
     config->length                      = sizeof(sysconfig_t);
 
-    reg0 = *(uint32*)(0x3ff00050);
-    reg1 = *(uint32*)(0x3ff00054);
-    reg3 = *(uint32*)(0x3ff0005c);
+    reg0 = READ_PERI_REG(0x3ff00050);
+    reg1 = READ_PERI_REG(0x3ff00054);
+    reg3 = READ_PERI_REG(0x3ff0005c);
 
     if (reg3 != 0) {
     mac[0] = (reg3 >> 16) & 0xff;
@@ -91,6 +91,10 @@ uint32_t reg0, reg1, reg3;
     config->max_portmap	        = IP_PORTMAP_MAX;
     config->tcp_timeout			= 0;  // use default
     config->udp_timeout			= 0;  // use default
+    config->max_nat_client		= 0;  // half of max_nat
+#if MSS_CLAMP
+    config->mss_clamp			= 0;  // off
+#endif
 
     IP4_ADDR(&config->network_addr, 192, 168, 4, 1);
     config->dns_addr.addr		= 0;  // use DHCP
@@ -121,6 +125,28 @@ uint32_t reg0, reg1, reg3;
 #if TOKENBUCKET
     config->kbps_ds			= 0;
     config->kbps_us			= 0;
+    config->qos_queue_len		= 0;   // drop
+#endif
+#if BRIDGE_MCAST_UNICAST
+    config->mcast_unicast		= 0;  // off
+#endif
+#if BRIDGE_IGMP_SNOOP
+    config->igmp_snoop			= 0;
+#endif
+#if BRIDGE_BCAST_LIMIT
+    os_memset(config->bcast_rate, 0, sizeof(config->bcast_rate));  // no limits
+    config->storm_rate			= 0;  // off
+#endif
+#if BRIDGE_ARP_CACHE
+    config->arp_cache_ttl		= 0;  // off
+    config->arp_cache_probe		= 1;
+#endif
+#if PKT_DEFER
+    config->hook_defer			= 0;
+#endif
+#if CONN_LIMIT
+    config->conn_rate			= 0;
+    config->conn_burst			= 20;
 #endif
 
 #if MQTT_CLIENT
@@ -210,6 +236,9 @@ int ICACHE_FLASH_ATTR config_load(sysconfig_p config)
 #if ACLS
     os_memcpy(&acl, &(config->acl), sizeof(acl));
     os_memcpy(&acl_freep, &(config->acl_freep), sizeof(acl_freep));
+    int i;
+    for (i = 0; i < MAX_NO_ACLS; i++)
+        acl_compile(i);
 #endif
     return 0;
 }
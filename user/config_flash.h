@@ -13,6 +13,7 @@
 
 #include "user_config.h"
 #include "acl.h"
+#include "bridge.h"
 
 #define FLASH_BLOCK_NO 0x68
 
@@ -76,6 +77,10 @@ typedef struct {
         uint32_t max_portmap;   // Max number of portmaps
 	uint32_t tcp_timeout; // NAT timeout of TCP connections
 	uint32_t udp_timeout; // NAT timeout of UDO 'connections'
+        uint16_t max_nat_client; // Max NAT entries of one client (0: half of max_nat)
+#if MSS_CLAMP
+        uint16_t mss_clamp; // Max TCP MSS of the routed connections (0: unchanged)
+#endif
 
         ip_addr_t network_addr; // Address of the internal network
         ip_addr_t dns_addr; // Optional: address of the dns server
@@ -107,6 +112,28 @@ typedef struct {
 #if TOKENBUCKET
         uint32_t kbps_ds; // Average downstream bitrate (0 if no limit);
         uint32_t kbps_us; // Average upstream bitrate (0 if no limit);
+        uint8_t qos_queue_len; // Packets queued per direction when over the limit (0: drop, default)
+#endif
+#if BRIDGE_MCAST_UNICAST
+        uint8_t mcast_unicast; // Max AP clients a multicast frame is copied to as unicast (0: off)
+#endif
+#if BRIDGE_IGMP_SNOOP
+        uint8_t igmp_snoop; // Send multicast only to the AP clients that joined the group
+#endif
+#if BRIDGE_BCAST_LIMIT
+        uint16_t bcast_rate[BCAST_CLASSES]; // Broadcasts per second and direction of each class (0: no limit)
+        uint16_t storm_rate; // Broadcasts per second that trigger the storm protection (0: off)
+#endif
+#if BRIDGE_ARP_CACHE
+        uint16_t arp_cache_ttl; // Secs an upstream ARP reply is used to answer AP clients (0: off)
+        uint8_t arp_cache_probe; // Verify the used entries with unicast ARP requests
+#endif
+#if PKT_DEFER
+        uint8_t hook_defer; // Packets per run of the deferred hook task (0: hooks run on receive)
+#endif
+#if CONN_LIMIT
+        uint16_t conn_rate; // New connections per second of an AP client (0 if no limit)
+        uint16_t conn_burst; // New connections of an AP client in a burst
 #endif
 #if MQTT_CLIENT
         uint8_t mqtt_host[32]; // IP or hostname of the MQTT broker, "none" if empty
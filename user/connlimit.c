@@ -0,0 +1,158 @@
+#include "user_config.h"
+
+#if CONN_LIMIT
+
+#include "c_types.h"
+#include "osapi.h"
+#include "user_interface.h"
+#include "lwip/ip.h"
+#include "lwip/tcp_impl.h"
+#include "connlimit.h"
+#if NAPT_INTREE
+#include "napt.h"
+#endif
+
+static connlimit_client connlimit_clients[CONNLIMIT_CLIENTS];
+static uint32_t connlimit_drop_count;
+static connlimit_cb connlimit_report;
+
+void ICACHE_FLASH_ATTR connlimit_init(connlimit_cb cb)
+{
+    os_memset(connlimit_clients, 0, sizeof(connlimit_clients));
+    connlimit_drop_count = 0;
+    connlimit_report = cb;
+}
+
+static void ICACHE_FLASH_ATTR connlimit_refill(connlimit_client *c, uint32_t now, uint16_t rate, uint16_t burst)
+{
+    uint32_t ms = (now - c->last_us) / 1000;
+    uint64_t tokens;
+
+    // whole ms only, the rest is carried
+    c->last_us += ms * 1000;
+    tokens = c->tokens + (uint64_t)ms * rate;
+    c->tokens = tokens >= 1000 * (uint32_t)burst ? 1000 * (uint32_t)burst : (uint32_t)tokens;
+}
+
+/* The entry of addr, a new one (the longest idle, not limited) if it has none */
+static connlimit_client * ICACHE_FLASH_ATTR connlimit_client_get(uint32_t addr, uint32_t now, uint16_t burst)
+{
+    connlimit_client *c, *slot = NULL;
+    uint8_t i;
+
+    for (i = 0; i < CONNLIMIT_CLIENTS; i++)
+    {
+        c = &connlimit_clients[i];
+        if (c->addr == addr)
+            return c;
+        if (c->addr == 0)
+        {
+            if (slot == NULL || slot->addr != 0)
+                slot = c;
+        }
+        else if (!c->limited && (slot == NULL || (slot->addr != 0 && c->idle_s > slot->idle_s)))
+        {
+            slot = c;
+        }
+    }
+    if (slot == NULL)
+        return NULL;
+
+    os_memset(slot, 0, sizeof(connlimit_client));
+    slot->addr = addr;
+    slot->tokens = 1000 * (uint32_t)burst;
+    slot->last_us = now;
+    return slot;
+}
+
+static bool ICACHE_FLASH_ATTR connlimit_is_new(const pkt_info *pi)
+{
+    if (pi->proto == IP_PROTO_TCP)
+        return (pi->flags & PKT_F_PORTS) && (pi->tcp_flags & (TCP_SYN | TCP_ACK | TCP_RST)) == TCP_SYN;
+#if NAPT_INTREE
+    // without the NAPT there is no cheap way to tell a first UDP packet
+    if (pi->proto == IP_PROTO_UDP)
+        return (pi->flags & PKT_F_PORTS) && napt_active() && !napt_has_session(pi);
+#endif
+    return false;
+}
+
+bool ICACHE_FLASH_ATTR connlimit_check(const pkt_info *pi, struct netif *inp, uint16_t rate, uint16_t burst)
+{
+    connlimit_client *c;
+    uint32_t now;
+
+    if ((pi->flags & (PKT_F_IP | PKT_F_FRAG)) != PKT_F_IP || pi->src == 0)
+        return true;
+    // local traffic doesn't get a session
+    if (pi->dest == 0xffffffff || (ntohl(pi->dest) >> 28) == 0xe ||
+        (pi->dest & inp->netmask.addr) == (inp->ip_addr.addr & inp->netmask.addr))
+        return true;
+    if (!connlimit_is_new(pi))
+        return true;
+
+    now = system_get_time();
+    c = connlimit_client_get(pi->src, now, burst);
+    if (c == NULL)
+        return true;
+    connlimit_refill(c, now, rate, burst);
+    c->idle_s = 0;
+
+    if (c->tokens >= 1000)
+    {
+        c->tokens -= 1000;
+        c->allowed++;
+        return true;
+    }
+
+    c->dropped++;
+    c->quiet_s = 0;
+    connlimit_drop_count++;
+    if (!c->limited)
+    {
+        c->limited = 1;
+        c->episode = 0;
+        if (connlimit_report != NULL)
+            connlimit_report(c->addr, true, 0);
+    }
+    c->episode++;
+    return false;
+}
+
+void ICACHE_FLASH_ATTR connlimit_tick(uint16_t rate, uint16_t burst)
+{
+    uint32_t now = system_get_time();
+    uint8_t i;
+
+    for (i = 0; i < CONNLIMIT_CLIENTS; i++)
+    {
+        connlimit_client *c = &connlimit_clients[i];
+
+        if (c->addr == 0)
+            continue;
+        // keeps the time since the last refill far from the wrap around
+        connlimit_refill(c, now, rate, burst);
+        if (c->limited && ++c->quiet_s >= CONNLIMIT_QUIET_S)
+        {
+            c->limited = 0;
+            if (connlimit_report != NULL)
+                connlimit_report(c->addr, false, c->episode);
+        }
+        if (!c->limited && ++c->idle_s >= CONNLIMIT_IDLE_S)
+            c->addr = 0;
+    }
+}
+
+connlimit_client * ICACHE_FLASH_ATTR connlimit_get_client(uint8_t i)
+{
+    if (i >= CONNLIMIT_CLIENTS || connlimit_clients[i].addr == 0)
+        return NULL;
+    return &connlimit_clients[i];
+}
+
+uint32_t ICACHE_FLASH_ATTR connlimit_drops(void)
+{
+    return connlimit_drop_count;
+}
+
+#endif /* CONN_LIMIT */
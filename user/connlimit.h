@@ -0,0 +1,51 @@
+#ifndef _CONNLIMIT_H_
+#define _CONNLIMIT_H_
+
+#include "c_types.h"
+#include "lwip/netif.h"
+#include "pkt_info.h"
+
+/*
+ * Rate limit of the new connections of each AP client, checked on ap-in
+ * before the packets can create a NAPT session. Every client address has
+ * a token bucket of "burst" connections, refilled with "rate" per second.
+ * New connections are TCP SYNs and, with the in-tree NAPT, UDP packets
+ * that don't belong to a session yet. Traffic to the AP network itself,
+ * broadcasts and multicasts are not counted.
+ *
+ * A client is "limited" from its first drop until it had no drops for
+ * CONNLIMIT_QUIET_S seconds. The start and the end of that are reported
+ * to the callback.
+ */
+
+#define CONNLIMIT_CLIENTS   (MAX_CLIENTS * 2)
+#define CONNLIMIT_QUIET_S   10
+/* Clients without a new connection for this long are forgotten */
+#define CONNLIMIT_IDLE_S    300
+
+typedef struct _connlimit_client {
+    uint32_t addr;          /* 0 if unused */
+    uint32_t tokens;        /* 1/1000 connections */
+    uint32_t last_us;       /* system_get_time() of the last refill */
+    uint32_t allowed;
+    uint32_t dropped;
+    uint32_t episode;       /* drops since it became limited */
+    uint16_t idle_s;        /* secs since the last new connection */
+    uint8_t  limited;
+    uint8_t  quiet_s;       /* secs without a drop while limited */
+} connlimit_client;
+
+/* limited: start (true) or end (false), dropped: drops while limited */
+typedef void (*connlimit_cb)(uint32_t addr, bool limited, uint32_t dropped);
+
+void connlimit_init(connlimit_cb cb);
+/* A packet from an AP client on inp: false if it is a new connection
+   over the limit of rate per second with a burst of burst */
+bool connlimit_check(const pkt_info *pi, struct netif *inp, uint16_t rate, uint16_t burst);
+/* Called once per second, refills the buckets and ends the limited state */
+void connlimit_tick(uint16_t rate, uint16_t burst);
+/* Returns the client entry i, or NULL if unused */
+connlimit_client *connlimit_get_client(uint8_t i);
+uint32_t connlimit_drops(void);
+
+#endif /* _CONNLIMIT_H_ */
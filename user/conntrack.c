@@ -0,0 +1,274 @@
+#include "user_config.h"
+
+#if CONNTRACK_SIZE
+
+#include "c_types.h"
+#include "osapi.h"
+#include "lwip/ip.h"
+#include "lwip/tcp_impl.h"
+#include "lwip/lwip_napt.h"
+#include "conntrack.h"
+
+#if CONNTRACK_SIZE == 16
+#define CT_HASH_BITS    4
+#elif CONNTRACK_SIZE == 32
+#define CT_HASH_BITS    5
+#elif CONNTRACK_SIZE == 64
+#define CT_HASH_BITS    6
+#elif CONNTRACK_SIZE == 128
+#define CT_HASH_BITS    7
+#else
+#error "CONNTRACK_SIZE must be 0, 16, 32, 64 or 128"
+#endif
+
+#define CT_NONE         0xff
+#define CT_CLOSED       (CT_F_RST | CT_F_FIN_OUT | CT_F_FIN_IN)
+
+static ct_entry ct_table[CONNTRACK_SIZE];
+static uint8_t ct_head[1 << CT_HASH_BITS];
+static uint8_t ct_free;
+static bool ct_ready;
+static uint32_t ct_now;
+static uint32_t ct_timeout_tcp = IP_NAPT_TIMEOUT_MS_TCP / 1000;
+static uint32_t ct_timeout_udp = IP_NAPT_TIMEOUT_MS_UDP / 1000;
+static ct_stats ct_stat;
+
+static void ICACHE_FLASH_ATTR ct_init(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < sizeof(ct_head); i++)
+        ct_head[i] = CT_NONE;
+    // all entries on the free list
+    for (i = 0; i < CONNTRACK_SIZE; i++)
+    {
+        ct_table[i].flags = 0;
+        ct_table[i].next = (i + 1 < CONNTRACK_SIZE) ? i + 1 : CT_NONE;
+    }
+    ct_free = 0;
+    ct_stat.used = 0;
+    ct_stat.size = CONNTRACK_SIZE;
+    ct_ready = true;
+}
+
+static uint8_t ICACHE_FLASH_ATTR ct_hash(uint8_t side, uint8_t proto, uint32_t src, uint32_t dest, uint32_t ports)
+{
+    uint32_t h = src ^ (dest * 31) ^ ports ^ ((uint32_t)proto << 8) ^ side;
+
+    return (uint8_t)((uint32_t)(h * 2654435761U) >> (32 - CT_HASH_BITS));
+}
+
+static uint32_t ICACHE_FLASH_ATTR ct_timeout(ct_entry *e)
+{
+    if (e->proto != IP_PROTO_TCP)
+        return ct_timeout_udp;
+    // the remaining packets of a closing connection still get through
+    if ((e->flags & CT_F_RST) || (e->flags & (CT_F_FIN_OUT | CT_F_FIN_IN)) == (CT_F_FIN_OUT | CT_F_FIN_IN))
+        return IP_NAPT_TIMEOUT_MS_TCP_DISCON / 1000;
+    return ct_timeout_tcp;
+}
+
+static void ICACHE_FLASH_ATTR ct_remove(uint8_t idx)
+{
+    ct_entry *e = &ct_table[idx];
+    uint8_t *pp = &ct_head[ct_hash(e->side, e->proto, e->src, e->dest, ((uint32_t)e->s_port << 16) | e->d_port)];
+
+    while (*pp != idx)
+        pp = &ct_table[*pp].next;
+    *pp = e->next;
+
+    e->flags = 0;
+    e->next = ct_free;
+    ct_free = idx;
+    ct_stat.used--;
+}
+
+// The outbound orientation of the tuple is the key
+static ct_entry * ICACHE_FLASH_ATTR ct_find(uint8_t side, uint8_t proto, uint32_t src, uint32_t dest,
+                                            uint16_t s_port, uint16_t d_port, uint8_t *hash)
+{
+    uint8_t i;
+
+    *hash = ct_hash(side, proto, src, dest, ((uint32_t)s_port << 16) | d_port);
+    for (i = ct_head[*hash]; i != CT_NONE; i = ct_table[i].next)
+    {
+        ct_entry *e = &ct_table[i];
+
+        if (e->src == src && e->dest == dest && e->s_port == s_port &&
+            e->d_port == d_port && e->proto == proto && e->side == side)
+        {
+            if (ct_now - e->last > ct_timeout(e))
+            {
+                ct_remove(i);
+                ct_stat.expired++;
+                return NULL;
+            }
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// Least recently used connection, closing TCP connections first
+static uint8_t ICACHE_FLASH_ATTR ct_victim(void)
+{
+    uint8_t i, best = 0;
+    uint32_t age, best_age = 0;
+
+    for (i = 0; i < CONNTRACK_SIZE; i++)
+    {
+        age = ct_now - ct_table[i].last;
+        if (ct_table[i].flags & CT_CLOSED)
+            age += ct_timeout_tcp;
+        if (age >= best_age)
+        {
+            best = i;
+            best_age = age;
+        }
+    }
+    return best;
+}
+
+static bool ICACHE_FLASH_ATTR ct_ports(const pkt_info *pi, uint16_t *s_port, uint16_t *d_port)
+{
+    if ((pi->flags & (PKT_F_IP | PKT_F_FRAG)) != PKT_F_IP)
+        return false;
+    if (pi->proto == IP_PROTO_TCP || pi->proto == IP_PROTO_UDP)
+    {
+        if (!(pi->flags & PKT_F_PORTS))
+            return false;
+        *s_port = pi->s_port;
+        *d_port = pi->d_port;
+        return true;
+    }
+    *s_port = *d_port = 0;
+    return pi->proto == IP_PROTO_ICMP;
+}
+
+void ICACHE_FLASH_ATTR conntrack_set_timeouts(uint32_t tcp, uint32_t udp)
+{
+    ct_timeout_tcp = tcp ? tcp : IP_NAPT_TIMEOUT_MS_TCP / 1000;
+    ct_timeout_udp = udp ? udp : IP_NAPT_TIMEOUT_MS_UDP / 1000;
+}
+
+void ICACHE_FLASH_ATTR conntrack_learn(uint8_t side, const pkt_info *pi)
+{
+    ct_entry *e;
+    uint16_t s_port, d_port;
+    uint8_t hash, idx;
+
+    if (!ct_ports(pi, &s_port, &d_port))
+        return;
+    if (!ct_ready)
+        ct_init();
+
+    e = ct_find(side, pi->proto, pi->src, pi->dest, s_port, d_port, &hash);
+    if (e == NULL)
+    {
+        // a RST doesn't open anything
+        if (pi->proto == IP_PROTO_TCP && (pi->tcp_flags & TCP_RST))
+            return;
+        if (ct_free == CT_NONE)
+        {
+            ct_remove(ct_victim());
+            ct_stat.evictions++;
+        }
+        idx = ct_free;
+        e = &ct_table[idx];
+        ct_free = e->next;
+
+        e->src = pi->src;
+        e->dest = pi->dest;
+        e->s_port = s_port;
+        e->d_port = d_port;
+        e->proto = pi->proto;
+        e->side = side;
+        e->flags = CT_F_USED;
+        e->next = ct_head[hash];
+        ct_head[hash] = idx;
+        ct_stat.used++;
+        ct_stat.learned++;
+    }
+    else if (pi->proto == IP_PROTO_TCP && (pi->tcp_flags & (TCP_SYN | TCP_ACK)) == TCP_SYN)
+    {
+        // the same ports are used for a new connection
+        e->flags = CT_F_USED;
+    }
+    e->last = ct_now;
+
+    if (pi->proto == IP_PROTO_TCP)
+    {
+        if (pi->tcp_flags & TCP_FIN)
+            e->flags |= CT_F_FIN_OUT;
+        if (pi->tcp_flags & TCP_RST)
+            e->flags |= CT_F_RST;
+    }
+}
+
+bool ICACHE_FLASH_ATTR conntrack_established(uint8_t side, const pkt_info *pi)
+{
+    ct_entry *e;
+    uint16_t s_port, d_port;
+    uint8_t hash;
+
+    if (!ct_ready || ct_stat.used == 0 || !ct_ports(pi, &s_port, &d_port))
+        return false;
+
+    e = ct_find(side, pi->proto, pi->dest, pi->src, d_port, s_port, &hash);
+    if (e == NULL)
+        return false;
+    // a reset connection only lets the RST itself through
+    if (e->flags & CT_F_RST)
+        return pi->proto == IP_PROTO_TCP && (pi->tcp_flags & TCP_RST);
+
+    e->last = ct_now;
+    if (pi->proto == IP_PROTO_TCP)
+    {
+        if (pi->tcp_flags & TCP_FIN)
+            e->flags |= CT_F_FIN_IN;
+        if (pi->tcp_flags & TCP_RST)
+            e->flags |= CT_F_RST;
+    }
+    ct_stat.hits++;
+    return true;
+}
+
+void ICACHE_FLASH_ATTR conntrack_flush(uint8_t side)
+{
+    uint8_t i;
+
+    if (!ct_ready)
+        return;
+    for (i = 0; i < CONNTRACK_SIZE; i++)
+    {
+        if ((ct_table[i].flags & CT_F_USED) && ct_table[i].side == side)
+            ct_remove(i);
+    }
+}
+
+void ICACHE_FLASH_ATTR conntrack_tick(void)
+{
+    uint8_t i;
+
+    ct_now++;
+    if (!ct_ready || ct_stat.used == 0)
+        return;
+    for (i = 0; i < CONNTRACK_SIZE; i++)
+    {
+        ct_entry *e = &ct_table[i];
+
+        if ((e->flags & CT_F_USED) && ct_now - e->last > ct_timeout(e))
+        {
+            ct_remove(i);
+            ct_stat.expired++;
+        }
+    }
+}
+
+ct_stats * ICACHE_FLASH_ATTR conntrack_stats(void)
+{
+    ct_stat.size = CONNTRACK_SIZE;
+    return &ct_stat;
+}
+
+#endif /* CONNTRACK_SIZE */
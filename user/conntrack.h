@@ -0,0 +1,56 @@
+#ifndef _CONNTRACK_H_
+#define _CONNTRACK_H_
+
+#include "c_types.h"
+#include "pkt_info.h"
+
+/*
+ * Connection tracking for the "established" ACL rule. Connections are
+ * learned from the allowed packets on the outbound hooks (from the clients
+ * on the AP side, to the uplink on the STA side) and a packet on the
+ * opposite hook of the same side that is a reply to one of them is
+ * "established". TCP connections age out quickly once both FINs or a
+ * RST have been seen, like in the NAPT table.
+ */
+
+#define CT_SIDE_AP      0   /* learned on ap-in, replies on ap-out */
+#define CT_SIDE_STA     1   /* learned on sta-out, replies on sta-in */
+
+#define CT_F_USED       0x01
+#define CT_F_FIN_OUT    0x02
+#define CT_F_FIN_IN     0x04
+#define CT_F_RST        0x08
+
+typedef struct _ct_entry {
+    uint32_t src;           /* of the outbound direction */
+    uint32_t dest;
+    uint16_t s_port;
+    uint16_t d_port;
+    uint8_t  proto;
+    uint8_t  side;          /* CT_SIDE_* */
+    uint8_t  flags;         /* CT_F_* */
+    uint8_t  next;          /* hash chain */
+    uint32_t last;          /* time of the last packet in s */
+} ct_entry;
+
+typedef struct _ct_stats {
+    uint16_t used;
+    uint16_t size;
+    uint32_t hits;          /* replies found */
+    uint32_t learned;
+    uint32_t expired;
+    uint32_t evictions;     /* connections dropped as the table was full */
+} ct_stats;
+
+/* Timeouts in s, TCP for open connections and UDP for UDP and ICMP */
+void conntrack_set_timeouts(uint32_t tcp, uint32_t udp);
+/* Outbound packet: adds or refreshes its connection */
+void conntrack_learn(uint8_t side, const pkt_info *pi);
+/* Inbound packet: true if it is a reply to a known connection */
+bool conntrack_established(uint8_t side, const pkt_info *pi);
+void conntrack_flush(uint8_t side);
+/* Called once per second, removes expired connections */
+void conntrack_tick(void);
+ct_stats *conntrack_stats(void);
+
+#endif /* _CONNTRACK_H_ */
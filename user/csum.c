@@ -0,0 +1,71 @@
+#include "c_types.h"
+#include "osapi.h"
+#include "csum.h"
+
+static inline uint16_t rd16(const uint8_t *b)
+{
+    return ((uint16_t)b[0] << 8) | b[1];
+}
+
+static inline void wr16(uint8_t *b, uint16_t v)
+{
+    b[0] = v >> 8;
+    b[1] = v;
+}
+
+static inline uint16_t csum_fold(uint32_t s)
+{
+    s = (s & 0xffff) + (s >> 16);
+    s = (s & 0xffff) + (s >> 16);
+    return (uint16_t)s;
+}
+
+void ICACHE_FLASH_ATTR csum_adjust(uint8_t *sum, uint16_t old, uint16_t new)
+{
+    if (sum == NULL)
+        return;
+    wr16(sum, ~csum_fold((uint16_t)~rd16(sum) + (uint16_t)~old + new));
+}
+
+void ICACHE_FLASH_ATTR csum_put16(uint8_t *f, uint16_t v, uint8_t *sum1, uint8_t *sum2)
+{
+    uint16_t old = rd16(f);
+
+    csum_adjust(sum1, old, v);
+    csum_adjust(sum2, old, v);
+    wr16(f, v);
+}
+
+void ICACHE_FLASH_ATTR csum_put_addr(uint8_t *f, uint32_t addr, uint8_t *sum1, uint8_t *sum2)
+{
+    const uint8_t *a = (const uint8_t *)&addr;
+
+    csum_put16(f, ((uint16_t)a[0] << 8) | a[1], sum1, sum2);
+    csum_put16(f + 2, ((uint16_t)a[2] << 8) | a[3], sum1, sum2);
+}
+
+void ICACHE_FLASH_ATTR csum_update(uint8_t *sum, const uint8_t *old, const uint8_t *new, uint16_t len, bool odd)
+{
+    uint32_t s;
+    uint16_t i;
+
+    if (sum == NULL)
+        return;
+    // ~m + m' byte by byte, each byte at its place in its 16 bit word
+    s = (uint16_t)~rd16(sum);
+    for (i = 0; i < len; i++)
+    {
+        uint8_t shift = ((i + odd) & 1) ? 0 : 8;
+
+        s += (uint16_t)~((uint16_t)old[i] << shift) + ((uint16_t)new[i] << shift);
+        if (s & 0x80000000)
+            s = csum_fold(s);
+    }
+    wr16(sum, ~csum_fold(s));
+}
+
+void ICACHE_FLASH_ATTR csum_udp_fix(uint8_t *sum)
+{
+    if (sum != NULL && rd16(sum) == 0)
+        wr16(sum, 0xffff);
+}
@@ -0,0 +1,28 @@
+#ifndef _CSUM_H_
+#define _CSUM_H_
+
+#include "c_types.h"
+
+/*
+ * Incremental updates of Internet checksums (RFC 1624) for the code that
+ * rewrites packets in place: HC' = ~(~HC + ~m + m'). Checksums and fields
+ * are big endian byte arrays, so they may be unaligned in the frame.
+ * A sum pointer may be NULL if there is no checksum to update.
+ */
+
+/* A 16 bit word at an even offset of the covered data changes from old to new */
+void csum_adjust(uint8_t *sum, uint16_t old, uint16_t new);
+/* Writes v to the 16 bit field f (at an even offset) and updates up to two
+   checksums covering it, e.g. the IP header and the TCP/UDP checksum */
+void csum_put16(uint8_t *f, uint16_t v, uint8_t *sum1, uint8_t *sum2);
+/* Writes the address (network byte order) to f, like csum_put16() */
+void csum_put_addr(uint8_t *f, uint32_t addr, uint8_t *sum1, uint8_t *sum2);
+/* len bytes change from old to new, odd if they start at an odd offset of
+   the covered data. The caller writes the new bytes. */
+void csum_update(uint8_t *sum, const uint8_t *old, const uint8_t *new, uint16_t len, bool odd);
+/* 0 means "no checksum" in UDP, an updated sum that became 0 is written as
+   0xffff. Only for a sum that was present: a datagram sent without a checksum
+   has no sum to update (NULL) and keeps 0. */
+void csum_udp_fix(uint8_t *sum);
+
+#endif /* _CSUM_H_ */
@@ -0,0 +1,84 @@
+#include "user_config.h"
+
+#if FLOW_CACHE_SIZE
+
+#include "c_types.h"
+#include "osapi.h"
+#include "lwip/ip.h"
+#include "flow_cache.h"
+
+#if FLOW_CACHE_SIZE == 32
+#define FLOW_HASH_BITS  5
+#elif FLOW_CACHE_SIZE == 64
+#define FLOW_HASH_BITS  6
+#elif FLOW_CACHE_SIZE == 128
+#define FLOW_HASH_BITS  7
+#else
+#error "FLOW_CACHE_SIZE must be 0, 32, 64 or 128"
+#endif
+
+static flow_entry flow_table[FLOW_CACHE_SIZE];
+static uint8_t flow_gen;
+static flow_stats flow_stat;
+
+static uint16_t ICACHE_FLASH_ATTR flow_hash(uint8_t chain, uint8_t proto, uint32_t src, uint32_t dest, uint32_t ports)
+{
+    uint32_t h = src ^ (dest * 31) ^ ports ^ ((uint32_t)proto << 8) ^ chain;
+
+    return (uint16_t)((uint32_t)(h * 2654435761U) >> (32 - FLOW_HASH_BITS));
+}
+
+flow_entry * ICACHE_FLASH_ATTR flow_cache_lookup(uint8_t chain, const pkt_info *pi)
+{
+    flow_entry *e;
+    uint16_t s_port = 0, d_port = 0;
+
+    if ((pi->flags & (PKT_F_IP | PKT_F_FRAG)) != PKT_F_IP)
+        return NULL;
+    if (pi->proto == IP_PROTO_TCP || pi->proto == IP_PROTO_UDP)
+    {
+        if (!(pi->flags & PKT_F_PORTS))
+            return NULL;
+        s_port = pi->s_port;
+        d_port = pi->d_port;
+    }
+    else if (pi->proto != IP_PROTO_ICMP)
+        return NULL;
+
+    e = &flow_table[flow_hash(chain, pi->proto, pi->src, pi->dest, ((uint32_t)s_port << 16) | d_port)];
+    if ((e->flags & FLOW_F_VALID) && e->gen == flow_gen)
+    {
+        if (e->src == pi->src && e->dest == pi->dest && e->s_port == s_port &&
+            e->d_port == d_port && e->proto == pi->proto && e->chain == chain)
+        {
+            flow_stat.hits++;
+            return e;
+        }
+        flow_stat.evictions++;
+    }
+    flow_stat.misses++;
+
+    e->src = pi->src;
+    e->dest = pi->dest;
+    e->s_port = s_port;
+    e->d_port = d_port;
+    e->proto = pi->proto;
+    e->chain = chain;
+    e->gen = flow_gen;
+    e->flags = FLOW_F_VALID;
+    return e;
+}
+
+void ICACHE_FLASH_ATTR flow_cache_invalidate(void)
+{
+    // after a wrap old entries could look current again
+    if (++flow_gen == 0)
+        os_memset(flow_table, 0, sizeof(flow_table));
+}
+
+flow_stats * ICACHE_FLASH_ATTR flow_cache_stats(void)
+{
+    return &flow_stat;
+}
+
+#endif /* FLOW_CACHE_SIZE */
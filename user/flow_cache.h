@@ -0,0 +1,46 @@
+#ifndef _FLOW_CACHE_H_
+#define _FLOW_CACHE_H_
+
+#include "c_types.h"
+#include "pkt_info.h"
+
+/*
+ * Direct-mapped cache of the per-flow decisions of the hook stages, keyed
+ * by (proto, src, dest, s_port, d_port) and the hook. A colliding flow
+ * simply replaces the old entry. All entries are invalidated at once by
+ * bumping a generation counter whenever something the decisions depend on
+ * changes (ACL rules, monitor filter).
+ */
+
+#define FLOW_F_VALID    0x01
+#define FLOW_F_ACL      0x02    /* acl and rule are known */
+#define FLOW_F_MON_SET  0x04    /* the monitor decision is known */
+#define FLOW_F_MON      0x08    /* ... and the flow is recorded */
+
+typedef struct _flow_entry {
+    uint32_t src;
+    uint32_t dest;
+    uint16_t s_port;
+    uint16_t d_port;
+    uint8_t  proto;
+    uint8_t  chain;
+    uint8_t  gen;
+    uint8_t  flags;         /* FLOW_F_* */
+    uint8_t  acl;           /* ACL verdict */
+    int8_t   rule;          /* index of the matching ACL rule */
+} flow_entry;
+
+typedef struct _flow_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;     /* misses that replaced a current entry */
+} flow_stats;
+
+/* Returns the entry of the packet's flow: either a hit or a fresh entry
+   with only FLOW_F_VALID set, to be filled in by the stages. NULL if the
+   packet can't be cached (not TCP/UDP/ICMP, fragments). */
+flow_entry *flow_cache_lookup(uint8_t chain, const pkt_info *pi);
+void flow_cache_invalidate(void);
+flow_stats *flow_cache_stats(void);
+
+#endif /* _FLOW_CACHE_H_ */
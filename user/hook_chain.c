@@ -0,0 +1,103 @@
+#include "user_config.h"
+#include "c_types.h"
+#include "osapi.h"
+#include "acl.h"
+#include "hook_chain.h"
+
+typedef struct _hook_chain {
+    uint8_t         n;
+    hook_stage     *stage[HOOK_MAX_STAGES];
+} hook_chain;
+
+static hook_stage hook_stages[HOOK_MAX_STAGES];
+static uint8_t hook_no_stages;
+static hook_chain hook_chains[HOOK_CHAINS];
+
+static const char *hook_chain_names[HOOK_CHAINS] = { "ap-in", "ap-out", "sta-in", "sta-out" };
+
+const char * ICACHE_FLASH_ATTR hook_chain_name(uint8_t chain)
+{
+    return hook_chain_names[chain];
+}
+
+bool ICACHE_FLASH_ATTR hook_register(const char *name, hook_stage_fn fn, hook_active_fn active, uint8_t chains)
+{
+    hook_stage *s;
+
+    if (hook_no_stages >= HOOK_MAX_STAGES)
+        return false;
+    s = &hook_stages[hook_no_stages++];
+    os_memset(s, 0, sizeof(hook_stage));
+    s->name = name;
+    s->fn = fn;
+    s->active = active;
+    s->chains = chains;
+    return true;
+}
+
+bool ICACHE_FLASH_ATTR hook_stage_active(hook_stage *s, uint8_t chain)
+{
+    return (s->chains & HOOK_MASK(chain)) && (s->active == NULL || s->active(chain));
+}
+
+void ICACHE_FLASH_ATTR hook_chain_rebuild(void)
+{
+    uint8_t chain, i;
+
+    for (chain = 0; chain < HOOK_CHAINS; chain++)
+    {
+        hook_chain *c = &hook_chains[chain];
+
+        c->n = 0;
+        for (i = 0; i < hook_no_stages; i++)
+        {
+            if (hook_stage_active(&hook_stages[i], chain))
+                c->stage[c->n++] = &hook_stages[i];
+        }
+    }
+}
+
+bool ICACHE_FLASH_ATTR hook_chain_run(uint8_t chain, hook_pkt *hp)
+{
+    hook_chain *c = &hook_chains[chain];
+    uint8_t i;
+
+    if (c->n == 0)
+        return true;
+
+    pkt_parse(hp->p, &hp->pi);
+    hp->pi.acl = ACL_ALLOW;
+    hp->chain = chain;
+    hp->flow_done = false;
+    hp->flow = NULL;
+
+    for (i = 0; i < c->n; i++)
+    {
+        hook_stage *s = c->stage[i];
+
+        s->packets[chain]++;
+        if (!s->fn(hp))
+        {
+            s->consumed[chain]++;
+            return false;
+        }
+    }
+    return true;
+}
+
+flow_entry * ICACHE_FLASH_ATTR hook_flow(hook_pkt *hp)
+{
+#if FLOW_CACHE_SIZE
+    if (!hp->flow_done)
+    {
+        hp->flow = flow_cache_lookup(hp->chain, &hp->pi);
+        hp->flow_done = true;
+    }
+#endif
+    return hp->flow;
+}
+
+hook_stage * ICACHE_FLASH_ATTR hook_get_stage(uint8_t n)
+{
+    return n < hook_no_stages ? &hook_stages[n] : NULL;
+}
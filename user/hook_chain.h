@@ -0,0 +1,70 @@
+#ifndef _HOOK_CHAIN_H_
+#define _HOOK_CHAIN_H_
+
+#include "c_types.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+#include "pkt_info.h"
+#include "flow_cache.h"
+
+/*
+ * Processing chains of the netif hooks. Every feature registers a stage
+ * for the hooks it applies to, together with a predicate that tells from
+ * the current configuration whether it has anything to do. When the
+ * configuration changes, hook_chain_rebuild() collects the active stages
+ * into one function pointer array per hook, so disabled features cost
+ * nothing per packet. Stages run in the order of registration.
+ */
+
+#define HOOK_AP_IN          0
+#define HOOK_AP_OUT         1
+#define HOOK_STA_IN         2
+#define HOOK_STA_OUT        3
+#define HOOK_CHAINS         4
+
+#define HOOK_MASK(chain)    (1 << (chain))
+#define HOOK_ALL            ((1 << HOOK_CHAINS) - 1)
+#define HOOK_MAX_STAGES     16
+
+typedef struct _hook_pkt {
+    struct pbuf  *p;
+    struct netif *nif;
+    uint8_t       chain;
+    bool          flow_done;    /* flow has been looked up */
+    flow_entry   *flow;
+    pkt_info      pi;
+} hook_pkt;
+
+/* Returns false if the stage has consumed the packet (dropped or queued it) */
+typedef bool (*hook_stage_fn)(hook_pkt *hp);
+/* Returns true if the stage has to run in the given chain */
+typedef bool (*hook_active_fn)(uint8_t chain);
+
+typedef struct _hook_stage {
+    const char     *name;
+    hook_stage_fn   fn;
+    hook_active_fn  active;     /* NULL: always active */
+    uint8_t         chains;     /* HOOK_MASK()s of the chains it applies to */
+    uint32_t        packets[HOOK_CHAINS];
+    uint32_t        consumed[HOOK_CHAINS];
+} hook_stage;
+
+const char *hook_chain_name(uint8_t chain);
+
+bool hook_register(const char *name, hook_stage_fn fn, hook_active_fn active, uint8_t chains);
+void hook_chain_rebuild(void);
+
+/* Runs the chain on hp->p, the headers are parsed only if there is any
+   active stage. Returns false if the packet has been consumed. */
+bool hook_chain_run(uint8_t chain, hook_pkt *hp);
+
+/* The flow cache entry of the packet (NULL if not cacheable), looked up
+   on the first call by a stage that needs it */
+flow_entry *hook_flow(hook_pkt *hp);
+
+/* For the statistics: the n-th registered stage or NULL, and whether it
+   is currently active in chain */
+hook_stage *hook_get_stage(uint8_t n);
+bool hook_stage_active(hook_stage *s, uint8_t chain);
+
+#endif /* _HOOK_CHAIN_H_ */
@@ -0,0 +1,65 @@
+#include "user_config.h"
+
+#if MSS_CLAMP
+
+#include "c_types.h"
+#include "osapi.h"
+#include "lwip/ip.h"
+#include "lwip/tcp_impl.h"
+#include "csum.h"
+#include "mss.h"
+
+#define MSS_OPT_END     0
+#define MSS_OPT_NOP     1
+#define MSS_OPT_MSS     2
+
+static mss_stats mss_stat;
+
+bool ICACHE_FLASH_ATTR mss_clamp(struct pbuf *p, const pkt_info *pi, uint16_t max, uint8_t dir)
+{
+    uint8_t *tcp, *opt, *end, new[2];
+    uint16_t hlen, mss;
+
+    if ((pi->flags & (PKT_F_IP | PKT_F_PORTS)) != (PKT_F_IP | PKT_F_PORTS) ||
+        pi->proto != IP_PROTO_TCP || !(pi->tcp_flags & TCP_SYN))
+        return false;
+
+    tcp = (uint8_t *)p->payload + pi->l4_off;
+    hlen = (tcp[12] >> 4) * 4;
+    if (hlen <= 20 || pi->l4_off + hlen > p->len)
+        return false;
+
+    for (opt = tcp + 20, end = tcp + hlen; opt < end && *opt != MSS_OPT_END; )
+    {
+        if (*opt == MSS_OPT_NOP)
+        {
+            opt++;
+            continue;
+        }
+        if (opt + 2 > end || opt[1] < 2 || opt + opt[1] > end)
+            return false;
+        if (*opt == MSS_OPT_MSS && opt[1] == 4)
+        {
+            mss_stat.syns[dir]++;
+            mss = ((uint16_t)opt[2] << 8) | opt[3];
+            if (mss <= max)
+                return false;
+            new[0] = max >> 8;
+            new[1] = max;
+            // the option may start at an odd offset
+            csum_update(tcp + 16, opt + 2, new, 2, (opt + 2 - tcp) & 1);
+            os_memcpy(opt + 2, new, 2);
+            mss_stat.clamped[dir]++;
+            return true;
+        }
+        opt += opt[1];
+    }
+    return false;
+}
+
+mss_stats * ICACHE_FLASH_ATTR mss_get_stats(void)
+{
+    return &mss_stat;
+}
+
+#endif /* MSS_CLAMP */
@@ -0,0 +1,30 @@
+#ifndef _MSS_H_
+#define _MSS_H_
+
+#include "c_types.h"
+#include "lwip/pbuf.h"
+#include "pkt_info.h"
+
+/*
+ * TCP MSS clamping for the routed traffic of the AP clients. The router
+ * can neither fragment nor reassemble, so the MSS option of SYNs and
+ * SYN-ACKs is lowered to a configured maximum, and both ends send
+ * segments that fit through the uplink. Connections are clamped in both
+ * directions: the SYNs of the clients and the SYN-ACKs to them, and the
+ * other way round for portmaps.
+ */
+
+#define MSS_FROM_AP     0   /* SYNs sent by the AP clients */
+#define MSS_TO_AP       1   /* SYNs sent to the AP clients */
+
+typedef struct _mss_stats {
+    uint32_t syns[2];       /* SYNs with an MSS option seen */
+    uint32_t clamped[2];    /* SYNs rewritten */
+} mss_stats;
+
+/* Lowers the MSS option of a TCP SYN in the frame p to max, dir is
+   MSS_FROM_AP or MSS_TO_AP. Returns true if the option was changed. */
+bool mss_clamp(struct pbuf *p, const pkt_info *pi, uint16_t max, uint8_t dir);
+mss_stats *mss_get_stats(void);
+
+#endif /* _MSS_H_ */
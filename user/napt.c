@@ -0,0 +1,846 @@
+#include "user_config.h"
+
+#if NAPT_INTREE
+
+#include "c_types.h"
+#include "mem.h"
+#include "osapi.h"
+#include "lwip/ip.h"
+#include "lwip/udp.h"
+#include "lwip/tcp_impl.h"
+#include "csum.h"
+#include "napt.h"
+
+#define NAPT_NONE           0xffff
+#define NAPT_MAX_IF         3
+#define NAPT_PORTS          (IP_NAPT_PORT_RANGE_END - IP_NAPT_PORT_RANGE_START + 1)
+#define NAPT_PORT_WORDS     ((NAPT_PORTS + 31) / 32)
+#define NAPT_MAX_CLIENTS    (MAX_CLIENTS * 2)
+#define NAPT_NO_CLIENT      0xff
+// Half-open TCP sessions without pressure
+#define NAPT_TIMEOUT_TCP_SYN    60
+
+#define NAPT_ICMP_ECHO_REPLY    0
+#define NAPT_ICMP_UNREACH       3
+#define NAPT_ICMP_ECHO          8
+#define NAPT_ICMP_TIME_EXCEEDED 11
+
+struct portmap_table *napt_portmap_table;
+
+static napt_entry *napt_table;
+static uint16_t *napt_in_hash;
+static uint16_t *napt_out_hash;
+static uint16_t napt_hash_mask;
+static uint8_t napt_hash_shift;
+static uint16_t napt_free;
+static uint16_t napt_lru_head[NAPT_CLASSES];
+static uint16_t napt_lru_tail[NAPT_CLASSES];
+static uint32_t napt_timeout[NAPT_CLASSES];
+static uint32_t napt_ports[NAPT_PORT_WORDS];   /* bit set: mapped port in use */
+static uint16_t napt_port_cur;
+static uint8_t napt_portmap_max;
+static struct netif *napt_if[NAPT_MAX_IF];
+static uint32_t napt_now;
+static napt_stats napt_stat;
+static napt_client napt_clients[NAPT_MAX_CLIENTS];
+static uint16_t napt_client_max;
+
+/* The IP header is not aligned in the frame, so fields are accessed bytewise */
+static inline uint16_t rd16(const uint8_t *b)
+{
+    return ((uint16_t)b[0] << 8) | b[1];
+}
+
+static inline uint32_t rd32_raw(const uint8_t *b)
+{
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+/* The checksum of the transport header that includes the pseudo header,
+   NULL if there is none (ICMP, UDP without checksum) */
+static uint8_t * ICACHE_FLASH_ATTR napt_l4_sum(uint8_t proto, uint8_t *l4)
+{
+    if (proto == IP_PROTO_TCP)
+        return l4 + 16;
+    if (proto == IP_PROTO_UDP && rd16(l4 + 6) != 0)
+        return l4 + 6;
+    return NULL;
+}
+
+static uint16_t ICACHE_FLASH_ATTR napt_hash_in(uint8_t proto, uint32_t src, uint16_t sport, uint32_t dest, uint16_t dport)
+{
+    uint32_t h = src ^ (dest * 31) ^ (((uint32_t)sport << 16) | dport) ^ ((uint32_t)proto << 8);
+
+    h ^= h >> 16;
+    return (uint16_t)((h * 2654435761U) >> napt_hash_shift);
+}
+
+// Mapped ports are unique and handed out in sequence, so they index directly
+#define napt_hash_out(mport) ((mport) & napt_hash_mask)
+
+/* Timeout of a class, the unreplied ones are shortened by the table pressure */
+static uint32_t ICACHE_FLASH_ATTR napt_cls_timeout(uint8_t cls)
+{
+    uint32_t t = napt_timeout[cls];
+
+    if (cls == NAPT_CLS_TCP_SYN || cls == NAPT_CLS_UDP_NEW)
+    {
+        t >>= napt_stat.pressure;
+        if (t == 0)
+            t = 1;
+    }
+    return t;
+}
+
+static void ICACHE_FLASH_ATTR napt_update_pressure(void)
+{
+    uint32_t fill = napt_stat.size ? (uint32_t)napt_stat.used * 100 / napt_stat.size : 0;
+
+    napt_stat.pressure = fill >= 90 ? 3 : fill >= 75 ? 2 : fill >= 50 ? 1 : 0;
+}
+
+static void ICACHE_FLASH_ATTR napt_lru_unlink(uint16_t i)
+{
+    napt_entry *e = &napt_table[i];
+
+    if (e->lru_prev != NAPT_NONE)
+        napt_table[e->lru_prev].lru_next = e->lru_next;
+    else
+        napt_lru_head[e->cls] = e->lru_next;
+    if (e->lru_next != NAPT_NONE)
+        napt_table[e->lru_next].lru_prev = e->lru_prev;
+    else
+        napt_lru_tail[e->cls] = e->lru_prev;
+}
+
+static void ICACHE_FLASH_ATTR napt_lru_push(uint16_t i, uint8_t cls)
+{
+    napt_entry *e = &napt_table[i];
+
+    e->cls = cls;
+    e->lru_prev = NAPT_NONE;
+    e->lru_next = napt_lru_head[cls];
+    if (e->lru_next != NAPT_NONE)
+        napt_table[e->lru_next].lru_prev = i;
+    else
+        napt_lru_tail[cls] = i;
+    napt_lru_head[cls] = i;
+}
+
+/* A packet of the session: most recently used, maybe in another class */
+static void ICACHE_FLASH_ATTR napt_touch(uint16_t i, uint8_t cls)
+{
+    napt_entry *e = &napt_table[i];
+
+    e->last = napt_now;
+    if (napt_lru_head[e->cls] == i && e->cls == cls)
+        return;
+    napt_lru_unlink(i);
+    napt_lru_push(i, cls);
+}
+
+static bool ICACHE_FLASH_ATTR napt_port_taken(uint8_t proto, uint16_t port)
+{
+    struct tcp_pcb *tpcb;
+    struct udp_pcb *upcb;
+    uint8_t i;
+
+    for (i = 0; i < napt_portmap_max; i++)
+    {
+        if (napt_portmap_table[i].valid && napt_portmap_table[i].mport == port)
+            return true;
+    }
+    // the ESP's own connections use the same range
+    if (proto == IP_PROTO_TCP)
+    {
+        for (tpcb = tcp_active_pcbs; tpcb != NULL; tpcb = tpcb->next)
+            if (tpcb->local_port == port)
+                return true;
+        for (tpcb = tcp_tw_pcbs; tpcb != NULL; tpcb = tpcb->next)
+            if (tpcb->local_port == port)
+                return true;
+        for (tpcb = (struct tcp_pcb *)tcp_listen_pcbs.pcbs; tpcb != NULL; tpcb = tpcb->next)
+            if (tpcb->local_port == port)
+                return true;
+    }
+    else if (proto == IP_PROTO_UDP)
+    {
+        for (upcb = udp_pcbs; upcb != NULL; upcb = upcb->next)
+            if (upcb->local_port == port)
+                return true;
+    }
+    return false;
+}
+
+/* Next free port of the range, 0 if there is none */
+static uint16_t ICACHE_FLASH_ATTR napt_port_alloc(uint8_t proto)
+{
+    uint16_t n;
+
+    for (n = 0; n < NAPT_PORT_WORDS; n++)
+    {
+        uint32_t avail = ~napt_ports[napt_port_cur];
+
+        while (avail != 0)
+        {
+            uint8_t bit = __builtin_ctz(avail);
+            uint16_t port = IP_NAPT_PORT_RANGE_START + napt_port_cur * 32 + bit;
+
+            avail &= avail - 1;
+            if (port > IP_NAPT_PORT_RANGE_END)
+                break;
+            if (napt_port_taken(proto, port))
+                continue;
+            napt_ports[napt_port_cur] |= 1U << bit;
+            return port;
+        }
+        if (++napt_port_cur == NAPT_PORT_WORDS)
+            napt_port_cur = 0;
+    }
+    return 0;
+}
+
+static void ICACHE_FLASH_ATTR napt_port_free(uint16_t port)
+{
+    port -= IP_NAPT_PORT_RANGE_START;
+    napt_ports[port / 32] &= ~(1U << (port % 32));
+}
+
+static void ICACHE_FLASH_ATTR napt_remove(uint16_t i)
+{
+    napt_entry *e = &napt_table[i];
+    uint16_t *pp;
+
+    pp = &napt_in_hash[napt_hash_in(e->proto, e->src, e->sport, e->dest, e->dport)];
+    while (*pp != i)
+        pp = &napt_table[*pp].in_next;
+    *pp = e->in_next;
+
+    pp = &napt_out_hash[napt_hash_out(e->mport)];
+    while (*pp != i)
+        pp = &napt_table[*pp].out_next;
+    *pp = e->out_next;
+
+    napt_lru_unlink(i);
+    napt_port_free(e->mport);
+    if (e->client != NAPT_NO_CLIENT)
+        napt_clients[e->client].sessions--;
+
+    e->cls = NAPT_CLS_FREE;
+    e->lru_next = napt_free;
+    napt_free = i;
+    napt_stat.used--;
+}
+
+/* Of the least recently used sessions of the classes the one that has been
+   idle for the largest part of its timeout, so unreplied sessions go first */
+static uint16_t ICACHE_FLASH_ATTR napt_victim(void)
+{
+    uint16_t victim = NAPT_NONE;
+    uint32_t v_idle = 0, v_timeout = 1;
+    uint8_t c;
+
+    for (c = 0; c < NAPT_CLASSES; c++)
+    {
+        uint16_t t = napt_lru_tail[c];
+        uint32_t idle, timeout;
+
+        if (t == NAPT_NONE)
+            continue;
+        idle = napt_now - napt_table[t].last;
+        timeout = napt_cls_timeout(c);
+        // idle / timeout > v_idle / v_timeout
+        if (victim == NAPT_NONE || (uint64_t)idle * v_timeout > (uint64_t)v_idle * timeout)
+        {
+            victim = t;
+            v_idle = idle;
+            v_timeout = timeout;
+        }
+    }
+    return victim;
+}
+
+/* The slot of an inside address, a new one if it has none */
+static uint8_t ICACHE_FLASH_ATTR napt_client_slot(uint32_t addr)
+{
+    uint8_t i, slot = NAPT_NO_CLIENT;
+
+    for (i = 0; i < NAPT_MAX_CLIENTS; i++)
+    {
+        if (napt_clients[i].addr == addr)
+            return i;
+        if (slot == NAPT_NO_CLIENT && napt_clients[i].sessions == 0)
+            slot = i;
+    }
+    if (slot != NAPT_NO_CLIENT)
+    {
+        napt_clients[slot].addr = addr;
+        napt_clients[slot].refused = 0;
+    }
+    return slot;
+}
+
+static uint16_t ICACHE_FLASH_ATTR napt_find_in(uint8_t proto, uint32_t src, uint16_t sport, uint32_t dest, uint16_t dport)
+{
+    uint16_t i;
+
+    for (i = napt_in_hash[napt_hash_in(proto, src, sport, dest, dport)]; i != NAPT_NONE; i = napt_table[i].in_next)
+    {
+        napt_entry *e = &napt_table[i];
+
+        if (e->src == src && e->sport == sport && e->dest == dest && e->dport == dport && e->proto == proto)
+            return i;
+    }
+    return NAPT_NONE;
+}
+
+/* The session of a reply from dest:dport to the mapped port */
+static uint16_t ICACHE_FLASH_ATTR napt_find_out(uint8_t proto, uint16_t mport, uint32_t dest, uint16_t dport)
+{
+    uint16_t i;
+
+    for (i = napt_out_hash[napt_hash_out(mport)]; i != NAPT_NONE; i = napt_table[i].out_next)
+    {
+        napt_entry *e = &napt_table[i];
+
+        if (e->mport == mport && e->proto == proto && e->dest == dest && e->dport == dport)
+            return i;
+    }
+    return NAPT_NONE;
+}
+
+static uint16_t ICACHE_FLASH_ATTR napt_new(uint8_t proto, uint32_t src, uint16_t sport, uint32_t dest, uint16_t dport)
+{
+    napt_entry *e;
+    uint16_t i, h, mport, max;
+    uint8_t client;
+
+    // more clients than slots are not limited
+    client = napt_client_slot(src);
+    max = napt_client_max ? napt_client_max : napt_stat.size / 2;
+    if (client != NAPT_NO_CLIENT && napt_clients[client].sessions >= max)
+    {
+        napt_clients[client].refused++;
+        napt_stat.refused++;
+        return NAPT_NONE;
+    }
+
+    if (napt_free == NAPT_NONE)
+    {
+        i = napt_victim();
+        if (i == NAPT_NONE)
+            return NAPT_NONE;
+        napt_remove(i);
+        napt_stat.evicted++;
+    }
+    mport = napt_port_alloc(proto);
+    if (mport == 0)
+    {
+        napt_stat.no_port++;
+        return NAPT_NONE;
+    }
+
+    i = napt_free;
+    e = &napt_table[i];
+    napt_free = e->lru_next;
+
+    e->src = src;
+    e->sport = sport;
+    e->dest = dest;
+    e->dport = dport;
+    e->mport = mport;
+    e->proto = proto;
+    e->flags = 0;
+    e->client = client;
+    e->last = napt_now;
+    if (client != NAPT_NO_CLIENT)
+        napt_clients[client].sessions++;
+
+    h = napt_hash_in(proto, src, sport, dest, dport);
+    e->in_next = napt_in_hash[h];
+    napt_in_hash[h] = i;
+    h = napt_hash_out(mport);
+    e->out_next = napt_out_hash[h];
+    napt_out_hash[h] = i;
+    napt_lru_push(i, proto == IP_PROTO_TCP ? NAPT_CLS_TCP_SYN : proto == IP_PROTO_UDP ? NAPT_CLS_UDP_NEW : NAPT_CLS_ICMP);
+
+    napt_stat.created++;
+    if (++napt_stat.used > napt_stat.peak)
+        napt_stat.peak = napt_stat.used;
+    napt_update_pressure();
+    return i;
+}
+
+/* TCP flags seen in one direction, returns the new class */
+static uint8_t ICACHE_FLASH_ATTR napt_tcp_state(napt_entry *e, uint8_t tcp_flags, bool out)
+{
+    if (out && (tcp_flags & (TCP_SYN | TCP_ACK)) == TCP_SYN)
+        e->flags = 0;
+    if (tcp_flags & TCP_FIN)
+        e->flags |= out ? NAPT_F_FIN_OUT : NAPT_F_FIN_IN;
+    if (tcp_flags & TCP_RST)
+        e->flags |= NAPT_F_RST;
+    if ((e->flags & NAPT_F_RST) || (e->flags & (NAPT_F_FIN_OUT | NAPT_F_FIN_IN)) == (NAPT_F_FIN_OUT | NAPT_F_FIN_IN))
+        return NAPT_CLS_TCP_FIN;
+    return (e->flags & NAPT_F_REPLIED) ? NAPT_CLS_TCP : NAPT_CLS_TCP_SYN;
+}
+
+static bool ICACHE_FLASH_ATTR napt_inside(uint32_t addr)
+{
+    uint8_t i;
+
+    for (i = 0; i < NAPT_MAX_IF; i++)
+    {
+        struct netif *nif = napt_if[i];
+
+        if (nif != NULL && (addr & nif->netmask.addr) == (nif->ip_addr.addr & nif->netmask.addr))
+            return true;
+    }
+    return false;
+}
+
+void ICACHE_FLASH_ATTR napt_init(uint16_t max_nat, uint8_t max_portmap)
+{
+    uint16_t i, buckets;
+
+    // called again (by the host tests), it starts over with empty tables
+    if (napt_table != NULL)
+    {
+        os_free(napt_table);
+        os_free(napt_in_hash);
+        os_free(napt_out_hash);
+        napt_table = NULL;
+    }
+    if (napt_portmap_table != NULL)
+        os_free(napt_portmap_table);
+    os_memset(napt_ports, 0, sizeof(napt_ports));
+    os_memset(napt_clients, 0, sizeof(napt_clients));
+    napt_port_cur = 0;
+
+    if (max_nat > NAPT_PORTS)
+        max_nat = NAPT_PORTS;
+    if (max_nat < 16)
+        max_nat = 16;
+    // about two sessions per bucket
+    for (buckets = 8, napt_hash_shift = 32 - 3; buckets < max_nat / 2; buckets <<= 1)
+        napt_hash_shift--;
+
+    napt_table = (napt_entry *)os_zalloc(sizeof(napt_entry) * max_nat);
+    napt_in_hash = (uint16_t *)os_malloc(sizeof(uint16_t) * buckets);
+    napt_out_hash = (uint16_t *)os_malloc(sizeof(uint16_t) * buckets);
+    napt_portmap_table = (struct portmap_table *)os_zalloc(sizeof(struct portmap_table) * max_portmap);
+    napt_portmap_max = napt_portmap_table != NULL ? max_portmap : 0;
+    if (napt_table == NULL || napt_in_hash == NULL || napt_out_hash == NULL)
+    {
+        os_printf("NAPT: out of memory\r\n");
+        // without the session table NAPT stays inactive, see napt_active()
+        if (napt_table != NULL)
+            os_free(napt_table);
+        if (napt_in_hash != NULL)
+            os_free(napt_in_hash);
+        if (napt_out_hash != NULL)
+            os_free(napt_out_hash);
+        napt_table = NULL;
+        napt_in_hash = napt_out_hash = NULL;
+        max_nat = 0;
+    }
+
+    napt_hash_mask = buckets - 1;
+    for (i = 0; max_nat != 0 && i < buckets; i++)
+        napt_in_hash[i] = napt_out_hash[i] = NAPT_NONE;
+    for (i = 0; i < max_nat; i++)
+    {
+        napt_table[i].cls = NAPT_CLS_FREE;
+        napt_table[i].lru_next = (i + 1 < max_nat) ? i + 1 : NAPT_NONE;
+    }
+    napt_free = max_nat ? 0 : NAPT_NONE;
+    for (i = 0; i < NAPT_CLASSES; i++)
+        napt_lru_head[i] = napt_lru_tail[i] = NAPT_NONE;
+
+    napt_timeout[NAPT_CLS_TCP] = IP_NAPT_TIMEOUT_MS_TCP / 1000;
+    napt_timeout[NAPT_CLS_TCP_FIN] = IP_NAPT_TIMEOUT_MS_TCP_DISCON / 1000;
+    napt_timeout[NAPT_CLS_UDP] = IP_NAPT_TIMEOUT_MS_UDP / 1000;
+    napt_timeout[NAPT_CLS_ICMP] = IP_NAPT_TIMEOUT_MS_ICMP / 1000;
+    napt_timeout[NAPT_CLS_TCP_SYN] = NAPT_TIMEOUT_TCP_SYN;
+    napt_timeout[NAPT_CLS_UDP_NEW] = napt_timeout[NAPT_CLS_UDP];
+
+    os_memset(&napt_stat, 0, sizeof(napt_stat));
+    napt_stat.size = max_nat;
+}
+
+void ICACHE_FLASH_ATTR napt_enable(u32_t addr, int enable)
+{
+    struct netif *nif;
+
+    for (nif = netif_list; nif != NULL && nif->ip_addr.addr != addr; nif = nif->next)
+        ;
+    if (nif != NULL)
+        napt_enable_no(nif->num, enable);
+}
+
+void ICACHE_FLASH_ATTR napt_enable_no(u8_t number, int enable)
+{
+    struct netif *nif;
+    uint8_t i;
+
+    for (nif = netif_list; nif != NULL && nif->num != number; nif = nif->next)
+        ;
+    if (nif == NULL)
+        return;
+    // the library NAPT stays off
+    nif->napt = 0;
+
+    for (i = 0; i < NAPT_MAX_IF; i++)
+    {
+        if (napt_if[i] == nif)
+            napt_if[i] = NULL;
+    }
+    if (!enable)
+        return;
+    for (i = 0; i < NAPT_MAX_IF; i++)
+    {
+        if (napt_if[i] == NULL)
+        {
+            napt_if[i] = nif;
+            return;
+        }
+    }
+}
+
+u8_t ICACHE_FLASH_ATTR napt_portmap_add(u8_t proto, u32_t maddr, u16_t mport, u32_t daddr, u16_t dport)
+{
+    struct portmap_table *m = NULL;
+    uint8_t i;
+
+    for (i = 0; i < napt_portmap_max; i++)
+    {
+        struct portmap_table *pm = &napt_portmap_table[i];
+
+        // an existing mapping of the port is overwritten
+        if (pm->valid && pm->proto == proto && pm->mport == mport)
+        {
+            m = pm;
+            break;
+        }
+        if (!pm->valid && m == NULL)
+            m = pm;
+    }
+    if (m == NULL)
+        return 0;
+
+    m->proto = proto;
+    m->maddr = maddr;
+    m->mport = mport;
+    m->daddr = daddr;
+    m->dport = dport;
+    m->valid = 1;
+    return 1;
+}
+
+u8_t ICACHE_FLASH_ATTR napt_portmap_remove(u8_t proto, u16_t mport)
+{
+    uint8_t i;
+
+    for (i = 0; i < napt_portmap_max; i++)
+    {
+        struct portmap_table *pm = &napt_portmap_table[i];
+
+        if (pm->valid && pm->proto == proto && pm->mport == mport)
+        {
+            pm->valid = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void ICACHE_FLASH_ATTR napt_set_tcp_timeout(u32_t secs)
+{
+    napt_timeout[NAPT_CLS_TCP] = secs ? secs : IP_NAPT_TIMEOUT_MS_TCP / 1000;
+    // a half-open session never lives longer than an open one
+    napt_timeout[NAPT_CLS_TCP_SYN] = napt_timeout[NAPT_CLS_TCP] < NAPT_TIMEOUT_TCP_SYN ?
+                                     napt_timeout[NAPT_CLS_TCP] : NAPT_TIMEOUT_TCP_SYN;
+}
+
+void ICACHE_FLASH_ATTR napt_set_udp_timeout(u32_t secs)
+{
+    napt_timeout[NAPT_CLS_UDP] = secs ? secs : IP_NAPT_TIMEOUT_MS_UDP / 1000;
+    napt_timeout[NAPT_CLS_UDP_NEW] = napt_timeout[NAPT_CLS_UDP];
+}
+
+void ICACHE_FLASH_ATTR napt_set_client_max(uint16_t max)
+{
+    napt_client_max = max;
+}
+
+bool ICACHE_FLASH_ATTR napt_active(void)
+{
+    uint8_t i;
+
+    if (napt_table == NULL)
+        return false;
+    for (i = 0; i < NAPT_MAX_IF; i++)
+    {
+        if (napt_if[i] != NULL)
+            return true;
+    }
+    return false;
+}
+
+static struct portmap_table * ICACHE_FLASH_ATTR napt_portmap_find(uint8_t proto, uint32_t maddr, uint16_t mport)
+{
+    uint8_t i;
+
+    for (i = 0; i < napt_portmap_max; i++)
+    {
+        struct portmap_table *pm = &napt_portmap_table[i];
+
+        if (pm->valid && pm->proto == proto && pm->maddr == maddr && pm->mport == mport)
+            return pm;
+    }
+    return NULL;
+}
+
+static struct portmap_table * ICACHE_FLASH_ATTR napt_portmap_find_dest(uint8_t proto, uint32_t daddr, uint16_t dport)
+{
+    uint8_t i;
+
+    for (i = 0; i < napt_portmap_max; i++)
+    {
+        struct portmap_table *pm = &napt_portmap_table[i];
+
+        if (pm->valid && pm->proto == proto && pm->daddr == daddr && pm->dport == dport)
+            return pm;
+    }
+    return NULL;
+}
+
+bool ICACHE_FLASH_ATTR napt_output(struct pbuf *p, pkt_info *pi, struct netif *outp)
+{
+    uint8_t *ip, *l4, *sum;
+    struct portmap_table *pm;
+    uint32_t addr = outp->ip_addr.addr;
+    uint16_t i, mport;
+    uint8_t cls;
+
+    if (!(pi->flags & PKT_F_IP) || pi->src == addr || !napt_inside(pi->src))
+        return true;
+    ip = (uint8_t *)p->payload + pi->ip_off;
+    l4 = (uint8_t *)p->payload + pi->l4_off;
+
+    // Later fragments don't have ports, only the address is translated
+    if ((pi->flags & PKT_F_FRAG) || (pi->proto != IP_PROTO_TCP && pi->proto != IP_PROTO_UDP && pi->proto != IP_PROTO_ICMP))
+    {
+        csum_put_addr(ip + 12, addr, ip + 10, NULL);
+        pi->src = addr;
+        return true;
+    }
+
+    if (pi->proto == IP_PROTO_ICMP)
+    {
+        if (pi->l4_off + 8 > p->len)
+            goto untranslated;
+        // only echo requests have an id that can be mapped
+        if (l4[0] != NAPT_ICMP_ECHO)
+        {
+            csum_put_addr(ip + 12, addr, ip + 10, NULL);
+            pi->src = addr;
+            return true;
+        }
+        i = napt_find_in(IP_PROTO_ICMP, pi->src, rd16(l4 + 4), pi->dest, 0);
+        if (i == NAPT_NONE)
+            i = napt_new(IP_PROTO_ICMP, pi->src, rd16(l4 + 4), pi->dest, 0);
+        if (i == NAPT_NONE)
+            goto untranslated;
+        napt_touch(i, NAPT_CLS_ICMP);
+        csum_put_addr(ip + 12, addr, ip + 10, NULL);
+        csum_put16(l4 + 4, napt_table[i].mport, l4 + 2, NULL);
+        pi->src = addr;
+        return true;
+    }
+
+    if (!(pi->flags & PKT_F_PORTS))
+        goto untranslated;
+
+    pm = napt_portmap_find_dest(pi->proto, pi->src, pi->s_port);
+    if (pm != NULL)
+    {
+        mport = pm->mport;
+    }
+    else
+    {
+        i = napt_find_in(pi->proto, pi->src, pi->s_port, pi->dest, pi->d_port);
+        if (i == NAPT_NONE)
+        {
+            // a RST doesn't need a session
+            if (pi->proto == IP_PROTO_TCP && (pi->tcp_flags & TCP_RST))
+                goto untranslated;
+            i = napt_new(pi->proto, pi->src, pi->s_port, pi->dest, pi->d_port);
+            if (i == NAPT_NONE)
+                goto untranslated;
+        }
+        if (pi->proto == IP_PROTO_TCP)
+            cls = napt_tcp_state(&napt_table[i], pi->tcp_flags, true);
+        else
+            cls = (napt_table[i].flags & NAPT_F_REPLIED) ? NAPT_CLS_UDP : NAPT_CLS_UDP_NEW;
+        napt_touch(i, cls);
+        mport = napt_table[i].mport;
+    }
+
+    sum = napt_l4_sum(pi->proto, l4);
+    csum_put_addr(ip + 12, addr, ip + 10, sum);
+    csum_put16(l4, mport, sum, NULL);
+    // a UDP datagram without a checksum has no sum and keeps 0,
+    // only an updated sum that became 0 is sent as 0xffff
+    if (pi->proto == IP_PROTO_UDP && sum != NULL)
+        csum_udp_fix(sum);
+    pi->src = addr;
+    pi->s_port = mport;
+    return true;
+
+untranslated:
+    napt_stat.untranslated++;
+    return false;
+}
+
+bool ICACHE_FLASH_ATTR napt_has_session(const pkt_info *pi)
+{
+    return napt_portmap_find_dest(pi->proto, pi->src, pi->s_port) != NULL ||
+           napt_find_in(pi->proto, pi->src, pi->s_port, pi->dest, pi->d_port) != NAPT_NONE;
+}
+
+/* ICMP error about one of our packets: translate the quoted header back */
+static void ICACHE_FLASH_ATTR napt_input_icmp_error(struct pbuf *p, pkt_info *pi, uint8_t *ip, uint8_t *l4)
+{
+    uint8_t *iip = l4 + 8, *il4, proto;
+    uint16_t i, old_sum;
+    napt_entry *e;
+
+    if (pi->l4_off + 8 + 20 > p->len)
+        return;
+    il4 = iip + (iip[0] & 0x0f) * 4;
+    if (il4 + 8 > (uint8_t *)p->payload + p->len || rd32_raw(iip + 12) != pi->dest)
+        return;
+
+    proto = iip[9];
+    if (proto == IP_PROTO_TCP || proto == IP_PROTO_UDP)
+        i = napt_find_out(proto, rd16(il4), rd32_raw(iip + 16), rd16(il4 + 2));
+    else if (proto == IP_PROTO_ICMP && il4[0] == NAPT_ICMP_ECHO)
+        i = napt_find_out(proto, rd16(il4 + 4), rd32_raw(iip + 16), 0);
+    else
+        return;
+    if (i == NAPT_NONE)
+        return;
+    e = &napt_table[i];
+
+    // the ICMP checksum covers the quoted header including its checksum
+    old_sum = rd16(iip + 10);
+    csum_put_addr(iip + 12, e->src, iip + 10, l4 + 2);
+    csum_adjust(l4 + 2, old_sum, rd16(iip + 10));
+    csum_put16(proto == IP_PROTO_ICMP ? il4 + 4 : il4, e->sport, l4 + 2, NULL);
+
+    csum_put_addr(ip + 16, e->src, ip + 10, NULL);
+    pi->dest = e->src;
+}
+
+bool ICACHE_FLASH_ATTR napt_input(struct pbuf *p, pkt_info *pi, struct netif *inp)
+{
+    uint8_t *ip, *l4, *sum;
+    struct portmap_table *pm;
+    napt_entry *e;
+    uint32_t daddr;
+    uint16_t i, dport;
+
+    if ((pi->flags & (PKT_F_IP | PKT_F_FRAG)) != PKT_F_IP || pi->dest != inp->ip_addr.addr)
+        return true;
+    ip = (uint8_t *)p->payload + pi->ip_off;
+    l4 = (uint8_t *)p->payload + pi->l4_off;
+
+    if (pi->proto == IP_PROTO_ICMP)
+    {
+        if (pi->l4_off + 8 > p->len)
+            return true;
+        if (l4[0] == NAPT_ICMP_UNREACH || l4[0] == NAPT_ICMP_TIME_EXCEEDED)
+        {
+            napt_input_icmp_error(p, pi, ip, l4);
+            return true;
+        }
+        if (l4[0] != NAPT_ICMP_ECHO_REPLY)
+            return true;
+        i = napt_find_out(IP_PROTO_ICMP, rd16(l4 + 4), pi->src, 0);
+        if (i == NAPT_NONE)
+            return true;
+        e = &napt_table[i];
+        e->flags |= NAPT_F_REPLIED;
+        napt_touch(i, NAPT_CLS_ICMP);
+        csum_put_addr(ip + 16, e->src, ip + 10, NULL);
+        csum_put16(l4 + 4, e->sport, l4 + 2, NULL);
+        pi->dest = e->src;
+        return true;
+    }
+
+    if ((pi->proto != IP_PROTO_TCP && pi->proto != IP_PROTO_UDP) || !(pi->flags & PKT_F_PORTS))
+        return true;
+
+    pm = napt_portmap_find(pi->proto, pi->dest, pi->d_port);
+    if (pm != NULL)
+    {
+        daddr = pm->daddr;
+        dport = pm->dport;
+    }
+    else
+    {
+        i = napt_find_out(pi->proto, pi->d_port, pi->src, pi->s_port);
+        // not a reply: for the ESP itself
+        if (i == NAPT_NONE)
+            return true;
+        e = &napt_table[i];
+        e->flags |= NAPT_F_REPLIED;
+        napt_touch(i, pi->proto == IP_PROTO_TCP ? napt_tcp_state(e, pi->tcp_flags, false) : NAPT_CLS_UDP);
+        daddr = e->src;
+        dport = e->sport;
+    }
+
+    sum = napt_l4_sum(pi->proto, l4);
+    csum_put_addr(ip + 16, daddr, ip + 10, sum);
+    csum_put16(l4 + 2, dport, sum, NULL);
+    // a UDP datagram without a checksum has no sum and keeps 0,
+    // only an updated sum that became 0 is sent as 0xffff
+    if (pi->proto == IP_PROTO_UDP && sum != NULL)
+        csum_udp_fix(sum);
+    pi->dest = daddr;
+    pi->d_port = dport;
+    return true;
+}
+
+void ICACHE_FLASH_ATTR napt_tick(void)
+{
+    uint8_t c;
+
+    napt_now++;
+    // each LRU list has a single timeout, so the expired sessions are at its end
+    for (c = 0; c < NAPT_CLASSES; c++)
+    {
+        uint16_t i;
+        uint32_t timeout = napt_cls_timeout(c);
+
+        while ((i = napt_lru_tail[c]) != NAPT_NONE && napt_now - napt_table[i].last > timeout)
+        {
+            napt_remove(i);
+            napt_stat.expired++;
+        }
+    }
+    napt_update_pressure();
+}
+
+napt_stats * ICACHE_FLASH_ATTR napt_get_stats(void)
+{
+    return &napt_stat;
+}
+
+napt_client * ICACHE_FLASH_ATTR napt_get_client(uint8_t n)
+{
+    return n < NAPT_MAX_CLIENTS ? &napt_clients[n] : NULL;
+}
+
+#endif /* NAPT_INTREE */
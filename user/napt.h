@@ -0,0 +1,115 @@
+#ifndef _NAPT_H_
+#define _NAPT_H_
+
+#include "c_types.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+#include "lwip/lwip_napt.h"
+#include "pkt_info.h"
+
+/*
+ * NAPT for the clients behind the SoftAP (and any other interface it is
+ * enabled for), done on the frames in the station netif hooks: sessions
+ * are translated on sta-out and translated back on sta-in, lwIP itself
+ * only routes.
+ *
+ * Every session is in two hash indexes, one on the inside tuple for the
+ * outgoing packets and one on the mapped port for the replies. The mapped
+ * ports come from a bitmap over IP_NAPT_PORT_RANGE_START..END. Sessions
+ * are kept in LRU lists, one per timeout class, so aging only looks at
+ * the oldest ones. TCP sessions without a SYN-ACK and UDP sessions without
+ * a reply are in classes of their own, their timeouts get shorter as the
+ * table fills up. A full table evicts the session that has been idle for
+ * the largest part of its timeout. Each inside address may hold at most
+ * napt_set_client_max() sessions.
+ *
+ * The functions have the signatures of the lwIP NAPT API in lwip_napt.h.
+ * As liblwip_open_napt.a defines the same symbols, they are named napt_*
+ * and the lwIP names are mapped to them below.
+ */
+
+#define NAPT_CLS_TCP        0   /* open TCP connections */
+#define NAPT_CLS_TCP_FIN    1   /* both FINs or a RST seen */
+#define NAPT_CLS_UDP        2
+#define NAPT_CLS_ICMP       3
+#define NAPT_CLS_TCP_SYN    4   /* half-open: no reply to the SYN yet */
+#define NAPT_CLS_UDP_NEW    5   /* no reply yet */
+#define NAPT_CLASSES        6
+#define NAPT_CLS_FREE       0xff
+
+#define NAPT_F_FIN_OUT      0x01
+#define NAPT_F_FIN_IN       0x02
+#define NAPT_F_RST          0x04
+#define NAPT_F_REPLIED      0x08    /* a reply has been seen */
+
+typedef struct _napt_entry {
+    uint32_t src;           /* inside address */
+    uint32_t dest;          /* remote address */
+    uint16_t sport;         /* inside port or ICMP id */
+    uint16_t dport;         /* remote port, 0 for ICMP */
+    uint16_t mport;         /* mapped port or ICMP id */
+    uint16_t in_next;       /* hash chain of the inside tuple */
+    uint16_t out_next;      /* hash chain of the mapped port */
+    uint16_t lru_prev;
+    uint16_t lru_next;
+    uint8_t  proto;
+    uint8_t  cls;           /* NAPT_CLS_* */
+    uint8_t  flags;         /* NAPT_F_* */
+    uint8_t  client;        /* index in the client table */
+    uint32_t last;          /* time of the last packet in s */
+} napt_entry;
+
+typedef struct _napt_stats {
+    uint16_t used;
+    uint16_t size;
+    uint16_t peak;
+    uint32_t created;
+    uint32_t expired;
+    uint32_t evicted;       /* sessions dropped for a new one */
+    uint32_t refused;       /* sessions refused by the per client limit */
+    uint32_t no_port;       /* no free port in the range */
+    uint32_t untranslated;  /* outgoing packets that couldn't be translated */
+    uint8_t  pressure;      /* 0..3: unreplied sessions time out 2^n times faster */
+} napt_stats;
+
+typedef struct _napt_client {
+    uint32_t addr;
+    uint16_t sessions;
+    uint32_t refused;
+} napt_client;
+
+void napt_init(uint16_t max_nat, uint8_t max_portmap);
+void napt_enable(u32_t addr, int enable);
+void napt_enable_no(u8_t number, int enable);
+u8_t napt_portmap_add(u8_t proto, u32_t maddr, u16_t mport, u32_t daddr, u16_t dport);
+u8_t napt_portmap_remove(u8_t proto, u16_t mport);
+void napt_set_tcp_timeout(u32_t secs);
+void napt_set_udp_timeout(u32_t secs);
+/* Max sessions of one inside address, 0: half of the table */
+void napt_set_client_max(uint16_t max);
+extern struct portmap_table *napt_portmap_table;
+
+/* True if NAPT is enabled for any interface */
+bool napt_active(void);
+/* Frames in the station hooks: translate them in place and update pi.
+   Return false if the frame has to be dropped. */
+bool napt_output(struct pbuf *p, pkt_info *pi, struct netif *outp);
+bool napt_input(struct pbuf *p, pkt_info *pi, struct netif *inp);
+/* True if a TCP/UDP packet from the inside has a session or a portmap */
+bool napt_has_session(const pkt_info *pi);
+/* Called once per second, removes expired sessions */
+void napt_tick(void);
+napt_stats *napt_get_stats(void);
+/* The n-th entry of the client table, NULL at its end */
+napt_client *napt_get_client(uint8_t n);
+
+#define ip_napt_init            napt_init
+#define ip_napt_enable          napt_enable
+#define ip_napt_enable_no       napt_enable_no
+#define ip_portmap_add          napt_portmap_add
+#define ip_portmap_remove       napt_portmap_remove
+#define ip_napt_set_tcp_timeout napt_set_tcp_timeout
+#define ip_napt_set_udp_timeout napt_set_udp_timeout
+#define ip_portmap_table        napt_portmap_table
+
+#endif /* _NAPT_H_ */
@@ -24,4 +24,69 @@ struct pcap_pkthdr {
 	uint32_t len;		/* length this packet (off wire) */
 };
 
+/* pcapng, see draft-ietf-opsawg-pcapng. All blocks are multiples of 4 bytes. */
+
+#define PCAPNG_BT_SHB		0x0a0d0d0a
+#define PCAPNG_BT_IDB		0x00000001
+#define PCAPNG_BT_ISB		0x00000005
+#define PCAPNG_BT_EPB		0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC	0x1a2b3c4d
+
+#define PCAPNG_OPT_ENDOFOPT	0
+#define PCAPNG_OPT_IF_NAME	2
+#define PCAPNG_OPT_ISB_IFRECV	4
+#define PCAPNG_OPT_ISB_IFDROP	5
+
+#define PCAPNG_PAD(len)		(((len) + 3) & ~3)
+
+struct pcapng_shb {
+	uint32_t block_type;
+	uint32_t block_len;
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	uint32_t section_len_lo;	/* -1: not specified */
+	uint32_t section_len_hi;
+	uint32_t block_len2;
+};
+
+/* followed by options and the trailing block length */
+struct pcapng_idb {
+	uint32_t block_type;
+	uint32_t block_len;
+	uint16_t linktype;
+	uint16_t reserved;
+	uint32_t snaplen;
+};
+
+/* followed by the padded packet data and the trailing block length */
+struct pcapng_epb {
+	uint32_t block_type;
+	uint32_t block_len;
+	uint32_t if_id;
+	uint32_t ts_high;	/* microseconds */
+	uint32_t ts_low;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+struct pcapng_isb {
+	uint32_t block_type;
+	uint32_t block_len;
+	uint32_t if_id;
+	uint32_t ts_high;
+	uint32_t ts_low;
+	uint16_t recv_code;
+	uint16_t recv_len;
+	uint32_t recv_lo;
+	uint32_t recv_hi;
+	uint16_t drop_code;
+	uint16_t drop_len;
+	uint32_t drop_lo;
+	uint32_t drop_hi;
+	uint16_t end_code;
+	uint16_t end_len;
+	uint32_t block_len2;
+};
+
 #endif /* __PCAP_H__ */
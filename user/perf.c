@@ -0,0 +1,61 @@
+#include "user_config.h"
+
+#if PERF_STATS
+
+#include "c_types.h"
+#include "osapi.h"
+#include "user_interface.h"
+#include "perf.h"
+
+uint8_t perf_verdict;
+
+static perf_stat perf_stats[PERF_HOOKS][PERF_VERDICTS];
+
+static const char *perf_hook_names[PERF_HOOKS] = {
+    "ap-in", "ap-out", "sta-in", "sta-out", "bridge-ap", "bridge-sta", "acl", "deferred"
+};
+static const char *perf_verdict_names[PERF_VERDICTS] = { "pass", "drop", "fwd" };
+
+void ICACHE_FLASH_ATTR perf_record(uint8_t hook, uint8_t verdict, uint32_t cycles)
+{
+    perf_stat *s = &perf_stats[hook][verdict];
+    uint32_t v = cycles >> PERF_HIST_SHIFT;
+    uint8_t b = 0;
+
+    while (v != 0 && b < PERF_BUCKETS - 1)
+    {
+        v >>= 1;
+        b++;
+    }
+    s->hist[b]++;
+    s->count++;
+    s->sum += cycles;
+    if (cycles > s->max)
+        s->max = cycles;
+    if (cycles >= PERF_LONG_US * system_get_cpu_freq())
+        s->slow++;
+    // back to the default for an enclosing hook
+    perf_verdict = PERF_PASS;
+}
+
+void ICACHE_FLASH_ATTR perf_reset(void)
+{
+    os_memset(perf_stats, 0, sizeof(perf_stats));
+}
+
+perf_stat * ICACHE_FLASH_ATTR perf_get(uint8_t hook, uint8_t verdict)
+{
+    return &perf_stats[hook][verdict];
+}
+
+const char * ICACHE_FLASH_ATTR perf_hook_name(uint8_t hook)
+{
+    return perf_hook_names[hook];
+}
+
+const char * ICACHE_FLASH_ATTR perf_verdict_name(uint8_t verdict)
+{
+    return perf_verdict_names[verdict];
+}
+
+#endif /* PERF_STATS */
@@ -0,0 +1,82 @@
+#ifndef _PERF_H_
+#define _PERF_H_
+
+#include "c_types.h"
+
+/*
+ * Per-hook latency statistics. Hook entry and exit are timestamped with the
+ * CPU cycle counter (CCOUNT) and the difference is accumulated per hook and
+ * verdict into a log2 histogram plus count, sum and max. The times include
+ * everything the hook calls, i.e. how long it blocks the WiFi task.
+ *
+ * With PERF_STATS 0 all the macros below compile to nothing.
+ */
+
+#define PERF_AP_IN      0
+#define PERF_AP_OUT     1
+#define PERF_STA_IN     2
+#define PERF_STA_OUT    3
+#define PERF_BRIDGE_AP  4
+#define PERF_BRIDGE_STA 5
+#define PERF_ACL        6
+#define PERF_DEFER      7   /* a packet processed by the deferred task */
+#define PERF_HOOKS      8
+
+#define PERF_PASS       0   /* handed on to the stack / allowed */
+#define PERF_DROP       1   /* dropped / denied */
+#define PERF_FWD        2   /* forwarded or answered by the bridge */
+#define PERF_VERDICTS   3
+
+/* Bucket 0: < 128 cycles, bucket b: 2^(b+6) .. 2^(b+7)-1 cycles,
+   the last bucket takes everything above */
+#define PERF_BUCKETS    16
+#define PERF_HIST_SHIFT 7
+
+typedef struct _perf_stat {
+    uint32_t count;
+    uint32_t slow;          /* longer than PERF_LONG_US */
+    uint32_t max;           /* cycles */
+    uint64_t sum;           /* cycles */
+    uint32_t hist[PERF_BUCKETS];
+} perf_stat;
+
+#if PERF_STATS
+
+extern uint8_t perf_verdict;
+
+#ifdef __XTENSA__
+static inline uint32_t perf_ccount(void)
+{
+    uint32_t r;
+    __asm__ __volatile__("rsr %0, ccount" : "=a"(r));
+    return r;
+}
+#else
+/* Host builds (test/host) count cycles of an 80 MHz clock */
+uint32_t perf_ccount(void);
+#endif
+
+void perf_record(uint8_t hook, uint8_t verdict, uint32_t cycles);
+void perf_reset(void);
+perf_stat *perf_get(uint8_t hook, uint8_t verdict);
+const char *perf_hook_name(uint8_t hook);
+const char *perf_verdict_name(uint8_t verdict);
+
+/* Measures a hook, the verdict can be set with PERF_VERDICT() anywhere in
+   between, it defaults to PERF_PASS and is reset by every measurement */
+#define PERF_START(t)           uint32_t t = perf_ccount()
+#define PERF_VERDICT(v)         perf_verdict = (v)
+#define PERF_END(hook, t)       perf_record((hook), perf_verdict, perf_ccount() - (t))
+/* Measures with an explicit verdict */
+#define PERF_END_V(hook, t, v)  perf_record((hook), (v), perf_ccount() - (t))
+
+#else
+
+#define PERF_START(t)
+#define PERF_VERDICT(v)
+#define PERF_END(hook, t)
+#define PERF_END_V(hook, t, v)
+
+#endif /* PERF_STATS */
+
+#endif /* _PERF_H_ */
@@ -0,0 +1,75 @@
+#include "c_types.h"
+#include "osapi.h"
+#include "lwip/pbuf.h"
+
+#include "pkt_info.h"
+
+#define ETHTYPE_IP  0x0800
+#define IP_PROTO_TCP 6
+#define IP_PROTO_UDP 17
+
+/* All multi-byte fields are assembled from single bytes: the IP header
+   starts at offset 14 of the frame, so its 32-bit fields are never
+   aligned and the lx106 would trap (or take the slow path) otherwise. */
+static inline uint16_t rd16(const uint8_t *b)
+{
+    return ((uint16_t)b[0] << 8) | b[1];
+}
+
+static inline uint32_t rd32_raw(const uint8_t *b)
+{
+    /* keeps the network byte order of the field */
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+/* Only the first pbuf of a chain is inspected, as the headers of received
+   and linkoutput frames are always in the first chunk. */
+void ICACHE_FLASH_ATTR pkt_parse(struct pbuf *p, pkt_info *pi)
+{
+    const uint8_t *b = (const uint8_t *)p->payload;
+    uint16_t len = p->len, ihl;
+
+    os_memset(pi, 0, sizeof(pkt_info));
+    pi->tot_len = p->tot_len;
+
+    if (len < PKT_ETH_HDR_LEN)
+        return;
+    if (b[0] & 0x01)
+        pi->flags |= PKT_F_BCAST;
+    pi->eth_type = rd16(&b[12]);
+
+    if (pi->eth_type != ETHTYPE_IP)
+        return;
+    pi->ip_off = PKT_ETH_HDR_LEN;
+    b += PKT_ETH_HDR_LEN;
+    len -= PKT_ETH_HDR_LEN;
+
+    if (len < 20)
+        return;
+    ihl = (b[0] & 0x0f) * 4;
+    if (ihl < 20 || len < ihl)
+        return;
+    pi->flags |= PKT_F_IP;
+    pi->proto = b[9];
+    pi->src = rd32_raw(&b[12]);
+    pi->dest = rd32_raw(&b[16]);
+    pi->l4_off = PKT_ETH_HDR_LEN + ihl;
+
+    if (rd16(&b[6]) & 0x1fff) {
+        pi->flags |= PKT_F_FRAG;
+        return;
+    }
+
+    b += ihl;
+    len -= ihl;
+    if (pi->proto == IP_PROTO_UDP && len >= 8) {
+        pi->s_port = rd16(&b[0]);
+        pi->d_port = rd16(&b[2]);
+        pi->flags |= PKT_F_PORTS;
+    } else if (pi->proto == IP_PROTO_TCP && len >= 20) {
+        pi->s_port = rd16(&b[0]);
+        pi->d_port = rd16(&b[2]);
+        pi->tcp_flags = b[13] & 0x3f;
+        pi->flags |= PKT_F_PORTS;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef _PKT_INFO_H_
+#define _PKT_INFO_H_
+
+#include "c_types.h"
+#include "lwip/pbuf.h"
+
+/* Header fields of an Ethernet frame, parsed once per frame at hook entry
+   and handed to everything that needs them (ACLs, monitor, QoS, counters).
+   Addresses are in network byte order, ports and lengths in host order. */
+
+#define PKT_F_BCAST     0x01    /* group bit set in the dest MAC */
+#define PKT_F_IP        0x02    /* IPv4 header present and complete */
+#define PKT_F_PORTS     0x04    /* TCP/UDP header present, ports valid */
+#define PKT_F_FRAG      0x08    /* non-first IP fragment: the ports are left 0, as
+                                   the bytes behind its IP header are payload. So
+                                   it never matches an ACL rule with a port, only
+                                   rules that leave the ports open */
+
+typedef struct _pkt_info {
+    uint16_t eth_type;          /* 0 if the frame is shorter than an Ethernet header */
+    uint16_t tot_len;           /* p->tot_len */
+    uint16_t ip_off;            /* offset of the IP header in the frame */
+    uint16_t l4_off;            /* offset of the transport header in the frame */
+    uint8_t  flags;             /* PKT_F_* */
+    uint8_t  proto;             /* IP protocol */
+    uint8_t  tcp_flags;         /* TCP flags (FIN, SYN, RST, ACK...) */
+    uint8_t  acl;               /* ACL verdict (ACL_* bits), set by the hooks */
+    uint32_t src;
+    uint32_t dest;
+    uint16_t s_port;
+    uint16_t d_port;
+} pkt_info;
+
+#define PKT_ETH_HDR_LEN 14
+
+void pkt_parse(struct pbuf *p, pkt_info *pi);
+
+#endif /* _PKT_INFO_H_ */
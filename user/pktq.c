@@ -0,0 +1,131 @@
+#include "user_config.h"
+
+#if PKT_DEFER
+
+#include "c_types.h"
+#include "osapi.h"
+#include "user_interface.h"
+#include "pktq.h"
+#include "perf.h"
+
+typedef struct {
+    struct pbuf  *p;
+    struct netif *nif;
+    uint8_t       chain;
+} pktq_entry;
+
+static pktq_entry pktq_ring[PKT_DEFER_QUEUE];
+static uint8_t pktq_head;
+static uint8_t pktq_count;
+static uint8_t pktq_batch = 1;
+static uint8_t pktq_prio;
+static bool pktq_posted;
+static pktq_fn pktq_handler;
+static pktq_stats pktq_stat;
+static os_event_t pktq_events[1];
+
+static uint8_t ICACHE_FLASH_ATTR pktq_bucket(uint32_t n)
+{
+    uint8_t b = 0;
+
+    while (n != 0 && b < PKTQ_HIST - 1)
+    {
+        n >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static void ICACHE_FLASH_ATTR pktq_task(os_event_t *events)
+{
+    uint8_t n;
+
+    pktq_posted = false;
+    for (n = 0; n < pktq_batch && pktq_count != 0; n++)
+    {
+        pktq_entry *e = &pktq_ring[pktq_head];
+        PERF_START(t);
+
+        if (++pktq_head == PKT_DEFER_QUEUE)
+            pktq_head = 0;
+        pktq_count--;
+        pktq_handler(e->chain, e->p, e->nif);
+        PERF_END(PERF_DEFER, t);
+    }
+    if (n != 0)
+    {
+        pktq_stat.batches++;
+        pktq_stat.batch[pktq_bucket(n)]++;
+    }
+    // the rest in the next run, after the others had their turn
+    if (pktq_count != 0)
+        pktq_posted = system_os_post(pktq_prio, 0, 0);
+}
+
+void ICACHE_FLASH_ATTR pktq_init(pktq_fn fn, uint8_t prio)
+{
+    pktq_handler = fn;
+    pktq_prio = prio;
+    pktq_head = pktq_count = 0;
+    pktq_posted = false;
+    os_memset(&pktq_stat, 0, sizeof(pktq_stat));
+    system_os_task(pktq_task, prio, pktq_events, 1);
+}
+
+void ICACHE_FLASH_ATTR pktq_put(uint8_t chain, struct pbuf *p, struct netif *nif)
+{
+    pktq_entry *e;
+    struct pbuf *copy = NULL;
+    uint8_t tail;
+
+    pktq_stat.depth[pktq_bucket(pktq_count)]++;
+    // the driver's receive buffers are few, the ring holds copies
+    if (pktq_count < PKT_DEFER_QUEUE)
+        copy = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM);
+    if (copy == NULL)
+    {
+        PERF_VERDICT(PERF_DROP);
+        pktq_stat.overflows++;
+        pbuf_free(p);
+        return;
+    }
+    pbuf_copy(copy, p);
+    pbuf_free(p);
+    p = copy;
+
+    tail = pktq_head + pktq_count;
+    if (tail >= PKT_DEFER_QUEUE)
+        tail -= PKT_DEFER_QUEUE;
+    e = &pktq_ring[tail];
+    e->p = p;
+    e->nif = nif;
+    e->chain = chain;
+    if (++pktq_count > pktq_stat.hwm)
+        pktq_stat.hwm = pktq_count;
+    pktq_stat.queued++;
+
+    if (!pktq_posted)
+        pktq_posted = system_os_post(pktq_prio, 0, 0);
+}
+
+void ICACHE_FLASH_ATTR pktq_set_batch(uint8_t batch)
+{
+    pktq_batch = batch ? batch : 1;
+}
+
+uint8_t ICACHE_FLASH_ATTR pktq_len(void)
+{
+    return pktq_count;
+}
+
+pktq_stats * ICACHE_FLASH_ATTR pktq_get_stats(void)
+{
+    return &pktq_stat;
+}
+
+void ICACHE_FLASH_ATTR pktq_reset_stats(void)
+{
+    os_memset(&pktq_stat, 0, sizeof(pktq_stat));
+}
+
+#endif /* PKT_DEFER */
@@ -0,0 +1,46 @@
+#ifndef _PKTQ_H_
+#define _PKTQ_H_
+
+#include "c_types.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+
+/*
+ * Deferred processing of received packets. Instead of running the hook
+ * chain in the WiFi receive path, the input hooks put the packets into a
+ * ring of PKT_DEFER_QUEUE entries and return. A task drains the ring in
+ * batches and hands every packet to the function given to pktq_init(),
+ * after each batch it posts itself again, so WiFi and the other tasks
+ * get their turn. The ring holds copies in RAM, the received pbufs are
+ * the WiFi driver's buffers and go back to it at once. A packet that finds
+ * the ring full or no memory for the copy is dropped.
+ *
+ * The queue length seen by each new packet and the number of packets per
+ * batch are kept as log2 histograms: bucket 0 is 0, bucket b is
+ * 2^(b-1) .. 2^b-1.
+ */
+
+#define PKTQ_HIST       6
+
+typedef err_t (*pktq_fn)(uint8_t chain, struct pbuf *p, struct netif *nif);
+
+typedef struct _pktq_stats {
+    uint32_t queued;
+    uint32_t overflows;     /* dropped on a full ring or without memory */
+    uint32_t batches;
+    uint8_t  hwm;           /* max length seen */
+    uint32_t depth[PKTQ_HIST];
+    uint32_t batch[PKTQ_HIST];
+} pktq_stats;
+
+/* The task runs with the given priority (1 or 2, 0 is the user task) */
+void pktq_init(pktq_fn fn, uint8_t prio);
+/* Takes ownership of p: queued for fn(chain, p, nif) or dropped */
+void pktq_put(uint8_t chain, struct pbuf *p, struct netif *nif);
+/* Max number of packets processed per run of the task */
+void pktq_set_batch(uint8_t batch);
+uint8_t pktq_len(void);
+pktq_stats *pktq_get_stats(void);
+void pktq_reset_stats(void);
+
+#endif /* _PKTQ_H_ */
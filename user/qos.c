@@ -0,0 +1,416 @@
+#include "user_config.h"
+
+#if TOKENBUCKET
+
+#include "c_types.h"
+#include "osapi.h"
+#include "user_interface.h"
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+#include "qos.h"
+
+/* Clients without a packet for this long don't count for the fair share */
+#define QOS_IDLE_S      2
+/* The smallest bucket of a client, at least one full frame */
+#define QOS_MIN_BURST   1600
+
+typedef struct {
+    uint32_t kbps;          /* the rate the values below are computed for */
+    uint32_t mul;           /* bytes per us, scaled by 2^20 */
+    uint32_t burst;         /* bytes */
+} qos_rate;
+
+static qos_rate qos_rates[2];
+static qos_bucket qos_global[2];
+static uint32_t qos_drop_count[2];
+static qos_client qos_clients[QOS_MAX_CLIENTS];
+static uint8_t qos_active;
+static uint8_t qos_last;
+
+static qos_queue qos_queues[2];
+static qos_pass_fn qos_pass[2];
+static os_timer_t qos_timer[2];
+
+static void qos_timer_cb(void *arg);
+
+void ICACHE_FLASH_ATTR qos_init(qos_pass_fn pass_us, qos_pass_fn pass_ds)
+{
+    os_memset(qos_rates, 0, sizeof(qos_rates));
+    os_memset(qos_global, 0, sizeof(qos_global));
+    os_memset(qos_clients, 0, sizeof(qos_clients));
+    os_memset(qos_queues, 0, sizeof(qos_queues));
+    qos_drop_count[QOS_US] = qos_drop_count[QOS_DS] = 0;
+    qos_active = 0;
+    qos_last = 0;
+
+    qos_pass[QOS_US] = pass_us;
+    qos_pass[QOS_DS] = pass_ds;
+    os_timer_disarm(&qos_timer[QOS_US]);
+    os_timer_setfn(&qos_timer[QOS_US], (os_timer_func_t *)qos_timer_cb, (void *)QOS_US);
+    os_timer_disarm(&qos_timer[QOS_DS]);
+    os_timer_setfn(&qos_timer[QOS_DS], (os_timer_func_t *)qos_timer_cb, (void *)QOS_DS);
+}
+
+static void ICACHE_FLASH_ATTR qos_set_rate(qos_rate *r, uint32_t kbps)
+{
+    uint32_t Bps = kbps * 1024 / 8;
+
+    r->kbps = kbps;
+    r->mul = (uint32_t)(((uint64_t)Bps << 20) / 1000000);
+    r->burst = MAX_TOKEN_RATIO * Bps;
+}
+
+static void ICACHE_FLASH_ATTR qos_refill(qos_bucket *b, uint32_t now, uint32_t mul, uint32_t burst)
+{
+    uint32_t elapsed = now - b->last_us;
+    uint64_t add;
+
+    b->last_us = now;
+    if (elapsed >= MAX_TOKEN_RATIO * 1000000)
+    {
+        b->tokens = burst;
+        b->frac = 0;
+        return;
+    }
+    // carry the fraction, so slow rates and short gaps still add up
+    add = (uint64_t)elapsed * mul + b->frac;
+    b->tokens += (uint32_t)(add >> 20);
+    b->frac = (uint32_t)add & 0xfffff;
+    if (b->tokens >= burst)
+    {
+        b->tokens = burst;
+        b->frac = 0;
+    }
+}
+
+static qos_client * ICACHE_FLASH_ATTR qos_find_client(uint32_t ip, uint32_t now)
+{
+    qos_client *c;
+    uint8_t i, free = QOS_MAX_CLIENTS, victim = QOS_MAX_CLIENTS, max_idle = 0;
+
+    // most packets belong to the same client as the one before
+    if (qos_clients[qos_last].ip == ip)
+        return &qos_clients[qos_last];
+
+    // prefer a free slot, then the client idle for the longest time
+    for (i = 0; i < QOS_MAX_CLIENTS; i++)
+    {
+        c = &qos_clients[i];
+        if (c->ip == ip)
+        {
+            qos_last = i;
+            return c;
+        }
+        if (free == QOS_MAX_CLIENTS && c->ip == 0)
+            free = i;
+        else if (c->ip != 0 && !c->active && c->idle_s >= max_idle)
+        {
+            max_idle = c->idle_s;
+            victim = i;
+        }
+    }
+    if (free != QOS_MAX_CLIENTS)
+        victim = free;
+    if (victim == QOS_MAX_CLIENTS)
+        return NULL;
+
+    c = &qos_clients[victim];
+    os_memset(c, 0, sizeof(qos_client));
+    c->ip = ip;
+    c->bucket[QOS_US].last_us = c->bucket[QOS_DS].last_us = now - MAX_TOKEN_RATIO * 1000000;
+    qos_last = victim;
+    return c;
+}
+
+/* Takes len bytes from the buckets if they fit, *cp is set to the client */
+static bool ICACHE_FLASH_ATTR qos_charge(uint8_t dir, uint32_t ip, uint16_t len, uint32_t now, qos_client **cp)
+{
+    qos_rate *r = &qos_rates[dir];
+    qos_client *c = NULL;
+
+    qos_refill(&qos_global[dir], now, r->mul, r->burst);
+
+    // no per-client bucket for broadcasts and multicasts
+    if (ip != 0 && ip != IPADDR_BROADCAST && (ntohl(ip) >> 28) != 0xe)
+        c = qos_find_client(ip, now);
+    *cp = c;
+
+    if (c != NULL)
+    {
+        uint32_t burst;
+
+        c->idle_s = 0;
+        if (!c->active)
+        {
+            c->active = 1;
+            qos_active++;
+        }
+        burst = r->burst / qos_active;
+        if (burst < QOS_MIN_BURST)
+            burst = QOS_MIN_BURST;
+        qos_refill(&c->bucket[dir], now, r->mul / qos_active, burst);
+
+        // over its share: only borrow while the global bucket is more
+        // than half full, i.e. other clients leave capacity unused
+        if (len > c->bucket[dir].tokens && qos_global[dir].tokens < r->burst / 2 + len)
+            return false;
+    }
+
+    if (len > qos_global[dir].tokens)
+        return false;
+
+    qos_global[dir].tokens -= len;
+    if (c != NULL)
+    {
+        c->bucket[dir].tokens -= (len < c->bucket[dir].tokens) ? len : c->bucket[dir].tokens;
+        c->bytes[dir] += len;
+    }
+    return true;
+}
+
+static void ICACHE_FLASH_ATTR qos_count_drop(uint8_t dir, qos_client *c)
+{
+    if (c != NULL)
+        c->drops[dir]++;
+    qos_drop_count[dir]++;
+}
+
+static void ICACHE_FLASH_ATTR qos_drop_entry(uint8_t dir, qos_entry *e)
+{
+    uint8_t i;
+
+    for (i = 0; i < QOS_MAX_CLIENTS; i++)
+    {
+        if (qos_clients[i].ip == e->ip)
+            break;
+    }
+    qos_count_drop(dir, i < QOS_MAX_CLIENTS ? &qos_clients[i] : NULL);
+    pbuf_free(e->p);
+}
+
+/* The CoDel control law: interval / sqrt(count) */
+static uint32_t ICACHE_FLASH_ATTR qos_codel_next(uint32_t interval, uint32_t count)
+{
+    uint32_t x = count << 16, root = 0, bit = 1UL << 30;
+
+    if (count >= 0x8000)
+        return interval / 181;
+    // integer square root, root = sqrt(count) * 256
+    while (bit > x)
+        bit >>= 2;
+    while (bit != 0)
+    {
+        if (x >= root + bit)
+        {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+            root >>= 1;
+        bit >>= 2;
+    }
+    return (uint32_t)(((uint64_t)interval << 8) / root);
+}
+
+/* Decides whether the head of the queue with the given sojourn time has
+   to be dropped */
+static bool ICACHE_FLASH_ATTR qos_codel_drop(uint8_t dir, uint32_t sojourn, uint32_t now)
+{
+    qos_queue *q = &qos_queues[dir];
+    uint32_t target = QOS_CODEL_TARGET * 1000, interval = QOS_CODEL_INTERVAL * 1000;
+    uint32_t mtu_us;
+
+    // on slow links the target has to cover the time of a full frame
+    mtu_us = (uint32_t)((uint64_t)1514 * 1000000 / (qos_rates[dir].kbps * 1024 / 8));
+    if (target < mtu_us)
+        target = mtu_us;
+    if (interval < 4 * target)
+        interval = 4 * target;
+
+    if (sojourn < target || q->len <= 1)
+    {
+        q->first_above = 0;
+        q->dropping = 0;
+        return false;
+    }
+    if (q->first_above == 0)
+    {
+        q->first_above = (now + interval) | 1;
+        return false;
+    }
+    if (!q->dropping)
+    {
+        if ((int32_t)(now - q->first_above) < 0)
+            return false;
+        q->dropping = 1;
+        // start near the last drop rate if the last episode was recent
+        if (q->count > 2 && (int32_t)(now - q->drop_next) < 16 * (int32_t)interval)
+            q->count -= 2;
+        else
+            q->count = 1;
+        q->drop_next = now + qos_codel_next(interval, q->count);
+        return true;
+    }
+    if ((int32_t)(now - q->drop_next) < 0)
+        return false;
+    q->count++;
+    q->drop_next += qos_codel_next(interval, q->count);
+    return true;
+}
+
+/* Releases packets from the head of the queue as long as there are tokens */
+static void ICACHE_FLASH_ATTR qos_release(uint8_t dir)
+{
+    qos_queue *q = &qos_queues[dir];
+    qos_client *c;
+    uint32_t now = system_get_time();
+
+    while (q->len > 0)
+    {
+        qos_entry e = q->ent[q->head];
+        bool drop = qos_codel_drop(dir, now - e.t_us, now);
+
+        if (!drop && !qos_charge(dir, e.ip, e.len, now, &c))
+            break;
+        q->head = (q->head + 1) % QOS_QUEUE_MAX;
+        q->len--;
+
+        if (drop)
+        {
+            q->codel_drops++;
+            qos_drop_entry(dir, &e);
+        }
+        else
+            qos_pass[dir](e.p, e.nif);
+    }
+
+    os_timer_disarm(&qos_timer[dir]);
+    if (q->len > 0)
+    {
+        uint32_t ms = 2, tokens = qos_global[dir].tokens;
+        uint16_t need = q->ent[q->head].len;
+
+        // wait until the global bucket has enough tokens for the head
+        if (need > tokens)
+            ms += (need - tokens) * 1000 / (qos_rates[dir].kbps * 1024 / 8);
+        if (ms > QOS_CODEL_INTERVAL)
+            ms = QOS_CODEL_INTERVAL;
+        os_timer_arm(&qos_timer[dir], ms, 0);
+    }
+}
+
+static void ICACHE_FLASH_ATTR qos_timer_cb(void *arg)
+{
+    qos_release((uint8_t)(uintptr_t)arg);
+}
+
+bool ICACHE_FLASH_ATTR qos_shape(uint8_t dir, uint32_t kbps, uint8_t depth, uint32_t ip,
+                                 struct pbuf *p, struct netif *nif, uint16_t len)
+{
+    qos_queue *q = &qos_queues[dir];
+    qos_client *c = NULL;
+    qos_entry *e;
+    struct pbuf *copy;
+    uint32_t now;
+
+    if (qos_rates[dir].kbps != kbps)
+        qos_set_rate(&qos_rates[dir], kbps);
+
+    // keep the order: packets only overtake an empty queue
+    if (q->len > 0)
+        qos_release(dir);
+
+    now = system_get_time();
+    if (q->len == 0 && qos_charge(dir, ip, len, now, &c))
+        return true;
+
+    if (depth > QOS_QUEUE_MAX)
+        depth = QOS_QUEUE_MAX;
+    if (depth == 0)
+    {
+        qos_count_drop(dir, c);
+        pbuf_free(p);
+        return false;
+    }
+
+    // Received frames are in the WiFi driver's receive buffers, holding
+    // them in the queue would stall the reception. A copy is queued.
+    copy = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM);
+    if (copy == NULL)
+    {
+        qos_count_drop(dir, c);
+        pbuf_free(p);
+        return false;
+    }
+    pbuf_copy(copy, p);
+    pbuf_free(p);
+    p = copy;
+
+    if (q->len >= depth)
+    {
+        // full: drop the oldest one, the new one has the better chances
+        q->overflows++;
+        qos_drop_entry(dir, &q->ent[q->head]);
+        q->head = (q->head + 1) % QOS_QUEUE_MAX;
+        q->len--;
+    }
+
+    e = &q->ent[(q->head + q->len) % QOS_QUEUE_MAX];
+    e->p = p;
+    e->nif = nif;
+    e->ip = ip;
+    e->len = len;
+    e->t_us = now;
+    q->len++;
+    q->queued++;
+    if (q->len > q->hwm)
+        q->hwm = q->len;
+
+    if (q->len == 1)
+        qos_release(dir);
+    return false;
+}
+
+void ICACHE_FLASH_ATTR qos_tick(void)
+{
+    uint8_t i, dir;
+
+    for (i = 0; i < QOS_MAX_CLIENTS; i++)
+    {
+        qos_client *c = &qos_clients[i];
+
+        if (c->ip == 0)
+            continue;
+        for (dir = 0; dir < 2; dir++)
+        {
+            c->rate[dir] = (c->rate[dir] * 3 + (c->bytes[dir] - c->last_bytes[dir])) / 4;
+            c->last_bytes[dir] = c->bytes[dir];
+        }
+        if (c->idle_s < 255)
+            c->idle_s++;
+        if (c->active && c->idle_s >= QOS_IDLE_S)
+        {
+            c->active = 0;
+            qos_active--;
+        }
+    }
+}
+
+qos_client * ICACHE_FLASH_ATTR qos_get_client(uint8_t i)
+{
+    if (i >= QOS_MAX_CLIENTS || qos_clients[i].ip == 0)
+        return NULL;
+    return &qos_clients[i];
+}
+
+uint32_t ICACHE_FLASH_ATTR qos_drops(uint8_t dir)
+{
+    return qos_drop_count[dir];
+}
+
+qos_queue * ICACHE_FLASH_ATTR qos_get_queue(uint8_t dir)
+{
+    return &qos_queues[dir];
+}
+
+#endif /* TOKENBUCKET */
@@ -0,0 +1,90 @@
+#ifndef _QOS_H_
+#define _QOS_H_
+
+#include "c_types.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+
+/*
+ * Token bucket traffic shaping. Each direction has a global bucket with
+ * the configured rate, and every AP client has its own bucket nested
+ * below it, refilled with the fair share of the global rate (the rate
+ * divided by the number of currently active clients). A packet has to
+ * fit into both, a client may only exceed its share while the global
+ * bucket is more than half full. Buckets are refilled lazily when a
+ * packet arrives.
+ *
+ * Packets over the limit are held in a small FIFO per direction instead
+ * of being dropped, and released by a timer or the next packet as soon as
+ * there are enough tokens. The queue is managed like CoDel: if packets
+ * stay longer than the target delay for a whole interval, they are
+ * dropped at the head with an increasing frequency.
+ */
+
+#define QOS_US 0    /* upstream: from the AP clients */
+#define QOS_DS 1    /* downstream: to the AP clients */
+
+#define QOS_MAX_CLIENTS MAX_CLIENTS
+
+typedef struct _qos_bucket {
+    uint32_t tokens;        /* bytes */
+    uint32_t frac;          /* fraction of a byte, 1/2^20 */
+    uint32_t last_us;       /* system_get_time() of the last refill */
+} qos_bucket;
+
+typedef struct _qos_entry {
+    struct pbuf  *p;
+    struct netif *nif;
+    uint32_t      ip;
+    uint32_t      t_us;     /* time of enqueue */
+    uint16_t      len;
+} qos_entry;
+
+typedef struct _qos_queue {
+    qos_entry ent[QOS_QUEUE_MAX];
+    uint8_t   head;
+    uint8_t   len;
+    uint8_t   hwm;          /* max length seen */
+    uint8_t   dropping;     /* CoDel state */
+    uint32_t  first_above;
+    uint32_t  drop_next;
+    uint32_t  count;
+    uint32_t  queued;       /* packets delayed */
+    uint32_t  overflows;    /* dropped on a full queue */
+    uint32_t  codel_drops;  /* dropped at the head */
+} qos_queue;
+
+typedef struct _qos_client {
+    uint32_t   ip;          /* 0 if unused */
+    uint8_t    active;
+    uint8_t    idle_s;      /* secs since the last packet */
+    qos_bucket bucket[2];
+    uint32_t   bytes[2];
+    uint32_t   drops[2];
+    uint32_t   last_bytes[2];
+    uint32_t   rate[2];     /* bytes/s, smoothed */
+} qos_client;
+
+/* Called for every packet that passes the limit, directly or from the
+   queue, takes ownership of p */
+typedef err_t (*qos_pass_fn)(struct pbuf *p, struct netif *nif);
+
+void qos_init(qos_pass_fn pass_us, qos_pass_fn pass_ds);
+
+/* Charges a packet of len bytes of the AP client ip (0 if there is no
+   single client, e.g. broadcasts) in direction dir against a limit of
+   kbps. Returns true if it may pass right now. Otherwise the packet has
+   been queued (up to depth packets) or dropped, the caller must not
+   touch it anymore. */
+bool qos_shape(uint8_t dir, uint32_t kbps, uint8_t depth, uint32_t ip,
+               struct pbuf *p, struct netif *nif, uint16_t len);
+
+/* Called once a second from timer_func() for the rate statistics */
+void qos_tick(void);
+
+/* Returns the client entry i, or NULL if unused */
+qos_client *qos_get_client(uint8_t i);
+uint32_t qos_drops(uint8_t dir);
+qos_queue *qos_get_queue(uint8_t dir);
+
+#endif /* _QOS_H_ */
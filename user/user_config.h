@@ -134,6 +134,18 @@
 #ifndef MAX_TOKEN_RATIO
 #define		MAX_TOKEN_RATIO 4
 #endif
+// Max number of packets per direction held back while over the limit
+// (the actual depth is set with "set qos_queue")
+#ifndef QOS_QUEUE_MAX
+#define		QOS_QUEUE_MAX 32
+#endif
+// CoDel target delay and interval in ms
+#ifndef QOS_CODEL_TARGET
+#define		QOS_CODEL_TARGET 5
+#endif
+#ifndef QOS_CODEL_INTERVAL
+#define		QOS_CODEL_INTERVAL 100
+#endif
 
 //
 // Define this to 1 if you want to offer monitoring access to all transmitted data between the soft AP and all STAs.
@@ -158,6 +170,64 @@
 #define		DROP_PACKET_IF_NOT_RECORDED 1
 #endif
 
+// Interval (in secs) of the interface statistics (drop counts) in pcapng monitor mode
+#ifndef MONITOR_STATS_INTERVAL
+#define		MONITOR_STATS_INTERVAL 5
+#endif
+
+//
+// Define this to 1 if you want to measure the CPU cycles spent in the packet hooks
+// (see "show perf"). Compiles to nothing if 0.
+//
+#ifndef PERF_STATS
+#define		PERF_STATS 0
+#endif
+// Hook runs longer than this (in us) are counted as slow
+#ifndef PERF_LONG_US
+#define		PERF_LONG_US 1000
+#endif
+
+//
+// Define this to 1 to be able to run the hooks of the received packets in a
+// task instead of the WiFi receive path (see "set hook_defer").
+// PKT_DEFER_QUEUE is the max number of packets waiting for the task, they
+// hold receive buffers of the WiFi driver.
+//
+#ifndef PKT_DEFER
+#ifdef REPEATER_MODE
+#define		PKT_DEFER 0
+#else
+#define		PKT_DEFER 1
+#endif
+#endif
+#ifndef PKT_DEFER_QUEUE
+#define		PKT_DEFER_QUEUE 8
+#endif
+
+//
+// Number of entries of the flow cache that remembers the ACL verdict and the
+// monitor decision per connection (32, 64 or 128, 0 to disable)
+//
+#ifndef FLOW_CACHE_SIZE
+#if ACLS || REMOTE_MONITORING
+#define		FLOW_CACHE_SIZE 64
+#else
+#define		FLOW_CACHE_SIZE 0
+#endif
+#endif
+
+//
+// Number of connections tracked for the "established" ACL rule
+// (16, 32, 64 or 128, 0 to disable)
+//
+#ifndef CONNTRACK_SIZE
+#if ACLS
+#define		CONNTRACK_SIZE 32
+#else
+#define		CONNTRACK_SIZE 0
+#endif
+#endif
+
 //
 //
 // Define this to 1 if you want to have it work as a MQTT client
@@ -210,6 +280,43 @@
 //
 #define		ENC28J60_HW_RESET 4
 
+//
+// Define this to 1 to use the NAPT in napt.c instead of the one of the lwIP
+// library. It works in the station interface hooks, so an ENC28J60 uplink
+// keeps the library NAPT.
+//
+#ifndef NAPT_INTREE
+#if defined(REPEATER_MODE) || HAVE_ENC28J60
+#define		NAPT_INTREE 0
+#else
+#define		NAPT_INTREE 1
+#endif
+#endif
+
+//
+// Define this to 1 to be able to limit the rate of new connections of each
+// AP client (see "set conn_rate")
+//
+#ifndef CONN_LIMIT
+#ifdef REPEATER_MODE
+#define		CONN_LIMIT 0
+#else
+#define		CONN_LIMIT 1
+#endif
+#endif
+
+//
+// Define this to 1 to be able to clamp the TCP MSS of the AP clients'
+// connections (see "set mss_clamp")
+//
+#ifndef MSS_CLAMP
+#ifdef REPEATER_MODE
+#define		MSS_CLAMP 0
+#else
+#define		MSS_CLAMP 1
+#endif
+#endif
+
 //
 // Define this to 1 if you want to be able to control GPIO pins from the command line
 //
@@ -225,6 +332,84 @@
 #define		MDNS_REPEATER 1
 #endif
 
+//
+// Number of slots of the repeater's IP->MAC forwarding database (64, 128 or 256).
+// It is filled up to 3/4, so the default serves up to 48 client addresses.
+// Define BRIDGE_FDB_MAC_INDEX to 1 to also keep a MAC->IP index, which drops
+// a client's old address as soon as it gets a new DHCP lease.
+//
+#ifndef BRIDGE_FDB_SIZE
+#define		BRIDGE_FDB_SIZE 64
+#endif
+#ifndef BRIDGE_FDB_MAC_INDEX
+#define		BRIDGE_FDB_MAC_INDEX 0
+#endif
+
+//
+// Number of full-size frames the repeater bridge allocates at startup for copied
+// frames and its own replies (proxy ARP, mDNS), so it doesn't depend on the
+// fragmented heap under load. If the pool is empty, the heap is used. 0 disables it.
+//
+#ifndef BRIDGE_POOL_FRAMES
+#define		BRIDGE_POOL_FRAMES 4
+#endif
+#define		BRIDGE_POOL_FRAME_SIZE 1536
+
+//
+// Define this to 1 to be able to send the repeater's multicast frames to the
+// AP clients as unicast copies (see "set mcast_unicast")
+//
+#ifndef BRIDGE_MCAST_UNICAST
+#ifdef REPEATER_MODE
+#define		BRIDGE_MCAST_UNICAST 1
+#else
+#define		BRIDGE_MCAST_UNICAST 0
+#endif
+#endif
+
+//
+// Define this to 1 to track the IGMP memberships of the AP clients in the
+// repeater, so multicast is only sent to the clients that joined the group
+// (see "set igmp_snoop"). BRIDGE_IGMP_SIZE is the max number of memberships.
+//
+#ifndef BRIDGE_IGMP_SNOOP
+#ifdef REPEATER_MODE
+#define		BRIDGE_IGMP_SNOOP 1
+#else
+#define		BRIDGE_IGMP_SNOOP 0
+#endif
+#endif
+#ifndef BRIDGE_IGMP_SIZE
+#define		BRIDGE_IGMP_SIZE 32
+#endif
+
+//
+// Define this to 1 to be able to limit the broadcasts and multicasts the
+// repeater forwards, per class (see "set bcast_rate" and "set storm_rate")
+//
+#ifndef BRIDGE_BCAST_LIMIT
+#ifdef REPEATER_MODE
+#define		BRIDGE_BCAST_LIMIT 1
+#else
+#define		BRIDGE_BCAST_LIMIT 0
+#endif
+#endif
+
+//
+// Define this to 1 to be able to answer the AP clients' ARP requests for
+// upstream hosts from a cache in the repeater (see "set arp_cache")
+//
+#ifndef BRIDGE_ARP_CACHE
+#ifdef REPEATER_MODE
+#define		BRIDGE_ARP_CACHE 1
+#else
+#define		BRIDGE_ARP_CACHE 0
+#endif
+#endif
+#ifndef BRIDGE_ARP_CACHE_SIZE
+#define		BRIDGE_ARP_CACHE_SIZE 16
+#endif
+
 // Internal
 
 typedef enum {
@@ -9,6 +9,9 @@
 #include "lwip/netif.h"
 #include "lwip/dns.h"
 #include "lwip/lwip_napt.h"
+#if NAPT_INTREE
+#include "napt.h"
+#endif
 #include "lwip/ip_route.h"
 #include "lwip/app/dhcpserver.h"
 #include "lwip/app/espconn.h"
@@ -43,6 +46,9 @@
 #endif
 #include "sys_time.h"
 #include "sntp.h"
+#include "pkt_info.h"
+#include "perf.h"
+#include "hook_chain.h"
 
 #include "easygpio.h"
 
@@ -54,8 +60,30 @@
 #include "acl.h"
 #endif
 
+#if CONNTRACK_SIZE
+#include "conntrack.h"
+#endif
+
+#if TOKENBUCKET
+#include "qos.h"
+#endif
+
+#if CONN_LIMIT
+#include "connlimit.h"
+#endif
+
+#if MSS_CLAMP
+#include "mss.h"
+#endif
+
+#if PKT_DEFER
+#include "pktq.h"
+#endif
+
 #if REMOTE_MONITORING
 #include "pcap.h"
+#include "cap_ring.h"
+#include "capfilter.h"
 #endif
 
 #if MQTT_CLIENT
@@ -96,11 +124,6 @@ uint64_t Bytes_per_day;
 uint8_t last_date;
 #endif
 
-#if TOKENBUCKET
-uint64_t t_old_tb;
-uint32_t token_bucket_ds, token_bucket_us;
-#endif
-
 /* Hold the system wide configuration */
 sysconfig_t config;
 
@@ -341,37 +364,56 @@ void ICACHE_FLASH_ATTR sleep_delay_timer_func(void *arg)
 #if REMOTE_MONITORING
 static uint8_t monitoring_on;
 static uint16_t monitor_port;
-static ringbuf_t pcap_buffer;
+static cap_ring_t pcap_buffer;
 struct espconn *cur_mon_conn;
 struct espconn *cur_mon_listen;
+static uint32_t mon_remote_ip;      // the peer of cur_mon_conn
+static uint16_t mon_remote_port;
 static uint8_t monitoring_send_ongoing;
+static uint16_t monitoring_in_flight;
 static uint8_t acl_monitoring;
+static uint8_t monitor_pcapng;
+static capf_prog monitor_filter;
+static char monitor_filter_str[MAX_CON_CMD_SIZE];
+
+// pcapng interfaces, one per hook
+#define MON_IF_AP_IN    0
+#define MON_IF_AP_OUT   1
+#define MON_IF_STA_IN   2
+#define MON_IF_STA_OUT  3
+#define MON_IF_MAX      4
+
+static const char *mon_if_name[MON_IF_MAX] = {"ap-in", "ap-out", "sta-in", "sta-out"};
+static uint32_t mon_if_recv[MON_IF_MAX];
+static uint32_t mon_if_drop[MON_IF_MAX];
 
 static void ICACHE_FLASH_ATTR tcp_monitor_sent_cb(void *arg)
 {
     uint16_t len;
-    static uint8_t tbuf[1400];
+    uint8_t *data;
 
     struct espconn *pespconn = (struct espconn *)arg;
     //os_printf("tcp_monitor_sent_cb(): Data sent to monitor\n");
 
+    // The last span has been sent, its space can be reused
+    cap_ring_consume(&pcap_buffer, monitoring_in_flight);
+    monitoring_in_flight = 0;
+
     monitoring_send_ongoing = 0;
     if (!monitoring_on)
         return;
 
-    len = ringbuf_bytes_used(pcap_buffer);
+    // Send directly out of the ring, no intermediate copy
+    len = cap_ring_peek(&pcap_buffer, &data, 1400);
     if (len > 0)
     {
-        if (len > 1400)
-            len = 1400;
-
-        ringbuf_memcpy_from(tbuf, pcap_buffer, len);
         //os_printf("tcp_monitor_sent_cb(): %d Bytes sent to monitor\n", len);
-        if (espconn_send(pespconn, tbuf, len) != 0)
+        if (espconn_send(pespconn, data, len) != 0)
         {
             os_printf("TCP send error\r\n");
             return;
         }
+        monitoring_in_flight = len;
         monitoring_send_ongoing = 1;
     }
 }
@@ -382,6 +424,107 @@ static void ICACHE_FLASH_ATTR tcp_monitor_discon_cb(void *arg)
     struct espconn *pespconn = (struct espconn *)arg;
 
     monitoring_on = 0;
+    hook_chain_rebuild();
+}
+
+/* Writes the pcapng Section Header Block and one Interface
+   Description Block per hook into the (empty) ring */
+static int ICACHE_FLASH_ATTR monitor_pcapng_header(void)
+{
+    struct pcapng_shb shb;
+    struct pcapng_idb idb;
+    uint8_t *rec;
+    uint16_t i, name_len, opt_len, len;
+
+    shb.block_type = PCAPNG_BT_SHB;
+    shb.block_len = shb.block_len2 = sizeof(shb);
+    shb.magic = PCAPNG_BYTE_ORDER_MAGIC;
+    shb.version_major = 1;
+    shb.version_minor = 0;
+    shb.section_len_lo = shb.section_len_hi = 0xffffffff;
+
+    rec = cap_ring_reserve(&pcap_buffer, sizeof(shb));
+    if (rec == NULL)
+        return -1;
+    os_memcpy(rec, &shb, sizeof(shb));
+    cap_ring_commit(&pcap_buffer, sizeof(shb));
+
+    for (i = 0; i < MON_IF_MAX; i++)
+    {
+        uint16_t opt[2];
+        uint32_t trailer;
+
+        // if_name option, end of options, trailing length
+        name_len = os_strlen(mon_if_name[i]);
+        opt_len = 4 + PCAPNG_PAD(name_len) + 4;
+        len = sizeof(idb) + opt_len + 4;
+
+        idb.block_type = PCAPNG_BT_IDB;
+        idb.block_len = len;
+        idb.linktype = LINKTYPE_ETHERNET;
+        idb.reserved = 0;
+        idb.snaplen = 1600;
+
+        rec = cap_ring_reserve(&pcap_buffer, len);
+        if (rec == NULL)
+            return -1;
+        os_memset(rec, 0, len);
+        os_memcpy(rec, &idb, sizeof(idb));
+        opt[0] = PCAPNG_OPT_IF_NAME;
+        opt[1] = name_len;
+        os_memcpy(rec + sizeof(idb), opt, 4);
+        os_memcpy(rec + sizeof(idb) + 4, mon_if_name[i], name_len);
+        // opt_endofopt is already zeroed
+        trailer = len;
+        os_memcpy(rec + len - 4, &trailer, 4);
+        cap_ring_commit(&pcap_buffer, len);
+    }
+    return 0;
+}
+
+/* Called periodically while a pcapng monitor session runs: writes an
+   Interface Statistics Block with the drop count of each hook */
+static void ICACHE_FLASH_ATTR monitor_pcapng_stats(void)
+{
+    struct pcapng_isb isb;
+    uint32_t sec, usec;
+    uint64_t ts;
+    uint8_t *rec;
+    uint16_t i;
+
+    if (!monitoring_on || !monitor_pcapng)
+        return;
+
+    cap_ring_timestamp(&sec, &usec);
+    ts = (uint64_t)sec * 1000000 + usec;
+
+    for (i = 0; i < MON_IF_MAX; i++)
+    {
+        isb.block_type = PCAPNG_BT_ISB;
+        isb.block_len = isb.block_len2 = sizeof(isb);
+        isb.if_id = i;
+        isb.ts_high = (uint32_t)(ts >> 32);
+        isb.ts_low = (uint32_t)ts;
+        isb.recv_code = PCAPNG_OPT_ISB_IFRECV;
+        isb.recv_len = 8;
+        isb.recv_lo = mon_if_recv[i];
+        isb.recv_hi = 0;
+        isb.drop_code = PCAPNG_OPT_ISB_IFDROP;
+        isb.drop_len = 8;
+        isb.drop_lo = mon_if_drop[i];
+        isb.drop_hi = 0;
+        isb.end_code = PCAPNG_OPT_ENDOFOPT;
+        isb.end_len = 0;
+
+        rec = cap_ring_reserve(&pcap_buffer, sizeof(isb));
+        if (rec == NULL)
+            return;
+        os_memcpy(rec, &isb, sizeof(isb));
+        cap_ring_commit(&pcap_buffer, sizeof(isb));
+    }
+
+    if (!monitoring_send_ongoing)
+        tcp_monitor_sent_cb(cur_mon_conn);
 }
 
 /* Called when a client connects to the monitor server */
@@ -389,30 +532,51 @@ static void ICACHE_FLASH_ATTR tcp_monitor_connected_cb(void *arg)
 {
     struct espconn *pespconn = (struct espconn *)arg;
     struct pcap_file_header pcf_hdr;
+    uint8_t *rec;
 
     os_printf("tcp_monitor_connected_cb(): Client connected\r\n");
 
-    ringbuf_reset(pcap_buffer);
+    cap_ring_reset(&pcap_buffer);
+    monitoring_in_flight = 0;
 
     cur_mon_conn = pespconn;
+    os_memcpy(&mon_remote_ip, pespconn->proto.tcp->remote_ip, 4);
+    mon_remote_port = pespconn->proto.tcp->remote_port;
 
     espconn_regist_sentcb(pespconn, tcp_monitor_sent_cb);
     espconn_regist_disconcb(pespconn, tcp_monitor_discon_cb);
     //espconn_regist_recvcb(pespconn,     tcp_client_recv_cb);
     espconn_regist_time(pespconn, 300, 1); // Specific to console only
 
-    pcf_hdr.magic = PCAP_MAGIC_NUMBER;
-    pcf_hdr.version_major = PCAP_VERSION_MAJOR;
-    pcf_hdr.version_minor = PCAP_VERSION_MINOR;
-    pcf_hdr.thiszone = 0;
-    pcf_hdr.sigfigs = 0;
-    pcf_hdr.snaplen = 1600;
-    pcf_hdr.linktype = LINKTYPE_ETHERNET;
+    os_memset(mon_if_recv, 0, sizeof(mon_if_recv));
+    os_memset(mon_if_drop, 0, sizeof(mon_if_drop));
 
-    espconn_send(pespconn, (uint8_t *)&pcf_hdr, sizeof(pcf_hdr));
-    monitoring_send_ongoing = 1;
+    // The file header is the first record in the ring
+    if (monitor_pcapng)
+    {
+        if (monitor_pcapng_header() != 0)
+            return;
+    }
+    else
+    {
+        pcf_hdr.magic = PCAP_MAGIC_NUMBER;
+        pcf_hdr.version_major = PCAP_VERSION_MAJOR;
+        pcf_hdr.version_minor = PCAP_VERSION_MINOR;
+        pcf_hdr.thiszone = 0;
+        pcf_hdr.sigfigs = 0;
+        pcf_hdr.snaplen = 1600;
+        pcf_hdr.linktype = LINKTYPE_ETHERNET;
+
+        rec = cap_ring_reserve(&pcap_buffer, sizeof(pcf_hdr));
+        if (rec == NULL)
+            return;
+        os_memcpy(rec, &pcf_hdr, sizeof(pcf_hdr));
+        cap_ring_commit(&pcap_buffer, sizeof(pcf_hdr));
+    }
 
     monitoring_on = 1;
+    hook_chain_rebuild();
+    tcp_monitor_sent_cb(pespconn);
 }
 
 static void ICACHE_FLASH_ATTR start_monitor(uint16_t portno)
@@ -420,7 +584,11 @@ static void ICACHE_FLASH_ATTR start_monitor(uint16_t portno)
     if (monitoring_on)
         return;
 
-    pcap_buffer = ringbuf_new(MONITOR_BUFFER_SIZE);
+    if (!cap_ring_init(&pcap_buffer, MONITOR_BUFFER_SIZE))
+    {
+        os_printf("Monitor buffer alloc failed\r\n");
+        return;
+    }
     monitoring_send_ongoing = 0;
 
     os_printf("Starting Monitor TCP Server on %d port\r\n", portno);
@@ -460,113 +628,144 @@ static void ICACHE_FLASH_ATTR stop_monitor(void)
     }
 
     monitoring_on = 0;
+    hook_chain_rebuild();
     monitor_port = 0;
     cur_mon_listen = NULL;
-    ringbuf_free(&pcap_buffer);
+    cap_ring_free(&pcap_buffer);
 }
 
-int ICACHE_FLASH_ATTR put_packet_to_ringbuf(struct pbuf *p)
+int ICACHE_FLASH_ATTR put_packet_to_ringbuf(struct pbuf *p, pkt_info *pi, uint8_t if_id)
 {
-    struct pcap_pkthdr pcap_phdr;
-    uint64_t t_usecs;
     uint32_t len = p->len;
+    uint16_t rec_len;
+    uint32_t sec, usec;
+    uint8_t *rec;
 
 #ifdef MONITOR_BUFFER_TIGHT
-    if (ringbuf_bytes_free(pcap_buffer) < MONITOR_BUFFER_TIGHT)
+    if (len > 60 && cap_ring_space(&pcap_buffer) < MONITOR_BUFFER_TIGHT)
     {
-        if (len > 60)
-        {
-            len = 60;
-            //os_printf("Packet cut\n");
-        }
+        len = 60;
+        pcap_buffer.truncated++;
+        //os_printf("Packet cut\n");
     }
 #endif
 
-    if (ringbuf_bytes_free(pcap_buffer) >= sizeof(pcap_phdr) + len)
-    {
-        //os_printf("Put %d Bytes into RingBuff\r\n", sizeof(pcap_phdr)+p->len);
-        t_usecs = get_long_systime();
-        pcap_phdr.ts_sec = (uint32_t)t_usecs / 1000000;
-        pcap_phdr.ts_usec = (uint32_t)t_usecs % 1000000;
-        pcap_phdr.caplen = len;
-        pcap_phdr.len = p->tot_len;
-        ringbuf_memcpy_into(pcap_buffer, (uint8_t *)&pcap_phdr, sizeof(pcap_phdr));
-        ringbuf_memcpy_into(pcap_buffer, p->payload, len);
-    }
+    // One reservation for header and data, filled in place
+    if (monitor_pcapng)
+        rec_len = sizeof(struct pcapng_epb) + PCAPNG_PAD(len) + 4;
     else
+        rec_len = sizeof(struct pcap_pkthdr) + len;
+    rec = cap_ring_reserve(&pcap_buffer, rec_len);
+    if (rec == NULL)
     {
         //os_printf("Packet with %d Bytes discarded\r\n", p->len);
         return -1;
     }
+
+    cap_ring_timestamp(&sec, &usec);
+    // The record may be unaligned, so no direct stores into it
+    if (monitor_pcapng)
+    {
+        struct pcapng_epb epb;
+        uint64_t ts = (uint64_t)sec * 1000000 + usec;
+        uint32_t trailer = rec_len;
+
+        epb.block_type = PCAPNG_BT_EPB;
+        epb.block_len = rec_len;
+        epb.if_id = if_id;
+        epb.ts_high = (uint32_t)(ts >> 32);
+        epb.ts_low = (uint32_t)ts;
+        epb.caplen = len;
+        epb.len = pi->tot_len;
+        os_memcpy(rec, &epb, sizeof(epb));
+        os_memcpy(rec + sizeof(epb), p->payload, len);
+        os_memset(rec + sizeof(epb) + len, 0, PCAPNG_PAD(len) - len);
+        os_memcpy(rec + rec_len - 4, &trailer, 4);
+    }
+    else
+    {
+        struct pcap_pkthdr pcap_phdr;
+
+        pcap_phdr.ts_sec = sec;
+        pcap_phdr.ts_usec = usec;
+        pcap_phdr.caplen = len;
+        pcap_phdr.len = pi->tot_len;
+        os_memcpy(rec, &pcap_phdr, sizeof(pcap_phdr));
+        os_memcpy(rec + sizeof(pcap_phdr), p->payload, len);
+    }
+    cap_ring_commit(&pcap_buffer, rec_len);
     return 0;
 }
-#endif /* REMOTE_MONITORING */
 
-err_t ICACHE_FLASH_ATTR my_input_ap(struct pbuf *p, struct netif *inp)
+/* Whether a packet is selected for the monitor (all packets or ACL
+   monitor rules, and the filter) */
+static bool ICACHE_FLASH_ATTR monitor_selects(pkt_info *pi)
 {
-
-    //  os_printf("Got packet from STA\r\n");
-
-    if (config.status_led <= 16)
-        easygpio_outputSet(config.status_led, 1);
-
-    client_watchdog_cnt = config.client_watchdog;
-
 #if ACLS
-    // Check ACLs - store result
-    uint8_t acl_check = ACL_ALLOW;
-    if (!acl_is_empty(0))
-        acl_check = acl_check_packet(0, p);
+    if (acl_monitoring && !(pi->acl & ACL_MONITOR))
+        return false;
 #endif
+    if (!capf_match(&monitor_filter, pi))
+        return false;
+    return true;
+}
 
-#if REMOTE_MONITORING
-    if (monitoring_on && !acl_monitoring)
+/* Whether a packet on the STA hooks belongs to the monitor's own
+   connection, which would otherwise record itself */
+static bool ICACHE_FLASH_ATTR monitor_own_stream(pkt_info *pi, uint8_t chain)
+{
+    if (pi->proto != IP_PROTO_TCP || !(pi->flags & PKT_F_PORTS))
+        return false;
+    if (chain == HOOK_STA_OUT)
+        return pi->s_port == monitor_port && pi->dest == mon_remote_ip && pi->d_port == mon_remote_port;
+    if (chain == HOOK_STA_IN)
+        return pi->d_port == monitor_port && pi->src == mon_remote_ip && pi->s_port == mon_remote_port;
+    return false;
+}
+
+/* Records a selected packet. Returns -1 if the packet has to be dropped,
+   as it could not be recorded. */
+static int ICACHE_FLASH_ATTR monitor_packet(struct pbuf *p, pkt_info *pi, uint8_t if_id)
+{
+    int ret = 0;
+
+    mon_if_recv[if_id]++;
+    if (put_packet_to_ringbuf(p, pi, if_id) != 0)
     {
-        if (put_packet_to_ringbuf(p) != 0)
-        {
+        mon_if_drop[if_id]++;
 #if DROP_PACKET_IF_NOT_RECORDED
-            pbuf_free(p);
-            return ERR_OK;
+        // as in the classic mode, only the AP side is slowed down to the monitor
+        if (!acl_monitoring && (if_id == HOOK_AP_IN || if_id == HOOK_AP_OUT))
+            ret = -1;
 #endif
-        }
-        if (!monitoring_send_ongoing)
-            tcp_monitor_sent_cb(cur_mon_conn);
-    }
-#if ACLS
-    // Check if packet should be monitored by ACL
-    if (monitoring_on && acl_monitoring && (acl_check & ACL_MONITOR))
-    {
-        put_packet_to_ringbuf(p);
-        if (!monitoring_send_ongoing)
-            tcp_monitor_sent_cb(cur_mon_conn);
     }
-#endif
+    if (!monitoring_send_ongoing)
+        tcp_monitor_sent_cb(cur_mon_conn);
+    return ret;
+}
 #endif /* REMOTE_MONITORING */
 
-#if ACLS
-    // If not allowed, drop packet
-    if (!(acl_check & ACL_ALLOW))
+// The last steps of the AP hooks, also called for packets released by the rate limit queue
+static err_t ICACHE_FLASH_ATTR ap_input_pass(struct pbuf *p, struct netif *inp)
+{
+#if DAILY_LIMIT
+    // again here, the limit may have been reached while the packet was queued
+    if (config.daily_limit != 0 && Bytes_per_day / 1024 >= config.daily_limit)
     {
         pbuf_free(p);
         return ERR_OK;
-    };
-#endif
-
-#if TOKENBUCKET
-    if (config.kbps_us != 0)
-    {
-        if (p->tot_len <= token_bucket_us)
-        {
-            token_bucket_us -= p->tot_len;
-        }
-        else
-        {
-            pbuf_free(p);
-            return ERR_OK;
-        }
     }
+
+    Bytes_per_day += p->tot_len;
 #endif
+    Bytes_in += p->tot_len;
+    Packets_in++;
 
+    return orig_input_ap(p, inp);
+}
+
+static err_t ICACHE_FLASH_ATTR ap_output_pass(struct pbuf *p, struct netif *outp)
+{
 #if DAILY_LIMIT
     if (config.daily_limit != 0 && Bytes_per_day / 1024 >= config.daily_limit)
     {
@@ -576,117 +775,390 @@ err_t ICACHE_FLASH_ATTR my_input_ap(struct pbuf *p, struct netif *inp)
 
     Bytes_per_day += p->tot_len;
 #endif
-    Bytes_in += p->tot_len;
-    Packets_in++;
+    Bytes_out += p->tot_len;
+    Packets_out++;
 
-    return orig_input_ap(p, inp);
+    return orig_output_ap(outp, p);
 }
 
-err_t ICACHE_FLASH_ATTR my_output_ap(struct netif *outp, struct pbuf *p)
+/*
+ * Stages of the hook chains (see hook_chain.h), registered in this order
+ * by hooks_init(). The *_active() functions decide from the config whether
+ * a stage is part of a chain at all.
+ */
+static bool ICACHE_FLASH_ATTR stage_drop(hook_pkt *hp)
 {
+    PERF_VERDICT(PERF_DROP);
+    pbuf_free(hp->p);
+    return false;
+}
 
-    //  os_printf("Send packet to STA\r\n");
+static bool ICACHE_FLASH_ATTR led_active(uint8_t chain)
+{
+    return config.status_led <= 16;
+}
 
-    if (config.status_led <= 16)
-        easygpio_outputSet(config.status_led, 0);
+static bool ICACHE_FLASH_ATTR stage_led(hook_pkt *hp)
+{
+    easygpio_outputSet(config.status_led, hp->chain == HOOK_AP_IN ? 1 : 0);
+    return true;
+}
+
+static bool ICACHE_FLASH_ATTR watchdog_active(uint8_t chain)
+{
+    return (chain == HOOK_AP_IN ? config.client_watchdog : config.ap_watchdog) >= 0;
+}
+
+static bool ICACHE_FLASH_ATTR stage_watchdog(hook_pkt *hp)
+{
+    if (hp->chain == HOOK_AP_IN)
+        client_watchdog_cnt = config.client_watchdog;
+    else
+        ap_watchdog_cnt = config.ap_watchdog;
+    return true;
+}
 
 #if ACLS
-    // Check ACLs - store result
-    uint8_t acl_check = ACL_ALLOW;
-    if (!acl_is_empty(1))
-        acl_check = acl_check_packet(1, p);
-#endif
+// The ACL numbers are the same as the chain numbers
+static bool ICACHE_FLASH_ATTR acl_active(uint8_t chain)
+{
+    return !acl_is_empty(chain);
+}
 
-#if REMOTE_MONITORING
-    if (monitoring_on && !acl_monitoring)
+static bool ICACHE_FLASH_ATTR stage_acl(hook_pkt *hp)
+{
+#if FLOW_CACHE_SIZE
+    flow_entry *f = hook_flow(hp);
+    int8_t rule;
+
+    if (f != NULL && (f->flags & FLOW_F_ACL))
     {
-        if (put_packet_to_ringbuf(p) != 0)
-        {
-#if DROP_PACKET_IF_NOT_RECORDED
-            pbuf_free(p);
-            return ERR_OK;
-#endif
-        }
-        if (!monitoring_send_ongoing)
-            tcp_monitor_sent_cb(cur_mon_conn);
+        hp->pi.acl = f->acl;
+        acl_count_cached(hp->chain, f->rule, f->acl);
+        return true;
     }
-
-#if ACLS
-    // Check if packet should be monitored by ACL
-    if (monitoring_on && acl_monitoring && (acl_check & ACL_MONITOR))
+    hp->pi.acl = acl_check_packet_rule(hp->chain, &hp->pi, &rule);
+    // Denied packets are always checked again, so every one is reported,
+    // and established ones, as the connection may be closed any time
+    if (f != NULL && (hp->pi.acl & (ACL_ALLOW | ACL_ESTABLISHED)) == ACL_ALLOW)
     {
-        put_packet_to_ringbuf(p);
-        if (!monitoring_send_ongoing)
-            tcp_monitor_sent_cb(cur_mon_conn);
+        f->acl = hp->pi.acl;
+        f->rule = rule;
+        f->flags |= FLOW_F_ACL;
     }
+#else
+    hp->pi.acl = acl_check_packet(hp->chain, &hp->pi);
 #endif
-#endif /* REMOTE_MONITORING */
+    return true;
+}
 
-#if ACLS
-    // If not allowed, drop packet
-    if (!(acl_check & ACL_ALLOW))
-    {
-        pbuf_free(p);
-        return ERR_OK;
-    };
+// Separate from stage_acl(), so that the monitor sees denied packets
+static bool ICACHE_FLASH_ATTR stage_acl_drop(hook_pkt *hp)
+{
+    if (!(hp->pi.acl & ACL_ALLOW))
+        return stage_drop(hp);
+    return true;
+}
 #endif
 
-#if TOKENBUCKET
-    if (config.kbps_ds != 0)
+#if CONNTRACK_SIZE
+// Learns the connections for the "established" rule of the reply direction
+static bool ICACHE_FLASH_ATTR conntrack_active(uint8_t chain)
+{
+    return acl_established(chain == HOOK_AP_IN ? ACL_TO_STA : ACL_FROM_AP);
+}
+
+static bool ICACHE_FLASH_ATTR stage_conntrack(hook_pkt *hp)
+{
+    conntrack_learn(hp->chain == HOOK_AP_IN ? CT_SIDE_AP : CT_SIDE_STA, &hp->pi);
+    return true;
+}
+#endif
+
+#if REMOTE_MONITORING
+// The upstream side is only recorded in pcapng mode
+static bool ICACHE_FLASH_ATTR monitor_active(uint8_t chain)
+{
+    return monitoring_on && (monitor_pcapng || chain == HOOK_AP_IN || chain == HOOK_AP_OUT);
+}
+
+// The monitor interface numbers are the same as the chain numbers
+static bool ICACHE_FLASH_ATTR stage_monitor(hook_pkt *hp)
+{
+    bool selected;
+#if FLOW_CACHE_SIZE
+    flow_entry *f;
+#endif
+
+    if (monitor_own_stream(&hp->pi, hp->chain))
+        return true;
+#if FLOW_CACHE_SIZE
+    f = hook_flow(hp);
+
+    if (f != NULL && (f->flags & FLOW_F_MON_SET))
     {
-        if (p->tot_len <= token_bucket_ds)
-        {
-            token_bucket_ds -= p->tot_len;
-        }
-        else
-        {
-            pbuf_free(p);
-            return ERR_OK;
-        }
+        selected = (f->flags & FLOW_F_MON) != 0;
     }
+    else
+    {
+        selected = monitor_selects(&hp->pi);
+        // the decision of a flow is fixed, unless the filter tests lengths
+        // or depends on a verdict that isn't cached
+        if (f != NULL && capf_per_flow(&monitor_filter) && (!acl_monitoring || (f->flags & FLOW_F_ACL)))
+            f->flags |= FLOW_F_MON_SET | (selected ? FLOW_F_MON : 0);
+    }
+#else
+    selected = monitor_selects(&hp->pi);
+#endif
+    if (selected && monitor_packet(hp->p, &hp->pi, hp->chain) != 0)
+        return stage_drop(hp);
+    return true;
+}
+#endif
+
+#if CONN_LIMIT
+static bool ICACHE_FLASH_ATTR connlimit_active(uint8_t chain)
+{
+    return config.conn_rate != 0;
+}
+
+// Before anything learns the connection or creates a session for it
+static bool ICACHE_FLASH_ATTR stage_connlimit(hook_pkt *hp)
+{
+    if (!connlimit_check(&hp->pi, hp->nif, config.conn_rate, config.conn_burst))
+        return stage_drop(hp);
+    return true;
+}
+#endif
+
+#if MSS_CLAMP
+static bool ICACHE_FLASH_ATTR mss_active(uint8_t chain)
+{
+    return config.mss_clamp != 0;
+}
+
+// The checksum is updated in place, the frame stays where it is
+static bool ICACHE_FLASH_ATTR stage_mss(hook_pkt *hp)
+{
+    mss_clamp(hp->p, &hp->pi, config.mss_clamp, hp->chain == HOOK_AP_IN ? MSS_FROM_AP : MSS_TO_AP);
+    return true;
+}
 #endif
 
 #if DAILY_LIMIT
-    if (config.daily_limit != 0 && Bytes_per_day / 1024 >= config.daily_limit)
-    {
-        pbuf_free(p);
-        return ERR_OK;
-    }
+static bool ICACHE_FLASH_ATTR limit_active(uint8_t chain)
+{
+    return config.daily_limit != 0;
+}
 
-    Bytes_per_day += p->tot_len;
+static bool ICACHE_FLASH_ATTR stage_limit(hook_pkt *hp)
+{
+    if (Bytes_per_day / 1024 >= config.daily_limit)
+        return stage_drop(hp);
+    return true;
+}
 #endif
-    Bytes_out += p->tot_len;
-    Packets_out++;
 
-    return orig_output_ap(outp, p);
+#if TOKENBUCKET
+static bool ICACHE_FLASH_ATTR qos_active(uint8_t chain)
+{
+    return (chain == HOOK_AP_IN ? config.kbps_us : config.kbps_ds) != 0;
 }
 
-err_t ICACHE_FLASH_ATTR my_input_sta(struct pbuf *p, struct netif *inp)
+// Over the limit: queued or dropped
+static bool ICACHE_FLASH_ATTR stage_qos(hook_pkt *hp)
 {
+    if (hp->chain == HOOK_AP_IN)
+        return qos_shape(QOS_US, config.kbps_us, config.qos_queue_len, hp->pi.src, hp->p, hp->nif, hp->pi.tot_len);
+    return qos_shape(QOS_DS, config.kbps_ds, config.qos_queue_len, hp->pi.dest, hp->p, hp->nif, hp->pi.tot_len);
+}
+#endif
 
-    ap_watchdog_cnt = config.ap_watchdog;
+#if NAPT_INTREE
+static bool ICACHE_FLASH_ATTR napt_stage_active(uint8_t chain)
+{
+    return napt_active();
+}
+
+// First on sta-out and last on sta-in, the other stages see the
+// packets on the upstream side with the translated addresses
+static bool ICACHE_FLASH_ATTR stage_napt_out(hook_pkt *hp)
+{
+    if (!napt_output(hp->p, &hp->pi, hp->nif))
+        return stage_drop(hp);
+    return true;
+}
+
+static bool ICACHE_FLASH_ATTR stage_napt_in(hook_pkt *hp)
+{
+    if (!napt_input(hp->p, &hp->pi, hp->nif))
+        return stage_drop(hp);
+    return true;
+}
+#endif
+
+static void ICACHE_FLASH_ATTR hooks_init(void)
+{
+    uint8_t ap = HOOK_MASK(HOOK_AP_IN) | HOOK_MASK(HOOK_AP_OUT);
+
+#if NAPT_INTREE
+    hook_register("napt-out", stage_napt_out, napt_stage_active, HOOK_MASK(HOOK_STA_OUT));
+#endif
+    hook_register("led", stage_led, led_active, ap);
+    hook_register("watchdog", stage_watchdog, watchdog_active, HOOK_MASK(HOOK_AP_IN) | HOOK_MASK(HOOK_STA_IN));
 #if ACLS
-    if (!acl_is_empty(2) && !(acl_check_packet(2, p) & ACL_ALLOW))
-    {
-        pbuf_free(p);
-        return ERR_OK;
-    };
+    hook_register("acl", stage_acl, acl_active, HOOK_ALL);
+#endif
+#if REMOTE_MONITORING
+    hook_register("monitor", stage_monitor, monitor_active, HOOK_ALL);
 #endif
+#if ACLS
+    hook_register("acl-drop", stage_acl_drop, acl_active, HOOK_ALL);
+#endif
+#if CONN_LIMIT
+    hook_register("connlimit", stage_connlimit, connlimit_active, HOOK_MASK(HOOK_AP_IN));
+#endif
+#if CONNTRACK_SIZE
+    hook_register("conntrack", stage_conntrack, conntrack_active, HOOK_MASK(HOOK_AP_IN) | HOOK_MASK(HOOK_STA_OUT));
+#endif
+#if MSS_CLAMP
+    hook_register("mss", stage_mss, mss_active, ap);
+#endif
+#if DAILY_LIMIT
+    hook_register("limit", stage_limit, limit_active, ap);
+#endif
+#if TOKENBUCKET
+    hook_register("qos", stage_qos, qos_active, ap);
+#endif
+#if NAPT_INTREE
+    hook_register("napt-in", stage_napt_in, napt_stage_active, HOOK_MASK(HOOK_STA_IN));
+#endif
+    hook_chain_rebuild();
+}
+
+static err_t ICACHE_FLASH_ATTR input_ap(struct pbuf *p, struct netif *inp)
+{
+    hook_pkt hp;
+
+    hp.p = p;
+    hp.nif = inp;
+    if (!hook_chain_run(HOOK_AP_IN, &hp))
+        return ERR_OK;
+    return ap_input_pass(p, inp);
+}
+
+err_t ICACHE_FLASH_ATTR my_output_ap(struct netif *outp, struct pbuf *p)
+{
+    hook_pkt hp;
+
+    hp.p = p;
+    hp.nif = outp;
+    if (!hook_chain_run(HOOK_AP_OUT, &hp))
+        return ERR_OK;
+    return ap_output_pass(p, outp);
+}
+
+static err_t ICACHE_FLASH_ATTR input_sta(struct pbuf *p, struct netif *inp)
+{
+    hook_pkt hp;
+
+    hp.p = p;
+    hp.nif = inp;
+    if (!hook_chain_run(HOOK_STA_IN, &hp))
+        return ERR_OK;
     return orig_input_sta(p, inp);
 }
 
 err_t ICACHE_FLASH_ATTR my_output_sta(struct netif *outp, struct pbuf *p)
 {
-#if ACLS
-    if (!acl_is_empty(3) && !(acl_check_packet(3, p) & ACL_ALLOW))
+    hook_pkt hp;
+
+    hp.p = p;
+    hp.nif = outp;
+    if (!hook_chain_run(HOOK_STA_OUT, &hp))
+        return ERR_OK;
+    return orig_output_sta(outp, p);
+}
+
+#if PKT_DEFER
+// The received packets and everything they cause (forwarding, replies)
+// are processed by the task, the output hooks only run directly for the
+// ESP's own packets
+static err_t ICACHE_FLASH_ATTR deferred_input(uint8_t chain, struct pbuf *p, struct netif *inp)
+{
+    return chain == HOOK_AP_IN ? input_ap(p, inp) : input_sta(p, inp);
+}
+#endif
+
+err_t ICACHE_FLASH_ATTR my_input_ap(struct pbuf *p, struct netif *inp)
+{
+#if PKT_DEFER
+    if (config.hook_defer)
     {
-        pbuf_free(p);
+        pktq_put(HOOK_AP_IN, p, inp);
         return ERR_OK;
-    };
+    }
 #endif
-    return orig_output_sta(outp, p);
+    return input_ap(p, inp);
+}
+
+err_t ICACHE_FLASH_ATTR my_input_sta(struct pbuf *p, struct netif *inp)
+{
+#if PKT_DEFER
+    if (config.hook_defer)
+    {
+        pktq_put(HOOK_STA_IN, p, inp);
+        return ERR_OK;
+    }
+#endif
+    return input_sta(p, inp);
+}
+
+#if PERF_STATS
+// Timed entry points, installed instead of the hooks above
+static err_t ICACHE_FLASH_ATTR perf_input_ap(struct pbuf *p, struct netif *inp)
+{
+    PERF_START(t);
+    err_t err = my_input_ap(p, inp);
+    PERF_END(PERF_AP_IN, t);
+    return err;
+}
+
+static err_t ICACHE_FLASH_ATTR perf_output_ap(struct netif *outp, struct pbuf *p)
+{
+    PERF_START(t);
+    err_t err = my_output_ap(outp, p);
+    PERF_END(PERF_AP_OUT, t);
+    return err;
+}
+
+static err_t ICACHE_FLASH_ATTR perf_input_sta(struct pbuf *p, struct netif *inp)
+{
+    PERF_START(t);
+    err_t err = my_input_sta(p, inp);
+    PERF_END(PERF_STA_IN, t);
+    return err;
+}
+
+static err_t ICACHE_FLASH_ATTR perf_output_sta(struct netif *outp, struct pbuf *p)
+{
+    PERF_START(t);
+    err_t err = my_output_sta(outp, p);
+    PERF_END(PERF_STA_OUT, t);
+    return err;
 }
 
+#define HOOK_INPUT_AP   perf_input_ap
+#define HOOK_OUTPUT_AP  perf_output_ap
+#define HOOK_INPUT_STA  perf_input_sta
+#define HOOK_OUTPUT_STA perf_output_sta
+#else
+#define HOOK_INPUT_AP   my_input_ap
+#define HOOK_OUTPUT_AP  my_output_ap
+#define HOOK_INPUT_STA  my_input_sta
+#define HOOK_OUTPUT_STA my_output_sta
+#endif
+
 static void ICACHE_FLASH_ATTR patch_netif(ip_addr_t netif_ip, netif_input_fn ifn, netif_input_fn *orig_ifn, netif_linkoutput_fn ofn, netif_linkoutput_fn *orig_ofn, bool nat)
 {
     struct netif *nif;
@@ -696,7 +1168,12 @@ static void ICACHE_FLASH_ATTR patch_netif(ip_addr_t netif_ip, netif_input_fn ifn
     if (nif == NULL)
         return;
 
+#if NAPT_INTREE
+    ip_napt_enable(netif_ip.addr, nat);
+    hook_chain_rebuild();
+#else
     nif->napt = nat ? 1 : 0;
+#endif
     if (ifn != NULL && nif->input != ifn)
     {
         *orig_ifn = nif->input;
@@ -907,6 +1384,19 @@ uint8_t acl_deny_cb(uint8_t proto, uint32_t saddr, uint16_t s_port, uint32_t dad
 }
 #endif /* ACLS */
 
+#if CONN_LIMIT && MQTT_CLIENT
+void ICACHE_FLASH_ATTR connlimit_report_cb(uint32_t addr, bool limited, uint32_t dropped)
+{
+    uint8_t buf[48];
+
+    if (limited)
+        os_sprintf(buf, "start " IPSTR, IP2STR((ip_addr_t *)&addr));
+    else
+        os_sprintf(buf, "end " IPSTR " %d dropped", IP2STR((ip_addr_t *)&addr), dropped);
+    mqtt_publish_str(MQTT_TOPIC_ACLDENY, "ConnLimit", buf);
+}
+#endif /* CONN_LIMIT && MQTT_CLIENT */
+
 #if OTAUPDATE
 void ICACHE_FLASH_ATTR Switch()
 {
@@ -1094,7 +1584,7 @@ void do_outputSet(uint8_t pin, uint8_t value, uint16_t duration)
 #endif
     if (duration > 0)
     {
-        os_timer_setfn(&duration_timer[pin], value > 0 ? set_low : set_high, (void *)(uint32_t)pin);
+        os_timer_setfn(&duration_timer[pin], value > 0 ? set_low : set_high, (void *)(uintptr_t)pin);
         os_timer_arm(&duration_timer[pin], duration * 1000, 0);
     }
 }
@@ -1127,7 +1617,7 @@ static char INVALID_ARG[] = "Invalid argument\r\n";
 
 void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
 {
-#define MAX_CMD_TOKENS 9
+#define MAX_CMD_TOKENS 16
 
     char cmd_line[MAX_CON_CMD_SIZE + 1];
     char response[256];
@@ -1182,6 +1672,16 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
                    "|ota"
 #else
                    ""
+#endif
+#ifndef REPEATER_MODE
+                   "|hooks"
+#else
+                   ""
+#endif
+#if PERF_STATS
+                   "|perf"
+#else
+                   ""
 #endif
         );
         to_console(response);
@@ -1207,10 +1707,14 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
         to_console(response);
 #endif
 #ifndef REPEATER_MODE
-        os_sprintf_flash(response, "set [max_nat|max_portmap|tcp_timeout|udp_timeout] <val>\r\nroute clear|route add <network> <gw>|route delete <network>\r\ninterface <int> [up|down]\r\nportmap [add|remove] [TCP|UDP] <ext_port> <int_addr> <int_port>\r\n");
+        os_sprintf_flash(response, "set [max_nat|max_nat_client|max_portmap|tcp_timeout|udp_timeout] <val>\r\nroute clear|route add <network> <gw>|route delete <network>\r\ninterface <int> [up|down]\r\nportmap [add|remove] [TCP|UDP] <ext_port> <int_addr> <int_port>\r\n");
         to_console(response);
 #if ACLS
-        os_sprintf_flash(response, "show acl|acl [from_sta|to_sta|from_ap|to_ap] [IP|TCP|UDP] <src_addr> [<src_port>] <dest_addr> [<dest_port>] [allow|deny|allow_monitor|deny_monitor]\r\nacl [from_sta|to_sta|from_ap|to_ap] clear\r\n");
+        os_sprintf_flash(response, "show acl|acl [from_sta|to_sta|from_ap|to_ap] [IP|TCP|UDP] <src_addr> [<src_port>] <dest_addr> [<dest_port>] [allow|deny|allow_monitor|deny_monitor]\r\nacl [from_sta|to_sta|from_ap|to_ap] clear\r\n"
+#if CONNTRACK_SIZE
+                                   "acl [to_sta|from_ap] established\r\n"
+#endif
+                                   );
         to_console(response);
 #endif
 #endif
@@ -1227,11 +1731,39 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
         os_sprintf_flash(response, "\r\n");
         to_console(response);
 #if REMOTE_MONITORING
-        os_sprintf_flash(response, "monitor [on|off] <portnumber>\r\n");
+        os_sprintf_flash(response, "monitor [on|off] <portnumber> [pcapng] [<filter>]\r\n");
         to_console(response);
 #endif
 #if TOKENBUCKET
-        os_sprintf_flash(response, "set [upstream_kbps|downstream_kbps] <val>\r\n");
+        os_sprintf_flash(response, "set [upstream_kbps|downstream_kbps|qos_queue] <val>\r\n");
+        to_console(response);
+#endif
+#if CONN_LIMIT
+        os_sprintf_flash(response, "set [conn_rate|conn_burst] <val>\r\n");
+        to_console(response);
+#endif
+#if MSS_CLAMP
+        os_sprintf_flash(response, "set mss_clamp <val>\r\n");
+        to_console(response);
+#endif
+#if PKT_DEFER
+        os_sprintf_flash(response, "set hook_defer <val>\r\n");
+        to_console(response);
+#endif
+#if BRIDGE_MCAST_UNICAST
+        os_sprintf_flash(response, "set mcast_unicast <val>\r\n");
+        to_console(response);
+#endif
+#if BRIDGE_IGMP_SNOOP
+        os_sprintf_flash(response, "set igmp_snoop [0|1]\r\n");
+        to_console(response);
+#endif
+#if BRIDGE_BCAST_LIMIT
+        os_sprintf_flash(response, "set bcast_rate [arp|dhcp|mdns|ssdp|other] <val>|set storm_rate <val>\r\n");
+        to_console(response);
+#endif
+#if BRIDGE_ARP_CACHE
+        os_sprintf_flash(response, "set [arp_cache|arp_probe] <val>\r\n");
         to_console(response);
 #endif
 #ifndef REPEATER_MODE
@@ -1383,27 +1915,85 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
 #if HAVE_ENC28J60
             if (config.eth_enable)
             {
-                mac_2_buff(mac_buf, config.ETH_MAC_address);
-                os_sprintf(response, "ETH MAC: %s\r\n", mac_buf);
+                mac_2_buff(mac_buf, config.ETH_MAC_address);
+                os_sprintf(response, "ETH MAC: %s\r\n", mac_buf);
+                to_console(response);
+            }
+#endif
+            os_sprintf(response, "STA hostname: %s\r\n", config.sta_hostname);
+            to_console(response);
+            if (config.max_clients != MAX_CLIENTS)
+            {
+                os_sprintf(response, "Max WiFi clients: %d\r\n", config.max_clients);
+                to_console(response);
+            }
+
+            if (config.max_nat != IP_NAPT_MAX || config.tcp_timeout || config.udp_timeout)
+            {
+                os_sprintf(response, "NAPT table size: %d\r\nNAPT timeouts: TCP %ds UDP %ds\r\n",
+                           config.max_nat,
+                           config.tcp_timeout ? config.tcp_timeout : IP_NAPT_TIMEOUT_MS_TCP / 1000,
+                           config.udp_timeout ? config.udp_timeout : IP_NAPT_TIMEOUT_MS_UDP / 1000);
+                to_console(response);
+            }
+#if NAPT_INTREE
+            if (config.max_nat_client)
+            {
+                os_sprintf(response, "NAPT sessions per client: %d\r\n", config.max_nat_client);
+                to_console(response);
+            }
+#endif
+#if MSS_CLAMP
+            if (config.mss_clamp)
+            {
+                os_sprintf(response, "TCP MSS clamped to: %d\r\n", config.mss_clamp);
+                to_console(response);
+            }
+#endif
+#if PKT_DEFER
+            if (config.hook_defer)
+            {
+                os_sprintf(response, "Received packets deferred, batches of %d\r\n", config.hook_defer);
+                to_console(response);
+            }
+#endif
+#if BRIDGE_MCAST_UNICAST
+            if (config.mcast_unicast)
+            {
+                os_sprintf(response, "Multicast as unicast to max %d clients\r\n", config.mcast_unicast);
                 to_console(response);
             }
 #endif
-            os_sprintf(response, "STA hostname: %s\r\n", config.sta_hostname);
-            to_console(response);
-            if (config.max_clients != MAX_CLIENTS)
+#if BRIDGE_IGMP_SNOOP
+            if (config.igmp_snoop)
             {
-                os_sprintf(response, "Max WiFi clients: %d\r\n", config.max_clients);
+                os_sprintf_flash(response, "IGMP snooping on\r\n");
                 to_console(response);
             }
-
-            if (config.max_nat != IP_NAPT_MAX || config.tcp_timeout || config.udp_timeout)
+#endif
+#if BRIDGE_BCAST_LIMIT
+            for (i = 0; i < BCAST_CLASSES; i++)
             {
-                os_sprintf(response, "NAPT table size: %d\r\nNAPT timeouts: TCP %ds UDP %ds\r\n",
-                           config.max_nat,
-                           config.tcp_timeout ? config.tcp_timeout : IP_NAPT_TIMEOUT_MS_TCP / 1000,
-                           config.udp_timeout ? config.udp_timeout : IP_NAPT_TIMEOUT_MS_UDP / 1000);
+                if (config.bcast_rate[i])
+                {
+                    os_sprintf(response, "Broadcast limit %s: %d/s\r\n", bridge_bcast_name(i), config.bcast_rate[i]);
+                    to_console(response);
+                }
+            }
+            if (config.storm_rate)
+            {
+                os_sprintf(response, "Broadcast storm protection above %d/s\r\n", config.storm_rate);
+                to_console(response);
+            }
+#endif
+#if BRIDGE_ARP_CACHE
+            if (config.arp_cache_ttl)
+            {
+                os_sprintf(response, "ARP cache: %d s%s\r\n", config.arp_cache_ttl,
+                           config.arp_cache_probe ? ", probed" : "");
                 to_console(response);
             }
+#endif
 
 #if REMOTE_CONFIG
             if (config.config_port == 0 || config.config_access == 0)
@@ -1430,6 +2020,18 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
                 os_sprintf(response, "Upstream limit: %d kbps\r\n", config.kbps_us);
                 to_console(response);
             }
+            if (config.kbps_ds != 0 || config.kbps_us != 0)
+            {
+                os_sprintf(response, "Rate limit queue: %d packets\r\n", config.qos_queue_len);
+                to_console(response);
+            }
+#endif
+#if CONN_LIMIT
+            if (config.conn_rate != 0)
+            {
+                os_sprintf(response, "New connections per client: %d/s, burst %d\r\n", config.conn_rate, config.conn_burst);
+                to_console(response);
+            }
 #endif
 #if MQTT_CLIENT
             os_sprintf(response, "MQTT: %s\r\n", mqtt_enabled ? "enabled" : "disabled");
@@ -1457,8 +2059,17 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
 #if REMOTE_MONITORING
             if (!config.locked && monitor_port != 0)
             {
-                os_sprintf(response, "Monitor (mode %s) started on port %d\r\n", acl_monitoring ? "acl" : "all", monitor_port);
+                os_sprintf(response, "Monitor (mode %s, %s) started on port %d\r\n", acl_monitoring ? "acl" : "all",
+                           monitor_pcapng ? "pcapng" : "pcap", monitor_port);
+                to_console(response);
+                os_sprintf(response, "Monitor: %d packets, %d dropped, %d truncated\r\n",
+                           pcap_buffer.packets, pcap_buffer.drops, pcap_buffer.truncated);
                 to_console(response);
+                if (monitor_filter.len > 0)
+                {
+                    os_sprintf(response, "Monitor filter: %s\r\n", monitor_filter_str);
+                    to_console(response);
+                }
             }
 #endif
             goto command_handled_2;
@@ -1518,6 +2129,30 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
                 os_sprintf_flash(response, "STA not connected\r\n");
                 to_console(response);
             }
+#if NAPT_INTREE
+            if (napt_active())
+            {
+                napt_stats *ns = napt_get_stats();
+                napt_client *nc;
+
+                os_sprintf(response, "NAPT sessions: %d of %d (peak %d), %d created, %d expired, %d evicted, %d refused, %d without port\r\n",
+                           ns->used, ns->size, ns->peak, ns->created, ns->expired, ns->evicted, ns->refused, ns->no_port);
+                to_console(response);
+                if (ns->pressure)
+                {
+                    os_sprintf(response, "NAPT pressure: unreplied sessions time out %dx faster\r\n", 1 << ns->pressure);
+                    to_console(response);
+                }
+                for (i = 0; (nc = napt_get_client(i)) != NULL; i++)
+                {
+                    if (nc->sessions == 0 && nc->refused == 0)
+                        continue;
+                    os_sprintf(response, "  " IPSTR ": %d sessions, %d refused\r\n",
+                               IP2STR((ip_addr_t *)&nc->addr), nc->sessions, nc->refused);
+                    to_console(response);
+                }
+            }
+#endif
 #if HAVE_ENC28J60
             if (eth_netif)
             {
@@ -1547,6 +2182,57 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
                 station = STAILQ_NEXT(station, next);
             }
             wifi_softap_free_station_info();
+#if TOKENBUCKET
+            if (config.kbps_us != 0 || config.kbps_ds != 0)
+            {
+                os_sprintf(response, "Rate limit drops: %d up, %d down\r\n", qos_drops(QOS_US), qos_drops(QOS_DS));
+                to_console(response);
+                for (i = 0; i < 2; i++)
+                {
+                    qos_queue *q = qos_get_queue(i);
+                    os_sprintf(response, "%s queue: %d/%d packets (max %d), %d delayed, %d overflows, %d CoDel drops\r\n",
+                               i == QOS_US ? "Up" : "Down", q->len, config.qos_queue_len, q->hwm,
+                               q->queued, q->overflows, q->codel_drops);
+                    to_console(response);
+                }
+                for (i = 0; i < QOS_MAX_CLIENTS; i++)
+                {
+                    qos_client *c = qos_get_client(i);
+                    if (c == NULL)
+                        continue;
+                    os_sprintf(response, "Client " IPSTR ": up %d B/s (%d drops), down %d B/s (%d drops)%s\r\n",
+                               IP2STR((ip_addr_t *)&c->ip), c->rate[QOS_US], c->drops[QOS_US],
+                               c->rate[QOS_DS], c->drops[QOS_DS], c->active ? "" : " idle");
+                    to_console(response);
+                }
+            }
+#endif
+#if MSS_CLAMP
+            if (config.mss_clamp != 0)
+            {
+                mss_stats *ms = mss_get_stats();
+
+                os_sprintf(response, "MSS clamped: %d of %d SYNs from clients, %d of %d SYNs to clients\r\n",
+                           ms->clamped[MSS_FROM_AP], ms->syns[MSS_FROM_AP], ms->clamped[MSS_TO_AP], ms->syns[MSS_TO_AP]);
+                to_console(response);
+            }
+#endif
+#if CONN_LIMIT
+            if (config.conn_rate != 0 || connlimit_drops() != 0)
+            {
+                os_sprintf(response, "New connections dropped: %d\r\n", connlimit_drops());
+                to_console(response);
+                for (i = 0; i < CONNLIMIT_CLIENTS; i++)
+                {
+                    connlimit_client *c = connlimit_get_client(i);
+                    if (c == NULL)
+                        continue;
+                    os_sprintf(response, "Client " IPSTR ": %d new connections, %d dropped%s\r\n",
+                               IP2STR((ip_addr_t *)&c->addr), c->allowed, c->dropped, c->limited ? " (limited)" : "");
+                    to_console(response);
+                }
+            }
+#endif
 
             if (config.ap_watchdog >= 0 || config.client_watchdog >= 0)
             {
@@ -1556,10 +2242,123 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
             goto command_handled_2;
         }
 
+#ifndef REPEATER_MODE
+        if (nTokens == 2 && strcmp(tokens[1], "hooks") == 0)
+        {
+            uint8_t chain, n;
+            hook_stage *hs;
+
+            os_sprintf_flash(response, "Hook stages (packets/consumed, 'off' if not in the chain):\r\n");
+            to_console(response);
+            for (chain = 0; chain < HOOK_CHAINS; chain++)
+            {
+                int len = os_sprintf(response, "%s:", hook_chain_name(chain));
+
+                for (n = 0; (hs = hook_get_stage(n)) != NULL; n++)
+                {
+                    if (!(hs->chains & HOOK_MASK(chain)))
+                        continue;
+                    len += os_sprintf(&response[len], " %s%s %d/%d", hs->name,
+                                      hook_stage_active(hs, chain) ? "" : "(off)",
+                                      hs->packets[chain], hs->consumed[chain]);
+                }
+                os_sprintf(&response[len], "\r\n");
+                to_console(response);
+            }
+#if FLOW_CACHE_SIZE
+            {
+                flow_stats *fs = flow_cache_stats();
+                os_sprintf(response, "Flow cache (%d entries): %d hits, %d misses, %d evictions\r\n",
+                           FLOW_CACHE_SIZE, fs->hits, fs->misses, fs->evictions);
+                to_console(response);
+            }
+#endif
+            goto command_handled_2;
+        }
+#endif
+
+#if PERF_STATS
+        if (nTokens >= 2 && strcmp(tokens[1], "perf") == 0)
+        {
+            uint32_t mhz = system_get_cpu_freq();
+            uint8_t h, v, b;
+
+            if (nTokens == 3 && strcmp(tokens[2], "clear") == 0)
+            {
+                perf_reset();
+#if PKT_DEFER
+                pktq_reset_stats();
+#endif
+                os_sprintf_flash(response, "Perf stats cleared\r\n");
+                goto command_handled;
+            }
+            os_sprintf(response, "Hook latencies (CPU at %d MHz):\r\n", mhz);
+            to_console(response);
+            for (h = 0; h < PERF_HOOKS; h++)
+            {
+                for (v = 0; v < PERF_VERDICTS; v++)
+                {
+                    perf_stat *ps = perf_get(h, v);
+
+                    if (ps->count == 0)
+                        continue;
+                    os_sprintf(response, "%s %s: %u, mean %u us, max %u us, %u slow\r\n",
+                               perf_hook_name(h), perf_verdict_name(v), ps->count,
+                               (uint32_t)(ps->sum / ps->count) / mhz, ps->max / mhz, ps->slow);
+                    to_console(response);
+                    // one bucket at a time, all of them don't fit into the response
+                    to_console(" cycles");
+                    for (b = 0; b < PERF_BUCKETS; b++)
+                    {
+                        if (ps->hist[b] == 0)
+                            continue;
+                        if (b == 0)
+                            os_sprintf(response, " <%d:%d", 1 << PERF_HIST_SHIFT, ps->hist[b]);
+                        else
+                            os_sprintf(response, " %d+:%d", 1 << (b + PERF_HIST_SHIFT - 1), ps->hist[b]);
+                        to_console(response);
+                    }
+                    to_console("\r\n");
+                }
+            }
+#if PKT_DEFER
+            {
+                pktq_stats *qs = pktq_get_stats();
+                uint32_t *hist;
+
+                os_sprintf(response, "Deferred: %d queued, %d now, max %d of %d, %d overflows, %d batches\r\n",
+                           qs->queued, pktq_len(), qs->hwm, PKT_DEFER_QUEUE, qs->overflows, qs->batches);
+                to_console(response);
+                for (h = 0; h < 2; h++)
+                {
+                    hist = h == 0 ? qs->depth : qs->batch;
+                    to_console(h == 0 ? " queue length" : " batch size");
+                    for (b = 0; b < PKTQ_HIST; b++)
+                    {
+                        if (hist[b] == 0)
+                            continue;
+                        if (b < 2)
+                            os_sprintf(response, " %d:%d", b, hist[b]);
+                        else
+                            os_sprintf(response, " %d+:%d", 1 << (b - 1), hist[b]);
+                        to_console(response);
+                    }
+                    to_console("\r\n");
+                }
+            }
+#endif
+            goto command_handled_2;
+        }
+#endif
+
 #ifdef REPEATER_MODE
         if (nTokens == 2 && strcmp(tokens[1], "repeater") == 0)
         {
             bridge_show_fdb();
+#if BRIDGE_IGMP_SNOOP
+            bridge_show_igmp();
+#endif
+            bridge_show_stats();
             goto command_handled_2;
         }
 #endif
@@ -1654,6 +2453,16 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
             os_sprintf(response, "Packets denied: %d Packets allowed: %d\r\n",
                        acl_deny_count, acl_allow_count);
             to_console(response);
+#if CONNTRACK_SIZE
+            if (acl_established(ACL_TO_STA) || acl_established(ACL_FROM_AP))
+            {
+                ct_stats *cs = conntrack_stats();
+
+                os_sprintf(response, "Connections tracked: %d of %d (%d replies, %d expired, %d evicted)\r\n",
+                           cs->used, cs->size, cs->hits, cs->expired, cs->evictions);
+                to_console(response);
+            }
+#endif
             goto command_handled_2;
         }
 #endif
@@ -1775,6 +2584,21 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
             os_sprintf_flash(response, "ACL cleared\r\n");
             goto command_handled;
         }
+#if CONNTRACK_SIZE
+        if (strcmp(tokens[2], "established") == 0)
+        {
+            if (nTokens != 3 || (acl_no != ACL_TO_STA && acl_no != ACL_FROM_AP) || acl_established(acl_no))
+            {
+                os_sprintf(response, INVALID_ARG);
+                goto command_handled;
+            }
+            if (acl_add(acl_no, 0, 0, 0, 0, 0, 0, 0, ACL_ALLOW | ACL_ESTABLISHED))
+                os_sprintf_flash(response, "ACL added\r\n");
+            else
+                os_sprintf_flash(response, "ACL add failed\r\n");
+            goto command_handled;
+        }
+#endif
 
         last_arg = 7;
         if (strcmp(tokens[2], "IP") == 0)
@@ -2307,7 +3131,7 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
 #endif
         )
         {
-            if (nTokens != 3)
+            if (nTokens < 3)
             {
                 os_sprintf_flash(response, "Port number missing\r\n");
                 goto command_handled;
@@ -2318,11 +3142,33 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
                 goto command_handled;
             }
 
+            int filter_start = 3;
+            monitor_pcapng = (nTokens > 3 && strcmp(tokens[3], "pcapng") == 0);
+            if (monitor_pcapng)
+                filter_start++;
+            if (!capf_compile(&monitor_filter, &tokens[filter_start], nTokens - filter_start))
+            {
+                os_sprintf_flash(response, "Invalid filter expression\r\n");
+                goto command_handled;
+            }
+            monitor_filter_str[0] = '\0';
+            for (i = filter_start; i < nTokens; i++)
+            {
+                if (os_strlen(monitor_filter_str) + os_strlen(tokens[i]) + 2 > sizeof(monitor_filter_str))
+                    break;
+                if (i > filter_start)
+                    os_strcat(monitor_filter_str, " ");
+                os_strcat(monitor_filter_str, tokens[i]);
+            }
             monitor_port = atoi(tokens[2]);
             if (monitor_port != 0)
             {
 #if ACLS
                 acl_monitoring = (strcmp(tokens[1], "acl") == 0);
+#endif
+#if FLOW_CACHE_SIZE
+                // new filter and mode: forget the cached monitor decisions
+                flow_cache_invalidate();
 #endif
                 start_monitor(monitor_port);
                 os_sprintf(response, "Started monitor on port %d\r\n", monitor_port);
@@ -2611,9 +3457,7 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
             if (strcmp(tokens[1], "ota_host") == 0)
             {
                 os_strncpy(config.ota_host, tokens[2], 64);
-#if MQTT_CLIENT
-                config.mqtt_host[63] = 0;
-#endif
+                config.ota_host[63] = 0;
                 os_sprintf_flash(response, "OTA host set\r\n");
                 goto command_handled;
             }
@@ -2683,6 +3527,129 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
                 os_sprintf_flash(response, "Bitrate set\r\n");
                 goto command_handled;
             }
+            if (strcmp(tokens[1], "qos_queue") == 0)
+            {
+                uint32_t len = atoi(tokens[2]);
+                if (len > QOS_QUEUE_MAX)
+                {
+                    os_sprintf(response, "Max queue length is %d\r\n", QOS_QUEUE_MAX);
+                    goto command_handled;
+                }
+                config.qos_queue_len = len;
+                os_sprintf_flash(response, "Queue length set\r\n");
+                goto command_handled;
+            }
+#endif
+#if PKT_DEFER
+            if (strcmp(tokens[1], "hook_defer") == 0)
+            {
+                uint32_t batch = atoi(tokens[2]);
+                if (batch > PKT_DEFER_QUEUE)
+                {
+                    os_sprintf(response, "Max batch size is %d\r\n", PKT_DEFER_QUEUE);
+                    goto command_handled;
+                }
+                config.hook_defer = batch;
+                pktq_set_batch(batch);
+                os_sprintf_flash(response, "Hook defer set\r\n");
+                goto command_handled;
+            }
+#endif
+#if BRIDGE_MCAST_UNICAST
+            if (strcmp(tokens[1], "mcast_unicast") == 0)
+            {
+                uint32_t fanout = atoi(tokens[2]);
+                if (fanout > MAX_CLIENTS)
+                {
+                    os_sprintf(response, "Max fan-out is %d\r\n", MAX_CLIENTS);
+                    goto command_handled;
+                }
+                config.mcast_unicast = fanout;
+                os_sprintf_flash(response, "Multicast fan-out set\r\n");
+                goto command_handled;
+            }
+#endif
+#if BRIDGE_IGMP_SNOOP
+            if (strcmp(tokens[1], "igmp_snoop") == 0)
+            {
+                config.igmp_snoop = atoi(tokens[2]) != 0;
+                os_sprintf_flash(response, "IGMP snooping set\r\n");
+                goto command_handled;
+            }
+#endif
+#if BRIDGE_BCAST_LIMIT
+            if (strcmp(tokens[1], "bcast_rate") == 0)
+            {
+                if (nTokens < 4)
+                {
+                    os_sprintf(response, INVALID_NUMARGS);
+                    goto command_handled;
+                }
+                for (i = 0; i < BCAST_CLASSES && strcmp(tokens[2], bridge_bcast_name(i)) != 0; i++)
+                    ;
+                if (i == BCAST_CLASSES)
+                {
+                    os_sprintf_flash(response, "Class must be arp, dhcp, mdns, ssdp or other\r\n");
+                    goto command_handled;
+                }
+                config.bcast_rate[i] = atoi(tokens[3]);
+                os_sprintf_flash(response, "Broadcast rate set\r\n");
+                goto command_handled;
+            }
+            if (strcmp(tokens[1], "storm_rate") == 0)
+            {
+                config.storm_rate = atoi(tokens[2]);
+                os_sprintf_flash(response, "Storm rate set\r\n");
+                goto command_handled;
+            }
+#endif
+#if BRIDGE_ARP_CACHE
+            if (strcmp(tokens[1], "arp_cache") == 0)
+            {
+                config.arp_cache_ttl = atoi(tokens[2]);
+                os_sprintf_flash(response, "ARP cache TTL set\r\n");
+                goto command_handled;
+            }
+            if (strcmp(tokens[1], "arp_probe") == 0)
+            {
+                config.arp_cache_probe = atoi(tokens[2]) != 0;
+                os_sprintf_flash(response, "ARP probe set\r\n");
+                goto command_handled;
+            }
+#endif
+#if MSS_CLAMP
+            if (strcmp(tokens[1], "mss_clamp") == 0)
+            {
+                uint32_t mss = atoi(tokens[2]);
+                if (mss != 0 && (mss < 536 || mss > 1460))
+                {
+                    os_sprintf_flash(response, "MSS must be 0 or 536..1460\r\n");
+                    goto command_handled;
+                }
+                config.mss_clamp = mss;
+                os_sprintf(response, "TCP MSS clamp set to %d\r\n", config.mss_clamp);
+                goto command_handled;
+            }
+#endif
+#if CONN_LIMIT
+            if (strcmp(tokens[1], "conn_rate") == 0)
+            {
+                config.conn_rate = atoi(tokens[2]);
+                os_sprintf_flash(response, "Connection rate set\r\n");
+                goto command_handled;
+            }
+            if (strcmp(tokens[1], "conn_burst") == 0)
+            {
+                uint32_t burst = atoi(tokens[2]);
+                if (burst < 1 || burst > 1000)
+                {
+                    os_sprintf_flash(response, "Burst must be 1..1000\r\n");
+                    goto command_handled;
+                }
+                config.conn_burst = burst;
+                os_sprintf_flash(response, "Connection burst set\r\n");
+                goto command_handled;
+            }
 #endif
 #if ALLOW_SLEEP
             if (strcmp(tokens[1], "vmin") == 0)
@@ -2816,6 +3783,16 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
                 goto command_handled;
             }
 
+#if NAPT_INTREE
+            if (strcmp(tokens[1], "max_nat_client") == 0)
+            {
+                config.max_nat_client = atoi(tokens[2]);
+                napt_set_client_max(config.max_nat_client);
+                os_sprintf(response, "NAPT sessions per client set to %d\r\n", config.max_nat_client);
+                goto command_handled;
+            }
+#endif
+
             if (strcmp(tokens[1], "max_portmap") == 0)
             {
                 new_portmap = atoi(tokens[2]);
@@ -2827,6 +3804,9 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
             {
                 config.tcp_timeout = atoi(tokens[2]);
                 ip_napt_set_tcp_timeout(config.tcp_timeout);
+#if CONNTRACK_SIZE
+                conntrack_set_timeouts(config.tcp_timeout, config.udp_timeout);
+#endif
                 os_sprintf(response, "TCP NAPT timeout set to %ds\r\n", config.tcp_timeout);
                 goto command_handled;
             }
@@ -2835,6 +3815,9 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
             {
                 config.udp_timeout = atoi(tokens[2]);
                 ip_napt_set_udp_timeout(config.udp_timeout);
+#if CONNTRACK_SIZE
+                conntrack_set_timeouts(config.tcp_timeout, config.udp_timeout);
+#endif
                 os_sprintf(response, "UDP NAPT timeout set to %ds\r\n", config.udp_timeout);
                 goto command_handled;
             }
@@ -3286,6 +4269,8 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
 command_handled:
     to_console(response);
 command_handled_2:
+    // Any command might have changed what the packet hooks have to do
+    hook_chain_rebuild();
     system_os_post(0, SIG_CONSOLE_TX, (ETSParam)pespconn);
     return;
 }
@@ -3410,7 +4395,7 @@ static void ICACHE_FLASH_ATTR handle_set_cmd(void *arg, char *cmd, char *val)
     console_handle_command(pespconn);
 }
 
-char *strstr(char *string, char *needle);
+char *strstr(const char *string, const char *needle);
 char *strtok(char *str, const char *delimiters);
 char *strtok_r(char *s, const char *delim, char **last);
 
@@ -3609,9 +4594,6 @@ void ICACHE_FLASH_ATTR timer_func(void *arg)
     uint32_t Vcurr;
     uint64_t t_new;
     uint32_t t_diff;
-#if TOKENBUCKET
-    uint32_t Bps;
-#endif
 
     toggle = !toggle;
 
@@ -3693,6 +4675,23 @@ void ICACHE_FLASH_ATTR timer_func(void *arg)
 #endif
     }
 
+#ifdef REPEATER_MODE
+    if (toggle)
+        bridge_tick();
+#endif
+
+#if REMOTE_MONITORING
+    if (toggle)
+    {
+        static uint8_t mon_stats_cnt;
+        if (++mon_stats_cnt >= MONITOR_STATS_INTERVAL)
+        {
+            mon_stats_cnt = 0;
+            monitor_pcapng_stats();
+        }
+    }
+#endif
+
     // Do we still have to configure the AP netif?
     if (do_ip_config)
     {
@@ -3719,22 +4718,23 @@ void ICACHE_FLASH_ATTR timer_func(void *arg)
     t_new = get_long_systime();
 
 #if TOKENBUCKET
-    t_diff = (uint32_t)((t_new - t_old_tb) / 1000);
-    if (config.kbps_ds != 0)
-    {
-        Bps = config.kbps_ds * 1024 / 8;
-        token_bucket_ds += (t_diff * Bps) / 1000;
-        if (token_bucket_ds > MAX_TOKEN_RATIO * Bps)
-            token_bucket_ds = MAX_TOKEN_RATIO * Bps;
-    }
-    if (config.kbps_us != 0)
-    {
-        Bps = config.kbps_us * 1024 / 8;
-        token_bucket_us += (t_diff * Bps) / 1000;
-        if (token_bucket_us > MAX_TOKEN_RATIO * Bps)
-            token_bucket_us = MAX_TOKEN_RATIO * Bps;
-    }
-    t_old_tb = t_new;
+    if (toggle)
+        qos_tick();
+#endif
+
+#if CONNTRACK_SIZE
+    if (toggle)
+        conntrack_tick();
+#endif
+
+#if CONN_LIMIT
+    if (toggle)
+        connlimit_tick(config.conn_rate, config.conn_burst);
+#endif
+
+#if NAPT_INTREE
+    if (toggle)
+        napt_tick();
 #endif
 
 #if MQTT_CLIENT
@@ -3753,6 +4753,35 @@ void ICACHE_FLASH_ATTR timer_func(void *arg)
 #if DAILY_LIMIT
         mqtt_publish_int(MQTT_TOPIC_BPD, "Bpd", "%d", (uint32_t)(Bytes_per_day / 1024));
 #endif
+#if PERF_STATS
+        {
+            // "<hook>: count mean_us max_us slow" for all hooks that saw packets,
+            // at most ", " + 10 chars of name + ": " + 4 x 10 digits + 3 blanks each
+            uint8_t buf[PERF_HOOKS * 64], h, v;
+            uint32_t mhz = system_get_cpu_freq();
+            int len = 0;
+
+            for (h = 0; h < PERF_HOOKS; h++)
+            {
+                uint32_t count = 0, max = 0, slow = 0;
+                uint64_t sum = 0;
+                for (v = 0; v < PERF_VERDICTS; v++)
+                {
+                    perf_stat *ps = perf_get(h, v);
+                    count += ps->count;
+                    sum += ps->sum;
+                    slow += ps->slow;
+                    if (ps->max > max)
+                        max = ps->max;
+                }
+                if (count != 0)
+                    len += os_sprintf(&buf[len], "%s%s: %u %u %u %u", len ? ", " : "", perf_hook_name(h),
+                                      count, (uint32_t)(sum / count) / mhz, max / mhz, slow);
+            }
+            if (len != 0)
+                mqtt_publish_str(MQTT_TOPIC_PACKETS, "Perf", buf);
+        }
+#endif
 #ifdef USER_GPIO_OUT
         mqtt_publish_int(MQTT_TOPIC_GPIOOUT, "GpioOut", "%d", (uint32_t)config.gpio_out_status);
 #endif
@@ -4003,7 +5032,7 @@ void wifi_handle_event_cb(System_Event_t *evt)
         connected = true;
 
 #ifndef REPEATER_MODE
-        patch_netif(my_ip, my_input_sta, &orig_input_sta, my_output_sta, &orig_output_sta, false);
+        patch_netif(my_ip, HOOK_INPUT_STA, &orig_input_sta, HOOK_OUTPUT_STA, &orig_output_sta, false);
 #else
         {
             struct netif *sta_nif = NULL, *ap_nif = NULL, *nif;
@@ -4062,7 +5091,7 @@ void wifi_handle_event_cb(System_Event_t *evt)
 #ifndef REPEATER_MODE
         ip_addr_t ap_ip = config.network_addr;
         ip4_addr4(&ap_ip) = 1;
-        patch_netif(ap_ip, my_input_ap, &orig_input_ap, my_output_ap, &orig_output_ap, config.nat_enable);
+        patch_netif(ap_ip, HOOK_INPUT_AP, &orig_input_ap, HOOK_OUTPUT_AP, &orig_output_ap, config.nat_enable);
 #endif
         break;
 
@@ -4247,7 +5276,7 @@ LOCAL void gpio_intr_handler(void *dummy)
         GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, gpio_status & BIT(USER_GPIO_IN));
 
         // Start the timer
-        os_timer_setfn(&inttimer, int_timer_func, (void *)(uint32_t)easygpio_inputGet(USER_GPIO_IN));
+        os_timer_setfn(&inttimer, int_timer_func, (void *)(uintptr_t)easygpio_inputGet(USER_GPIO_IN));
         os_timer_arm(&inttimer, 50, 0);
 
         // Reactivate interrupts foR GPIO
@@ -4388,8 +5417,17 @@ void ICACHE_FLASH_ATTR user_init()
 #endif
 
 #if TOKENBUCKET
-    t_old_tb = 0;
-    token_bucket_ds = token_bucket_us = 0;
+    qos_init(ap_input_pass, ap_output_pass);
+#endif
+#if PKT_DEFER
+    pktq_init(deferred_input, 1);    // priority 0 is user_procTask
+#endif
+#if CONN_LIMIT
+#if MQTT_CLIENT
+    connlimit_init(connlimit_report_cb);
+#else
+    connlimit_init(NULL);
+#endif
 #endif
 
     console_rx_buffer = ringbuf_new(MAX_CON_CMD_SIZE);
@@ -4422,6 +5460,15 @@ void ICACHE_FLASH_ATTR user_init()
         ip_napt_set_tcp_timeout(config.tcp_timeout);
     if (config.udp_timeout != 0)
         ip_napt_set_udp_timeout(config.udp_timeout);
+#if NAPT_INTREE
+    napt_set_client_max(config.max_nat_client);
+#endif
+#if PKT_DEFER
+    pktq_set_batch(config.hook_defer);
+#endif
+#if CONNTRACK_SIZE
+    conntrack_set_timeouts(config.tcp_timeout, config.udp_timeout);
+#endif
 #endif /* !REPEATER_MODE */
 
 #if ACLS
@@ -4625,6 +5672,9 @@ void ICACHE_FLASH_ATTR user_init()
     acl_monitoring = 0;
 #endif
 
+    // Set up the packet processing chains for the loaded config
+    hooks_init();
+
 #if MQTT_CLIENT
     mqtt_connected = false;
     mqtt_enabled = (os_strcmp(config.mqtt_host, "none") != 0);